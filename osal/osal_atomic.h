@@ -0,0 +1,92 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Atomic operations on uint32 for lock free exchange between threads.
+ * Loads acquire, stores release, exchange does both, OSAL_ATOMIC_INC() is a
+ * relaxed increment without result and OSAL_ATOMIC_FENCE() a full fence.
+ *
+ * GCC and compatible compilers use the __atomic builtins, MSVC
+ * __iso_volatile loads and stores with barriers and its interlocked
+ * intrinsics, and other C11 compilers <stdatomic.h>. Without
+ * any of these plain volatile accesses are used, which is only safe if the
+ * threads sharing the data can not preempt each other inside an operation,
+ * f.e. all run at the same priority on one core.
+ */
+
+#ifndef _osal_atomic_
+#define _osal_atomic_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "osal.h"
+
+#if defined(__GNUC__)
+#define OSAL_ATOMIC_LOAD(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define OSAL_ATOMIC_STORE(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define OSAL_ATOMIC_XCHG(p, v)    __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define OSAL_ATOMIC_INC(p)        ((void)__atomic_add_fetch((p), 1, __ATOMIC_RELAXED))
+#define OSAL_ATOMIC_FENCE()       __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+/* x86 and x64 keep the order of plain loads and stores except store-load,
+ * so acquire and release only have to stop the compiler. ARM needs a dmb. */
+#if defined(_M_ARM64)
+#define OSAL_ATOMIC_BARRIER()     __dmb(_ARM64_BARRIER_ISH)
+#define OSAL_ATOMIC_FENCE()       __dmb(_ARM64_BARRIER_ISH)
+#elif defined(_M_ARM)
+#define OSAL_ATOMIC_BARRIER()     __dmb(_ARM_BARRIER_ISH)
+#define OSAL_ATOMIC_FENCE()       __dmb(_ARM_BARRIER_ISH)
+#else
+#define OSAL_ATOMIC_BARRIER()     _ReadWriteBarrier()
+#define OSAL_ATOMIC_FENCE()       _mm_mfence()
+#endif
+static __inline uint32 osal_atomic_load(const volatile uint32 *p)
+{
+   uint32 v = (uint32)__iso_volatile_load32((const volatile __int32 *)p);
+
+   OSAL_ATOMIC_BARRIER();
+   return v;
+}
+static __inline void osal_atomic_store(volatile uint32 *p, uint32 v)
+{
+   OSAL_ATOMIC_BARRIER();
+   __iso_volatile_store32((volatile __int32 *)p, (__int32)v);
+}
+#define OSAL_ATOMIC_LOAD(p)       osal_atomic_load((const volatile uint32 *)(p))
+#define OSAL_ATOMIC_STORE(p, v)   osal_atomic_store((volatile uint32 *)(p), (uint32)(v))
+#define OSAL_ATOMIC_XCHG(p, v)    ((uint32)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#define OSAL_ATOMIC_INC(p)        ((void)_InterlockedIncrement((volatile long *)(p)))
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define OSAL_ATOMIC_LOAD(p)       atomic_load_explicit((_Atomic uint32 *)(p), memory_order_acquire)
+#define OSAL_ATOMIC_STORE(p, v)   atomic_store_explicit((_Atomic uint32 *)(p), (v), memory_order_release)
+#define OSAL_ATOMIC_XCHG(p, v)    atomic_exchange_explicit((_Atomic uint32 *)(p), (v), memory_order_acq_rel)
+#define OSAL_ATOMIC_INC(p)        ((void)atomic_fetch_add_explicit((_Atomic uint32 *)(p), 1, memory_order_relaxed))
+#define OSAL_ATOMIC_FENCE()       atomic_thread_fence(memory_order_seq_cst)
+#else
+static inline uint32 osal_atomic_xchg(volatile uint32 *p, uint32 v)
+{
+   uint32 old = *p;
+
+   *p = v;
+   return old;
+}
+#define OSAL_ATOMIC_LOAD(p)       (*(volatile uint32 *)(p))
+#define OSAL_ATOMIC_STORE(p, v)   (*(volatile uint32 *)(p) = (v))
+#define OSAL_ATOMIC_XCHG(p, v)    osal_atomic_xchg((volatile uint32 *)(p), (v))
+#define OSAL_ATOMIC_INC(p)        ((void)++*(volatile uint32 *)(p))
+#define OSAL_ATOMIC_FENCE()       do {} while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -85,9 +85,15 @@ typedef struct
 	// TODO: add mutex support
 } ecx_portt;
 
+/** statistics struct, see ethercatstats.h */
+struct ec_stats;
+
 extern const uint16 priMAC[3];
 extern const uint16 secMAC[3];
 
+/** statistics struct, see ethercatstats.h */
+struct ec_stats;
+
 #ifdef EC_VER1
 extern ecx_portt     ecx_port;
 extern ecx_redportt  ecx_redport;
@@ -98,6 +104,10 @@ void ec_setbufstat(uint8 idx, int bufstat);
 uint8 ec_getindex(void);
 int ec_outframe(uint8 idx, int sock);
 int ec_outframe_red(uint8 idx);
+int ec_outframe_flush(void);
+int ec_bufcount(void);
+int ec_setstats(struct ec_stats *stats, int hwstamp);
+int ec_collectstats(void);
 int ec_waitinframe(uint8 idx, int timeout);
 int ec_srconfirm(uint8 idx,int timeout);
 int ec_inframe(uint8 idx, int stacknumber);
@@ -110,6 +120,10 @@ void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat);
 uint8 ecx_getindex(ecx_portt *port);
 int ecx_outframe(ecx_portt *port, uint8 idx, int sock);
 int ecx_outframe_red(ecx_portt *port, uint8 idx);
+int ecx_outframe_flush(ecx_portt *port);
+int ecx_bufcount(ecx_portt *port);
+int ecx_setstats(ecx_portt *port, struct ec_stats *stats, int hwstamp);
+int ecx_collectstats(ecx_portt *port);
 int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout);
 int ecx_srconfirm(ecx_portt *port, uint8 idx,int timeout);
 
@@ -0,0 +1,558 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Process image in named shared memory, for use by other processes.
+ *
+ * The process owning the context creates the segment with ecx_shm_create()
+ * and maps a group into the private IOmap returned by it, with the same
+ * layout as the IOmap inside the segment. ecx_shm_map() then adds a
+ * directory of the slaves with their process data offsets. Other processes
+ * attach with ecx_shm_open().
+ *
+ * The cyclic thread calls ecx_shm_send() and ecx_shm_receive() instead of
+ * the group process data functions. The frames are received into the
+ * private IOmap, so the wait for them does not block readers, and then the
+ * process data of the group is copied to the segment under a seqlock: a
+ * reader takes ecx_shm_read_begin(), reads the IOmap in place and repeats
+ * while ecx_shm_read_retry() is TRUE. Every receive increments a cycle
+ * counter that readers can sleep on with ecx_shm_wait(), a futex that is
+ * only woken when somebody waits. Outputs are written to a staging copy
+ * between ecx_shm_stage_begin() and ecx_shm_stage_end(); the cyclic thread
+ * copies it to the IOmap before the next send, but skips a cycle instead of
+ * waiting if a process is staging at that moment. The staging lock holds
+ * the process id of its owner, if it stays taken for EC_SHM_STAGEBUSY tries
+ * and the owner died, the lock is taken over and the partly staged outputs
+ * are dropped.
+ *
+ * Apart from ecx_shm_wait() and the check for a dead owner of the staging
+ * lock no system call is made after the setup.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oshw.h"
+#include "osal.h"
+#include "ecshm.h"
+
+/** alignment of the parts of a segment, one cache line */
+#define EC_SHM_ALIGN(x)    (((x) + 63) & ~((size_t)63))
+
+/** Open the file of a segment.
+ * @param[in]  shm        = shared process image with name and flags set
+ * @param[in]  oflag      = open flags
+ * @return file descriptor, <0 on error
+ */
+static int ecx_shm_fd(ec_shmt *shm, int oflag)
+{
+   char path[sizeof(EC_SHM_HUGEDIR) + sizeof(shm->name)];
+
+   if (shm->flags & EC_SHM_HUGEPAGE)
+   {
+      snprintf(path, sizeof(path), "%s%s", EC_SHM_HUGEDIR, shm->name);
+      return open(path, oflag, 0660);
+   }
+   return shm_open(shm->name, oflag, 0660);
+}
+
+/** Remove the file of a segment, mappings stay valid.
+ * @param[in]  shm        = shared process image with name and flags set
+ */
+static void ecx_shm_unlink(ec_shmt *shm)
+{
+   char path[sizeof(EC_SHM_HUGEDIR) + sizeof(shm->name)];
+
+   if (shm->flags & EC_SHM_HUGEPAGE)
+   {
+      snprintf(path, sizeof(path), "%s%s", EC_SHM_HUGEDIR, shm->name);
+      unlink(path);
+   }
+   else
+   {
+      shm_unlink(shm->name);
+   }
+}
+
+/** Set name and flags of a shared process image.
+ * @param[out] shm        = shared process image
+ * @param[in]  name       = segment name, with or without leading '/'
+ * @param[in]  flags      = EC_SHM_xxx flags
+ */
+static void ecx_shm_setname(ec_shmt *shm, const char *name, int flags)
+{
+   memset(shm, 0, sizeof(*shm));
+   snprintf(shm->name, sizeof(shm->name), "/%s", (name[0] == '/') ? name + 1 : name);
+   shm->flags = flags;
+   shm->pid = (uint32)getpid();
+}
+
+/** Try to take the staging lock. After EC_SHM_STAGEBUSY failed tries in a
+ * row the owner is checked, if it died the lock is taken over and the
+ * staged outputs are reset to the outputs in the IOmap.
+ * @param[in]  shm        = shared process image
+ * @return TRUE if the lock is taken
+ */
+static boolean ecx_shm_stage_lock(ec_shmt *shm)
+{
+   ec_shmheadert *hdr = shm->hdr;
+   uint32 owner = 0;
+
+   if (!__atomic_compare_exchange_n(&(hdr->stagelock), &owner, shm->pid, FALSE,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+   {
+      if ((++shm->stagebusy < EC_SHM_STAGEBUSY) || (owner == shm->pid) ||
+          (kill((pid_t)owner, 0) == 0) || (errno != ESRCH))
+      {
+         return FALSE;
+      }
+      /* owner died while holding the lock */
+      if (!__atomic_compare_exchange_n(&(hdr->stagelock), &owner, shm->pid, FALSE,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      {
+         return FALSE;
+      }
+      if (hdr->Obytes)
+      {
+         memcpy(shm->stage, shm->iomap + hdr->Ooffset, hdr->Obytes);
+      }
+   }
+   shm->stagebusy = 0;
+
+   return TRUE;
+}
+
+/** Check that the parts a header describes lie inside the segment.
+ * @param[in]  hdr        = header of the segment
+ * @param[in]  size       = size of the segment file
+ * @return TRUE if the header is sane
+ */
+static boolean ecx_shm_checkhdr(const ec_shmheadert *hdr, uint64 size)
+{
+   return ((uint64)hdr->iomapoffset + hdr->iomapsize <= size) &&
+          ((uint64)hdr->stageoffset + hdr->iomapsize <= size) &&
+          ((uint64)hdr->slaveoffset + (uint64)hdr->nslave * sizeof(ec_shmslavet) <= size) &&
+          ((uint64)hdr->Ooffset + hdr->Obytes <= hdr->iomapsize) &&
+          ((uint64)hdr->Ioffset + hdr->Ibytes <= hdr->iomapsize) &&
+          (hdr->Obytes <= hdr->iomapsize);
+}
+
+/** Set the pointers of a mapped segment.
+ * @param[in]  shm        = shared process image
+ */
+static void ecx_shm_setpointers(ec_shmt *shm)
+{
+   uint8 *base = (uint8 *)shm->hdr;
+
+   shm->iomap = base + shm->hdr->iomapoffset;
+   shm->stage = base + shm->hdr->stageoffset;
+   shm->slave = (ec_shmslavet *)(base + shm->hdr->slaveoffset);
+}
+
+/** Create a shared process image, after ecx_config_init(). A segment left
+ * by a previous run is replaced, processes still attached to it keep the
+ * old one. Map a group into the returned private IOmap and call
+ * ecx_shm_map().
+ * @param[in]  context        = context struct
+ * @param[out] shm            = shared process image
+ * @param[in]  name           = segment name
+ * @param[in]  iomapsize      = size of the IOmap
+ * @param[in]  flags          = EC_SHM_xxx flags
+ * @return private IOmap of the same layout as the segment, NULL on error
+ */
+uint8 *ecx_shm_create(ecx_contextt *context, ec_shmt *shm, const char *name,
+   uint32 iomapsize, int flags)
+{
+   ec_shmheadert *hdr;
+   size_t slaveoffset, iomapoffset, stageoffset, size;
+   uint32 nslave;
+   void *p;
+   int fd;
+
+   ecx_shm_setname(shm, name, flags);
+   nslave = (uint32)*(context->slavecount) + 1;
+   slaveoffset = EC_SHM_ALIGN(sizeof(ec_shmheadert));
+   iomapoffset = EC_SHM_ALIGN(slaveoffset + nslave * sizeof(ec_shmslavet));
+   stageoffset = EC_SHM_ALIGN(iomapoffset + iomapsize);
+   size = EC_SHM_ALIGN(stageoffset + iomapsize);
+   if (flags & EC_SHM_HUGEPAGE)
+   {
+      size = (size + EC_SHM_HUGESIZE - 1) / EC_SHM_HUGESIZE * EC_SHM_HUGESIZE;
+   }
+   ecx_shm_unlink(shm);
+   fd = ecx_shm_fd(shm, O_CREAT | O_EXCL | O_RDWR);
+   if (fd < 0)
+   {
+      return NULL;
+   }
+   if (ftruncate(fd, (off_t)size) < 0)
+   {
+      close(fd);
+      ecx_shm_unlink(shm);
+      return NULL;
+   }
+   p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+   close(fd);
+   if (p == MAP_FAILED)
+   {
+      ecx_shm_unlink(shm);
+      return NULL;
+   }
+   shm->image = (uint8 *)calloc(1, iomapsize);
+   if (!shm->image)
+   {
+      munmap(p, size);
+      ecx_shm_unlink(shm);
+      return NULL;
+   }
+   hdr = (ec_shmheadert *)p;
+   hdr->version = EC_SHM_VERSION;
+   hdr->size = size;
+   hdr->iomapoffset = (uint32)iomapoffset;
+   hdr->iomapsize = iomapsize;
+   hdr->stageoffset = (uint32)stageoffset;
+   hdr->slaveoffset = (uint32)slaveoffset;
+   hdr->nslave = nslave;
+   shm->hdr = hdr;
+   shm->size = size;
+   shm->owner = TRUE;
+   ecx_shm_setpointers(shm);
+
+   return shm->image;
+}
+
+/** Publish the directory of a group mapped into the private IOmap.
+ * Other processes can attach from now on.
+ * @param[in]  context        = context struct
+ * @param[in]  shm            = shared process image from ecx_shm_create()
+ * @param[in]  group          = group number, 0 = all groups
+ * @return 1 if successful, 0 if the group is not mapped in the segment
+ */
+int ecx_shm_map(ecx_contextt *context, ec_shmt *shm, uint8 group)
+{
+   ec_shmheadert *hdr = shm->hdr;
+   ec_groupt *grp;
+   ec_slavet *sl;
+   ec_shmslavet *entry;
+   uint32 slave;
+
+   if (group >= context->maxgroup)
+   {
+      return 0;
+   }
+   grp = &(context->grouplist[group]);
+   if (!shm->image ||
+       (grp->outputs < shm->image) ||
+       ((grp->outputs + grp->Obytes) > (shm->image + hdr->iomapsize)) ||
+       (grp->inputs < shm->image) ||
+       ((grp->inputs + grp->Ibytes) > (shm->image + hdr->iomapsize)))
+   {
+      return 0;
+   }
+   hdr->group = group;
+   hdr->Ooffset = (uint32)(grp->outputs - shm->image);
+   hdr->Obytes = grp->Obytes;
+   hdr->Ioffset = (uint32)(grp->inputs - shm->image);
+   hdr->Ibytes = grp->Ibytes;
+   for (slave = 1; (slave < hdr->nslave) && ((int)slave <= *(context->slavecount)); slave++)
+   {
+      sl = &(context->slavelist[slave]);
+      entry = &(shm->slave[slave]);
+      memset(entry, 0, sizeof(*entry));
+      entry->eep_man = sl->eep_man;
+      entry->eep_id = sl->eep_id;
+      entry->eep_rev = sl->eep_rev;
+      entry->group = sl->group;
+      entry->configadr = sl->configadr;
+      memcpy(entry->name, sl->name, sizeof(entry->name));
+      if (group && (sl->group != group))
+      {
+         continue;
+      }
+      if (sl->Obits && sl->outputs)
+      {
+         entry->Ooffset = (uint32)(sl->outputs - shm->image);
+         entry->Obits = sl->Obits;
+         entry->Ostartbit = sl->Ostartbit;
+      }
+      if (sl->Ibits && sl->inputs)
+      {
+         entry->Ioffset = (uint32)(sl->inputs - shm->image);
+         entry->Ibits = sl->Ibits;
+         entry->Istartbit = sl->Istartbit;
+      }
+   }
+   memcpy(shm->iomap, shm->image, hdr->iomapsize);
+   if (grp->Obytes)
+   {
+      memcpy(shm->stage, grp->outputs, grp->Obytes);
+   }
+   shm->stageseen = hdr->stagegen;
+   __atomic_store_n(&(hdr->magic), EC_SHM_MAGIC, __ATOMIC_RELEASE);
+
+   return 1;
+}
+
+/** Copy staged outputs to the private IOmap and send process data of the group.
+ * Called by the cyclic thread instead of ecx_send_processdata_group().
+ * @param[in]  context        = context struct
+ * @param[in]  shm            = shared process image
+ * @return >0 if processdata is transmitted
+ */
+int ecx_shm_send(ecx_contextt *context, ec_shmt *shm)
+{
+   ec_shmheadert *hdr = shm->hdr;
+   uint8 group = (uint8)hdr->group;
+
+   if ((__atomic_load_n(&(hdr->stagegen), __ATOMIC_ACQUIRE) != shm->stageseen) &&
+       ecx_shm_stage_lock(shm))
+   {
+      shm->stageseen = hdr->stagegen;
+      if (hdr->Obytes)
+      {
+         memcpy(shm->image + hdr->Ooffset, shm->stage, hdr->Obytes);
+      }
+      __atomic_store_n(&(hdr->stagelock), 0, __ATOMIC_RELEASE);
+   }
+   if (shm->flags & EC_SHM_OVERLAP)
+   {
+      return ecx_send_overlap_processdata_group(context, group);
+   }
+   return ecx_send_processdata_group(context, group);
+}
+
+/** Receive process data of the group, publish it in the segment and wake
+ * waiting processes. The frames are awaited before the seqlock is taken.
+ * Called by the cyclic thread instead of ecx_receive_processdata_group().
+ * @param[in]  context        = context struct
+ * @param[in]  shm            = shared process image
+ * @param[in]  timeout        = Timeout in us
+ * @return Work counter
+ */
+int ecx_shm_receive(ecx_contextt *context, ec_shmt *shm, int timeout)
+{
+   ec_shmheadert *hdr = shm->hdr;
+   uint8 group = (uint8)hdr->group;
+   uint32 seq = hdr->seq;
+   int wkc;
+
+   wkc = ecx_receive_processdata_group(context, group, timeout);
+   __atomic_store_n(&(hdr->seq), seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   /* an LRW returns the outputs as well, both parts are published */
+   if (hdr->Obytes)
+   {
+      memcpy(shm->iomap + hdr->Ooffset, shm->image + hdr->Ooffset, hdr->Obytes);
+   }
+   if (hdr->Ibytes)
+   {
+      memcpy(shm->iomap + hdr->Ioffset, shm->image + hdr->Ioffset, hdr->Ibytes);
+   }
+   hdr->wkc = wkc;
+   hdr->dctime = context->grouplist[group].hasdc ? *(context->DCtime) : 0;
+   __atomic_store_n(&(hdr->seq), seq + 2, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&(hdr->gen), 1, __ATOMIC_SEQ_CST);
+   /* a flag instead of a count, a waiter that died costs one wake only */
+   if (__atomic_exchange_n(&(hdr->waiters), 0, __ATOMIC_SEQ_CST))
+   {
+      syscall(SYS_futex, &(hdr->gen), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+   }
+
+   return wkc;
+}
+
+/** Attach to a shared process image created by another process.
+ * @param[out] shm            = shared process image
+ * @param[in]  name           = segment name
+ * @param[in]  flags          = EC_SHM_HUGEPAGE if created with it
+ * @return 1 if successful, 0 if it does not exist or is not complete yet
+ */
+int ecx_shm_open(ec_shmt *shm, const char *name, int flags)
+{
+   struct stat st;
+   ec_shmheadert *hdr;
+   void *p;
+   int fd;
+
+   ecx_shm_setname(shm, name, flags);
+   fd = ecx_shm_fd(shm, O_RDWR);
+   if (fd < 0)
+   {
+      return 0;
+   }
+   if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(ec_shmheadert)))
+   {
+      close(fd);
+      return 0;
+   }
+   p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (p == MAP_FAILED)
+   {
+      return 0;
+   }
+   hdr = (ec_shmheadert *)p;
+   if ((__atomic_load_n(&(hdr->magic), __ATOMIC_ACQUIRE) != EC_SHM_MAGIC) ||
+       (hdr->version != EC_SHM_VERSION) || (hdr->size > (uint64)st.st_size) ||
+       !ecx_shm_checkhdr(hdr, (uint64)st.st_size))
+   {
+      munmap(p, (size_t)st.st_size);
+      return 0;
+   }
+   shm->hdr = hdr;
+   shm->size = (size_t)st.st_size;
+   ecx_shm_setpointers(shm);
+
+   return 1;
+}
+
+/** Detach from a shared process image, the owner also removes its name.
+ * @param[in]  shm            = shared process image
+ */
+void ecx_shm_close(ec_shmt *shm)
+{
+   if (shm->hdr)
+   {
+      munmap(shm->hdr, shm->size);
+      shm->hdr = NULL;
+   }
+   free(shm->image);
+   shm->image = NULL;
+   if (shm->owner)
+   {
+      ecx_shm_unlink(shm);
+      shm->owner = FALSE;
+   }
+}
+
+/** Start reading the inputs in the IOmap.
+ * @param[in]  shm            = shared process image
+ * @return sequence to pass to ecx_shm_read_retry()
+ */
+uint32 ecx_shm_read_begin(ec_shmt *shm)
+{
+   return __atomic_load_n(&(shm->hdr->seq), __ATOMIC_ACQUIRE);
+}
+
+/** Check if the inputs read since ecx_shm_read_begin() are consistent.
+ * @param[in]  shm            = shared process image
+ * @param[in]  seq            = sequence from ecx_shm_read_begin()
+ * @return TRUE if the inputs changed meanwhile and must be read again
+ */
+boolean ecx_shm_read_retry(ec_shmt *shm, uint32 seq)
+{
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return ((seq & 1) || (__atomic_load_n(&(shm->hdr->seq), __ATOMIC_RELAXED) != seq));
+}
+
+/** Wait for a cycle after the given one.
+ * @param[in]  shm            = shared process image
+ * @param[in]  gen            = last seen cycle counter
+ * @param[in]  timeout        = Timeout in us, <0 to wait forever
+ * @return current cycle counter, equal to gen on timeout or signal
+ */
+uint32 ecx_shm_wait(ec_shmt *shm, uint32 gen, int timeout)
+{
+   ec_shmheadert *hdr = shm->hdr;
+   struct timespec ts;
+   uint32 cur;
+
+   cur = __atomic_load_n(&(hdr->gen), __ATOMIC_ACQUIRE);
+   if ((cur != gen) || (timeout == 0))
+   {
+      return cur;
+   }
+   ts.tv_sec = timeout / 1000000;
+   ts.tv_nsec = (timeout % 1000000) * 1000;
+   __atomic_store_n(&(hdr->waiters), 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&(hdr->gen), __ATOMIC_SEQ_CST) == gen)
+   {
+      syscall(SYS_futex, &(hdr->gen), FUTEX_WAIT, gen, (timeout < 0) ? NULL : &ts, NULL, 0);
+   }
+
+   return __atomic_load_n(&(hdr->gen), __ATOMIC_ACQUIRE);
+}
+
+/** Start staging outputs. Only one process stages at a time.
+ * @param[in]  shm            = shared process image
+ * @return staged outputs in group output layout, NULL if busy, try again
+ */
+uint8 *ecx_shm_stage_begin(ec_shmt *shm)
+{
+   if (!ecx_shm_stage_lock(shm))
+   {
+      return NULL;
+   }
+   return shm->stage;
+}
+
+/** End staging outputs, they are sent with the next cycle.
+ * @param[in]  shm            = shared process image
+ */
+void ecx_shm_stage_end(ec_shmt *shm)
+{
+   __atomic_add_fetch(&(shm->hdr->stagegen), 1, __ATOMIC_RELAXED);
+   __atomic_store_n(&(shm->hdr->stagelock), 0, __ATOMIC_RELEASE);
+}
+
+#ifdef EC_VER1
+/** Create a shared process image.
+ * @param[out] shm            = shared process image
+ * @param[in]  name           = segment name
+ * @param[in]  iomapsize      = size of the IOmap
+ * @param[in]  flags          = EC_SHM_xxx flags
+ * @return private IOmap of the same layout as the segment, NULL on error
+ * @see ecx_shm_create
+ */
+uint8 *ec_shm_create(ec_shmt *shm, const char *name, uint32 iomapsize, int flags)
+{
+   return ecx_shm_create(&ecx_context, shm, name, iomapsize, flags);
+}
+
+/** Publish the directory of a group mapped into the private IOmap.
+ * @param[in]  shm            = shared process image
+ * @param[in]  group          = group number, 0 = all groups
+ * @return 1 if successful
+ * @see ecx_shm_map
+ */
+int ec_shm_map(ec_shmt *shm, uint8 group)
+{
+   return ecx_shm_map(&ecx_context, shm, group);
+}
+
+/** Copy staged outputs to the private IOmap and send process data of the group.
+ * @param[in]  shm            = shared process image
+ * @return >0 if processdata is transmitted
+ * @see ecx_shm_send
+ */
+int ec_shm_send(ec_shmt *shm)
+{
+   return ecx_shm_send(&ecx_context, shm);
+}
+
+/** Receive process data of the group, publish it and wake waiting processes.
+ * @param[in]  shm            = shared process image
+ * @param[in]  timeout        = Timeout in us
+ * @return Work counter
+ * @see ecx_shm_receive
+ */
+int ec_shm_receive(ec_shmt *shm, int timeout)
+{
+   return ecx_shm_receive(&ecx_context, shm, timeout);
+}
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ecshm.c
+ */
+
+#ifndef _ecshmh_
+#define _ecshmh_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include "ethercatmain.h"
+
+/** magic number at start of a shared process image, "ECSH" */
+#define EC_SHM_MAGIC       0x48534345
+/** version of the shared process image layout */
+#define EC_SHM_VERSION     2
+/** place the segment in EC_SHM_HUGEDIR instead of POSIX shared memory */
+#define EC_SHM_HUGEPAGE    0x01
+/** the group is mapped with ecx_config_overlap_map_group() */
+#define EC_SHM_OVERLAP     0x02
+/** hugetlbfs mount used with EC_SHM_HUGEPAGE */
+#ifndef EC_SHM_HUGEDIR
+#define EC_SHM_HUGEDIR     "/dev/hugepages"
+#endif
+/** size the segment is rounded up to with EC_SHM_HUGEPAGE */
+#ifndef EC_SHM_HUGESIZE
+#define EC_SHM_HUGESIZE    (2 * 1024 * 1024)
+#endif
+/** failed tries to take the staging lock before its owner is checked to be
+ * alive, the cyclic thread tries once per cycle with new staged outputs */
+#ifndef EC_SHM_STAGEBUSY
+#define EC_SHM_STAGEBUSY   100
+#endif
+
+/** directory entry of one slave, offsets are relative to the IOmap */
+typedef struct
+{
+   /** manufacturer from EEPROM */
+   uint32           eep_man;
+   /** ID from EEPROM */
+   uint32           eep_id;
+   /** revision from EEPROM */
+   uint32           eep_rev;
+   /** offset of the outputs, valid if Obits > 0 */
+   uint32           Ooffset;
+   /** offset of the inputs, valid if Ibits > 0 */
+   uint32           Ioffset;
+   /** output bits */
+   uint16           Obits;
+   /** input bits */
+   uint16           Ibits;
+   /** startbit in first output byte */
+   uint8            Ostartbit;
+   /** startbit in first input byte */
+   uint8            Istartbit;
+   /** group */
+   uint8            group;
+   /** station address */
+   uint16           configadr;
+   /** readable name */
+   char             name[EC_MAXNAME + 1];
+} ec_shmslavet;
+
+/** header at the start of a shared process image */
+typedef struct
+{
+   /** EC_SHM_MAGIC once the directory is complete, 0 before */
+   uint32           magic;
+   /** EC_SHM_VERSION */
+   uint32           version;
+   /** size of the segment */
+   uint64           size;
+   /** offset of the IOmap in the segment */
+   uint32           iomapoffset;
+   /** size of the IOmap */
+   uint32           iomapsize;
+   /** offset of the staged outputs in the segment */
+   uint32           stageoffset;
+   /** offset of the slave directory in the segment */
+   uint32           slaveoffset;
+   /** number of directory entries, entry n is slave n, entry 0 is unused */
+   uint32           nslave;
+   /** group of the process image */
+   uint32           group;
+   /** offset of the group outputs in the IOmap */
+   uint32           Ooffset;
+   /** output bytes of the group */
+   uint32           Obytes;
+   /** offset of the group inputs in the IOmap */
+   uint32           Ioffset;
+   /** input bytes of the group */
+   uint32           Ibytes;
+   /** seqlock of the inputs, odd while the cyclic thread writes them */
+   uint32           seq;
+   /** cycle counter, futex word for ecx_shm_wait() */
+   uint32           gen;
+   /** set by processes going to sleep in ecx_shm_wait(), cleared by the
+    * receive that wakes them */
+   uint32           waiters;
+   /** process id of the process staging outputs or of the cyclic thread
+    * taking them, 0 if free */
+   uint32           stagelock;
+   /** incremented by every ecx_shm_stage_end() */
+   uint32           stagegen;
+   /** work counter of the last cycle, written under seq */
+   int32            wkc;
+   /** DC time of the last cycle, written under seq */
+   int64            dctime;
+} ec_shmheadert;
+
+/** shared process image as mapped by one process */
+typedef struct
+{
+   /** mapped segment */
+   ec_shmheadert    *hdr;
+   /** size of the mapping */
+   size_t           size;
+   /** IOmap in the segment */
+   uint8            *iomap;
+   /** in the creating process the private IOmap the group is mapped into,
+    * NULL in other processes */
+   uint8            *image;
+   /** staged outputs in the segment, same layout as the group outputs */
+   uint8            *stage;
+   /** slave directory in the segment */
+   ec_shmslavet     *slave;
+   /** TRUE in the process that created the segment */
+   boolean          owner;
+   /** flags used to create or open the segment */
+   int              flags;
+   /** internal, stagegen of the outputs last copied to the IOmap */
+   uint32           stageseen;
+   /** internal, process id written to stagelock */
+   uint32           pid;
+   /** internal, failed tries to take the staging lock in a row */
+   uint32           stagebusy;
+   /** segment name */
+   char             name[64];
+} ec_shmt;
+
+#ifdef EC_VER1
+uint8 *ec_shm_create(ec_shmt *shm, const char *name, uint32 iomapsize, int flags);
+int ec_shm_map(ec_shmt *shm, uint8 group);
+int ec_shm_send(ec_shmt *shm);
+int ec_shm_receive(ec_shmt *shm, int timeout);
+#endif
+
+uint8 *ecx_shm_create(ecx_contextt *context, ec_shmt *shm, const char *name,
+   uint32 iomapsize, int flags);
+int ecx_shm_map(ecx_contextt *context, ec_shmt *shm, uint8 group);
+int ecx_shm_send(ecx_contextt *context, ec_shmt *shm);
+int ecx_shm_receive(ecx_contextt *context, ec_shmt *shm, int timeout);
+int ecx_shm_open(ec_shmt *shm, const char *name, int flags);
+void ecx_shm_close(ec_shmt *shm);
+uint32 ecx_shm_read_begin(ec_shmt *shm);
+boolean ecx_shm_read_retry(ec_shmt *shm, uint32 seq);
+uint32 ecx_shm_wait(ec_shmt *shm, uint32 gen, int timeout);
+uint8 *ecx_shm_stage_begin(ec_shmt *shm);
+void ecx_shm_stage_end(ec_shmt *shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,8 +28,28 @@
  * packets. The software layer will detect the possible failure modes and
  * compensate. If needed the packets from interface A are resent through interface B.
  * This layer if fully transparent for the higher layers.
+ *
+ * Optionally the socket can be opened with ecx_setupnic_mmap(). Frames are
+ * then exchanged through PACKET_MMAP rx and tx rings shared with the kernel.
+ * Polling the rx ring is a plain memory read, so no syscall is needed when
+ * no frame is waiting, and received frames are copied from the ring slot
+ * straight into the indexed rx buffer.
+ *
+ * With ecx_setupnic_xdp() frames are exchanged through an AF_XDP socket
+ * bound to a single NIC queue instead, see nicdrv_xdp.c.
+ *
+ * In batch mode (port->batchmode) process data frames passed to
+ * ecx_outframe_red() are queued and sent together by ecx_outframe_flush(),
+ * and received frames are drained from the socket in batches. Frames of
+ * ecx_srconfirm() bypass the queue, so mailbox and configuration traffic is
+ * not delayed.
+ *
+ * When a statistics struct is attached with ecx_setstats() every frame
+ * exchange on the primary socket is recorded with its tx and rx time, see
+ * ethercatstats.c. Kernel or NIC timestamps are used when available.
  */
 
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -40,12 +60,19 @@
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <linux/errqueue.h>
+#include <sys/mman.h>
 #include <pthread.h>
 
 #include "oshw.h"
 #include "osal.h"
+#include "nicdrv_xdp.h"
+#include "ethercatstats.h"
 
 /** Redundancy modes */
 enum
@@ -72,16 +99,77 @@ const uint16 secMAC[3] = { 0x0404, 0x0404, 0x0404 };
 /** second MAC word is used for identification */
 #define RX_SEC secMAC[1]
 
-static void ecx_clear_rxbufstat(int *rxbufstat)
+/** number of frame slots per PACKET_MMAP ring, must be a power of 2 */
+#define EC_RINGFRAMES     64
+/** size of one PACKET_MMAP frame slot, must fit TPACKET2_HDRLEN + EC_BUFSIZE */
+#define EC_RINGFRAMESIZE  2048
+/** size of dummy BRD frame sent on secondary port in redundant mode */
+#define EC_REDFRAMESIZE   (ETH_HEADERSIZE + EC_HEADERSIZE + EC_WKCSIZE + 2)
+
+/* Buffer states are shared between the cyclic thread and other threads
+ * using the same port without a lock. A slot moves EMPTY -> ALLOC in
+ * ecx_getindex(), ALLOC -> TX when sent, TX -> RCVD when a frame for it is
+ * received by another thread, TX/RCVD -> COMPLETE when the owner reads it
+ * and back to EMPTY with ecx_setbufstat(). Only the EMPTY -> ALLOC and
+ * TX -> RCVD steps can race and use compare and swap.
+ */
+static int ecx_getbufstat(int *bufstat)
+{
+   return __atomic_load_n(bufstat, __ATOMIC_ACQUIRE);
+}
+
+static void ecx_putbufstat(int *bufstat, int state)
+{
+   __atomic_store_n(bufstat, state, __ATOMIC_RELEASE);
+}
+
+static int ecx_swapbufstat(int *bufstat, int from, int to)
+{
+   return __atomic_compare_exchange_n(bufstat, &from, to, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void ecx_clear_rxbufstat(ec_bufstatt *rxbufstat, int maxbuf)
 {
    int i;
-   for(i = 0; i < EC_MAXBUF; i++)
+   for(i = 0; i < maxbuf; i++)
+   {
+      ecx_putbufstat(&rxbufstat[i].state, EC_BUF_EMPTY);
+   }
+}
+
+/** Allocate zeroed frame buffer memory aligned to a cache line.
+ * @param[in] size        = size in bytes
+ * @return pointer to memory, NULL if out of memory
+ */
+static void *ecx_bufalloc(size_t size)
+{
+   void *p;
+
+   if (posix_memalign(&p, EC_CACHELINE, size))
    {
-      rxbufstat[i] = EC_BUF_EMPTY;
+      return NULL;
    }
+   memset(p, 0, size);
+
+   return p;
+}
+
+/** Free frame buffer memory and clear the pointer.
+ * @param[in,out] p       = pointer to pointer to memory
+ */
+static void ecx_buffree(void *p)
+{
+   void **pp = p;
+
+   free(*pp);
+   *pp = NULL;
 }
 
 /** Basic setup to connect NIC to socket.
+ * The frame buffers are allocated here, port->maxbuf selects how many.
+ * It is read when the primary NIC is set up and must be 0 (EC_MAXBUF
+ * buffers) or between 1 and EC_MAXFRAMEIDX - 1, EC_NOINDEX is reserved.
+ * The secondary NIC uses the same number as the primary one.
  * @param[in] port        = port context struct
  * @param[in] ifname      = Name of NIC device, f.e. "eth0"
  * @param[in] secondary   = if >0 then use secondary stack instead of primary
@@ -108,13 +196,29 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
          *psock = -1;
          port->redstate                   = ECT_RED_DOUBLE;
          port->redport->stack.sock        = &(port->redport->sockhandle);
-         port->redport->stack.txbuf       = &(port->txbuf);
-         port->redport->stack.txbuflength = &(port->txbuflength);
+         port->redport->rxbuf             = ecx_bufalloc(port->maxbuf * sizeof(ec_bufT));
+         port->redport->rxbufstat         = ecx_bufalloc(port->maxbuf * sizeof(ec_bufstatt));
+         if (!port->redport->rxbuf || !port->redport->rxbufstat)
+         {
+            ecx_buffree(&(port->redport->rxbuf));
+            ecx_buffree(&(port->redport->rxbufstat));
+            return 0;
+         }
+         port->redport->stack.txbuf       = port->txbuf;
+         port->redport->stack.txbuflength = port->txbuflength;
          port->redport->stack.tempbuf     = &(port->redport->tempinbuf);
-         port->redport->stack.rxbuf       = &(port->redport->rxbuf);
-         port->redport->stack.rxbufstat   = &(port->redport->rxbufstat);
-         port->redport->stack.rxsa        = &(port->redport->rxsa);
-         ecx_clear_rxbufstat(&(port->redport->rxbufstat[0]));
+         port->redport->stack.rxbuf       = port->redport->rxbuf;
+         port->redport->stack.rxbufstat   = port->redport->rxbufstat;
+         port->redport->stack.rxring      = &(port->redport->rxring);
+         port->redport->stack.txring      = &(port->redport->txring);
+         port->redport->rxring.map        = NULL;
+         port->redport->txring.map        = NULL;
+         port->redport->stack.xsk         = &(port->redport->xsk);
+         port->redport->xsk               = NULL;
+         port->redport->stack.rxbatch     = &(port->redport->rxbatch);
+         port->redport->rxbatch.cnt       = 0;
+         port->redport->rxbatch.pos       = 0;
+         ecx_clear_rxbufstat(port->redport->rxbufstat, port->maxbuf);
       }
       else
       {
@@ -124,22 +228,51 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
    }
    else
    {
+      if ((port->maxbuf <= 0) || (port->maxbuf >= EC_MAXFRAMEIDX))
+      {
+         port->maxbuf = EC_MAXBUF;
+      }
+      port->txbuf             = ecx_bufalloc(port->maxbuf * sizeof(ec_bufT));
+      port->txbuflength       = ecx_bufalloc(port->maxbuf * sizeof(int));
+      port->rxbuf             = ecx_bufalloc(port->maxbuf * sizeof(ec_bufT));
+      port->rxbufstat         = ecx_bufalloc(port->maxbuf * sizeof(ec_bufstatt));
+      if (!port->txbuf || !port->txbuflength || !port->rxbuf || !port->rxbufstat)
+      {
+         ecx_buffree(&(port->txbuf));
+         ecx_buffree(&(port->txbuflength));
+         ecx_buffree(&(port->rxbuf));
+         ecx_buffree(&(port->rxbufstat));
+         return 0;
+      }
       pthread_mutexattr_init(&mutexattr);
       pthread_mutexattr_setprotocol(&mutexattr  , PTHREAD_PRIO_INHERIT);
-      pthread_mutex_init(&(port->getindex_mutex), &mutexattr);
       pthread_mutex_init(&(port->tx_mutex)      , &mutexattr);
       pthread_mutex_init(&(port->rx_mutex)      , &mutexattr);
       port->sockhandle        = -1;
       port->lastidx           = 0;
+      port->bufexhausted      = 0;
+      port->stats             = NULL;
+      port->tsmode            = 0;
+      port->txstamps          = 0;
       port->redstate          = ECT_RED_NONE;
       port->stack.sock        = &(port->sockhandle);
-      port->stack.txbuf       = &(port->txbuf);
-      port->stack.txbuflength = &(port->txbuflength);
+      port->stack.txbuf       = port->txbuf;
+      port->stack.txbuflength = port->txbuflength;
       port->stack.tempbuf     = &(port->tempinbuf);
-      port->stack.rxbuf       = &(port->rxbuf);
-      port->stack.rxbufstat   = &(port->rxbufstat);
-      port->stack.rxsa        = &(port->rxsa);
-      ecx_clear_rxbufstat(&(port->rxbufstat[0]));
+      port->stack.rxbuf       = port->rxbuf;
+      port->stack.rxbufstat   = port->rxbufstat;
+      port->stack.rxring      = &(port->rxring);
+      port->stack.txring      = &(port->txring);
+      port->rxring.map        = NULL;
+      port->txring.map        = NULL;
+      port->stack.xsk         = &(port->xsk);
+      port->xsk               = NULL;
+      port->stack.rxbatch     = &(port->rxbatch);
+      port->rxbatch.cnt       = 0;
+      port->rxbatch.pos       = 0;
+      port->batchmode         = FALSE;
+      port->txbatchcnt        = 0;
+      ecx_clear_rxbufstat(port->rxbufstat, port->maxbuf);
       psock = &(port->sockhandle);
    }
    /* we use RAW packet socket, with packet type ETH_P_ECAT */
@@ -171,10 +304,10 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
    sll.sll_protocol = htons(ETH_P_ECAT);
    r |= bind(*psock, (struct sockaddr *)&sll, sizeof(sll));
    /* setup ethernet headers in tx buffers so we don't have to repeat it */
-   for (i = 0; i < EC_MAXBUF; i++)
+   for (i = 0; i < port->maxbuf; i++)
    {
       ec_setupheader(&(port->txbuf[i]));
-      port->rxbufstat[i] = EC_BUF_EMPTY;
+      ecx_putbufstat(&(port->rxbufstat[i].state), EC_BUF_EMPTY);
    }
    ec_setupheader(&(port->txbuf2));
    if (r == 0) rval = 1;
@@ -182,16 +315,183 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
    return rval;
 }
 
-/** Close sockets used
+/** Attach PACKET_MMAP rx and tx rings to an opened NIC socket.
+ * TPACKET_V2 is used because it hands over every frame as soon as it is
+ * received. TPACKET_V3 only hands over complete blocks, or blocks retired
+ * by a timer with millisecond resolution, which is too slow for cyclic use.
+ * @param[in] stack       = stack to attach the rings to
+ * @return >0 if succeeded
+ */
+static int ecx_setupring(ec_stackT *stack)
+{
+   struct tpacket_req req;
+   int r, i, blocksize;
+   size_t ringsize;
+   uint8 *map;
+
+   blocksize = getpagesize();
+   if (blocksize < EC_RINGFRAMESIZE)
+   {
+      blocksize = EC_RINGFRAMESIZE;
+   }
+   req.tp_block_size = blocksize;
+   req.tp_frame_size = EC_RINGFRAMESIZE;
+   req.tp_block_nr   = (EC_RINGFRAMES * EC_RINGFRAMESIZE) / blocksize;
+   req.tp_frame_nr   = EC_RINGFRAMES;
+   r = 0;
+   i = TPACKET_V2;
+   r |= setsockopt(*stack->sock, SOL_PACKET, PACKET_VERSION, &i, sizeof(i));
+   r |= setsockopt(*stack->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+   r |= setsockopt(*stack->sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+   if (r)
+   {
+      return 0;
+   }
+   /* frames do not need the qdisc layer, ignore failure on old kernels */
+   i = 1;
+   (void)setsockopt(*stack->sock, SOL_PACKET, PACKET_QDISC_BYPASS, &i, sizeof(i));
+   /* rx ring and tx ring are mapped back to back */
+   ringsize = (size_t)req.tp_block_size * req.tp_block_nr;
+   map = mmap(NULL, ringsize * 2, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, *stack->sock, 0);
+   if (map == MAP_FAILED)
+   {
+      return 0;
+   }
+   stack->rxring->map       = map;
+   stack->rxring->framesize = EC_RINGFRAMESIZE;
+   stack->rxring->framenr   = EC_RINGFRAMES;
+   stack->rxring->head      = 0;
+   stack->txring->map       = map + ringsize;
+   stack->txring->framesize = EC_RINGFRAMESIZE;
+   stack->txring->framenr   = EC_RINGFRAMES;
+   stack->txring->head      = 0;
+
+   return 1;
+}
+
+/** Prepare "dummy" BRD tx frame for the secondary socket in redundant operation.
+ * @param[in] port        = port context struct
+ */
+static void ecx_setupredframe(ecx_portt *port)
+{
+   ec_comt *datagramP;
+   uint8 *frameP;
+
+   frameP = port->txbuf2;
+   datagramP = (ec_comt *)&frameP[ETH_HEADERSIZE];
+   datagramP->elength = htoes(EC_ECATTYPE + EC_HEADERSIZE + 2);
+   datagramP->command = EC_CMD_BRD;
+   datagramP->index = 0;
+   datagramP->ADP = 0;
+   datagramP->ADO = 0;
+   datagramP->dlength = htoes(2);
+   memset(&frameP[ETH_HEADERSIZE + EC_HEADERSIZE], 0, 2 + EC_WKCSIZE);
+   port->txbuflength2 = ETH_HEADERSIZE + EC_HEADERSIZE + EC_WKCSIZE + 2;
+}
+
+/** Basic setup to connect NIC to socket with PACKET_MMAP rx and tx rings.
+ * Same as ecx_setupnic() but frames are exchanged through rings shared with
+ * the kernel instead of a send() and recv() per frame. For redundant
+ * operation set port->redport and call this function for the primary and
+ * then for the secondary NIC instead of using ecx_init_redundant().
+ * @param[in] port        = port context struct
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @param[in] secondary   = if >0 then use secondary stack instead of primary
+ * @return >0 if succeeded
+ */
+int ecx_setupnic_mmap(ecx_portt *port, const char *ifname, int secondary)
+{
+   int rval;
+
+   rval = ecx_setupnic(port, ifname, secondary);
+   if (rval)
+   {
+      if (secondary)
+      {
+         rval = ecx_setupring(&(port->redport->stack));
+         ecx_setupredframe(port);
+      }
+      else
+      {
+         rval = ecx_setupring(&(port->stack));
+      }
+   }
+
+   return rval;
+}
+
+/** Basic setup to connect NIC to an AF_XDP socket.
+ * Same as ecx_setupnic() but EtherCAT frames are redirected by XDP to an
+ * AF_XDP socket bound to one NIC queue. Native zero-copy mode is tried
+ * first, then native copy mode and at last generic XDP. For redundant
+ * operation set port->redport and call this function for the primary and
+ * then for the secondary NIC instead of using ecx_init_redundant().
+ * @param[in] port        = port context struct
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @param[in] secondary   = if >0 then use secondary stack instead of primary
+ * @param[in] queue       = NIC queue to bind to, EtherCAT frames must arrive on it
+ * @param[in] busypoll    = if >0 busy poll the NIC for this many us when waiting for frames
+ * @return >0 if succeeded
+ */
+int ecx_setupnic_xdp(ecx_portt *port, const char *ifname, int secondary, int queue, int busypoll)
+{
+   int rval;
+
+   rval = ecx_setupnic(port, ifname, secondary);
+   if (rval)
+   {
+      if (secondary)
+      {
+         rval = ecx_xsk_open(&(port->redport->xsk), ifname, queue, busypoll);
+         ecx_setupredframe(port);
+      }
+      else
+      {
+         rval = ecx_xsk_open(&(port->xsk), ifname, queue, busypoll);
+      }
+   }
+
+   return rval;
+}
+
+/** Unmap PACKET_MMAP rings and close AF_XDP socket of a stack, if any.
+ * @param[in] stack       = stack to release the rings of
+ */
+static void ecx_closering(ec_stackT *stack)
+{
+   if (stack->rxring && stack->rxring->map)
+   {
+      munmap(stack->rxring->map, (size_t)stack->rxring->framenr * stack->rxring->framesize * 2);
+      stack->rxring->map = NULL;
+      stack->txring->map = NULL;
+   }
+   if (stack->xsk)
+   {
+      ecx_xsk_close(stack->xsk);
+   }
+}
+
+/** Close sockets used and free frame buffers
  * @param[in] port        = port context struct
  * @return 0
  */
 int ecx_closenic(ecx_portt *port)
 {
+   ecx_closering(&(port->stack));
    if (port->sockhandle >= 0)
       close(port->sockhandle);
-   if ((port->redport) && (port->redport->sockhandle >= 0))
-      close(port->redport->sockhandle);
+   if (port->redport)
+   {
+      ecx_closering(&(port->redport->stack));
+      if (port->redport->sockhandle >= 0)
+         close(port->redport->sockhandle);
+      ecx_buffree(&(port->redport->rxbuf));
+      ecx_buffree(&(port->redport->rxbufstat));
+   }
+   ecx_buffree(&(port->txbuf));
+   ecx_buffree(&(port->txbuflength));
+   ecx_buffree(&(port->rxbuf));
+   ecx_buffree(&(port->rxbufstat));
 
    return 0;
 }
@@ -214,40 +514,288 @@ void ec_setupheader(void *p)
    bp->etype = htons(ETH_P_ECAT);
 }
 
+/** Current time in ns, same clock as kernel software timestamps.
+ * @return time in ns
+ */
+static int64 ecx_stamp_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Get kernel or NIC timestamp from control messages of a received message.
+ * @param[in] port        = port context struct
+ * @param[in] msg         = received message
+ * @param[out] t          = timestamp in ns
+ * @return timestamp source, 0 if no timestamp found
+ */
+static int ecx_stamp_cmsg(ecx_portt *port, struct msghdr *msg, int64 *t)
+{
+   struct cmsghdr *cmsg;
+   struct scm_timestamping *tss;
+
+   for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+   {
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_TIMESTAMPING))
+      {
+         tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+         if ((port->tsmode & EC_STAT_TSHW) && (tss->ts[2].tv_sec || tss->ts[2].tv_nsec))
+         {
+            *t = (int64)tss->ts[2].tv_sec * 1000000000 + tss->ts[2].tv_nsec;
+            return EC_STAT_TSHW;
+         }
+         if (tss->ts[0].tv_sec || tss->ts[0].tv_nsec)
+         {
+            *t = (int64)tss->ts[0].tv_sec * 1000000000 + tss->ts[0].tv_nsec;
+            return EC_STAT_TSSOFT;
+         }
+      }
+   }
+
+   return 0;
+}
+
+/** Read tx timestamps looped back on the error queue of the primary socket
+ * and set them in the frame records they belong to.
+ * @param[in] port        = port context struct
+ * @param[in] collect     = FALSE to drop the timestamps
+ * @return number of records that got their tx timestamp
+ */
+static int ecx_readtxstamps(ecx_portt *port, int collect)
+{
+   uint8 buf[ETH_HEADERSIZE + EC_HEADERSIZE];
+   uint8 control[256];
+   struct msghdr msg;
+   struct iovec iov;
+   ec_etherheadert *ehp;
+   ec_comt *ecp;
+   int64 t;
+   int src, cnt;
+
+   cnt = 0;
+   __atomic_store_n(&(port->txstamps), 0, __ATOMIC_RELAXED);
+   for (;;)
+   {
+      memset(&msg, 0, sizeof(msg));
+      iov.iov_base = buf;
+      iov.iov_len = sizeof(buf);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (recvmsg(port->sockhandle, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < (int)sizeof(buf))
+      {
+         break;
+      }
+      ehp = (ec_etherheadert *)buf;
+      ecp = (ec_comt *)&buf[ETH_HEADERSIZE];
+      src = ecx_stamp_cmsg(port, &msg, &t);
+      if (collect && src && port->stats && (ehp->etype == htons(ETH_P_ECAT)))
+      {
+         cnt += ecx_stats_txstamp(port->stats, ecp->index, t, (uint8)src);
+      }
+   }
+
+   return cnt;
+}
+
+/** Check if tx timestamps of the primary socket are read from its error
+ * queue.
+ * @param[in] port        = port context struct
+ * @return TRUE if they are
+ */
+static int ecx_txstamped(ecx_portt *port)
+{
+   return (port->tsmode & (EC_STAT_TSSOFT | EC_STAT_TSHW)) &&
+          !port->rxring.map && !port->xsk && !port->batchmode;
+}
+
+/** Stamp frame with user space tx time before it is sent.
+ * @param[in] port        = port context struct
+ * @param[in] idx         = index in buffer array
+ */
+static void ecx_stamptx(ecx_portt *port, uint8 idx)
+{
+   port->rxbufstat[idx].txtime = ecx_stamp_now();
+   port->rxbufstat[idx].txsrc = EC_STAT_TSUSER;
+   port->rxbufstat[idx].rxtime = 0;
+   __atomic_add_fetch(&(port->txstamps), 1, __ATOMIC_RELAXED);
+}
+
+/** Write frame record of a completed or lost frame to the statistics.
+ * @param[in] port        = port context struct
+ * @param[in] idx         = index in buffer array
+ * @param[in] wkc         = work counter or EC_NOFRAME
+ */
+static void ecx_putframerec(ecx_portt *port, uint8 idx, int wkc)
+{
+   ec_bufstatt *bs = &(port->rxbufstat[idx]);
+   ec_framerect rec;
+   int64 rtt;
+   uint8 txsrc;
+
+   txsrc = bs->txsrc;
+   if (ecx_txstamped(port))
+   {
+      /* the tx timestamp is set by ecx_collectstats(), unless it is not
+       * called and the error queue has to be cleared here */
+      txsrc |= EC_STAT_TSPEND;
+      if (__atomic_load_n(&(port->txstamps), __ATOMIC_RELAXED) >= EC_STATTXPEND)
+      {
+         ecx_readtxstamps(port, FALSE);
+      }
+   }
+   rec.idx = idx;
+   rec.wkc = (int16)wkc;
+   rec.txtime = bs->txtime;
+   rec.rxtime = (wkc > EC_NOFRAME) ? bs->rxtime : 0;
+   rec.tssrc = (uint8)((txsrc << 4) | (rec.rxtime ? bs->rxsrc : 0));
+   rec.rtt = -1;
+   /* NIC clock and system clock can not be compared */
+   if (rec.rxtime && ((bs->txsrc == EC_STAT_TSHW) == (bs->rxsrc == EC_STAT_TSHW)))
+   {
+      rtt = rec.rxtime - rec.txtime;
+      if ((rtt >= 0) && (rtt <= 0x7fffffff))
+      {
+         rec.rtt = (int32)rtt;
+      }
+   }
+   ecx_stats_putframe(port->stats, &rec);
+}
+
+/** Attach statistics struct for frame records, or detach it. Call after
+ * the NIC is set up. Frames on the primary socket are recorded with the
+ * best timestamps available: NIC hardware stamps if requested and supported,
+ * else kernel software stamps. In AF_XDP and batch mode the time is taken
+ * in user space.
+ * @param[in] port        = port context struct
+ * @param[in] stats       = statistics struct, NULL to stop recording
+ * @param[in] hwstamp     = if TRUE use NIC hardware timestamps
+ * @return timestamp sources used, EC_STAT_TSxxx bits
+ */
+int ecx_setstats(ecx_portt *port, struct ec_stats *stats, int hwstamp)
+{
+   struct hwtstamp_config hwcfg;
+   struct sockaddr_ll sll;
+   socklen_t sll_len;
+   struct ifreq ifr;
+   int flags, mode;
+
+   port->stats = NULL;
+   port->tsmode = 0;
+   if (!stats)
+   {
+      return 0;
+   }
+   mode = EC_STAT_TSUSER;
+   if (!port->xsk)
+   {
+      flags = 0;
+      if (hwstamp && !port->batchmode)
+      {
+         /* NIC is found by the interface the socket is bound to */
+         memset(&ifr, 0, sizeof(ifr));
+         sll_len = sizeof(sll);
+         if ((getsockname(port->sockhandle, (struct sockaddr *)&sll, &sll_len) == 0) &&
+             if_indextoname(sll.sll_ifindex, ifr.ifr_name))
+         {
+            memset(&hwcfg, 0, sizeof(hwcfg));
+            hwcfg.tx_type = HWTSTAMP_TX_ON;
+            hwcfg.rx_filter = HWTSTAMP_FILTER_ALL;
+            ifr.ifr_data = (void *)&hwcfg;
+            if (ioctl(port->sockhandle, SIOCSHWTSTAMP, &ifr) == 0)
+            {
+               flags |= SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+                        SOF_TIMESTAMPING_TX_HARDWARE;
+               mode |= EC_STAT_TSHW;
+            }
+         }
+      }
+      if (port->rxring.map)
+      {
+         /* rx ring slots carry the timestamp, tx is stamped in user space */
+         flags &= SOF_TIMESTAMPING_RAW_HARDWARE;
+         if (flags)
+         {
+            (void)setsockopt(port->sockhandle, SOL_PACKET, PACKET_TIMESTAMP, &flags, sizeof(flags));
+         }
+         mode |= EC_STAT_TSSOFT;
+      }
+      else if (!port->batchmode)
+      {
+         flags |= SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE;
+         if (setsockopt(port->sockhandle, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+         {
+            mode |= EC_STAT_TSSOFT;
+         }
+         else
+         {
+            mode = EC_STAT_TSUSER;
+         }
+      }
+   }
+   port->tsmode = mode;
+   port->stats = stats;
+
+   return mode;
+}
+
+/** Collect tx timestamps of the primary socket into the frame records,
+ * called by ecx_stats_collect() from the thread reading the records.
+ * @param[in] port        = port context struct
+ * @return number of records that got their tx timestamp
+ */
+int ecx_collectstats(ecx_portt *port)
+{
+   if (!port->stats || !ecx_txstamped(port))
+   {
+      return 0;
+   }
+   return ecx_readtxstamps(port, TRUE);
+}
+
 /** Get new frame identifier index and allocate corresponding rx buffer.
+ * Lock free, concurrent callers always get different indexes as long as
+ * buffers are free. When all port->maxbuf buffers are in use
+ * port->bufexhausted is incremented and EC_NOINDEX is returned, the caller
+ * must then fail the send. Raise port->maxbuf if this happens.
  * @param[in] port        = port context struct
- * @return new index.
+ * @return new index, EC_NOINDEX if all buffers are in use.
  */
 uint8 ecx_getindex(ecx_portt *port)
 {
-   uint8 idx;
-   uint8 cnt;
+   int idx;
+   int cnt;
 
-   pthread_mutex_lock( &(port->getindex_mutex) );
-
-   idx = port->lastidx + 1;
+   idx = __atomic_load_n(&(port->lastidx), __ATOMIC_RELAXED) + 1;
    /* index can't be larger than buffer array */
-   if (idx >= EC_MAXBUF)
+   if (idx >= port->maxbuf)
    {
       idx = 0;
    }
    cnt = 0;
-   /* try to find unused index */
-   while ((port->rxbufstat[idx] != EC_BUF_EMPTY) && (cnt < EC_MAXBUF))
+   /* try to find and claim unused index, the count is checked first so a
+    * buffer claimed by the swap is never given up */
+   while ((cnt < port->maxbuf) && !ecx_swapbufstat(&(port->rxbufstat[idx].state), EC_BUF_EMPTY, EC_BUF_ALLOC))
    {
       idx++;
       cnt++;
-      if (idx >= EC_MAXBUF)
+      if (idx >= port->maxbuf)
       {
          idx = 0;
       }
    }
-   port->rxbufstat[idx] = EC_BUF_ALLOC;
+   if (cnt >= port->maxbuf)
+   {
+      __atomic_add_fetch(&(port->bufexhausted), 1, __ATOMIC_RELAXED);
+      EC_PRINT("ecx_getindex: all %d frame buffers in use\n", port->maxbuf);
+      return EC_NOINDEX;
+   }
    if (port->redstate != ECT_RED_NONE)
-      port->redport->rxbufstat[idx] = EC_BUF_ALLOC;
-   port->lastidx = idx;
-
-   pthread_mutex_unlock( &(port->getindex_mutex) );
+      ecx_putbufstat(&(port->redport->rxbufstat[idx].state), EC_BUF_ALLOC);
+   __atomic_store_n(&(port->lastidx), idx, __ATOMIC_RELAXED);
 
    return idx;
 }
@@ -259,9 +807,134 @@ uint8 ecx_getindex(ecx_portt *port)
  */
 void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat)
 {
-   port->rxbufstat[idx] = bufstat;
+   ecx_putbufstat(&(port->rxbufstat[idx].state), bufstat);
    if (port->redstate != ECT_RED_NONE)
-      port->redport->rxbufstat[idx] = bufstat;
+      ecx_putbufstat(&(port->redport->rxbufstat[idx].state), bufstat);
+}
+
+/** Put frame in the next free tx ring slot, the kernel is not kicked.
+ * Slots are claimed atomically so concurrent senders do not need the
+ * tx mutex.
+ * @param[in] ring        = tx ring
+ * @param[in] buf         = frame including ethernet header
+ * @param[in] len         = frame length in bytes
+ * @return len if succeeded, -1 if ring is full
+ */
+static int ecx_ringqueue(ec_ringt *ring, const void *buf, int len)
+{
+   struct tpacket2_hdr *hdr;
+   unsigned int head;
+
+   /* head only moves past a free slot, a full ring leaves no hole that
+    * would stop the kernel's tx scan */
+   head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+   do
+   {
+      hdr = (struct tpacket2_hdr *)(ring->map + (head & (ring->framenr - 1)) * ring->framesize);
+      /* slot still owned by kernel, ring is full */
+      if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
+      {
+         return -1;
+      }
+   } while (!__atomic_compare_exchange_n(&ring->head, &head, head + 1, FALSE,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+   memcpy((uint8 *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll), buf, len);
+   hdr->tp_len = len;
+   __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+   return len;
+}
+
+/** Transmit frame over socket, tx ring or AF_XDP socket (non blocking).
+ * In ring mode the frame is put in the next free slot and the kernel is
+ * kicked to transmit all pending slots.
+ * @param[in] stack       = stack to transmit on
+ * @param[in] buf         = frame including ethernet header
+ * @param[in] len         = frame length in bytes
+ * @return socket send result
+ */
+static int ecx_sendpkt(ec_stackT *stack, const void *buf, int len)
+{
+   if (*stack->xsk)
+   {
+      return ecx_xsk_send(*stack->xsk, buf, len);
+   }
+   if (stack->txring->map == NULL)
+   {
+      return send(*stack->sock, buf, len, 0);
+   }
+   if ((ecx_ringqueue(stack->txring, buf, len) == -1) ||
+       (send(*stack->sock, NULL, 0, MSG_DONTWAIT) == -1))
+   {
+      return -1;
+   }
+
+   return len;
+}
+
+/** Transmit a batch of frames with a single syscall (non blocking).
+ * In socket mode sendmmsg() is used, in ring and AF_XDP mode all frames
+ * are put in the tx ring and the kernel is kicked once.
+ * @param[in] stack       = stack to transmit on
+ * @param[in] iov         = frames including ethernet header
+ * @param[in] cnt         = number of frames
+ * @return number of frames sent, counted from the start of the batch
+ */
+static int ecx_sendbatch(ec_stackT *stack, struct iovec *iov, int cnt)
+{
+   struct mmsghdr msg[EC_MAXBUF];
+   int i, n, sent, rval;
+
+   if (*stack->xsk)
+   {
+      for (i = 0; i < cnt; i++)
+      {
+         if (ecx_xsk_queue(*stack->xsk, iov[i].iov_base, iov[i].iov_len) == -1)
+         {
+            break;
+         }
+      }
+      return (ecx_xsk_kick(*stack->xsk) == -1) ? 0 : i;
+   }
+   if (stack->txring->map)
+   {
+      for (i = 0; i < cnt; i++)
+      {
+         if (ecx_ringqueue(stack->txring, iov[i].iov_base, iov[i].iov_len) == -1)
+         {
+            break;
+         }
+      }
+      return (send(*stack->sock, NULL, 0, MSG_DONTWAIT) == -1) ? 0 : i;
+   }
+   /* sendmmsg() in chunks of EC_MAXBUF frames to bound stack usage */
+   sent = 0;
+   while (sent < cnt)
+   {
+      n = cnt - sent;
+      if (n > EC_MAXBUF)
+      {
+         n = EC_MAXBUF;
+      }
+      memset(msg, 0, n * sizeof(msg[0]));
+      for (i = 0; i < n; i++)
+      {
+         msg[i].msg_hdr.msg_iov = &iov[sent + i];
+         msg[i].msg_hdr.msg_iovlen = 1;
+      }
+      rval = sendmmsg(*stack->sock, msg, n, 0);
+      if (rval <= 0)
+      {
+         break;
+      }
+      sent += rval;
+      if (rval < n)
+      {
+         break;
+      }
+   }
+
+   return sent;
 }
 
 /** Transmit buffer over socket (non blocking).
@@ -283,24 +956,31 @@ int ecx_outframe(ecx_portt *port, uint8 idx, int stacknumber)
    {
       stack = &(port->redport->stack);
    }
-   lp = (*stack->txbuflength)[idx];
-   (*stack->rxbufstat)[idx] = EC_BUF_TX;
-   rval = send(*stack->sock, (*stack->txbuf)[idx], lp, 0);
+   lp = stack->txbuflength[idx];
+   ecx_putbufstat(&stack->rxbufstat[idx].state, EC_BUF_TX);
+   if (port->stats && !stacknumber)
+   {
+      ecx_stamptx(port, idx);
+   }
+   rval = ecx_sendpkt(stack, stack->txbuf[idx], lp);
    if (rval == -1)
    {
-      (*stack->rxbufstat)[idx] = EC_BUF_EMPTY;
+      ecx_putbufstat(&stack->rxbufstat[idx].state, EC_BUF_EMPTY);
    }
 
    return rval;
 }
 
-/** Transmit buffer over socket (non blocking).
+/** Transmit buffer over primary socket and in redundant mode a dummy frame
+ * over the secondary socket (non blocking). Lock free, the dummy frame is
+ * built on the stack so concurrent senders do not share a buffer.
  * @param[in] port        = port context struct
  * @param[in] idx = index in tx buffer array
  * @return socket send result
  */
-int ecx_outframe_red(ecx_portt *port, uint8 idx)
+static int ecx_sendframe_red(ecx_portt *port, uint8 idx)
 {
+   uint8 dummy[EC_REDFRAMESIZE];
    ec_comt *datagramP;
    ec_etherheadert *ehp;
    int rval;
@@ -312,35 +992,181 @@ int ecx_outframe_red(ecx_portt *port, uint8 idx)
    rval = ecx_outframe(port, idx, 0);
    if (port->redstate != ECT_RED_NONE)
    {
-      pthread_mutex_lock( &(port->tx_mutex) );
-      ehp = (ec_etherheadert *)&(port->txbuf2);
       /* use dummy frame for secondary socket transmit (BRD) */
-      datagramP = (ec_comt*)&(port->txbuf2[ETH_HEADERSIZE]);
+      memcpy(dummy, &(port->txbuf2), port->txbuflength2);
+      ehp = (ec_etherheadert *)dummy;
+      datagramP = (ec_comt*)&dummy[ETH_HEADERSIZE];
       /* write index to frame */
       datagramP->index = idx;
       /* rewrite MAC source address 1 to secondary */
       ehp->sa1 = htons(secMAC[1]);
       /* transmit over secondary socket */
-      port->redport->rxbufstat[idx] = EC_BUF_TX;
-      if (send(port->redport->sockhandle, &(port->txbuf2), port->txbuflength2 , 0) == -1)
+      ecx_putbufstat(&(port->redport->rxbufstat[idx].state), EC_BUF_TX);
+      if (ecx_sendpkt(&(port->redport->stack), dummy, port->txbuflength2) == -1)
       {
-         port->redport->rxbufstat[idx] = EC_BUF_EMPTY;
+         ecx_putbufstat(&(port->redport->rxbufstat[idx].state), EC_BUF_EMPTY);
+      }
+   }
+
+   return rval;
+}
+
+/** Transmit buffer over socket (non blocking).
+ * In batch mode the frame is only queued and sent by ecx_outframe_flush().
+ * @param[in] port        = port context struct
+ * @param[in] idx = index in tx buffer array
+ * @return socket send result
+ */
+int ecx_outframe_red(ecx_portt *port, uint8 idx)
+{
+   ec_etherheadert *ehp;
+
+   if (port->batchmode)
+   {
+      ehp = (ec_etherheadert *)&(port->txbuf[idx]);
+      /* rewrite MAC source address 1 to primary */
+      ehp->sa1 = htons(priMAC[1]);
+      pthread_mutex_lock( &(port->tx_mutex) );
+      ecx_putbufstat(&(port->rxbufstat[idx].state), EC_BUF_TX);
+      if (port->redstate != ECT_RED_NONE)
+      {
+         ecx_putbufstat(&(port->redport->rxbufstat[idx].state), EC_BUF_TX);
+      }
+      if (port->txbatchcnt < EC_MAXFRAMEIDX)
+      {
+         port->txbatchidx[port->txbatchcnt++] = idx;
       }
       pthread_mutex_unlock( &(port->tx_mutex) );
+      return port->txbuflength[idx];
+   }
+
+   return ecx_sendframe_red(port, idx);
+}
+
+/** Transmit all frames queued by ecx_outframe_red() in batch mode with
+ * one syscall per socket. In redundant mode the dummy frames for the
+ * secondary socket are sent as one batch as well.
+ * @param[in] port        = port context struct
+ * @return number of frames sent on primary socket
+ */
+int ecx_outframe_flush(ecx_portt *port)
+{
+   struct iovec iov[EC_MAXFRAMEIDX];
+   uint8 dummy[EC_MAXFRAMEIDX][EC_REDFRAMESIZE];
+   ec_comt *datagramP;
+   ec_etherheadert *ehp;
+   int i, cnt, rval;
+   uint8 idx;
+
+   pthread_mutex_lock( &(port->tx_mutex) );
+   cnt = port->txbatchcnt;
+   port->txbatchcnt = 0;
+   for (i = 0; i < cnt; i++)
+   {
+      idx = port->txbatchidx[i];
+      iov[i].iov_base = &(port->txbuf[idx]);
+      iov[i].iov_len = port->txbuflength[idx];
+      if (port->stats)
+      {
+         ecx_stamptx(port, idx);
+      }
    }
+   rval = cnt ? ecx_sendbatch(&(port->stack), iov, cnt) : 0;
+   for (i = rval; i < cnt; i++)
+   {
+      ecx_putbufstat(&(port->rxbufstat[port->txbatchidx[i]].state), EC_BUF_EMPTY);
+   }
+   if (cnt && (port->redstate != ECT_RED_NONE))
+   {
+      for (i = 0; i < cnt; i++)
+      {
+         /* use dummy frame for secondary socket transmit (BRD) */
+         memcpy(dummy[i], &(port->txbuf2), port->txbuflength2);
+         ehp = (ec_etherheadert *)dummy[i];
+         datagramP = (ec_comt *)&dummy[i][ETH_HEADERSIZE];
+         datagramP->index = port->txbatchidx[i];
+         ehp->sa1 = htons(secMAC[1]);
+         iov[i].iov_base = dummy[i];
+         iov[i].iov_len = port->txbuflength2;
+      }
+      for (i = ecx_sendbatch(&(port->redport->stack), iov, cnt); i < cnt; i++)
+      {
+         ecx_putbufstat(&(port->redport->rxbufstat[port->txbatchidx[i]].state), EC_BUF_EMPTY);
+      }
+   }
+   pthread_mutex_unlock( &(port->tx_mutex) );
 
    return rval;
 }
 
-/** Non blocking read of socket. Put frame in temporary buffer.
+/** Number of frame buffers of the port, see port->maxbuf.
+ * @param[in] port        = port context struct
+ * @return number of frame buffers
+ */
+int ecx_bufcount(ecx_portt *port)
+{
+   return port->maxbuf;
+}
+
+/** Hand out next frame from batch receive buffer. When it is empty, drain
+ * all waiting frames from the socket with one recvmmsg() call.
+ * @param[in] stack       = stack to receive on
+ * @param[out] frame      = start of received frame including ethernet header
+ * @return frame length, 0 if no frame is available
+ */
+static int ecx_recvbatch(ec_stackT *stack, uint8 **frame)
+{
+   struct mmsghdr msg[EC_MAXBUF];
+   struct iovec iov[EC_MAXBUF];
+   ec_rxbatcht *b;
+   int i, rval;
+
+   b = stack->rxbatch;
+   if (b->pos >= b->cnt)
+   {
+      memset(msg, 0, sizeof(msg));
+      for (i = 0; i < EC_MAXBUF; i++)
+      {
+         iov[i].iov_base = b->buf[i];
+         iov[i].iov_len = sizeof(b->buf[i]);
+         msg[i].msg_hdr.msg_iov = &iov[i];
+         msg[i].msg_hdr.msg_iovlen = 1;
+      }
+      rval = recvmmsg(*stack->sock, msg, EC_MAXBUF, MSG_DONTWAIT, NULL);
+      b->cnt = (rval > 0) ? rval : 0;
+      b->pos = 0;
+      for (i = 0; i < b->cnt; i++)
+      {
+         b->len[i] = msg[i].msg_len;
+      }
+   }
+   if (b->pos >= b->cnt)
+   {
+      return 0;
+   }
+   *frame = b->buf[b->pos];
+
+   return b->len[b->pos];
+}
+
+/** Non blocking read of socket, rx ring or AF_XDP socket.
+ * In socket mode the frame is put in the temporary buffer. In ring and
+ * AF_XDP mode the frame stays in its slot until released with
+ * ecx_releasepkt().
  * @param[in] port        = port context struct
  * @param[in] stacknumber = 0=primary 1=secondary stack
+ * @param[out] frame      = start of received frame including ethernet header
  * @return >0 if frame is available and read
  */
-static int ecx_recvpkt(ecx_portt *port, int stacknumber)
+static int ecx_recvpkt(ecx_portt *port, int stacknumber, uint8 **frame)
 {
    int lp, bytesrx;
    ec_stackT *stack;
+   ec_ringt *ring;
+   struct tpacket2_hdr *hdr;
+   struct msghdr msg;
+   struct iovec iov;
+   uint8 control[256];
 
    if (!stacknumber)
    {
@@ -350,13 +1176,100 @@ static int ecx_recvpkt(ecx_portt *port, int stacknumber)
    {
       stack = &(port->redport->stack);
    }
-   lp = sizeof(port->tempinbuf);
-   bytesrx = recv(*stack->sock, (*stack->tempbuf), lp, 0);
+   ring = stack->rxring;
+   if (*stack->xsk)
+   {
+      bytesrx = ecx_xsk_recv(*stack->xsk, frame);
+   }
+   else if ((ring->map == NULL) && port->batchmode)
+   {
+      bytesrx = ecx_recvbatch(stack, frame);
+   }
+   else if ((ring->map == NULL) && (port->tsmode & (EC_STAT_TSSOFT | EC_STAT_TSHW)))
+   {
+      /* same as recv() below, but also get the kernel timestamp */
+      memset(&msg, 0, sizeof(msg));
+      iov.iov_base = (*stack->tempbuf);
+      iov.iov_len = sizeof(port->tempinbuf);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      bytesrx = recvmsg(*stack->sock, &msg, 0);
+      *frame = (*stack->tempbuf);
+      if (bytesrx > 0)
+      {
+         port->rxsrc = ecx_stamp_cmsg(port, &msg, &(port->rxtime));
+      }
+   }
+   else if (ring->map == NULL)
+   {
+      lp = sizeof(port->tempinbuf);
+      bytesrx = recv(*stack->sock, (*stack->tempbuf), lp, 0);
+      *frame = (*stack->tempbuf);
+   }
+   else
+   {
+      bytesrx = 0;
+      hdr = (struct tpacket2_hdr *)(ring->map + ring->head * ring->framesize);
+      if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)
+      {
+         bytesrx = hdr->tp_snaplen;
+         *frame = (uint8 *)hdr + hdr->tp_mac;
+         if (port->tsmode)
+         {
+            port->rxtime = (int64)hdr->tp_sec * 1000000000 + hdr->tp_nsec;
+            port->rxsrc = (hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) ? EC_STAT_TSHW : EC_STAT_TSSOFT;
+         }
+      }
+   }
+   if (port->tsmode && (bytesrx > 0) && !(port->tsmode & port->rxsrc & (EC_STAT_TSSOFT | EC_STAT_TSHW)))
+   {
+      port->rxtime = ecx_stamp_now();
+      port->rxsrc = EC_STAT_TSUSER;
+   }
    port->tempinbufs = bytesrx;
 
    return (bytesrx > 0);
 }
 
+/** Hand rx slot read by ecx_recvpkt() back to the kernel, or advance
+ * to the next frame in the batch receive buffer.
+ * Does nothing in plain socket mode.
+ * @param[in] port        = port context struct
+ * @param[in] stacknumber = 0=primary 1=secondary stack
+ */
+static void ecx_releasepkt(ecx_portt *port, int stacknumber)
+{
+   ec_stackT *stack;
+   ec_ringt *ring;
+   struct tpacket2_hdr *hdr;
+
+   if (!stacknumber)
+   {
+      stack = &(port->stack);
+   }
+   else
+   {
+      stack = &(port->redport->stack);
+   }
+   ring = stack->rxring;
+   if (*stack->xsk)
+   {
+      ecx_xsk_release(*stack->xsk);
+   }
+   else if (ring->map)
+   {
+      hdr = (struct tpacket2_hdr *)(ring->map + ring->head * ring->framesize);
+      __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+      ring->head = (ring->head + 1) & (ring->framenr - 1);
+   }
+   else if (port->batchmode)
+   {
+      stack->rxbatch->pos++;
+   }
+}
+
 /** Non blocking receive frame function. Uses RX buffer and index to combine
  * read frame with transmitted frame. To compensate for received frames that
  * are out-of-order all frames are stored in their respective indexed buffer.
@@ -366,6 +1279,8 @@ static int ecx_recvpkt(ecx_portt *port, int stacknumber)
  * three options now, 1 no frame read, so exit. 2 frame read but other
  * than requested index, store in buffer and exit. 3 frame read with matching
  * index, store in buffer, set completed flag in buffer status and exit.
+ * If another thread is reading the socket the function does not wait for
+ * it but returns EC_NOFRAME, that thread stores our frame in the buffer.
  *
  * @param[in] port        = port context struct
  * @param[in] idx         = requested index of frame
@@ -378,6 +1293,7 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
    uint16  l;
    int     rval;
    uint8   idxf;
+   uint8   *frame;
    ec_etherheadert *ehp;
    ec_comt *ecp;
    ec_stackT *stack;
@@ -392,53 +1308,57 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
       stack = &(port->redport->stack);
    }
    rval = EC_NOFRAME;
-   rxbuf = &(*stack->rxbuf)[idx];
+   rxbuf = &stack->rxbuf[idx];
    /* check if requested index is already in buffer ? */
-   if ((idx < EC_MAXBUF) && ((*stack->rxbufstat)[idx] == EC_BUF_RCVD))
+   if ((idx < port->maxbuf) && (ecx_getbufstat(&stack->rxbufstat[idx].state) == EC_BUF_RCVD))
    {
       l = (*rxbuf)[0] + ((uint16)((*rxbuf)[1] & 0x0f) << 8);
       /* return WKC */
       rval = ((*rxbuf)[l] + ((uint16)(*rxbuf)[l + 1] << 8));
       /* mark as completed */
-      (*stack->rxbufstat)[idx] = EC_BUF_COMPLETE;
+      ecx_putbufstat(&stack->rxbufstat[idx].state, EC_BUF_COMPLETE);
    }
-   else
+   /* never wait for the socket when another thread is reading it */
+   else if (pthread_mutex_trylock(&(port->rx_mutex)) == 0)
    {
-      pthread_mutex_lock(&(port->rx_mutex));
       /* non blocking call to retrieve frame from socket */
-      if (ecx_recvpkt(port, stacknumber))
+      if (ecx_recvpkt(port, stacknumber, &frame))
       {
          rval = EC_OTHERFRAME;
-         ehp =(ec_etherheadert*)(stack->tempbuf);
+         ehp =(ec_etherheadert*)frame;
          /* check if it is an EtherCAT frame */
          if (ehp->etype == htons(ETH_P_ECAT))
          {
-            ecp =(ec_comt*)(&(*stack->tempbuf)[ETH_HEADERSIZE]);
+            ecp =(ec_comt*)(&frame[ETH_HEADERSIZE]);
             l = etohs(ecp->elength) & 0x0fff;
             idxf = ecp->index;
             /* found index equals requested index ? */
             if (idxf == idx)
             {
                /* yes, put it in the buffer array (strip ethernet header) */
-               memcpy(rxbuf, &(*stack->tempbuf)[ETH_HEADERSIZE], (*stack->txbuflength)[idx] - ETH_HEADERSIZE);
+               memcpy(rxbuf, &frame[ETH_HEADERSIZE], stack->txbuflength[idx] - ETH_HEADERSIZE);
                /* return WKC */
                rval = ((*rxbuf)[l] + ((uint16)((*rxbuf)[l + 1]) << 8));
-               /* mark as completed */
-               (*stack->rxbufstat)[idx] = EC_BUF_COMPLETE;
                /* store MAC source word 1 for redundant routing info */
-               (*stack->rxsa)[idx] = ntohs(ehp->sa1);
+               stack->rxbufstat[idx].rxsa = ntohs(ehp->sa1);
+               stack->rxbufstat[idx].rxtime = port->rxtime;
+               stack->rxbufstat[idx].rxsrc = port->rxsrc;
+               /* mark as completed */
+               ecx_putbufstat(&stack->rxbufstat[idx].state, EC_BUF_COMPLETE);
             }
             else
             {
                /* check if index exist and someone is waiting for it */
-               if (idxf < EC_MAXBUF && (*stack->rxbufstat)[idxf] == EC_BUF_TX)
+               if (idxf < port->maxbuf && ecx_getbufstat(&stack->rxbufstat[idxf].state) == EC_BUF_TX)
                {
-                  rxbuf = &(*stack->rxbuf)[idxf];
+                  rxbuf = &stack->rxbuf[idxf];
                   /* put it in the buffer array (strip ethernet header) */
-                  memcpy(rxbuf, &(*stack->tempbuf)[ETH_HEADERSIZE], (*stack->txbuflength)[idxf] - ETH_HEADERSIZE);
-                  /* mark as received */
-                  (*stack->rxbufstat)[idxf] = EC_BUF_RCVD;
-                  (*stack->rxsa)[idxf] = ntohs(ehp->sa1);
+                  memcpy(rxbuf, &frame[ETH_HEADERSIZE], stack->txbuflength[idxf] - ETH_HEADERSIZE);
+                  stack->rxbufstat[idxf].rxsa = ntohs(ehp->sa1);
+                  stack->rxbufstat[idxf].rxtime = port->rxtime;
+                  stack->rxbufstat[idxf].rxsrc = port->rxsrc;
+                  /* mark as received, unless the owner gave up meanwhile */
+                  ecx_swapbufstat(&stack->rxbufstat[idxf].state, EC_BUF_TX, EC_BUF_RCVD);
                }
                else
                {
@@ -446,6 +1366,7 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
                }
             }
          }
+         ecx_releasepkt(port, stacknumber);
       }
       pthread_mutex_unlock( &(port->rx_mutex) );
 
@@ -496,10 +1417,10 @@ static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
    {
       /* primrx if the received MAC source on primary socket */
       primrx = 0;
-      if (wkc > EC_NOFRAME) primrx = port->rxsa[idx];
+      if (wkc > EC_NOFRAME) primrx = port->rxbufstat[idx].rxsa;
       /* secrx if the received MAC source on psecondary socket */
       secrx = 0;
-      if (wkc2 > EC_NOFRAME) secrx = port->redport->rxsa[idx];
+      if (wkc2 > EC_NOFRAME) secrx = port->redport->rxbufstat[idx].rxsa;
 
       /* primary socket got secondary frame and secondary socket got primary frame */
       /* normal situation in redundant mode */
@@ -538,6 +1459,10 @@ static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
          }
       }
    }
+   if (port->stats)
+   {
+      ecx_putframerec(port, idx, wkc);
+   }
 
    /* return WKC or EC_NOFRAME */
    return wkc;
@@ -566,7 +1491,8 @@ int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout)
  * for an answer and returns the workcounter. The function retries if time is
  * left and the result is WKC=0 or no frame received.
  *
- * The function calls ec_outframe_red() and ec_waitinframe_red().
+ * The frame is sent right away with ecx_sendframe_red(), also in batch mode,
+ * and the answer is awaited with ecx_waitinframe_red().
  *
  * @param[in] port        = port context struct
  * @param[in] idx      = index of frame
@@ -582,7 +1508,7 @@ int ecx_srconfirm(ecx_portt *port, uint8 idx, int timeout)
    do
    {
       /* tx frame on primary and if in redundant mode a dummy on secondary */
-      ecx_outframe_red(port, idx);
+      ecx_sendframe_red(port, idx);
       if (timeout < EC_TIMEOUTRET)
       {
          osal_timer_start (&timer2, timeout);
@@ -606,6 +1532,16 @@ int ec_setupnic(const char *ifname, int secondary)
    return ecx_setupnic(&ecx_port, ifname, secondary);
 }
 
+int ec_setupnic_mmap(const char *ifname, int secondary)
+{
+   return ecx_setupnic_mmap(&ecx_port, ifname, secondary);
+}
+
+int ec_setupnic_xdp(const char *ifname, int secondary, int queue, int busypoll)
+{
+   return ecx_setupnic_xdp(&ecx_port, ifname, secondary, queue, busypoll);
+}
+
 int ec_closenic(void)
 {
    return ecx_closenic(&ecx_port);
@@ -631,6 +1567,26 @@ int ec_outframe_red(uint8 idx)
    return ecx_outframe_red(&ecx_port, idx);
 }
 
+int ec_outframe_flush(void)
+{
+   return ecx_outframe_flush(&ecx_port);
+}
+
+int ec_bufcount(void)
+{
+   return ecx_bufcount(&ecx_port);
+}
+
+int ec_setstats(struct ec_stats *stats, int hwstamp)
+{
+   return ecx_setstats(&ecx_port, stats, hwstamp);
+}
+
+int ec_collectstats(void)
+{
+   return ecx_collectstats(&ecx_port);
+}
+
 int ec_inframe(uint8 idx, int stacknumber)
 {
    return ecx_inframe(&ecx_port, idx, stacknumber);
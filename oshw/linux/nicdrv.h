@@ -18,23 +18,79 @@ extern "C"
 
 #include <pthread.h>
 
+/** PACKET_MMAP frame ring, only used when NIC is opened with ecx_setupnic_mmap() */
+typedef struct
+{
+   /** start of mapped frame slots, NULL if ring is not used */
+   uint8       *map;
+   /** size of one frame slot in bytes */
+   int         framesize;
+   /** number of frame slots in ring */
+   int         framenr;
+   /** next frame slot to use */
+   unsigned int head;
+} ec_ringt;
+
+/** frames drained from the socket with one recvmmsg() call in batch mode */
+typedef struct
+{
+   /** received frames */
+   ec_bufT     buf[EC_MAXBUF];
+   /** received frame lengths */
+   int         len[EC_MAXBUF];
+   /** number of frames in buf */
+   int         cnt;
+   /** next frame to hand out */
+   int         pos;
+} ec_rxbatcht;
+
+/** statistics struct, see ethercatstats.h */
+struct ec_stats;
+
+/** AF_XDP socket, only used when NIC is opened with ecx_setupnic_xdp() */
+typedef struct ec_xsk ec_xskt;
+
+/** frame buffer state, one cache line per frame index so threads working
+ * on different frames do not share cache lines */
+typedef struct
+{
+   /** rx buffer status, only accessed atomically */
+   int         state;
+   /** received MAC source address (middle word) */
+   int         rxsa;
+   /** transmit time in ns, only set when recording statistics */
+   int64       txtime;
+   /** receive time in ns, only set when recording statistics */
+   int64       rxtime;
+   /** timestamp source of txtime, EC_STAT_TSxxx */
+   uint8       txsrc;
+   /** timestamp source of rxtime, EC_STAT_TSxxx */
+   uint8       rxsrc;
+} __attribute__((aligned(EC_CACHELINE))) ec_bufstatt;
+
 /** pointer structure to Tx and Rx stacks */
 typedef struct
 {
    /** socket connection used */
    int         *sock;
-   /** tx buffer */
-   ec_bufT     (*txbuf)[EC_MAXBUF];
+   /** tx buffers */
+   ec_bufT     *txbuf;
    /** tx buffer lengths */
-   int         (*txbuflength)[EC_MAXBUF];
+   int         *txbuflength;
    /** temporary receive buffer */
    ec_bufT     *tempbuf;
    /** rx buffers */
-   ec_bufT     (*rxbuf)[EC_MAXBUF];
+   ec_bufT     *rxbuf;
    /** rx buffer status fields */
-   int         (*rxbufstat)[EC_MAXBUF];
-   /** received MAC source address (middle word) */
-   int         (*rxsa)[EC_MAXBUF];
+   ec_bufstatt *rxbufstat;
+   /** rx ring */
+   ec_ringt    *rxring;
+   /** tx ring */
+   ec_ringt    *txring;
+   /** AF_XDP socket */
+   ec_xskt     **xsk;
+   /** batch receive buffer */
+   ec_rxbatcht *rxbatch;
 } ec_stackT;
 
 /** pointer structure to buffers for redundant port */
@@ -42,14 +98,20 @@ typedef struct
 {
    ec_stackT   stack;
    int         sockhandle;
-   /** rx buffers */
-   ec_bufT rxbuf[EC_MAXBUF];
-   /** rx buffer status */
-   int rxbufstat[EC_MAXBUF];
-   /** rx MAC source address */
-   int rxsa[EC_MAXBUF];
+   /** rx buffers, port->maxbuf allocated by ecx_setupnic() */
+   ec_bufT *rxbuf;
+   /** rx buffer status and MAC source address */
+   ec_bufstatt *rxbufstat;
    /** temporary rx buffer */
    ec_bufT tempinbuf;
+   /** rx ring */
+   ec_ringt rxring;
+   /** tx ring */
+   ec_ringt txring;
+   /** AF_XDP socket, NULL if not used */
+   ec_xskt *xsk;
+   /** batch receive buffer */
+   ec_rxbatcht rxbatch;
 } ecx_redportt;
 
 /** pointer structure to buffers, vars and mutexes for port instantiation */
@@ -57,31 +119,57 @@ typedef struct
 {
    ec_stackT   stack;
    int         sockhandle;
-   /** rx buffers */
-   ec_bufT rxbuf[EC_MAXBUF];
-   /** rx buffer status */
-   int rxbufstat[EC_MAXBUF];
-   /** rx MAC source address */
-   int rxsa[EC_MAXBUF];
+   /** number of frame buffers, set before ecx_setupnic(). 0 selects
+    * EC_MAXBUF, at most EC_MAXFRAMEIDX - 1 */
+   int maxbuf;
+   /** rx buffers, maxbuf allocated by ecx_setupnic() */
+   ec_bufT *rxbuf;
+   /** rx buffer status and MAC source address */
+   ec_bufstatt *rxbufstat;
    /** temporary rx buffer */
    ec_bufT tempinbuf;
    /** temporary rx buffer status */
    int tempinbufs;
-   /** transmit buffers */
-   ec_bufT txbuf[EC_MAXBUF];
+   /** transmit buffers, maxbuf allocated by ecx_setupnic() */
+   ec_bufT *txbuf;
    /** transmit buffer lengths */
-   int txbuflength[EC_MAXBUF];
+   int *txbuflength;
    /** temporary tx buffer */
    ec_bufT txbuf2;
    /** temporary tx buffer length */
    int txbuflength2;
+   /** rx ring */
+   ec_ringt rxring;
+   /** tx ring */
+   ec_ringt txring;
+   /** AF_XDP socket, NULL if not used */
+   ec_xskt *xsk;
+   /** batch receive buffer */
+   ec_rxbatcht rxbatch;
+   /** if TRUE queue frames in ecx_outframe_red() and receive in batches */
+   int batchmode;
+   /** number of frames queued for ecx_outframe_flush() */
+   int txbatchcnt;
+   /** indexes of queued frames */
+   uint8 txbatchidx[EC_MAXFRAMEIDX];
    /** last used frame index */
    uint8 lastidx;
+   /** number of times ecx_getindex() found no free buffer */
+   int bufexhausted;
+   /** statistics struct for frame records, NULL if not recording */
+   struct ec_stats *stats;
+   /** timestamp sources in use, EC_STAT_TSxxx bits */
+   int tsmode;
+   /** frames sent since the tx timestamps were last read */
+   int txstamps;
+   /** receive time of last frame read from primary or secondary socket */
+   int64 rxtime;
+   /** timestamp source of rxtime */
+   int rxsrc;
    /** current redundancy state */
    int redstate;
    /** pointer to redundancy port and buffers */
    ecx_redportt *redport;
-   pthread_mutex_t getindex_mutex;
    pthread_mutex_t tx_mutex;
    pthread_mutex_t rx_mutex;
 } ecx_portt;
@@ -94,22 +182,34 @@ extern ecx_portt     ecx_port;
 extern ecx_redportt  ecx_redport;
 
 int ec_setupnic(const char * ifname, int secondary);
+int ec_setupnic_mmap(const char * ifname, int secondary);
+int ec_setupnic_xdp(const char * ifname, int secondary, int queue, int busypoll);
 int ec_closenic(void);
 void ec_setbufstat(uint8 idx, int bufstat);
 uint8 ec_getindex(void);
 int ec_outframe(uint8 idx, int sock);
 int ec_outframe_red(uint8 idx);
+int ec_outframe_flush(void);
+int ec_bufcount(void);
+int ec_setstats(struct ec_stats *stats, int hwstamp);
+int ec_collectstats(void);
 int ec_waitinframe(uint8 idx, int timeout);
 int ec_srconfirm(uint8 idx,int timeout);
 #endif
 
 void ec_setupheader(void *p);
 int ecx_setupnic(ecx_portt *port, const char * ifname, int secondary);
+int ecx_setupnic_mmap(ecx_portt *port, const char * ifname, int secondary);
+int ecx_setupnic_xdp(ecx_portt *port, const char * ifname, int secondary, int queue, int busypoll);
 int ecx_closenic(ecx_portt *port);
 void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat);
 uint8 ecx_getindex(ecx_portt *port);
 int ecx_outframe(ecx_portt *port, uint8 idx, int sock);
 int ecx_outframe_red(ecx_portt *port, uint8 idx);
+int ecx_outframe_flush(ecx_portt *port);
+int ecx_bufcount(ecx_portt *port);
+int ecx_setstats(ecx_portt *port, struct ec_stats *stats, int hwstamp);
+int ecx_collectstats(ecx_portt *port);
 int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout);
 int ecx_srconfirm(ecx_portt *port, uint8 idx,int timeout);
 
@@ -0,0 +1,512 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * AF_XDP socket backend for the Linux EtherCAT NIC driver.
+ *
+ * The socket is bound to a single NIC queue. A small XDP program redirects
+ * all EtherCAT frames received on that queue to the socket, all other
+ * traffic is passed to the network stack. Frames are exchanged through
+ * UMEM buffers and the rx, tx, fill and completion rings shared with the
+ * kernel. The setup tries native driver mode with zero-copy first, then
+ * native driver mode with copy and at last the generic (SKB) XDP path, so
+ * it also works on NICs without XDP support and on veth pairs.
+ *
+ * No external library is used, the BPF program is loaded with the bpf()
+ * syscall directly.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#include "oshw.h"
+#include "osal.h"
+#include "nicdrv_xdp.h"
+
+/** UMEM frames per ring direction, must be a power of 2 */
+#define EC_XSK_FRAMES       64
+/** size of one UMEM frame, must fit EC_BUFSIZE */
+#define EC_XSK_FRAMESIZE    2048
+/** max entries in XSKMAP, queue number must be below this */
+#define EC_XSK_MAXQUEUE     64
+
+/** one ring shared with the kernel */
+typedef struct
+{
+   uint32   *producer;
+   uint32   *consumer;
+   uint32   *flags;
+   void     *ring;
+   void     *map;
+   size_t   mapsize;
+} ec_xskringt;
+
+/** AF_XDP socket state */
+struct ec_xsk
+{
+   /** AF_XDP socket */
+   int            fd;
+   /** XSKMAP holding fd for the bound queue */
+   int            mapfd;
+   /** redirect program */
+   int            progfd;
+   /** program to interface link */
+   int            linkfd;
+   /** UMEM area, first half used for rx and second half for tx */
+   uint8          *umem;
+   ec_xskringt    rx;
+   ec_xskringt    tx;
+   ec_xskringt    fill;
+   ec_xskringt    comp;
+   /** number of tx frames handed back by the kernel */
+   uint32         txdone;
+   /** drive NAPI from ecx_xsk_recv() when rx ring is empty */
+   int            busypoll;
+   pthread_mutex_t tx_mutex;
+};
+
+/** XDP setup modes tried in order */
+static const struct
+{
+   uint32 xdpflags;
+   uint16 bindflags;
+} ec_xskmode[] =
+{
+   { XDP_FLAGS_DRV_MODE, XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP },
+   { XDP_FLAGS_DRV_MODE, XDP_COPY | XDP_USE_NEED_WAKEUP },
+   { XDP_FLAGS_SKB_MODE, XDP_COPY },
+};
+
+static long ecx_bpf(int cmd, union bpf_attr *attr)
+{
+   return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/** Load XDP program redirecting EtherCAT frames to the XSKMAP entry of
+ * the receive queue. Other frames, and frames for a queue without socket,
+ * are passed on to the network stack.
+ * @param[in] mapfd       = XSKMAP file descriptor
+ * @return program fd, <0 if failed
+ */
+static int ecx_xsk_loadprog(int mapfd)
+{
+   struct bpf_insn prog[] =
+   {
+      /* r2 = ctx->data_end, r3 = ctx->data */
+      { BPF_LDX | BPF_W | BPF_MEM, 2, 1, 4, 0 },
+      { BPF_LDX | BPF_W | BPF_MEM, 3, 1, 0, 0 },
+      /* if (data + ETH_HEADERSIZE > data_end) goto pass */
+      { BPF_ALU64 | BPF_MOV | BPF_X, 4, 3, 0, 0 },
+      { BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_HEADERSIZE },
+      { BPF_JMP | BPF_JGT | BPF_X, 4, 2, 8, 0 },
+      /* if (etype != ETH_P_ECAT) goto pass */
+      { BPF_LDX | BPF_H | BPF_MEM, 4, 3, 12, 0 },
+      { BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, htons(ETH_P_ECAT) },
+      /* return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS) */
+      { BPF_LDX | BPF_W | BPF_MEM, 2, 1, 16, 0 },
+      { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapfd },
+      { 0, 0, 0, 0, 0 },
+      { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+      { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+      { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+      /* pass: return XDP_PASS */
+      { BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS },
+      { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+   };
+   union bpf_attr attr;
+
+   memset(&attr, 0, sizeof(attr));
+   attr.prog_type = BPF_PROG_TYPE_XDP;
+   attr.insns = (uint64)(uintptr_t)prog;
+   attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+   attr.license = (uint64)(uintptr_t)"GPL";
+   attr.expected_attach_type = BPF_XDP;
+   strncpy(attr.prog_name, "soem_xsk", sizeof(attr.prog_name) - 1);
+
+   return ecx_bpf(BPF_PROG_LOAD, &attr);
+}
+
+/** Map one ring of the AF_XDP socket.
+ * @param[in] fd          = AF_XDP socket
+ * @param[out] ring       = ring to set up
+ * @param[in] off         = ring offsets reported by the kernel
+ * @param[in] pgoff       = mmap page offset of the ring
+ * @param[in] entrysize   = size of one ring entry
+ * @return >0 if succeeded
+ */
+static int ecx_xsk_mapring(int fd, ec_xskringt *ring, struct xdp_ring_offset *off,
+                           off_t pgoff, size_t entrysize)
+{
+   uint8 *map;
+
+   ring->mapsize = off->desc + EC_XSK_FRAMES * entrysize;
+   map = mmap(NULL, ring->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+   if (map == MAP_FAILED)
+   {
+      ring->map = NULL;
+      return 0;
+   }
+   ring->map = map;
+   ring->producer = (uint32 *)(map + off->producer);
+   ring->consumer = (uint32 *)(map + off->consumer);
+   ring->flags = (uint32 *)(map + off->flags);
+   ring->ring = map + off->desc;
+
+   return 1;
+}
+
+static void ecx_xsk_unmapring(ec_xskringt *ring)
+{
+   if (ring->map)
+   {
+      munmap(ring->map, ring->mapsize);
+      ring->map = NULL;
+   }
+}
+
+/** Release all resources of an AF_XDP socket.
+ * @param[in] xsk         = pointer to socket, set to NULL on return
+ */
+void ecx_xsk_close(ec_xskt **xsk)
+{
+   ec_xskt *x = *xsk;
+
+   if (x == NULL)
+   {
+      return;
+   }
+   /* closing the link detaches the program from the interface */
+   if (x->linkfd >= 0) close(x->linkfd);
+   if (x->progfd >= 0) close(x->progfd);
+   if (x->mapfd >= 0) close(x->mapfd);
+   ecx_xsk_unmapring(&x->rx);
+   ecx_xsk_unmapring(&x->tx);
+   ecx_xsk_unmapring(&x->fill);
+   ecx_xsk_unmapring(&x->comp);
+   if (x->fd >= 0) close(x->fd);
+   if (x->umem) munmap(x->umem, 2 * EC_XSK_FRAMES * EC_XSK_FRAMESIZE);
+   pthread_mutex_destroy(&x->tx_mutex);
+   free(x);
+   *xsk = NULL;
+}
+
+/** Try to create, bind and attach an AF_XDP socket in one XDP mode.
+ * @param[in] x           = socket state, fds set to -1
+ * @param[in] ifindex     = interface index
+ * @param[in] queue       = NIC rx/tx queue to bind to
+ * @param[in] mode        = index in ec_xskmode[]
+ * @return >0 if succeeded
+ */
+static int ecx_xsk_trymode(ec_xskt *x, int ifindex, int queue, int mode)
+{
+   struct xdp_umem_reg mr;
+   struct xdp_mmap_offsets off;
+   struct sockaddr_xdp sxdp;
+   union bpf_attr attr;
+   socklen_t optlen;
+   uint64 *fillring;
+   int i, n;
+
+   x->fd = socket(AF_XDP, SOCK_RAW, 0);
+   if (x->fd < 0)
+   {
+      return 0;
+   }
+   memset(&mr, 0, sizeof(mr));
+   mr.addr = (uint64)(uintptr_t)x->umem;
+   mr.len = 2 * EC_XSK_FRAMES * EC_XSK_FRAMESIZE;
+   mr.chunk_size = EC_XSK_FRAMESIZE;
+   n = EC_XSK_FRAMES;
+   optlen = sizeof(off);
+   if (setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) ||
+       setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n)) ||
+       setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &n, sizeof(n)) ||
+       setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &n, sizeof(n)) ||
+       setsockopt(x->fd, SOL_XDP, XDP_TX_RING, &n, sizeof(n)) ||
+       getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+   {
+      return 0;
+   }
+   if (!ecx_xsk_mapring(x->fd, &x->rx, &off.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) ||
+       !ecx_xsk_mapring(x->fd, &x->tx, &off.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)) ||
+       !ecx_xsk_mapring(x->fd, &x->fill, &off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64)) ||
+       !ecx_xsk_mapring(x->fd, &x->comp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64)))
+   {
+      return 0;
+   }
+   /* hand all rx frames to the kernel */
+   fillring = x->fill.ring;
+   for (i = 0; i < EC_XSK_FRAMES; i++)
+   {
+      fillring[i] = (uint64)i * EC_XSK_FRAMESIZE;
+   }
+   __atomic_store_n(x->fill.producer, EC_XSK_FRAMES, __ATOMIC_RELEASE);
+   x->txdone = 0;
+
+   memset(&sxdp, 0, sizeof(sxdp));
+   sxdp.sxdp_family = AF_XDP;
+   sxdp.sxdp_flags = ec_xskmode[mode].bindflags;
+   sxdp.sxdp_ifindex = ifindex;
+   sxdp.sxdp_queue_id = queue;
+   if (bind(x->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)))
+   {
+      return 0;
+   }
+
+   memset(&attr, 0, sizeof(attr));
+   attr.link_create.prog_fd = x->progfd;
+   attr.link_create.target_ifindex = ifindex;
+   attr.link_create.attach_type = BPF_XDP;
+   attr.link_create.flags = ec_xskmode[mode].xdpflags;
+   x->linkfd = ecx_bpf(BPF_LINK_CREATE, &attr);
+   if (x->linkfd < 0)
+   {
+      return 0;
+   }
+
+   memset(&attr, 0, sizeof(attr));
+   attr.map_fd = x->mapfd;
+   attr.key = (uint64)(uintptr_t)&queue;
+   attr.value = (uint64)(uintptr_t)&x->fd;
+   if (ecx_bpf(BPF_MAP_UPDATE_ELEM, &attr))
+   {
+      return 0;
+   }
+
+   return 1;
+}
+
+/** Undo a failed ecx_xsk_trymode() so the next mode can be tried.
+ * @param[in] x           = socket state
+ */
+static void ecx_xsk_resetmode(ec_xskt *x)
+{
+   if (x->linkfd >= 0) close(x->linkfd);
+   ecx_xsk_unmapring(&x->rx);
+   ecx_xsk_unmapring(&x->tx);
+   ecx_xsk_unmapring(&x->fill);
+   ecx_xsk_unmapring(&x->comp);
+   if (x->fd >= 0) close(x->fd);
+   x->linkfd = -1;
+   x->fd = -1;
+}
+
+/** Open AF_XDP socket bound to one queue of a NIC.
+ * @param[out] xsk        = created socket, NULL if failed
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @param[in] queue       = NIC rx/tx queue to bind to
+ * @param[in] busypoll    = if >0 busy poll the NIC for this many us per receive call
+ * @return >0 if succeeded
+ */
+int ecx_xsk_open(ec_xskt **xsk, const char *ifname, int queue, int busypoll)
+{
+   union bpf_attr attr;
+   ec_xskt *x;
+   int ifindex, mode;
+
+   *xsk = NULL;
+   ifindex = if_nametoindex(ifname);
+   if ((ifindex == 0) || (queue < 0) || (queue >= EC_XSK_MAXQUEUE))
+   {
+      return 0;
+   }
+   x = calloc(1, sizeof(*x));
+   if (x == NULL)
+   {
+      return 0;
+   }
+   x->fd = x->mapfd = x->progfd = x->linkfd = -1;
+   pthread_mutex_init(&x->tx_mutex, NULL);
+   *xsk = x;
+   x->umem = mmap(NULL, 2 * EC_XSK_FRAMES * EC_XSK_FRAMESIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+   if (x->umem == MAP_FAILED)
+   {
+      x->umem = NULL;
+      ecx_xsk_close(xsk);
+      return 0;
+   }
+
+   memset(&attr, 0, sizeof(attr));
+   attr.map_type = BPF_MAP_TYPE_XSKMAP;
+   attr.key_size = sizeof(int);
+   attr.value_size = sizeof(int);
+   attr.max_entries = EC_XSK_MAXQUEUE;
+   x->mapfd = ecx_bpf(BPF_MAP_CREATE, &attr);
+   if (x->mapfd >= 0)
+   {
+      x->progfd = ecx_xsk_loadprog(x->mapfd);
+   }
+   if (x->progfd < 0)
+   {
+      ecx_xsk_close(xsk);
+      return 0;
+   }
+
+   for (mode = 0; mode < (int)(sizeof(ec_xskmode) / sizeof(ec_xskmode[0])); mode++)
+   {
+      if (ecx_xsk_trymode(x, ifindex, queue, mode))
+      {
+         break;
+      }
+      ecx_xsk_resetmode(x);
+   }
+   if (x->fd < 0)
+   {
+      ecx_xsk_close(xsk);
+      return 0;
+   }
+
+   if (busypoll > 0)
+   {
+      x->busypoll = 1;
+      /* not supported on all kernels, busy poll then falls back to plain wakeups */
+      (void)setsockopt(x->fd, SOL_SOCKET, SO_BUSY_POLL, &busypoll, sizeof(busypoll));
+#ifdef SO_PREFER_BUSY_POLL
+      {
+         int i = 1;
+         (void)setsockopt(x->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &i, sizeof(i));
+         i = EC_XSK_FRAMES;
+         (void)setsockopt(x->fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &i, sizeof(i));
+      }
+#endif
+   }
+
+   return 1;
+}
+
+/** Put frame in the AF_XDP tx ring, the kernel is not kicked.
+ * @param[in] xsk         = socket
+ * @param[in] buf         = frame including ethernet header
+ * @param[in] len         = frame length in bytes
+ * @return len if succeeded, -1 if tx ring is full
+ */
+int ecx_xsk_queue(ec_xskt *xsk, const void *buf, int len)
+{
+   struct xdp_desc *desc;
+   uint32 prod, cons, slot;
+   int rval;
+
+   pthread_mutex_lock(&xsk->tx_mutex);
+   /* reclaim frames the kernel is done with, they complete in order */
+   cons = *xsk->comp.consumer;
+   prod = __atomic_load_n(xsk->comp.producer, __ATOMIC_ACQUIRE);
+   xsk->txdone += prod - cons;
+   __atomic_store_n(xsk->comp.consumer, prod, __ATOMIC_RELEASE);
+
+   rval = -1;
+   prod = *xsk->tx.producer;
+   if ((prod - xsk->txdone) < EC_XSK_FRAMES)
+   {
+      slot = prod & (EC_XSK_FRAMES - 1);
+      desc = &((struct xdp_desc *)xsk->tx.ring)[slot];
+      desc->addr = (uint64)(EC_XSK_FRAMES + slot) * EC_XSK_FRAMESIZE;
+      desc->len = len;
+      desc->options = 0;
+      memcpy(xsk->umem + desc->addr, buf, len);
+      __atomic_store_n(xsk->tx.producer, prod + 1, __ATOMIC_RELEASE);
+      rval = len;
+   }
+   pthread_mutex_unlock(&xsk->tx_mutex);
+
+   return rval;
+}
+
+/** Kick the kernel to transmit all frames in the AF_XDP tx ring.
+ * @param[in] xsk         = socket
+ * @return 0 if succeeded, -1 on socket error
+ */
+int ecx_xsk_kick(ec_xskt *xsk)
+{
+   /* copy mode and need_wakeup mode both need a kick to start transmit */
+   if (sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0)
+   {
+      if ((errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS))
+      {
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
+/** Transmit frame over AF_XDP socket (non blocking).
+ * @param[in] xsk         = socket
+ * @param[in] buf         = frame including ethernet header
+ * @param[in] len         = frame length in bytes
+ * @return len if succeeded, -1 if tx ring is full or kick failed
+ */
+int ecx_xsk_send(ec_xskt *xsk, const void *buf, int len)
+{
+   int rval;
+
+   rval = ecx_xsk_queue(xsk, buf, len);
+   if (ecx_xsk_kick(xsk) == -1)
+   {
+      rval = -1;
+   }
+
+   return rval;
+}
+
+/** Non blocking read of AF_XDP rx ring. The frame stays in its UMEM buffer
+ * until released with ecx_xsk_release().
+ * @param[in] xsk         = socket
+ * @param[out] frame      = start of received frame including ethernet header
+ * @return frame length, 0 if no frame is available
+ */
+int ecx_xsk_recv(ec_xskt *xsk, uint8 **frame)
+{
+   struct xdp_desc *desc;
+   uint32 cons;
+
+   cons = *xsk->rx.consumer;
+   if (__atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE) == cons)
+   {
+      /* let the kernel run the NAPI poll in our context */
+      if (xsk->busypoll || (*xsk->fill.flags & XDP_RING_NEED_WAKEUP))
+      {
+         recvfrom(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+      }
+      if (__atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE) == cons)
+      {
+         return 0;
+      }
+   }
+   desc = &((struct xdp_desc *)xsk->rx.ring)[cons & (EC_XSK_FRAMES - 1)];
+   *frame = xsk->umem + desc->addr;
+
+   return desc->len;
+}
+
+/** Hand rx frame read by ecx_xsk_recv() back to the kernel.
+ * @param[in] xsk         = socket
+ */
+void ecx_xsk_release(ec_xskt *xsk)
+{
+   struct xdp_desc *desc;
+   uint32 cons, prod;
+
+   cons = *xsk->rx.consumer;
+   desc = &((struct xdp_desc *)xsk->rx.ring)[cons & (EC_XSK_FRAMES - 1)];
+   prod = *xsk->fill.producer;
+   ((uint64 *)xsk->fill.ring)[prod & (EC_XSK_FRAMES - 1)] =
+      desc->addr & ~(uint64)(EC_XSK_FRAMESIZE - 1);
+   __atomic_store_n(xsk->fill.producer, prod + 1, __ATOMIC_RELEASE);
+   __atomic_store_n(xsk->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+}
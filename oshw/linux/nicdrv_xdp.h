@@ -0,0 +1,31 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for nicdrv_xdp.c
+ */
+
+#ifndef _nicdrv_xdph_
+#define _nicdrv_xdph_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int ecx_xsk_open(ec_xskt **xsk, const char *ifname, int queue, int busypoll);
+void ecx_xsk_close(ec_xskt **xsk);
+int ecx_xsk_queue(ec_xskt *xsk, const void *buf, int len);
+int ecx_xsk_kick(ec_xskt *xsk);
+int ecx_xsk_send(ec_xskt *xsk, const void *buf, int len);
+int ecx_xsk_recv(ec_xskt *xsk, uint8 **frame);
+void ecx_xsk_release(ec_xskt *xsk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
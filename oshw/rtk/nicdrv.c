@@ -306,6 +306,53 @@ int ecx_outframe_red(ecx_portt *port, uint8 idx)
    return rval;
 }
 
+/** Transmit frames queued for batch transmit. This driver has no batch
+ * mode, frames are sent by ecx_outframe_red() directly.
+ * @param[in] port        = port context struct
+ * @return number of frames sent
+ */
+int ecx_outframe_flush(ecx_portt *port)
+{
+   (void)port;
+   return 0;
+}
+
+/** Number of frame buffers of the port.
+ * @param[in] port        = port context struct
+ * @return number of frame buffers, EC_MAXBUF in this driver
+ */
+int ecx_bufcount(ecx_portt *port)
+{
+   (void)port;
+   return EC_MAXBUF;
+}
+
+/** Attach statistics struct for frame records. This driver does not
+ * record frames.
+ * @param[in] port        = port context struct
+ * @param[in] stats       = statistics struct, NULL to stop recording
+ * @param[in] hwstamp     = if TRUE use NIC hardware timestamps
+ * @return timestamp sources used, EC_STAT_TSxxx bits
+ */
+int ecx_setstats(ecx_portt *port, struct ec_stats *stats, int hwstamp)
+{
+   (void)port;
+   (void)stats;
+   (void)hwstamp;
+   return 0;
+}
+
+/** Collect tx timestamps into the frame records. This driver does not
+ * record frames.
+ * @param[in] port        = port context struct
+ * @return number of records that got their tx timestamp, always 0
+ */
+int ecx_collectstats(ecx_portt *port)
+{
+   (void)port;
+   return 0;
+}
+
 /** Non blocking read of socket. Put frame in temporary buffer.
  * @param[in] port        = port context struct
  * @param[in] stacknumber = 0=primary 1=secondary stack
@@ -610,6 +657,26 @@ int ec_outframe_red(uint8 idx)
    return ecx_outframe_red(&ecx_port, idx);
 }
 
+int ec_outframe_flush(void)
+{
+   return ecx_outframe_flush(&ecx_port);
+}
+
+int ec_bufcount(void)
+{
+   return ecx_bufcount(&ecx_port);
+}
+
+int ec_setstats(struct ec_stats *stats, int hwstamp)
+{
+   return ecx_setstats(&ecx_port, stats, hwstamp);
+}
+
+int ec_collectstats(void)
+{
+   return ecx_collectstats(&ecx_port);
+}
+
 int ec_inframe(uint8 idx, int stacknumber)
 {
    return ecx_inframe(&ecx_port, idx, stacknumber);
@@ -79,6 +79,9 @@ typedef struct
    mtx_t * rx_mutex;
 } ecx_portt;
 
+/** statistics struct, see ethercatstats.h */
+struct ec_stats;
+
 extern const uint16 priMAC[3];
 extern const uint16 secMAC[3];
 
@@ -92,6 +95,10 @@ void ec_setbufstat(uint8 idx, int bufstat);
 uint8 ec_getindex(void);
 int ec_outframe(uint8 idx, int stacknumber);
 int ec_outframe_red(uint8 idx);
+int ec_outframe_flush(void);
+int ec_bufcount(void);
+int ec_setstats(struct ec_stats *stats, int hwstamp);
+int ec_collectstats(void);
 int ec_waitinframe(uint8 idx, int timeout);
 int ec_srconfirm(uint8 idx,int timeout);
 #endif
@@ -103,6 +110,10 @@ void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat);
 uint8 ecx_getindex(ecx_portt *port);
 int ecx_outframe(ecx_portt *port, uint8 idx, int stacknumber);
 int ecx_outframe_red(ecx_portt *port, uint8 idx);
+int ecx_outframe_flush(ecx_portt *port);
+int ecx_bufcount(ecx_portt *port);
+int ecx_setstats(ecx_portt *port, struct ec_stats *stats, int hwstamp);
+int ecx_collectstats(ecx_portt *port);
 int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout);
 int ecx_srconfirm(ecx_portt *port, uint8 idx,int timeout);
 
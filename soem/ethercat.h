@@ -22,5 +22,11 @@
 #include "ethercateoe.h"
 #include "ethercatconfig.h"
 #include "ethercatprint.h"
+#include "ethercatstats.h"
+#include "ethercatsiicache.h"
+#include "ethercatpi.h"
+#include "ethercatpdo.h"
+#include "ethercatbits.h"
+#include "ethercatchange.h"
 
 #endif /* _EC_ETHERCAT_H */
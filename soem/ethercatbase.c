@@ -107,7 +107,7 @@ uint16 ecx_adddatagram(ecx_portt *port, void *frame, uint8 com, uint8 idx, boole
 {
    ec_comt *datagramP;
    uint8 *frameP;
-   uint16 prevlength;
+   uint16 prevlength, last, next;
 
    frameP = frame;
    /* copy previous frame size */
@@ -115,6 +115,14 @@ uint16 ecx_adddatagram(ecx_portt *port, void *frame, uint8 com, uint8 idx, boole
    datagramP = (ec_comt*)&frameP[ETH_HEADERSIZE];
    /* add new datagram to ethernet frame size */
    datagramP->elength = htoes( etohs(datagramP->elength) + EC_HEADERSIZE + length );
+   /* find previous subframe, the last one before the new datagram */
+   next = ETH_HEADERSIZE;
+   do
+   {
+      last = next;
+      datagramP = (ec_comt*)&frameP[last];
+      next = last + EC_HEADERSIZE - EC_ELENGTHSIZE + (etohs(datagramP->dlength) & EC_DATAGRAMLENGTH) + EC_WKCSIZE;
+   } while (next < (prevlength - EC_ELENGTHSIZE));
    /* add "datagram follows" flag to previous subframe dlength */
    datagramP->dlength = htoes( etohs(datagramP->dlength) | EC_DATAGRAMFOLLOWS );
    /* set new EtherCAT header position */
@@ -162,6 +170,10 @@ int ecx_BWR (ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
 
    /* get fresh index */
    idx = ecx_getindex (port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    /* setup datagram */
    ecx_setupdatagram (port, &(port->txbuf[idx]), EC_CMD_BWR, idx, ADP, ADO, length, data);
    /* send data and wait for answer */
@@ -189,6 +201,10 @@ int ecx_BRD(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
 
    /* get fresh index */
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    /* setup datagram */
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_BRD, idx, ADP, ADO, length, data);
    /* send data and wait for answer */
@@ -220,6 +236,10 @@ int ecx_APRD(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    uint8 idx;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_APRD, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if (wkc > 0)
@@ -248,6 +268,10 @@ int ecx_ARMW(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    uint8 idx;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_ARMW, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if (wkc > 0)
@@ -276,6 +300,10 @@ int ecx_FRMW(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    uint8 idx;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_FRMW, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if (wkc > 0)
@@ -321,6 +349,10 @@ int ecx_FPRD(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    uint8 idx;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_FPRD, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if (wkc > 0)
@@ -365,6 +397,10 @@ int ecx_APWR(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    int wkc;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_APWR, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    ecx_setbufstat(port, idx, EC_BUF_EMPTY);
@@ -402,6 +438,10 @@ int ecx_FPWR(ecx_portt *port, uint16 ADP, uint16 ADO, uint16 length, void *data,
    uint8 idx;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_FPWR, idx, ADP, ADO, length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    ecx_setbufstat(port, idx, EC_BUF_EMPTY);
@@ -438,6 +478,10 @@ int ecx_LRW(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeo
    int wkc;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LRW, idx, LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if ((wkc > 0) && (port->rxbuf[idx][EC_CMDOFFSET] == EC_CMD_LRW))
@@ -464,6 +508,10 @@ int ecx_LRD(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeo
    int wkc;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LRD, idx, LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    if ((wkc > 0) && (port->rxbuf[idx][EC_CMDOFFSET]==EC_CMD_LRD))
@@ -490,6 +538,10 @@ int ecx_LWR(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeo
    int wkc;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LWR, idx, LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
    wkc = ecx_srconfirm(port, idx, timeout);
    ecx_setbufstat(port, idx, EC_BUF_EMPTY);
@@ -517,6 +569,10 @@ int ecx_LRWDC(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, uint16
    uint64 DCtE;
 
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    /* LRW in first datagram */
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LRW, idx, LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
    /* FPRMW in second datagram */
@@ -535,6 +591,143 @@ int ecx_LRWDC(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, uint16
    return wkc;
 }
 
+/** Time left until a timer expires.
+ * @param[in]  timer          = timer
+ * @return time left in us, 0 if expired
+ */
+int ecx_timer_left(osal_timert *timer)
+{
+   osal_timert now;
+   ec_timet left;
+
+   /* a timer started with zero timeout holds the current time */
+   osal_timer_start(&now, 0);
+   if ((now.stop_time.sec > timer->stop_time.sec) ||
+       ((now.stop_time.sec == timer->stop_time.sec) &&
+        (now.stop_time.usec >= timer->stop_time.usec)))
+   {
+      return 0;
+   }
+   osal_time_diff(&now.stop_time, &timer->stop_time, &left);
+
+   return (int)(left.sec * 1000000 + left.usec);
+}
+
+/** Transaction of many datagrams, f.e. register access to many slaves.
+ * The datagrams are packed in as few frames as possible. Up to a quarter of
+ * the frame buffers of the port, at most EC_MAXTRXFRAMES, are sent before
+ * the responses are collected, so a transaction of hundreds of datagrams
+ * takes a few round trips instead of one per datagram. The frames sent
+ * together share one deadline, so lost frames cost one timeout per round
+ * trip and not one per frame. Returned data of read and read/write commands is
+ * copied back to the data of each datagram and its work counter is stored
+ * in wkc, EC_NOFRAME if its frame did not return or no frame buffer was
+ * free for it. Lost frames are not repeated.
+ * @param[in] port        = port context struct
+ * @param[in,out] dg      = datagrams
+ * @param[in] n           = number of datagrams
+ * @param[in] timeout     = timeout in us per round trip, standard is EC_TIMEOUTRET
+ * @return number of datagrams whose frame returned, EC_NOFRAME if a
+ * datagram is longer than EC_MAXLRWDATA
+ */
+int ecx_transaction(ecx_portt *port, ec_datagramt *dg, int n, int timeout)
+{
+   uint8 idx[EC_MAXTRXFRAMES];
+   int first[EC_MAXTRXFRAMES + 1];
+   int nframes, maxframes, f, i, next, wkc, answered;
+   uint16 offset, le_wkc;
+   uint8 *frame;
+   uint8 com;
+   osal_timert timer;
+
+   for (i = 0; i < n; i++)
+   {
+      if (dg[i].length > EC_MAXLRWDATA)
+      {
+         return EC_NOFRAME;
+      }
+   }
+   /* leave most frame buffers to other users of the port */
+   maxframes = ecx_bufcount(port) / 4;
+   if (maxframes < 1)
+   {
+      maxframes = 1;
+   }
+   if (maxframes > EC_MAXTRXFRAMES)
+   {
+      maxframes = EC_MAXTRXFRAMES;
+   }
+   answered = 0;
+   next = 0;
+   while (next < n)
+   {
+      /* fill and send a batch of frames */
+      nframes = 0;
+      while ((next < n) && (nframes < maxframes))
+      {
+         idx[nframes] = ecx_getindex(port);
+         if (idx[nframes] == EC_NOINDEX)
+         {
+            break;
+         }
+         frame = (uint8 *)&(port->txbuf[idx[nframes]]);
+         first[nframes] = next;
+         ecx_setupdatagram(port, frame, dg[next].command, idx[nframes],
+                           dg[next].ADP, dg[next].ADO, dg[next].length, dg[next].data);
+         next++;
+         while ((next < n) &&
+                ((port->txbuflength[idx[nframes]] + EC_HEADERSIZE - EC_ELENGTHSIZE +
+                  dg[next].length + EC_WKCSIZE) <= EC_MAXDGFRAME))
+         {
+            ecx_adddatagram(port, frame, dg[next].command, idx[nframes], FALSE,
+                            dg[next].ADP, dg[next].ADO, dg[next].length, dg[next].data);
+            next++;
+         }
+         ecx_outframe_red(port, idx[nframes]);
+         nframes++;
+      }
+      first[nframes] = next;
+      if (nframes == 0)
+      {
+         /* no frame buffer free, the remaining datagrams fail */
+         while (next < n)
+         {
+            dg[next++].wkc = EC_NOFRAME;
+         }
+         break;
+      }
+      ecx_outframe_flush(port);
+      /* collect the responses, frames arriving while an earlier one is
+       * awaited are buffered by the driver */
+      osal_timer_start(&timer, timeout);
+      for (f = 0; f < nframes; f++)
+      {
+         wkc = ecx_waitinframe(port, idx[f], ecx_timer_left(&timer));
+         offset = EC_HEADERSIZE;
+         for (i = first[f]; i < first[f + 1]; i++)
+         {
+            dg[i].wkc = EC_NOFRAME;
+            if (wkc > EC_NOFRAME)
+            {
+               com = dg[i].command;
+               if ((com != EC_CMD_APWR) && (com != EC_CMD_FPWR) &&
+                   (com != EC_CMD_BWR) && (com != EC_CMD_LWR) && (com != EC_CMD_NOP))
+               {
+                  memcpy(dg[i].data, &(port->rxbuf[idx[f]][offset]), dg[i].length);
+               }
+               memcpy(&le_wkc, &(port->rxbuf[idx[f]][offset + dg[i].length]), EC_WKCSIZE);
+               dg[i].wkc = etohs(le_wkc);
+               answered++;
+            }
+            offset += EC_HEADERSIZE - EC_ELENGTHSIZE + dg[i].length + EC_WKCSIZE;
+         }
+         ecx_setbufstat(port, idx[f], EC_BUF_EMPTY);
+      }
+   }
+
+   return answered;
+}
+
 #ifdef EC_VER1
 int ec_setupdatagram(void *frame, uint8 com, uint8 idx, uint16 ADP, uint16 ADO, uint16 length, void *data)
 {
@@ -634,4 +827,9 @@ int ec_LRWDC(uint32 LogAdr, uint16 length, void *data, uint16 DCrs, int64 *DCtim
 {
    return ecx_LRWDC(&ecx_port, LogAdr, length, data, DCrs, DCtime, timeout);
 }
+
+int ec_transaction(ec_datagramt *dg, int n, int timeout)
+{
+   return ecx_transaction(&ecx_port, dg, n, timeout);
+}
 #endif
@@ -16,6 +16,26 @@ extern "C"
 {
 #endif
 
+/** maximum number of frames in flight for one ecx_transaction() batch */
+#define EC_MAXTRXFRAMES    (EC_MAXFRAMEIDX / 4)
+
+/** datagram of a transaction, see ecx_transaction() */
+typedef struct ec_datagram
+{
+   /** EtherCAT command, see ec_cmdtype */
+   uint8    command;
+   /** ADP */
+   uint16   ADP;
+   /** ADO */
+   uint16   ADO;
+   /** length of data, at most EC_MAXLRWDATA */
+   uint16   length;
+   /** data to send, receives the returned data of read and read/write commands */
+   void     *data;
+   /** returned work counter, EC_NOFRAME if no frame returned */
+   int      wkc;
+} ec_datagramt;
+
 int ecx_setupdatagram(ecx_portt *port, void *frame, uint8 com, uint8 idx, uint16 ADP, uint16 ADO, uint16 length, void *data);
 uint16 ecx_adddatagram(ecx_portt *port, void *frame, uint8 com, uint8 idx, boolean more, uint16 ADP, uint16 ADO, uint16 length, void *data);
 int ecx_BWR(ecx_portt *port, uint16 ADP,uint16 ADO,uint16 length,void *data,int timeout);
@@ -34,6 +54,8 @@ int ecx_LRW(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeo
 int ecx_LRD(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeout);
 int ecx_LWR(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, int timeout);
 int ecx_LRWDC(ecx_portt *port, uint32 LogAdr, uint16 length, void *data, uint16 DCrs, int64 *DCtime, int timeout);
+int ecx_timer_left(osal_timert *timer);
+int ecx_transaction(ecx_portt *port, ec_datagramt *dg, int n, int timeout);
 
 #ifdef EC_VER1
 int ec_setupdatagram(void *frame, uint8 com, uint8 idx, uint16 ADP, uint16 ADO, uint16 length, void *data);
@@ -54,6 +76,7 @@ int ec_LRW(uint32 LogAdr, uint16 length, void *data, int timeout);
 int ec_LRD(uint32 LogAdr, uint16 length, void *data, int timeout);
 int ec_LWR(uint32 LogAdr, uint16 length, void *data, int timeout);
 int ec_LRWDC(uint32 LogAdr, uint16 length, void *data, uint16 DCrs, int64 *DCtime, int timeout);
+int ec_transaction(ec_datagramt *dg, int n, int timeout);
 #endif
 
 #ifdef __cplusplus
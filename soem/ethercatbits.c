@@ -0,0 +1,417 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Bulk access to bit packed digital IO.
+ *
+ * ecx_config_map_group() packs slaves with less than 8 bits of inputs or
+ * outputs bitwise, so the points of small digital terminals share bytes at
+ * any start bit. ecx_bits_init() collects the IO of the small slaves of a
+ * group into a table of bit ranges, merging slaves that follow each other in
+ * the IOmap, and numbers their points consecutively.
+ *
+ * ecx_bits_unpack() expands the input ranges into one byte per point, 0 or 1,
+ * and in the same pass finds the points that changed since the previous call.
+ * ecx_bits_pack() packs one byte per point back into the output ranges. The
+ * byte arrays may be arrays of C99 bool.
+ *
+ * Byte aligned parts of a range are converted in blocks, 32 points with AVX2,
+ * 16 points with SSE2 or NEON and 8 points with plain 64 bit arithmetic
+ * otherwise. The instruction set is selected at compile time, e.g. with
+ * -mavx2, NEON only with EC_SIMD_USE_NEON, see ethercatsimd.h. Bits before
+ * the first and after the last full byte of a range are converted one by
+ * one.
+ */
+
+#include <string.h>
+#include "osal.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatbits.h"
+#include "ethercatsimd.h"
+
+/** points handled by one block kernel */
+#define EC_BITS_BLOCK      EC_SIMD_WIDTH
+
+#if defined(__GNUC__)
+#define EC_BITS_POPCOUNT(x)   ((uint32)__builtin_popcount(x))
+#else
+#define EC_BITS_POPCOUNT(x)   ecx_bits_popcount(x)
+static uint32 ecx_bits_popcount(uint32 x)
+{
+   uint32 n = 0;
+
+   while (x)
+   {
+      x &= x - 1;
+      n++;
+   }
+   return n;
+}
+#endif
+
+/** Set the bytes that are not 0 to 1.
+ * @param[in]  x        = 8 bytes
+ * @return 8 bytes of 0 or 1
+ */
+static uint64 ecx_bits_bool8(uint64 x)
+{
+   return ((((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x) >> 7) &
+      0x0101010101010101ULL;
+}
+
+/** Pack 8 bytes of 0 or 1, the first byte becomes bit 0.
+ * @param[in]  x        = 8 bytes of 0 or 1, in host byte order
+ * @return 8 bits
+ */
+static uint32 ecx_bits_pack64(uint64 x)
+{
+   return (uint32)((x * 0x0102040810204080ULL) >> 56);
+}
+
+/** Expand 8 bits to 8 points.
+ * @param[in]  src      = bits in the IOmap
+ * @param[out] dst      = points, the previous values are compared
+ * @return changed points, bit n is set if point n changed
+ */
+static uint32 ecx_bits_unpack8(const uint8 *src, uint8 *dst)
+{
+   uint64 v, old;
+
+   v = ((uint64)src[0] * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+   v = ((v + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+   memcpy(&old, dst, sizeof(old));
+   old = etohll(old);
+   v = htoell(v);
+   memcpy(dst, &v, sizeof(v));
+   return ecx_bits_pack64(ecx_bits_bool8(old ^ etohll(v)));
+}
+
+/** Pack 8 points to 8 bits.
+ * @param[in]  src      = points, not 0 is 1
+ * @return 8 bits
+ */
+static uint32 ecx_bits_pack8(const uint8 *src)
+{
+   uint64 v;
+
+   memcpy(&v, src, sizeof(v));
+   return ecx_bits_pack64(ecx_bits_bool8(etohll(v)));
+}
+
+#if defined(EC_SIMD_AVX2)
+/** Expand EC_BITS_BLOCK bits to points, see ecx_bits_unpack8() */
+static uint32 ecx_bits_unpack_block(const uint8 *src, uint8 *dst)
+{
+   const __m256i sel = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+   const __m256i bit = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+   __m256i v, old;
+   int32 w;
+
+   memcpy(&w, src, sizeof(w));
+   v = _mm256_shuffle_epi8(_mm256_set1_epi32(w), sel);
+   v = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, bit), bit), _mm256_set1_epi8(1));
+   old = _mm256_loadu_si256((const __m256i *)dst);
+   _mm256_storeu_si256((__m256i *)dst, v);
+   return ~(uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(old, v));
+}
+
+/** Pack EC_BITS_BLOCK points to bits, see ecx_bits_pack8() */
+static uint32 ecx_bits_pack_block(const uint8 *src)
+{
+   __m256i v = _mm256_loadu_si256((const __m256i *)src);
+
+   return ~(uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+}
+#elif defined(EC_SIMD_SSE2)
+/** Expand EC_BITS_BLOCK bits to points, see ecx_bits_unpack8() */
+static uint32 ecx_bits_unpack_block(const uint8 *src, uint8 *dst)
+{
+   const __m128i bit = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+   __m128i v, old;
+
+   /* byte 0 to lanes 0-7, byte 1 to lanes 8-15 */
+   v = _mm_cvtsi32_si128(src[0] | (src[1] << 8));
+   v = _mm_unpacklo_epi8(v, v);
+   v = _mm_unpacklo_epi16(v, v);
+   v = _mm_unpacklo_epi32(v, v);
+   v = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, bit), bit), _mm_set1_epi8(1));
+   old = _mm_loadu_si128((const __m128i *)dst);
+   _mm_storeu_si128((__m128i *)dst, v);
+   return ~(uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(old, v)) & 0xffff;
+}
+
+/** Pack EC_BITS_BLOCK points to bits, see ecx_bits_pack8() */
+static uint32 ecx_bits_pack_block(const uint8 *src)
+{
+   __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+   return ~(uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) & 0xffff;
+}
+#elif defined(EC_SIMD_NEON)
+static const uint8 ecx_bits_weight[16] =
+   { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+/** Collect the lanes of a compare result to bits.
+ * @param[in]  m        = lanes of 0 or 0xff
+ * @return bit n is set if lane n is 0xff
+ */
+static uint32 ecx_bits_neon_mask(uint8x16_t m)
+{
+   uint64x2_t s;
+
+   s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vandq_u8(m, vld1q_u8(ecx_bits_weight)))));
+   return (uint32)vgetq_lane_u64(s, 0) | ((uint32)vgetq_lane_u64(s, 1) << 8);
+}
+
+/** Expand EC_BITS_BLOCK bits to points, see ecx_bits_unpack8() */
+static uint32 ecx_bits_unpack_block(const uint8 *src, uint8 *dst)
+{
+   uint8x16_t v, old;
+
+   v = vcombine_u8(vdup_n_u8(src[0]), vdup_n_u8(src[1]));
+   v = vandq_u8(vtstq_u8(v, vld1q_u8(ecx_bits_weight)), vdupq_n_u8(1));
+   old = vld1q_u8(dst);
+   vst1q_u8(dst, v);
+   return ecx_bits_neon_mask(vmvnq_u8(vceqq_u8(old, v)));
+}
+
+/** Pack EC_BITS_BLOCK points to bits, see ecx_bits_pack8() */
+static uint32 ecx_bits_pack_block(const uint8 *src)
+{
+   uint8x16_t v = vld1q_u8(src);
+
+   return ecx_bits_neon_mask(vtstq_u8(v, v));
+}
+#else
+#define ecx_bits_unpack_block    ecx_bits_unpack8
+#define ecx_bits_pack_block      ecx_bits_pack8
+#endif
+
+/** Add the IO of a slave to the ranges of one direction.
+ * @param[in,out] range  = ranges
+ * @param[in,out] nrange = number of ranges
+ * @param[in,out] npoint = number of points
+ * @param[in]  bitpos    = bit offset of the IO
+ * @param[in]  nbits     = bits of the IO
+ * @return first point of the slave, EC_BITS_NOINDEX if the table is full
+ */
+static uint32 ecx_bits_addrange(ec_bitranget *range, uint32 *nrange, uint32 *npoint,
+   uint32 bitpos, uint32 nbits)
+{
+   ec_bitranget *r = *nrange ? &range[*nrange - 1] : NULL;
+   uint32 index = *npoint;
+
+   if (!r || ((r->bitpos + r->nbits) != bitpos))
+   {
+      if (*nrange >= EC_BITS_MAXRANGE)
+      {
+         return EC_BITS_NOINDEX;
+      }
+      r = &range[(*nrange)++];
+      r->bitpos = bitpos;
+      r->nbits = 0;
+      r->index = index;
+   }
+   r->nbits += nbits;
+   *npoint += nbits;
+
+   return index;
+}
+
+/** Build the bit map of the digital IO of a group, after it is mapped.
+ * Slaves with at most maxbits inputs or outputs are in the map, each bit is
+ * one point. Points are numbered in slave order, inputs and outputs
+ * separately, Iindex[] and Oindex[] hold the first point of each slave.
+ * @param[in]  context  = context struct
+ * @param[out] map      = bit map
+ * @param[in]  group    = group number, 0 for all slaves
+ * @param[in]  maxbits  = largest IO of a slave in the map, e.g. 16 for digital terminals
+ * @return 1 if successful, 0 if the group is unknown or there are more than
+ *         EC_BITS_MAXRANGE ranges
+ */
+int ecx_bits_init(ecx_contextt *context, ec_bitmapt *map, uint8 group, uint16 maxbits)
+{
+   ec_groupt *grp;
+   ec_slavet *sl;
+   uint16 slave;
+
+   if (group >= context->maxgroup)
+   {
+      return 0;
+   }
+   grp = &(context->grouplist[group]);
+   memset(map, 0, sizeof(*map));
+   memset(map->Iindex, 0xff, sizeof(map->Iindex));
+   memset(map->Oindex, 0xff, sizeof(map->Oindex));
+   map->group = group;
+   for (slave = 1; (slave <= *(context->slavecount)) && (slave < EC_MAXSLAVE); slave++)
+   {
+      sl = &(context->slavelist[slave]);
+      if (group && (group != sl->group))
+      {
+         continue;
+      }
+      if (sl->Ibits && (sl->Ibits <= maxbits) && sl->inputs)
+      {
+         map->Iindex[slave] = ecx_bits_addrange(map->in, &(map->ninrange), &(map->nin),
+            (uint32)(sl->inputs - grp->inputs) * 8 + sl->Istartbit, sl->Ibits);
+         if (map->Iindex[slave] == EC_BITS_NOINDEX)
+         {
+            return 0;
+         }
+      }
+      if (sl->Obits && (sl->Obits <= maxbits) && sl->outputs)
+      {
+         map->Oindex[slave] = ecx_bits_addrange(map->out, &(map->noutrange), &(map->nout),
+            (uint32)(sl->outputs - grp->outputs) * 8 + sl->Ostartbit, sl->Obits);
+         if (map->Oindex[slave] == EC_BITS_NOINDEX)
+         {
+            return 0;
+         }
+      }
+   }
+
+   return 1;
+}
+
+/** Expand the input bits of a bit map to one byte per point.
+ * @param[in]  map      = bit map
+ * @param[in]  inputs   = group inputs, ec_group[].inputs or a copy in IOmap
+ *                        layout such as ecx_pi_inputs()
+ * @param[in,out] points = nin points, 0 or 1. Compared with the new values
+ *                        before they are written
+ * @param[out] changed  = change mask of (nin + 7) / 8 bytes, bit n is set if
+ *                        point n changed. May be NULL
+ * @return number of changed points
+ */
+uint32 ecx_bits_unpack(const ec_bitmapt *map, const uint8 *inputs, uint8 *points,
+   uint8 *changed)
+{
+   const ec_bitranget *r;
+   uint32 n, bit, i, k, c, p, accn, count = 0;
+   uint64 acc;
+   uint8 v;
+
+   for (r = map->in; r < &(map->in[map->ninrange]); r++)
+   {
+      bit = r->bitpos;
+      i = r->index;
+      /* change bits are collected from the byte boundary before the first point */
+      p = i >> 3;
+      accn = i & 7;
+      acc = changed ? (changed[p] & ((1U << accn) - 1)) : 0;
+      for (n = r->nbits; n; n -= k)
+      {
+         if (!(bit & 7) && (n >= EC_BITS_BLOCK))
+         {
+            c = ecx_bits_unpack_block(&inputs[bit >> 3], &points[i]);
+            k = EC_BITS_BLOCK;
+         }
+         else if (!(bit & 7) && (n >= 8))
+         {
+            c = ecx_bits_unpack8(&inputs[bit >> 3], &points[i]);
+            k = 8;
+         }
+         else
+         {
+            v = (uint8)((inputs[bit >> 3] >> (bit & 7)) & 1);
+            c = (points[i] != v);
+            points[i] = v;
+            k = 1;
+         }
+         if (c)
+         {
+            count += EC_BITS_POPCOUNT(c);
+         }
+         if (changed)
+         {
+            acc |= (uint64)c << accn;
+            for (accn += k; accn >= 8; accn -= 8)
+            {
+               changed[p++] = (uint8)acc;
+               acc >>= 8;
+            }
+         }
+         bit += k;
+         i += k;
+      }
+      if (changed && accn)
+      {
+         changed[p] = (uint8)((changed[p] & ~((1U << accn) - 1)) | acc);
+      }
+   }
+
+   return count;
+}
+
+/** Pack one byte per point to the output bits of a bit map. Other bits of
+ * bytes shared with slaves outside the map are kept.
+ * @param[in]  map      = bit map
+ * @param[in]  points   = nout points, not 0 is 1
+ * @param[out] outputs  = group outputs, ec_group[].outputs or a copy in IOmap
+ *                        layout such as ecx_pi_outputs()
+ */
+void ecx_bits_pack(const ec_bitmapt *map, const uint8 *points, uint8 *outputs)
+{
+   const ec_bitranget *r;
+   uint32 n, bit, i, k, b, c;
+   uint8 m;
+
+   for (r = map->out; r < &(map->out[map->noutrange]); r++)
+   {
+      bit = r->bitpos;
+      i = r->index;
+      for (n = r->nbits; n; n -= k)
+      {
+         if (!(bit & 7) && (n >= EC_BITS_BLOCK))
+         {
+            c = ecx_bits_pack_block(&points[i]);
+            for (b = 0; b < (EC_BITS_BLOCK / 8); b++)
+            {
+               outputs[(bit >> 3) + b] = (uint8)(c >> (b * 8));
+            }
+            k = EC_BITS_BLOCK;
+         }
+         else if (!(bit & 7) && (n >= 8))
+         {
+            outputs[bit >> 3] = (uint8)ecx_bits_pack8(&points[i]);
+            k = 8;
+         }
+         else
+         {
+            m = (uint8)(1 << (bit & 7));
+            if (points[i])
+            {
+               outputs[bit >> 3] |= m;
+            }
+            else
+            {
+               outputs[bit >> 3] &= (uint8)~m;
+            }
+            k = 1;
+         }
+         bit += k;
+         i += k;
+      }
+   }
+}
+
+#ifdef EC_VER1
+/** Build the bit map of the digital IO of a group, after it is mapped.
+ * @param[out] map      = bit map
+ * @param[in]  group    = group number, 0 for all slaves
+ * @param[in]  maxbits  = largest IO of a slave in the map
+ * @return 1 if successful, 0 if not
+ * @see ecx_bits_init
+ */
+int ec_bits_init(ec_bitmapt *map, uint8 group, uint16 maxbits)
+{
+   return ecx_bits_init(&ecx_context, map, group, maxbits);
+}
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatbits.c
+ */
+
+#ifndef _EC_ECATBITS_H
+#define _EC_ECATBITS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** maximum number of bit ranges per direction of a bit map */
+#ifndef EC_BITS_MAXRANGE
+#define EC_BITS_MAXRANGE   EC_MAXSLAVE
+#endif
+/** index of slaves without points in ec_bitmapt.Iindex and Oindex */
+#define EC_BITS_NOINDEX    0xffffffffU
+
+/** consecutive bits in the IOmap that map to consecutive points */
+typedef struct
+{
+   /** bit offset from the start of the group inputs or outputs */
+   uint32          bitpos;
+   /** number of bits */
+   uint32          nbits;
+   /** point of the first bit */
+   uint32          index;
+} ec_bitranget;
+
+/** bit map of the digital IO of a group, built with ecx_bits_init() */
+typedef struct
+{
+   /** group number */
+   uint8           group;
+   /** number of input points */
+   uint32          nin;
+   /** number of output points */
+   uint32          nout;
+   /** number of input ranges */
+   uint32          ninrange;
+   /** number of output ranges */
+   uint32          noutrange;
+   /** input ranges, adjacent slaves are merged */
+   ec_bitranget    in[EC_BITS_MAXRANGE];
+   /** output ranges, adjacent slaves are merged */
+   ec_bitranget    out[EC_BITS_MAXRANGE];
+   /** first input point of each slave, EC_BITS_NOINDEX if not in the map */
+   uint32          Iindex[EC_MAXSLAVE];
+   /** first output point of each slave, EC_BITS_NOINDEX if not in the map */
+   uint32          Oindex[EC_MAXSLAVE];
+} ec_bitmapt;
+
+#ifdef EC_VER1
+int ec_bits_init(ec_bitmapt *map, uint8 group, uint16 maxbits);
+#endif
+
+int ecx_bits_init(ecx_contextt *context, ec_bitmapt *map, uint8 group, uint16 maxbits);
+uint32 ecx_bits_unpack(const ec_bitmapt *map, const uint8 *inputs, uint8 *points,
+   uint8 *changed);
+void ecx_bits_pack(const ec_bitmapt *map, const uint8 *points, uint8 *outputs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATBITS_H */
@@ -0,0 +1,355 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Change detection of the process data inputs of a group.
+ *
+ * With change detection attached to a group, ecx_receive_processdata_group()
+ * compares the returned input data with a copy of the inputs received in the
+ * previous cycle after copying it to the IOmap. The copy is kept apart from
+ * the IOmap, so writes to the inputs by the application or the stack, like
+ * clearing the mailbox status bits, are not taken for input changes. Equal
+ * blocks of 32 bytes with AVX2, 16 bytes with SSE2 or NEON or 8 bytes
+ * otherwise are skipped with one compare, so a cycle without changes costs
+ * little more than the copy itself. See ethercatsimd.h for the selection of
+ * the instruction set.
+ *
+ * After the receive the changed input bytes and the changed slaves of the
+ * cycle are found in bitmaps, see ecx_change_slave(), ecx_change_byte() and
+ * ecx_change_next(). A slave with bit packed inputs only counts as changed
+ * if one of its own bits changed. For every changed slave an optional hook
+ * is called by the receiving thread and an event is put in a queue that
+ * another thread reads with ecx_change_poll(), so a consumer that is not in
+ * the cyclic thread only runs on real input edges.
+ */
+
+#include <string.h>
+#include "osal.h"
+#include "osal_atomic.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatchange.h"
+#include "ethercatsimd.h"
+
+/** bytes compared by one block compare */
+#define EC_CHANGE_BLOCK    EC_SIMD_WIDTH
+
+/** Compare one block of EC_CHANGE_BLOCK bytes.
+ * @param[in]  a        = first block
+ * @param[in]  b        = second block
+ * @return TRUE if equal
+ */
+static boolean ecx_change_equal(const uint8 *a, const uint8 *b)
+{
+#if defined(EC_SIMD_AVX2)
+   return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)a),
+      _mm256_loadu_si256((const __m256i *)b))) == -1;
+#elif defined(EC_SIMD_SSE2)
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a),
+      _mm_loadu_si128((const __m128i *)b))) == 0xffff;
+#elif defined(EC_SIMD_NEON)
+   uint64x2_t x = vreinterpretq_u64_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+
+   return (vgetq_lane_u64(x, 0) | vgetq_lane_u64(x, 1)) == 0;
+#else
+   uint64 x, y;
+
+   memcpy(&x, a, sizeof(x));
+   memcpy(&y, b, sizeof(y));
+   return x == y;
+#endif
+}
+
+/** Attach change detection to a group, after it is mapped, or detach it.
+ * Mapping the group again with ecx_config_init() detaches it.
+ * @param[in]  context  = context struct
+ * @param[out] chg      = change detection, NULL to detach
+ * @param[in]  group    = group number, 0 for all slaves
+ * @return 1 if successful, 0 if the group is unknown, has more than
+ *         EC_CHANGE_MAXBYTES input bytes or slaves with inputs from
+ *         EC_MAXSLAVE on
+ */
+int ecx_change_attach(ecx_contextt *context, ec_changet *chg, uint8 group)
+{
+   ec_groupt *grp;
+   ec_slavet *sl;
+   ec_changeslavet *s;
+   uint16 slave, maxslave;
+   uint32 endbit;
+
+   if (group >= context->maxgroup)
+   {
+      return 0;
+   }
+   grp = &(context->grouplist[group]);
+   if (!chg)
+   {
+      grp->change = NULL;
+      return 1;
+   }
+   if (grp->Ibytes > EC_CHANGE_MAXBYTES)
+   {
+      return 0;
+   }
+   maxslave = (context->maxslave < EC_MAXSLAVE) ? (uint16)context->maxslave : EC_MAXSLAVE;
+   memset(chg, 0, sizeof(*chg));
+   chg->group = group;
+   chg->Ibytes = grp->Ibytes;
+   chg->inputs = grp->inputs;
+   chg->maxslave = maxslave;
+   memcpy(chg->prev, grp->inputs, grp->Ibytes);
+   for (slave = 1; (slave <= *(context->slavecount)) && (slave < context->maxslave); slave++)
+   {
+      sl = &(context->slavelist[slave]);
+      if ((group && (group != sl->group)) || !sl->Ibits || !sl->inputs)
+      {
+         continue;
+      }
+      if (slave >= maxslave)
+      {
+         return 0;
+      }
+      s = &(chg->slave[chg->nslave++]);
+      endbit = (uint32)sl->Istartbit + sl->Ibits;
+      s->slave = slave;
+      s->offset = (uint32)(sl->inputs - grp->inputs);
+      s->nbytes = (uint16)((endbit + 7) / 8);
+      s->firstmask = (uint8)(0xff << sl->Istartbit);
+      s->lastmask = (uint8)(0xff >> ((8 - (endbit & 7)) & 7));
+   }
+   grp->change = chg;
+
+   return 1;
+}
+
+/** Set the hook called for every changed slave.
+ * The hook runs in the thread calling ecx_receive_processdata_group(),
+ * after the changes of the cycle are complete.
+ * @param[in]  chg      = change detection
+ * @param[in]  hook     = hook, NULL for none
+ * @param[in]  arg      = argument of hook
+ */
+void ecx_change_hook(ec_changet *chg,
+   void (*hook)(ecx_contextt *context, uint16 slave, void *arg), void *arg)
+{
+   chg->hook = hook;
+   chg->arg = arg;
+}
+
+/** Start a receive cycle, called by ecx_receive_processdata_group().
+ * @param[in]  chg      = change detection
+ */
+void ecx_change_begin(ec_changet *chg)
+{
+   memset(chg->bytes, 0, (chg->Ibytes + 7) / 8);
+   chg->nbytes = 0;
+}
+
+/** Copy returned process data to the IOmap and mark the inputs that changed
+ * since the previous receive, called by ecx_receive_processdata_group()
+ * instead of memcpy().
+ * @param[in]  chg      = change detection
+ * @param[out] dst      = destination in the IOmap
+ * @param[in]  src      = datagram data in the receive buffer
+ * @param[in]  length   = length of the data
+ */
+void ecx_change_copy(ec_changet *chg, uint8 *dst, const uint8 *src, uint16 length)
+{
+   uint8 *lo, *hi, *end, *iend, *prev;
+   uint32 off, n, i, j, k;
+
+   memcpy(dst, src, length);
+   end = dst + length;
+   iend = chg->inputs + chg->Ibytes;
+   lo = (dst > chg->inputs) ? dst : chg->inputs;
+   hi = (end < iend) ? end : iend;
+   /* no group inputs in the data, f.e. outputs returned by LRW */
+   if (!chg->Ibytes || (lo >= hi))
+   {
+      return;
+   }
+   src += lo - dst;
+   off = (uint32)(lo - chg->inputs);
+   prev = &(chg->prev[off]);
+   n = (uint32)(hi - lo);
+   for (i = 0; i < n; i += k)
+   {
+      k = ((n - i) >= EC_CHANGE_BLOCK) ? EC_CHANGE_BLOCK : (n - i);
+      if ((k == EC_CHANGE_BLOCK) && ecx_change_equal(&prev[i], &src[i]))
+      {
+         continue;
+      }
+      for (j = i; j < (i + k); j++)
+      {
+         if (prev[j] != src[j])
+         {
+            chg->diff[off + j] = prev[j] ^ src[j];
+            chg->bytes[(off + j) >> 3] |= (uint8)(1 << ((off + j) & 7));
+            chg->nbytes++;
+            prev[j] = src[j];
+         }
+      }
+   }
+}
+
+/** Find the changed slaves of a receive cycle and report them, called by
+ * ecx_receive_processdata_group() after all frames of the group.
+ * @param[in]  context  = context struct
+ * @param[in]  chg      = change detection
+ */
+void ecx_change_receive(ecx_contextt *context, ec_changet *chg)
+{
+   ec_changeslavet *s;
+   ec_changeeventt *ev;
+   uint32 o, b, head;
+   uint8 m;
+
+   chg->cycle++;
+   if (chg->nslaves)
+   {
+      memset(chg->slaves, 0, sizeof(chg->slaves));
+      chg->nslaves = 0;
+   }
+   if (!chg->nbytes)
+   {
+      return;
+   }
+   for (s = chg->slave; s < &(chg->slave[chg->nslave]); s++)
+   {
+      for (b = 0; b < s->nbytes; b++)
+      {
+         o = s->offset + b;
+         if (!(chg->bytes[o >> 3] & (1 << (o & 7))))
+         {
+            continue;
+         }
+         m = 0xff;
+         if (b == 0)
+         {
+            m &= s->firstmask;
+         }
+         if (b == (uint32)(s->nbytes - 1))
+         {
+            m &= s->lastmask;
+         }
+         if (chg->diff[o] & m)
+         {
+            break;
+         }
+      }
+      if (b >= s->nbytes)
+      {
+         continue;
+      }
+      chg->slaves[s->slave >> 3] |= (uint8)(1 << (s->slave & 7));
+      chg->nslaves++;
+      head = chg->head;
+      if ((head - OSAL_ATOMIC_LOAD(&(chg->tail))) >= EC_CHANGE_QUEUE)
+      {
+         chg->dropped++;
+      }
+      else
+      {
+         ev = &(chg->event[head & (EC_CHANGE_QUEUE - 1)]);
+         ev->slave = s->slave;
+         ev->cycle = chg->cycle;
+         OSAL_ATOMIC_STORE(&(chg->head), head + 1);
+      }
+      if (chg->hook)
+      {
+         chg->hook(context, s->slave, chg->arg);
+      }
+   }
+}
+
+/** Check if the inputs of a slave changed in the last receive cycle.
+ * @param[in]  chg      = change detection
+ * @param[in]  slave    = slave number
+ * @return TRUE if changed
+ */
+boolean ecx_change_slave(const ec_changet *chg, uint16 slave)
+{
+   if (slave >= chg->maxslave)
+   {
+      return FALSE;
+   }
+   return (chg->slaves[slave >> 3] >> (slave & 7)) & 1;
+}
+
+/** Check if an input byte changed in the last receive cycle.
+ * @param[in]  chg      = change detection
+ * @param[in]  offset   = offset of the byte in the group inputs
+ * @return TRUE if changed
+ */
+boolean ecx_change_byte(const ec_changet *chg, uint32 offset)
+{
+   if (offset >= chg->Ibytes)
+   {
+      return FALSE;
+   }
+   return (chg->bytes[offset >> 3] >> (offset & 7)) & 1;
+}
+
+/** Find the next slave with changed inputs in the last receive cycle.
+ * @param[in]  chg      = change detection
+ * @param[in]  slave    = previous slave, 0 to start
+ * @return next changed slave, 0 if there is none
+ */
+int ecx_change_next(const ec_changet *chg, int slave)
+{
+   uint8 b;
+
+   if (!chg->nslaves)
+   {
+      return 0;
+   }
+   for (slave++; slave < chg->maxslave; slave = (slave | 7) + 1)
+   {
+      b = (uint8)(chg->slaves[slave >> 3] >> (slave & 7));
+      if (b)
+      {
+         while (!(b & 1))
+         {
+            b >>= 1;
+            slave++;
+         }
+         return slave;
+      }
+   }
+   return 0;
+}
+
+/** Take the oldest event from the queue. One thread may read the queue.
+ * @param[in]  chg      = change detection
+ * @param[out] event    = event
+ * @return 1 if an event was taken, 0 if the queue is empty
+ */
+int ecx_change_poll(ec_changet *chg, ec_changeeventt *event)
+{
+   uint32 tail = chg->tail;
+
+   if (OSAL_ATOMIC_LOAD(&(chg->head)) == tail)
+   {
+      return 0;
+   }
+   *event = chg->event[tail & (EC_CHANGE_QUEUE - 1)];
+   OSAL_ATOMIC_STORE(&(chg->tail), tail + 1);
+   return 1;
+}
+
+#ifdef EC_VER1
+/** Attach change detection to a group, after it is mapped, or detach it.
+ * @param[out] chg      = change detection, NULL to detach
+ * @param[in]  group    = group number, 0 for all slaves
+ * @return 1 if successful, 0 if not
+ * @see ecx_change_attach
+ */
+int ec_change_attach(ec_changet *chg, uint8 group)
+{
+   return ecx_change_attach(&ecx_context, chg, group);
+}
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatchange.c
+ */
+
+#ifndef _EC_ECATCHANGE_H
+#define _EC_ECATCHANGE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** maximum number of input bytes of a group with change detection */
+#ifndef EC_CHANGE_MAXBYTES
+#define EC_CHANGE_MAXBYTES 4096
+#endif
+/** number of events in the change queue, must be a power of 2 */
+#ifndef EC_CHANGE_QUEUE
+#define EC_CHANGE_QUEUE    256
+#endif
+
+/** input change of one slave */
+typedef struct
+{
+   /** slave number */
+   uint16          slave;
+   /** receive cycle of the change, see ec_changet.cycle */
+   uint32          cycle;
+} ec_changeeventt;
+
+/** input range of one slave, internal */
+typedef struct
+{
+   /** slave number */
+   uint16          slave;
+   /** input bytes */
+   uint16          nbytes;
+   /** offset of the inputs in the group inputs */
+   uint32          offset;
+   /** bits of the slave in the first input byte */
+   uint8           firstmask;
+   /** bits of the slave in the last input byte */
+   uint8           lastmask;
+} ec_changeslavet;
+
+/** change detection of the inputs of one group, set up with ecx_change_attach() */
+struct ec_change
+{
+   /** group number */
+   uint8           group;
+   /** input bytes of the group */
+   uint32          Ibytes;
+   /** group inputs in the IOmap */
+   uint8           *inputs;
+   /** number of receive cycles */
+   uint32          cycle;
+   /** number of input bytes changed by the last receive */
+   uint32          nbytes;
+   /** number of slaves with inputs changed by the last receive */
+   uint32          nslaves;
+   /** changed bytes of the last receive, bit n is set if byte n of the group
+    * inputs changed */
+   uint8           bytes[EC_CHANGE_MAXBYTES / 8];
+   /** changed slaves of the last receive, bit n is set if slave n changed */
+   uint8           slaves[(EC_MAXSLAVE + 7) / 8];
+   /** internal, old ^ new of the changed bytes */
+   uint8           diff[EC_CHANGE_MAXBYTES];
+   /** internal, group inputs as received in the previous cycle */
+   uint8           prev[EC_CHANGE_MAXBYTES];
+   /** internal, slave numbers below this fit in slaves */
+   uint16          maxslave;
+   /** internal, number of slaves with inputs in the group */
+   uint16          nslave;
+   /** internal, input ranges of the slaves */
+   ec_changeslavet slave[EC_MAXSLAVE];
+   /** called by the receiving thread for every changed slave, may be NULL */
+   void            (*hook)(ecx_contextt *context, uint16 slave, void *arg);
+   /** argument of hook */
+   void            *arg;
+   /** next event to write, only written by the receiving thread */
+   uint32          head;
+   /** next event to read, only written by the reader */
+   uint32          tail;
+   /** events dropped because the queue was full */
+   uint32          dropped;
+   /** event queue, read with ecx_change_poll() */
+   ec_changeeventt event[EC_CHANGE_QUEUE];
+};
+
+#ifdef EC_VER1
+int ec_change_attach(ec_changet *chg, uint8 group);
+#endif
+
+int ecx_change_attach(ecx_contextt *context, ec_changet *chg, uint8 group);
+void ecx_change_hook(ec_changet *chg,
+   void (*hook)(ecx_contextt *context, uint16 slave, void *arg), void *arg);
+void ecx_change_begin(ec_changet *chg);
+void ecx_change_copy(ec_changet *chg, uint8 *dst, const uint8 *src, uint16 length);
+void ecx_change_receive(ecx_contextt *context, ec_changet *chg);
+boolean ecx_change_slave(const ec_changet *chg, uint16 slave);
+boolean ecx_change_byte(const ec_changet *chg, uint32 offset);
+int ecx_change_next(const ec_changet *chg, int slave);
+int ecx_change_poll(ec_changet *chg, ec_changeeventt *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATCHANGE_H */
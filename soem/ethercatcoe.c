@@ -18,6 +18,7 @@
 #include "ethercatbase.h"
 #include "ethercatmain.h"
 #include "ethercatcoe.h"
+#include "ethercatpdo.h"
 
 /** SDO structure, not to be confused with EcSDOserviceT */
 PACKED_BEGIN
@@ -779,6 +780,503 @@ uint32 ecx_readPDOassignCA(ecx_contextt *context, uint16 Slave, int Thread_n,
    return bsize;
 }
 
+/* steps of a PDO mapping job, named after the running SDO upload */
+enum
+{
+   /** SM communication type count, 1C00:00 or 1C00 CA */
+   EC_PDOMAP_NSM,
+   /** SM communication type, 1C00:iSM+1 */
+   EC_PDOMAP_TSM,
+   /** PDO assign count, 1C1x:00 or 1C1x CA */
+   EC_PDOMAP_NIDX,
+   /** PDO assign, 1C1x:idxloop */
+   EC_PDOMAP_IDX,
+   /** PDO entry count, idx:00 */
+   EC_PDOMAP_SUBCNT,
+   /** PDO entry, idx:subidxloop or idx CA */
+   EC_PDOMAP_ENTRY
+};
+
+/** Put SDO upload request of a PDO mapping job in its mailbox.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @param[in]  command  = SDO command
+ */
+static void ecx_PDOmapjob_request(ecx_contextt *context, ec_PDOmapjobt *mj, uint8 command)
+{
+   ec_SDOt *SDOp;
+   uint16 Slave = mj->job.slave;
+   uint8 cnt;
+
+   ec_clearmbx(&(mj->job.mbx));
+   SDOp = (ec_SDOt *)&(mj->job.mbx);
+   SDOp->MbxHeader.length = htoes(0x000a);
+   SDOp->MbxHeader.address = htoes(0x0000);
+   SDOp->MbxHeader.priority = 0x00;
+   /* get new mailbox count value, used as session handle */
+   cnt = ec_nextmbxcnt(context->slavelist[Slave].mbx_cnt);
+   context->slavelist[Slave].mbx_cnt = cnt;
+   SDOp->MbxHeader.mbxtype = ECT_MBXT_COE + MBX_HDR_SET_CNT(cnt); /* CoE */
+   SDOp->CANOpen = htoes(0x000 + (ECT_COES_SDOREQ << 12)); /* number 9bits service upper 4 bits (SDO request) */
+   SDOp->Command = command;
+   SDOp->Index = htoes(mj->index);
+   SDOp->SubIndex = mj->subindex;
+   SDOp->ldata[0] = 0;
+}
+
+/** Start SDO upload of a PDO mapping job, as ecx_SDOread().
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @param[in]  index    = Index to read
+ * @param[in]  subindex = Subindex to read
+ * @param[in]  size     = Size in bytes of parameter buffer
+ * @param[out] p        = Pointer to parameter buffer
+ * @param[in]  seq      = step of the mapping sequence that uses the result
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_upload(ecx_contextt *context, ec_PDOmapjobt *mj,
+   uint16 index, uint8 subindex, int size, void *p, int seq)
+{
+   mj->seq = seq;
+   mj->index = index;
+   mj->subindex = subindex;
+   mj->size = size;
+   mj->p = p;
+   mj->len = 0;
+   mj->segmented = FALSE;
+   ecx_PDOmapjob_request(context, mj, mj->CA ? ECT_SDO_UP_REQ_CA : ECT_SDO_UP_REQ);
+
+   return EC_MBXJOB_SEND;
+}
+
+/** Handle SDO upload response of a PDO mapping job. Sets mj->wkc as
+ * ecx_SDOread() would return it.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return TRUE if upload is finished, FALSE if a segment upload request is
+ * put in the mailbox
+ */
+static boolean ecx_PDOmapjob_response(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   ec_SDOt *aSDOp;
+   uint16 Slave = mj->job.slave;
+   uint16 bytesize, Framedatasize;
+   int32 SDOlen;
+
+   mj->wkc = mj->job.wkc;
+   if (mj->wkc <= 0)
+   {
+      return TRUE;
+   }
+   aSDOp = (ec_SDOt *)&(mj->job.mbx);
+   if (!mj->segmented)
+   {
+      /* slave response should be CoE, SDO response and the correct index */
+      if (((aSDOp->MbxHeader.mbxtype & 0x0f) == ECT_MBXT_COE) &&
+          ((etohs(aSDOp->CANOpen) >> 12) == ECT_COES_SDORES) &&
+          (etohs(aSDOp->Index) == mj->index))
+      {
+         if ((aSDOp->Command & 0x02) > 0)
+         {
+            /* expedited frame response */
+            bytesize = 4 - ((aSDOp->Command >> 2) & 0x03);
+            if (mj->size >= bytesize) /* parameter buffer big enough ? */
+            {
+               memcpy(mj->p, &aSDOp->ldata[0], bytesize);
+               mj->len = bytesize;
+               return TRUE;
+            }
+         }
+         else
+         { /* normal frame response */
+            SDOlen = etohl(aSDOp->ldata[0]);
+            /* Does parameter fit in parameter buffer ? */
+            if (SDOlen <= mj->size)
+            {
+               /* calculate mailbox transfer size */
+               Framedatasize = (etohs(aSDOp->MbxHeader.length) - 10);
+               if (Framedatasize < SDOlen) /* transfer in segments? */
+               {
+                  memcpy(mj->p, &aSDOp->ldata[1], Framedatasize);
+                  mj->len = Framedatasize;
+                  mj->segmented = TRUE;
+                  mj->toggle = 0x00;
+                  ecx_PDOmapjob_request(context, mj, ECT_SDO_SEG_UP_REQ + mj->toggle);
+                  return FALSE;
+               }
+               /* non segmented transfer */
+               memcpy(mj->p, &aSDOp->ldata[1], SDOlen);
+               mj->len = SDOlen;
+               return TRUE;
+            }
+         }
+         mj->wkc = 0;
+         ecx_packeterror(context, Slave, mj->index, mj->subindex, 3); /*  data container too small for type */
+         return TRUE;
+      }
+   }
+   /* slave response should be CoE, SDO segment response */
+   else if (((aSDOp->MbxHeader.mbxtype & 0x0f) == ECT_MBXT_COE) &&
+            ((etohs(aSDOp->CANOpen) >> 12) == ECT_COES_SDORES) &&
+            ((aSDOp->Command & 0xe0) == 0x00))
+   {
+      /* calculate mailbox transfer size */
+      Framedatasize = etohs(aSDOp->MbxHeader.length) - 3;
+      if (((aSDOp->Command & 0x01) > 0) && (Framedatasize == 7))
+      {
+         /* subtract unused bytes from frame */
+         Framedatasize = Framedatasize - ((aSDOp->Command & 0x0e) >> 1);
+      }
+      if (Framedatasize > (mj->size - mj->len))
+      {
+         Framedatasize = (uint16)(mj->size - mj->len);
+      }
+      memcpy(mj->p + mj->len, &(aSDOp->Index), Framedatasize);
+      mj->len += Framedatasize;
+      if ((aSDOp->Command & 0x01) == 0) /* segments follow */
+      {
+         mj->toggle ^= 0x10; /* toggle bit for segment request */
+         ecx_PDOmapjob_request(context, mj, ECT_SDO_SEG_UP_REQ + mj->toggle);
+         return FALSE;
+      }
+      mj->segmented = FALSE;
+      return TRUE;
+   }
+   /* other slave response */
+   mj->segmented = FALSE;
+   if ((aSDOp->Command) == ECT_SDO_ABORT) /* SDO abort frame received */
+   {
+      ecx_SDOerror(context, Slave, mj->index, mj->subindex, etohl(aSDOp->ldata[0]));
+   }
+   else
+   {
+      ecx_packeterror(context, Slave, mj->index, mj->subindex, 1); /* Unexpected frame returned */
+   }
+   mj->wkc = 0;
+
+   return TRUE;
+}
+
+/** Use SM type of current SM of a PDO mapping job and start reading its PDO
+ * assign if the SM holds process data.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return TRUE if reading the PDO assign is started
+ */
+static boolean ecx_PDOmapjob_SMtype(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   uint16 Slave = mj->job.slave;
+   uint8 iSM = mj->iSM;
+
+// start slave bug prevention code, remove if possible
+   if((iSM == 2) && (mj->tSM == 2)) // SM2 has type 2 == mailbox out, this is a bug in the slave!
+   {
+      mj->SMt_bug_add = 1; // try to correct, this works if the types are 0 1 2 3 and should be 1 2 3 4
+   }
+   if(mj->tSM)
+   {
+      mj->tSM += mj->SMt_bug_add; // only add if SMt > 0
+   }
+   if(!mj->CA && (iSM == 2) && (mj->tSM == 0)) // SM2 has type 0, this is a bug in the slave!
+   {
+      mj->tSM = 3;
+   }
+   if(!mj->CA && (iSM == 3) && (mj->tSM == 0)) // SM3 has type 0, this is a bug in the slave!
+   {
+      mj->tSM = 4;
+   }
+// end slave bug prevention code
+
+   context->slavelist[Slave].SMtype[iSM] = mj->tSM;
+   /* check if SM is unused -> clear enable flag */
+   if (mj->tSM == 0)
+   {
+      context->slavelist[Slave].SM[iSM].SMflags =
+         htoel( etohl(context->slavelist[Slave].SM[iSM].SMflags) & EC_SMENABLEMASK);
+   }
+   if ((mj->tSM == 3) || (mj->tSM == 4))
+   {
+      /* read the assign PDO */
+      mj->Tsize = 0;
+      if (mj->CA)
+      {
+         mj->PDOassign.n = 0;
+         (void)ecx_PDOmapjob_upload(context, mj, ECT_SDO_PDOASSIGN + iSM, 0x00,
+            sizeof(mj->PDOassign), &(mj->PDOassign), EC_PDOMAP_NIDX);
+      }
+      else
+      {
+         mj->rdat = 0;
+         (void)ecx_PDOmapjob_upload(context, mj, ECT_SDO_PDOASSIGN + iSM, 0x00,
+            sizeof(mj->rdat), &(mj->rdat), EC_PDOMAP_NIDX);
+      }
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+/** Continue a PDO mapping job with the current SM or the ones after it.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_nextSM(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   /* iterate for every SM type defined */
+   for (; mj->iSM < mj->nSM; mj->iSM++)
+   {
+      if (!mj->CA)
+      {
+         /* read SyncManager Communication Type */
+         mj->tSM = 0;
+         return ecx_PDOmapjob_upload(context, mj, ECT_SDO_SMCOMMTYPE, mj->iSM + 1,
+            sizeof(mj->tSM), &(mj->tSM), EC_PDOMAP_TSM);
+      }
+      mj->tSM = mj->SMcommtype.SMtype[mj->iSM];
+      if (ecx_PDOmapjob_SMtype(context, mj))
+      {
+         return EC_MBXJOB_SEND;
+      }
+   }
+
+   return EC_MBXJOB_IDLE;
+}
+
+/** Finish the PDO assign of the current SM of a PDO mapping job and
+ * continue with the next SM.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_endassign(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   /* if a mapping is found */
+   if (mj->Tsize)
+   {
+      context->slavelist[mj->job.slave].SM[mj->iSM].SMlength = htoes((uint16)((mj->Tsize + 7) / 8));
+      if (mj->tSM == 3)
+      {
+         /* we are doing outputs */
+         mj->Osize += mj->Tsize;
+      }
+      else
+      {
+         /* we are doing inputs */
+         mj->Isize += mj->Tsize;
+      }
+   }
+   mj->iSM++;
+
+   return ecx_PDOmapjob_nextSM(context, mj);
+}
+
+/** Continue a PDO mapping job with the current PDO of the PDO assign or the
+ * ones after it.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_nextidx(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   for (; mj->idxloop <= mj->nidx; mj->idxloop++)
+   {
+      if (!mj->CA)
+      {
+         /* read PDO assign */
+         mj->rdat = 0;
+         return ecx_PDOmapjob_upload(context, mj, ECT_SDO_PDOASSIGN + mj->iSM, (uint8)mj->idxloop,
+            sizeof(mj->rdat), &(mj->rdat), EC_PDOMAP_IDX);
+      }
+      /* get index from PDOassign struct */
+      mj->idx = etohs(mj->PDOassign.index[mj->idxloop - 1]);
+      if (mj->idx > 0)
+      {
+         /* read SDO's that are mapped in PDO, CA mode */
+         mj->PDOdesc.n = 0;
+         return ecx_PDOmapjob_upload(context, mj, mj->idx, 0x00,
+            sizeof(mj->PDOdesc), &(mj->PDOdesc), EC_PDOMAP_ENTRY);
+      }
+   }
+
+   return ecx_PDOmapjob_endassign(context, mj);
+}
+
+/** Continue a PDO mapping job with the current entry of the current PDO or
+ * the ones after it.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_nextsub(ecx_contextt *context, ec_PDOmapjobt *mj)
+{
+   if (mj->subidxloop <= mj->subidx)
+   {
+      /* read SDO that is mapped in PDO */
+      mj->rdat2 = 0;
+      return ecx_PDOmapjob_upload(context, mj, mj->idx, (uint8)mj->subidxloop,
+         sizeof(mj->rdat2), &(mj->rdat2), EC_PDOMAP_ENTRY);
+   }
+   mj->idxloop++;
+
+   return ecx_PDOmapjob_nextidx(context, mj);
+}
+
+/** Record a mapped entry in the PDO directory, if one is attached.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = PDO mapping job, Tsize is the bit offset of the entry
+ * @param[in]  map      = mapping object value, index, subindex and bit length
+ */
+static void ecx_PDOmapjob_entry(ecx_contextt *context, ec_PDOmapjobt *mj, uint32 map)
+{
+   if (context->pdodir && (map >> 16))
+   {
+      ecx_pdo_add(context->pdodir, mj->job.slave, mj->iSM, mj->idx, (uint16)(map >> 16),
+         (uint8)(map >> 8), mj->Tsize, LO_BYTE(map), 0, NULL);
+   }
+}
+
+/** Step function of a PDO mapping job, see ec_mbxjobt.
+ * @param[in]  context  = context struct
+ * @param[in]  job      = mailbox job of the PDO mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_PDOmapjob_step(ecx_contextt *context, ec_mbxjobt *job)
+{
+   ec_PDOmapjobt *mj = (ec_PDOmapjobt *)job;
+   uint16 subidxloop;
+
+   if (!ecx_PDOmapjob_response(context, mj))
+   {
+      /* segmented upload continues */
+      return EC_MBXJOB_SEND;
+   }
+   switch (mj->seq)
+   {
+      case EC_PDOMAP_NSM:
+         if (mj->CA)
+         {
+            mj->nSM = mj->SMcommtype.n;
+            if ((mj->wkc > 0) && (mj->nSM > EC_MAXSM))
+            {
+               ecx_packeterror(context, job->slave, 0, 0, 10); /* #SM larger than EC_MAXSM */
+            }
+         }
+         /* positive result from slave ? */
+         if ((mj->wkc > 0) && (mj->nSM > 2))
+         {
+            /* limit to maximum number of SM defined, if true the slave can't be configured */
+            if (mj->nSM > EC_MAXSM)
+            {
+               mj->nSM = EC_MAXSM;
+            }
+            mj->iSM = 2;
+            return ecx_PDOmapjob_nextSM(context, mj);
+         }
+         return EC_MBXJOB_IDLE;
+      case EC_PDOMAP_TSM:
+         if ((mj->wkc > 0) && ecx_PDOmapjob_SMtype(context, mj))
+         {
+            return EC_MBXJOB_SEND;
+         }
+         mj->iSM++;
+         return ecx_PDOmapjob_nextSM(context, mj);
+      case EC_PDOMAP_NIDX:
+         /* number of available sub indexes */
+         mj->nidx = mj->CA ? mj->PDOassign.n : etohs(mj->rdat);
+         /* positive result from slave ? */
+         if ((mj->wkc > 0) && (mj->nidx > 0))
+         {
+            mj->idxloop = 1;
+            return ecx_PDOmapjob_nextidx(context, mj);
+         }
+         return ecx_PDOmapjob_endassign(context, mj);
+      case EC_PDOMAP_IDX:
+         /* result is index of PDO */
+         mj->idx = etohs(mj->rdat);
+         if (mj->idx > 0)
+         {
+            /* read number of subindexes of PDO */
+            mj->subcnt = 0;
+            return ecx_PDOmapjob_upload(context, mj, mj->idx, 0x00,
+               sizeof(mj->subcnt), &(mj->subcnt), EC_PDOMAP_SUBCNT);
+         }
+         mj->idxloop++;
+         return ecx_PDOmapjob_nextidx(context, mj);
+      case EC_PDOMAP_SUBCNT:
+         mj->subidx = mj->subcnt;
+         mj->subidxloop = 1;
+         return ecx_PDOmapjob_nextsub(context, mj);
+      case EC_PDOMAP_ENTRY:
+         if (mj->CA)
+         {
+            /* extract all bitlengths of SDO's */
+            for (subidxloop = 1; subidxloop <= mj->PDOdesc.n; subidxloop++)
+            {
+               ecx_PDOmapjob_entry(context, mj, etohl(mj->PDOdesc.PDO[subidxloop - 1]));
+               mj->Tsize += LO_BYTE(etohl(mj->PDOdesc.PDO[subidxloop - 1]));
+            }
+            mj->idxloop++;
+            return ecx_PDOmapjob_nextidx(context, mj);
+         }
+         mj->rdat2 = etohl(mj->rdat2);
+         ecx_PDOmapjob_entry(context, mj, (uint32)mj->rdat2);
+         /* extract bitlength of SDO */
+         if (LO_BYTE(mj->rdat2) < 0xff)
+         {
+            mj->Tsize += LO_BYTE(mj->rdat2);
+         }
+         else
+         {
+            mj->Tsize += 0xff;
+         }
+         mj->subidxloop++;
+         return ecx_PDOmapjob_nextsub(context, mj);
+      default:
+         return EC_MBXJOB_IDLE;
+   }
+}
+
+/** Start a CoE PDO mapping job. The job reads the same objects as
+ * ecx_readPDOmap() or ecx_readPDOmapCA(), but does not block. Run it with
+ * ecx_mbxjob_poll() together with the jobs of other slaves, the mapping is
+ * found when its state is EC_MBXJOB_IDLE again. The job sets SMtype and
+ * SMlength of the slave and the sizes in mj.
+ *
+ * @param[in]  context  = context struct
+ * @param[out] mj       = PDO mapping job
+ * @param[in]  Slave    = Slave number
+ * @param[in]  CA       = TRUE to use Complete Access, slave has to support it
+ */
+void ecx_PDOmapjob(ecx_contextt *context, ec_PDOmapjobt *mj, uint16 Slave, boolean CA)
+{
+   mj->job.slave = Slave;
+   mj->job.timeout = EC_TIMEOUTRXM;
+   mj->job.step = &ecx_PDOmapjob_step;
+   mj->CA = CA;
+   mj->Osize = 0;
+   mj->Isize = 0;
+   mj->SMt_bug_add = 0;
+   if (context->pdodir)
+   {
+      ecx_pdo_remove(context->pdodir, Slave);
+   }
+   /* read SyncManager Communication Type object count */
+   if (CA)
+   {
+      mj->SMcommtype.n = 0;
+      (void)ecx_PDOmapjob_upload(context, mj, ECT_SDO_SMCOMMTYPE, 0x00,
+         sizeof(mj->SMcommtype), &(mj->SMcommtype), EC_PDOMAP_NSM);
+   }
+   else
+   {
+      mj->nSM = 0;
+      (void)ecx_PDOmapjob_upload(context, mj, ECT_SDO_SMCOMMTYPE, 0x00,
+         sizeof(mj->nSM), &(mj->nSM), EC_PDOMAP_NSM);
+   }
+   ecx_mbxjob_start(&(mj->job));
+}
+
 /** CoE read PDO mapping.
  *
  * CANopen has standard indexes defined for PDO mapping. This function
@@ -801,6 +1299,8 @@ uint32 ecx_readPDOassignCA(ecx_contextt *context, uint16 Slave, int Thread_n,
  * 1A00:00 is number of object defined for this PDO\n
  * 1A00:01 object mapping #1, f.e. 60100710 (SDO 6010 SI 07 bitlength 0x10)
  *
+ * The objects are read by a PDO mapping job, see ecx_PDOmapjob().
+ *
  * @param[in]  context = context struct
  * @param[in]  Slave   = Slave number
  * @param[out] Osize   = Size in bits of output mapping (rxPDO) found
@@ -809,89 +1309,16 @@ uint32 ecx_readPDOassignCA(ecx_contextt *context, uint16 Slave, int Thread_n,
  */
 int ecx_readPDOmap(ecx_contextt *context, uint16 Slave, uint32 *Osize, uint32 *Isize)
 {
-   int wkc, rdl;
-   int retVal = 0;
-   uint8 nSM, iSM, tSM;
-   uint32 Tsize;
-   uint8 SMt_bug_add;
-
-   *Isize = 0;
-   *Osize = 0;
-   SMt_bug_add = 0;
-   rdl = sizeof(nSM); nSM = 0;
-   /* read SyncManager Communication Type object count */
-   wkc = ecx_SDOread(context, Slave, ECT_SDO_SMCOMMTYPE, 0x00, FALSE, &rdl, &nSM, EC_TIMEOUTRXM);
-   /* positive result from slave ? */
-   if ((wkc > 0) && (nSM > 2))
-   {
-      /* limit to maximum number of SM defined, if true the slave can't be configured */
-      if (nSM > EC_MAXSM)
-         nSM = EC_MAXSM;
-      /* iterate for every SM type defined */
-      for (iSM = 2 ; iSM < nSM ; iSM++)
-      {
-         rdl = sizeof(tSM); tSM = 0;
-         /* read SyncManager Communication Type */
-         wkc = ecx_SDOread(context, Slave, ECT_SDO_SMCOMMTYPE, iSM + 1, FALSE, &rdl, &tSM, EC_TIMEOUTRXM);
-         if (wkc > 0)
-         {
-// start slave bug prevention code, remove if possible
-            if((iSM == 2) && (tSM == 2)) // SM2 has type 2 == mailbox out, this is a bug in the slave!
-            {
-               SMt_bug_add = 1; // try to correct, this works if the types are 0 1 2 3 and should be 1 2 3 4
-            }
-            if(tSM)
-            {
-               tSM += SMt_bug_add; // only add if SMt > 0
-            }
-            if((iSM == 2) && (tSM == 0)) // SM2 has type 0, this is a bug in the slave!
-            {
-               tSM = 3;
-            }
-            if((iSM == 3) && (tSM == 0)) // SM3 has type 0, this is a bug in the slave!
-            {
-               tSM = 4;
-            }
-// end slave bug prevention code
+   ec_PDOmapjobt mj;
+   ec_mbxjobt *job = &(mj.job);
 
-            context->slavelist[Slave].SMtype[iSM] = tSM;
-            /* check if SM is unused -> clear enable flag */
-            if (tSM == 0)
-            {
-               context->slavelist[Slave].SM[iSM].SMflags =
-                  htoel( etohl(context->slavelist[Slave].SM[iSM].SMflags) & EC_SMENABLEMASK);
-            }
-            if ((tSM == 3) || (tSM == 4))
-            {
-               /* read the assign PDO */
-               Tsize = ecx_readPDOassign(context, Slave, ECT_SDO_PDOASSIGN + iSM );
-               /* if a mapping is found */
-               if (Tsize)
-               {
-                  context->slavelist[Slave].SM[iSM].SMlength = htoes((uint16)((Tsize + 7) / 8));
-                  if (tSM == 3)
-                  {
-                     /* we are doing outputs */
-                     *Osize += Tsize;
-                  }
-                  else
-                  {
-                     /* we are doing inputs */
-                     *Isize += Tsize;
-                  }
-               }
-            }
-         }
-      }
-   }
+   ecx_PDOmapjob(context, &mj, Slave, FALSE);
+   ecx_mbxjob_run(context, &job, 1);
+   *Osize = mj.Osize;
+   *Isize = mj.Isize;
 
    /* found some I/O bits ? */
-   if ((*Isize > 0) || (*Osize > 0))
-   {
-      retVal = 1;
-   }
-
-   return retVal;
+   return ((*Isize > 0) || (*Osize > 0)) ? 1 : 0;
 }
 
 /** CoE read PDO mapping in Complete Access mode (CA).
@@ -900,92 +1327,28 @@ int ecx_readPDOmap(ecx_contextt *context, uint16 Slave, uint32 *Osize, uint32 *I
  * tries to read them and collect a full input and output mapping size
  * of designated slave. Slave has to support CA, otherwise use ec_readPDOmap().
  *
+ * The objects are read by a PDO mapping job, see ecx_PDOmapjob().
+ *
  * @param[in]  context  = context struct
  * @param[in]  Slave    = Slave number
- * @param[in]  Thread_n = Calling thread index
+ * @param[in]  Thread_n = not used, the job holds its own buffers
  * @param[out] Osize    = Size in bits of output mapping (rxPDO) found
  * @param[out] Isize    = Size in bits of input mapping (txPDO) found
  * @return >0 if mapping successful.
  */
 int ecx_readPDOmapCA(ecx_contextt *context, uint16 Slave, int Thread_n, uint32 *Osize, uint32 *Isize)
 {
-   int wkc, rdl;
-   int retVal = 0;
-   uint8 nSM, iSM, tSM;
-   uint32 Tsize;
-   uint8 SMt_bug_add;
-
-   *Isize = 0;
-   *Osize = 0;
-   SMt_bug_add = 0;
-   rdl = sizeof(ec_SMcommtypet);
-   context->SMcommtype[Thread_n].n = 0;
-   /* read SyncManager Communication Type object count Complete Access*/
-   wkc = ecx_SDOread(context, Slave, ECT_SDO_SMCOMMTYPE, 0x00, TRUE, &rdl,
-         &(context->SMcommtype[Thread_n]), EC_TIMEOUTRXM);
-   /* positive result from slave ? */
-   if ((wkc > 0) && (context->SMcommtype[Thread_n].n > 2))
-   {
-      nSM = context->SMcommtype[Thread_n].n;
-      /* limit to maximum number of SM defined, if true the slave can't be configured */
-      if (nSM > EC_MAXSM)
-      {
-         nSM = EC_MAXSM;
-         ecx_packeterror(context, Slave, 0, 0, 10); /* #SM larger than EC_MAXSM */
-      }
-      /* iterate for every SM type defined */
-      for (iSM = 2 ; iSM < nSM ; iSM++)
-      {
-         tSM = context->SMcommtype[Thread_n].SMtype[iSM];
-
-// start slave bug prevention code, remove if possible
-         if((iSM == 2) && (tSM == 2)) // SM2 has type 2 == mailbox out, this is a bug in the slave!
-         {
-            SMt_bug_add = 1; // try to correct, this works if the types are 0 1 2 3 and should be 1 2 3 4
-         }
-         if(tSM)
-         {
-            tSM += SMt_bug_add; // only add if SMt > 0
-         }
-// end slave bug prevention code
+   ec_PDOmapjobt mj;
+   ec_mbxjobt *job = &(mj.job);
 
-         context->slavelist[Slave].SMtype[iSM] = tSM;
-         /* check if SM is unused -> clear enable flag */
-         if (tSM == 0)
-         {
-            context->slavelist[Slave].SM[iSM].SMflags =
-               htoel( etohl(context->slavelist[Slave].SM[iSM].SMflags) & EC_SMENABLEMASK);
-         }
-         if ((tSM == 3) || (tSM == 4))
-         {
-            /* read the assign PDO */
-            Tsize = ecx_readPDOassignCA(context, Slave, Thread_n,
-                  ECT_SDO_PDOASSIGN + iSM );
-            /* if a mapping is found */
-            if (Tsize)
-            {
-               context->slavelist[Slave].SM[iSM].SMlength = htoes((uint16)((Tsize + 7) / 8));
-               if (tSM == 3)
-               {
-                  /* we are doing outputs */
-                  *Osize += Tsize;
-               }
-               else
-               {
-                  /* we are doing inputs */
-                  *Isize += Tsize;
-               }
-            }
-         }
-      }
-   }
+   (void)Thread_n;
+   ecx_PDOmapjob(context, &mj, Slave, TRUE);
+   ecx_mbxjob_run(context, &job, 1);
+   *Osize = mj.Osize;
+   *Isize = mj.Isize;
 
    /* found some I/O bits ? */
-   if ((*Isize > 0) || (*Osize > 0))
-   {
-      retVal = 1;
-   }
-   return retVal;
+   return ((*Isize > 0) || (*Osize > 0)) ? 1 : 0;
 }
 
 /** CoE read Object Description List.
@@ -58,6 +58,64 @@ typedef struct
    char   Name[EC_MAXOELIST][EC_MAXNAME+1];
 } ec_OElistt;
 
+/** CoE PDO mapping job of one slave, see ecx_PDOmapjob() */
+typedef struct
+{
+   /** mailbox job, run by ecx_mbxjob_poll() */
+   ec_mbxjobt     job;
+   /** TRUE if Complete Access is used */
+   boolean        CA;
+   /** size in bits of output mapping (rxPDO) found */
+   uint32         Osize;
+   /** size in bits of input mapping (txPDO) found */
+   uint32         Isize;
+   /** internal, step of the mapping sequence */
+   int            seq;
+   /** internal, object of running SDO upload */
+   uint16         index;
+   /** internal, subindex of running SDO upload */
+   uint8          subindex;
+   /** internal, running SDO upload is segmented */
+   boolean        segmented;
+   /** internal, toggle bit of segment upload */
+   uint8          toggle;
+   /** internal, buffer of running SDO upload */
+   uint8          *p;
+   /** internal, size of buffer */
+   int            size;
+   /** internal, bytes uploaded */
+   int            len;
+   /** internal, result of SDO upload as of ecx_SDOread() */
+   int            wkc;
+   /** internal, number of SM */
+   uint8          nSM;
+   /** internal, current SM */
+   uint8          iSM;
+   /** internal, type of current SM */
+   uint8          tSM;
+   /** internal, correction of SM types */
+   uint8          SMt_bug_add;
+   /** internal, bitlength of PDO assign of current SM */
+   uint32         Tsize;
+   /** internal, number of PDO in PDO assign */
+   uint16         nidx;
+   /** internal, current PDO in PDO assign */
+   uint16         idxloop;
+   /** internal, index of current PDO */
+   uint16         idx;
+   /** internal, number of entries of current PDO */
+   uint16         subidx;
+   /** internal, current entry of current PDO */
+   uint16         subidxloop;
+   /** internal, upload buffers */
+   uint8          subcnt;
+   uint16         rdat;
+   int32          rdat2;
+   ec_SMcommtypet SMcommtype;
+   ec_PDOassignt  PDOassign;
+   ec_PDOdesct    PDOdesc;
+} ec_PDOmapjobt;
+
 #ifdef EC_VER1
 void ec_SDOerror(uint16 Slave, uint16 Index, uint8 SubIdx, int32 AbortCode);
 int ec_SDOread(uint16 slave, uint16 index, uint8 subindex,
@@ -83,6 +141,7 @@ int ecx_RxPDO(ecx_contextt *context, uint16 Slave, uint16 RxPDOnumber , int psiz
 int ecx_TxPDO(ecx_contextt *context, uint16 slave, uint16 TxPDOnumber , int *psize, void *p, int timeout);
 int ecx_readPDOmap(ecx_contextt *context, uint16 Slave, uint32 *Osize, uint32 *Isize);
 int ecx_readPDOmapCA(ecx_contextt *context, uint16 Slave, int Thread_n, uint32 *Osize, uint32 *Isize);
+void ecx_PDOmapjob(ecx_contextt *context, ec_PDOmapjobt *mj, uint16 Slave, boolean CA);
 int ecx_readODlist(ecx_contextt *context, uint16 Slave, ec_ODlistt *pODlist);
 int ecx_readODdescription(ecx_contextt *context, uint16 Item, ec_ODlistt *pODlist);
 int ecx_readOEsingle(ecx_contextt *context, uint16 Item, uint8 SubI, ec_ODlistt *pODlist, ec_OElistt *pOElist);
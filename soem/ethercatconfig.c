@@ -21,20 +21,23 @@
 #include "ethercatcoe.h"
 #include "ethercatsoe.h"
 #include "ethercatconfig.h"
+#include "ethercatsiicache.h"
+#include "ethercatpdo.h"
 
+/** number of slaves per sweep of ecx_config_discover() */
+#define EC_MAXDISCOVER 32
 
-typedef struct
+/** number of slaves per ecx_statewait() of ecx_config_find_mappings() */
+#define EC_MAXWAITLIST 64
+
+/** stages of reading the CoE or SoE mapping of a slave */
+enum
 {
-   int thread_n;
-   int running;
-   ecx_contextt *context;
-   uint16 slave;
-} ecx_mapt_t;
-
-ecx_mapt_t ecx_mapt[EC_MAX_MAPT];
-#if EC_MAX_MAPT > 1
-OSAL_THREAD_HANDLE ecx_threadh[EC_MAX_MAPT];
-#endif
+   ECX_MAPJOB_START,
+   ECX_MAPJOB_COECA,
+   ECX_MAPJOB_COE,
+   ECX_MAPJOB_SOE
+};
 
 #ifdef EC_VER1
 /** Slave configuration structure */
@@ -106,9 +109,18 @@ void ecx_init_context(ecx_contextt *context)
    *(context->slavecount) = 0;
    /* clean ec_slave array */
    memset(context->slavelist, 0x00, sizeof(ec_slavet) * context->maxslave);
+   /* give back the frame buffers reserved by prepared groups */
+   for(lp = 0; lp < context->maxgroup; lp++)
+   {
+      ecx_release_prepared(context, (uint8)lp);
+   }
    memset(context->grouplist, 0x00, sizeof(ec_groupt) * context->maxgroup);
-   /* clear slave eeprom cache, does not actually read any eeprom */
-   ecx_siigetbyte(context, 0, EC_MAXEEPBUF);
+   /* clear slave eeprom cache */
+   ecx_siiclear(context, 0);
+   if (context->pdodir)
+   {
+      ecx_pdo_clear(context->pdodir);
+   }
    for(lp = 0; lp < context->maxgroup; lp++)
    {
       /* default start address per group entry */
@@ -148,34 +160,206 @@ int ecx_detect_slaves(ecx_contextt *context)
    return wkc;
 }
 
+/** broadcast register writes of ecx_set_slaves_to_default() */
+static const struct
+{
+   uint16 ADO;
+   uint16 length;
+   uint16 value;
+} ecx_slavedefaults[] =
+{
+   { ECT_REG_DLPORT,     1,      0x0000 },                          /* deact loop manual */
+   { ECT_REG_IRQMASK,    2,      0x0004 },                          /* set IRQ mask */
+   { ECT_REG_RXERR,      8,      0x0000 },                          /* reset CRC counters */
+   { ECT_REG_FMMU0,      16 * 3, 0x0000 },                          /* reset FMMU's */
+   { ECT_REG_SM0,        8 * 4,  0x0000 },                          /* reset SyncM */
+   { ECT_REG_DCSYNCACT,  1,      0x0000 },                          /* reset activation register */
+   { ECT_REG_DCSYSTIME,  4,      0x0000 },                          /* reset system time+ofs */
+   { ECT_REG_DCSPEEDCNT, 2,      0x1000 },                          /* DC speedstart */
+   { ECT_REG_DCTIMEFILT, 2,      0x0c00 },                          /* DC filt expr */
+   { ECT_REG_DLALIAS,    1,      0x0000 },                          /* Ignore Alias register */
+   { ECT_REG_ALCTL,      2,      EC_STATE_INIT | EC_STATE_ACK },    /* Reset all slaves to Init */
+   { ECT_REG_EEPCFG,     1,      0x0002 },                          /* force Eeprom from PDI */
+   { ECT_REG_EEPCFG,     1,      0x0000 },                          /* set Eeprom to master */
+};
+
+#define EC_SLAVEDEFAULTS (sizeof(ecx_slavedefaults) / sizeof(ecx_slavedefaults[0]))
+
 static void ecx_set_slaves_to_default(ecx_contextt *context)
 {
-   uint8 b;
-   uint16 w;
-   uint8 zbuf[64];
+   ec_datagramt dg[EC_SLAVEDEFAULTS];
+   uint8 zbuf[EC_SLAVEDEFAULTS][64];
+   int i;
+
    memset(&zbuf, 0x00, sizeof(zbuf));
-   b = 0x00;
-   ecx_BWR(context->port, 0x0000, ECT_REG_DLPORT      , sizeof(b) , &b, EC_TIMEOUTRET3);     /* deact loop manual */
-   w = htoes(0x0004);
-   ecx_BWR(context->port, 0x0000, ECT_REG_IRQMASK     , sizeof(w) , &w, EC_TIMEOUTRET3);     /* set IRQ mask */
-   ecx_BWR(context->port, 0x0000, ECT_REG_RXERR       , 8         , &zbuf, EC_TIMEOUTRET3);  /* reset CRC counters */
-   ecx_BWR(context->port, 0x0000, ECT_REG_FMMU0       , 16 * 3    , &zbuf, EC_TIMEOUTRET3);  /* reset FMMU's */
-   ecx_BWR(context->port, 0x0000, ECT_REG_SM0         , 8 * 4     , &zbuf, EC_TIMEOUTRET3);  /* reset SyncM */
-   b = 0x00;
-   ecx_BWR(context->port, 0x0000, ECT_REG_DCSYNCACT   , sizeof(b) , &b, EC_TIMEOUTRET3);     /* reset activation register */
-   ecx_BWR(context->port, 0x0000, ECT_REG_DCSYSTIME   , 4         , &zbuf, EC_TIMEOUTRET3);  /* reset system time+ofs */
-   w = htoes(0x1000);
-   ecx_BWR(context->port, 0x0000, ECT_REG_DCSPEEDCNT  , sizeof(w) , &w, EC_TIMEOUTRET3);     /* DC speedstart */
-   w = htoes(0x0c00);
-   ecx_BWR(context->port, 0x0000, ECT_REG_DCTIMEFILT  , sizeof(w) , &w, EC_TIMEOUTRET3);     /* DC filt expr */
-   b = 0x00;
-   ecx_BWR(context->port, 0x0000, ECT_REG_DLALIAS     , sizeof(b) , &b, EC_TIMEOUTRET3);     /* Ignore Alias register */
-   w = htoes(EC_STATE_INIT | EC_STATE_ACK);
-   ecx_BWR(context->port, 0x0000, ECT_REG_ALCTL       , sizeof(w) , &w, EC_TIMEOUTRET3);     /* Reset all slaves to Init */
-   b = 2;
-   ecx_BWR(context->port, 0x0000, ECT_REG_EEPCFG      , sizeof(b) , &b, EC_TIMEOUTRET3);     /* force Eeprom from PDI */
+   for (i = 0; i < (int)EC_SLAVEDEFAULTS; i++)
+   {
+      /* values in EtherCAT byte order */
+      zbuf[i][0] = LO_BYTE(ecx_slavedefaults[i].value);
+      zbuf[i][1] = HI_BYTE(ecx_slavedefaults[i].value);
+      dg[i].command = EC_CMD_BWR;
+      dg[i].ADP = 0x0000;
+      dg[i].ADO = ecx_slavedefaults[i].ADO;
+      dg[i].length = ecx_slavedefaults[i].length;
+      dg[i].data = zbuf[i];
+   }
+   /* all writes in one frame, repeat one by one if the frame got lost */
+   if (!context->batchdiscovery ||
+       (ecx_transaction(context->port, dg, EC_SLAVEDEFAULTS, EC_TIMEOUTRET3) < (int)EC_SLAVEDEFAULTS))
+   {
+      for (i = 0; i < (int)EC_SLAVEDEFAULTS; i++)
+      {
+         ecx_BWR(context->port, 0x0000, dg[i].ADO, dg[i].length, dg[i].data, EC_TIMEOUTRET3);
+      }
+   }
+}
+
+/** Set DC support, topology and physical port type of a slave from its
+ * ESC registers.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ * @param[in] escsup       = ESC feature register, host byte order
+ * @param[in] topology     = DL status register, host byte order
+ * @param[in] portdes      = port descriptor register, host byte order
+ */
+static void ecx_config_ports(ecx_contextt *context, uint16 slave, uint16 escsup, uint16 topology, uint16 portdes)
+{
+   uint8 b, h;
+
+   if ((escsup & 0x04) > 0)  /* Support DC? */
+   {
+      context->slavelist[slave].hasdc = TRUE;
+   }
+   else
+   {
+      context->slavelist[slave].hasdc = FALSE;
+   }
+   /* extract topology from DL status */
+   h = 0;
    b = 0;
-   ecx_BWR(context->port, 0x0000, ECT_REG_EEPCFG      , sizeof(b) , &b, EC_TIMEOUTRET3);     /* set Eeprom to master */
+   if ((topology & 0x0300) == 0x0200) /* port0 open and communication established */
+   {
+      h++;
+      b |= 0x01;
+   }
+   if ((topology & 0x0c00) == 0x0800) /* port1 open and communication established */
+   {
+      h++;
+      b |= 0x02;
+   }
+   if ((topology & 0x3000) == 0x2000) /* port2 open and communication established */
+   {
+      h++;
+      b |= 0x04;
+   }
+   if ((topology & 0xc000) == 0x8000) /* port3 open and communication established */
+   {
+      h++;
+      b |= 0x08;
+   }
+   /* ptype = Physical type*/
+   context->slavelist[slave].ptype = LO_BYTE(portdes);
+   context->slavelist[slave].topology = h;
+   context->slavelist[slave].activeports = b;
+   /* 0=no links, not possible             */
+   /* 1=1 link  , end of line              */
+   /* 2=2 links , one before and one after */
+   /* 3=3 links , split point              */
+   /* 4=4 links , cross point              */
+}
+
+/** registers read per slave by ecx_config_discover() */
+static const uint16 ecx_discoverregs[] =
+{
+   ECT_REG_PDICTL, ECT_REG_STADR, ECT_REG_ALIAS, ECT_REG_EEPSTAT,
+   ECT_REG_ESCSUP, ECT_REG_DLSTAT, ECT_REG_PORTDES
+};
+
+#define EC_DISCOVERREGS (sizeof(ecx_discoverregs) / sizeof(ecx_discoverregs[0]))
+
+/** Discover slaves with batched register access, see ecx_transaction().
+ * Gives the same slave data as the one by one discovery in ecx_config_init(),
+ * but each sweep carries one datagram per slave and register, so the number
+ * of round trips depends on the number of frames instead of slaves.
+ * @param[in] context      = context struct
+ * @return TRUE if all slaves answered, FALSE if the sequential discovery
+ * has to be used
+ */
+static boolean ecx_config_discover(ecx_contextt *context)
+{
+   ec_datagramt dg[EC_MAXDISCOVER * EC_DISCOVERREGS];
+   uint16 reg[EC_MAXDISCOVER][EC_DISCOVERREGS];
+   uint16 fslave, slave, ADPh;
+   int i, n;
+
+   for (fslave = 1; fslave <= *(context->slavecount); fslave += EC_MAXDISCOVER)
+   {
+      /* set node address and non ecat frame behaviour */
+      n = 0;
+      for (slave = fslave; (slave <= *(context->slavecount)) && (slave < fslave + EC_MAXDISCOVER); slave++)
+      {
+         ADPh = (uint16)(1 - slave);
+         i = slave - fslave;
+         /* a node offset is used to improve readability of network frames */
+         /* this has no impact on the number of addressable slaves (auto wrap around) */
+         reg[i][0] = htoes(slave + EC_NODEOFFSET);
+         /* kill non ecat frames for first slave, pass all frames for following slaves */
+         reg[i][1] = htoes((slave == 1) ? 1 : 0);
+         dg[n].command = EC_CMD_APWR;
+         dg[n].ADP = ADPh;
+         dg[n].ADO = ECT_REG_STADR;
+         dg[n].length = sizeof(uint16);
+         dg[n++].data = &reg[i][0];
+         dg[n].command = EC_CMD_APWR;
+         dg[n].ADP = ADPh;
+         dg[n].ADO = ECT_REG_DLCTL;
+         dg[n].length = sizeof(uint16);
+         dg[n++].data = &reg[i][1];
+      }
+      ecx_transaction(context->port, dg, n, EC_TIMEOUTRET3);
+      for (i = 0; i < n; i++)
+      {
+         if (dg[i].wkc != 1)
+         {
+            return FALSE;
+         }
+      }
+      /* read identification and port registers */
+      n = 0;
+      for (slave = fslave; (slave <= *(context->slavecount)) && (slave < fslave + EC_MAXDISCOVER); slave++)
+      {
+         for (i = 0; i < (int)EC_DISCOVERREGS; i++)
+         {
+            dg[n].command = EC_CMD_APRD;
+            dg[n].ADP = (uint16)(1 - slave);
+            dg[n].ADO = ecx_discoverregs[i];
+            dg[n].length = sizeof(uint16);
+            dg[n++].data = &reg[slave - fslave][i];
+         }
+      }
+      ecx_transaction(context->port, dg, n, EC_TIMEOUTRET3);
+      for (i = 0; i < n; i++)
+      {
+         if (dg[i].wkc != 1)
+         {
+            return FALSE;
+         }
+      }
+      for (slave = fslave; (slave <= *(context->slavecount)) && (slave < fslave + EC_MAXDISCOVER); slave++)
+      {
+         i = slave - fslave;
+         context->slavelist[slave].Itype = etohs(reg[i][0]);
+         context->slavelist[slave].configadr = etohs(reg[i][1]);
+         context->slavelist[slave].aliasadr = etohs(reg[i][2]);
+         if (etohs(reg[i][3]) & EC_ESTAT_R64) /* check if slave can read 8 byte chunks */
+         {
+            context->slavelist[slave].eep_8byte = 1;
+         }
+         ecx_config_ports(context, slave, etohs(reg[i][4]), etohs(reg[i][5]), etohs(reg[i][6]));
+      }
+   }
+
+   return TRUE;
 }
 
 #ifdef EC_VER1
@@ -299,6 +483,143 @@ static int ecx_lookup_prev_sii(ecx_contextt *context, uint16 slave)
    return 0;
 }
 
+/** Get one 32bit word of EEPROM data read by ecx_readeeprom_multi().
+ * @param[in] data         = EEPROM data
+ * @param[in] second       = FALSE for the first, TRUE for the second word
+ *                           of an 8 byte read
+ * @return 32bit word
+ */
+static uint32 ecx_siidword(const uint64 *data, int second)
+{
+   uint32 dw;
+
+   memcpy(&dw, (const uint8 *)data + (second ? sizeof(dw) : 0), sizeof(dw));
+
+   return etohl(dw);
+}
+
+/** Read identity and mailbox settings from the SII of all slaves.
+ * The EEPROMs of all slaves are read in parallel, one EEPROM address at a
+ * time. Slaves with 8 byte EEPROM reads get two SII items per read.
+ * @param[in] context      = context struct
+ */
+static void ecx_config_siiinfo(ecx_contextt *context)
+{
+   uint16 list[EC_MAXEEPMULTI], sub[EC_MAXEEPMULTI];
+   uint64 data[EC_MAXEEPMULTI];
+   uint16 fslave, slave;
+   uint32 eedat;
+   int i, n, m;
+
+   for (fslave = 1; fslave <= *(context->slavecount); fslave += EC_MAXEEPMULTI)
+   {
+      n = 0;
+      for (slave = fslave; (slave <= *(context->slavecount)) && (n < EC_MAXEEPMULTI); slave++)
+      {
+         list[n++] = slave;
+      }
+      /* Manuf, with 8 byte reads also ID */
+      ecx_readeeprom_multi(context, n, list, ECT_SII_MANUF, data, EC_TIMEOUTEEP);
+      m = 0;
+      for (i = 0; i < n; i++)
+      {
+         context->slavelist[list[i]].eep_man = ecx_siidword(&data[i], FALSE);
+         if (context->slavelist[list[i]].eep_8byte)
+         {
+            context->slavelist[list[i]].eep_id = ecx_siidword(&data[i], TRUE);
+         }
+         else
+         {
+            sub[m++] = list[i];
+         }
+      }
+      ecx_readeeprom_multi(context, m, sub, ECT_SII_ID, data, EC_TIMEOUTEEP);
+      for (i = 0; i < m; i++)
+      {
+         context->slavelist[sub[i]].eep_id = ecx_siidword(&data[i], FALSE);
+      }
+      /* revision, with 8 byte reads also serial # */
+      ecx_readeeprom_multi(context, n, list, ECT_SII_REV, data, EC_TIMEOUTEEP);
+      m = 0;
+      for (i = 0; i < n; i++)
+      {
+         context->slavelist[list[i]].eep_rev = ecx_siidword(&data[i], FALSE);
+         if (context->slavelist[list[i]].eep_8byte)
+         {
+            context->slavelist[list[i]].eep_sn = ecx_siidword(&data[i], TRUE);
+         }
+         else
+         {
+            sub[m++] = list[i];
+         }
+      }
+      ecx_readeeprom_multi(context, m, sub, ECT_SII_SN, data, EC_TIMEOUTEEP);
+      for (i = 0; i < m; i++)
+      {
+         context->slavelist[sub[i]].eep_sn = ecx_siidword(&data[i], FALSE);
+      }
+      /* slaves in the SII cache need no further EEPROM reads */
+      m = 0;
+      for (i = 0; i < n; i++)
+      {
+         if (!ecx_siicache_getmbx(context, list[i]))
+         {
+            list[m++] = list[i];
+         }
+      }
+      n = m;
+      /* write mailbox address and mailboxsize, with 8 byte reads also read mailbox */
+      ecx_readeeprom_multi(context, n, list, ECT_SII_RXMBXADR, data, EC_TIMEOUTEEP);
+      m = 0;
+      for (i = 0; i < n; i++)
+      {
+         slave = list[i];
+         eedat = ecx_siidword(&data[i], FALSE);
+         context->slavelist[slave].mbx_wo = (uint16)LO_WORD(eedat);
+         context->slavelist[slave].mbx_l = (uint16)HI_WORD(eedat);
+         if (context->slavelist[slave].mbx_l > 0)
+         {
+            if (context->slavelist[slave].eep_8byte)
+            {
+               eedat = ecx_siidword(&data[i], TRUE);
+               context->slavelist[slave].mbx_ro = (uint16)LO_WORD(eedat); /* read mailbox offset */
+               context->slavelist[slave].mbx_rl = (uint16)HI_WORD(eedat); /* read mailbox length */
+            }
+            else
+            {
+               sub[m++] = slave;
+            }
+         }
+      }
+      ecx_readeeprom_multi(context, m, sub, ECT_SII_TXMBXADR, data, EC_TIMEOUTEEP);
+      for (i = 0; i < m; i++)
+      {
+         eedat = ecx_siidword(&data[i], FALSE);
+         context->slavelist[sub[i]].mbx_ro = (uint16)LO_WORD(eedat); /* read mailbox offset */
+         context->slavelist[sub[i]].mbx_rl = (uint16)HI_WORD(eedat); /* read mailbox length */
+      }
+      /* mailbox protocols of slaves with mailbox */
+      m = 0;
+      for (i = 0; i < n; i++)
+      {
+         slave = list[i];
+         if (context->slavelist[slave].mbx_l > 0)
+         {
+            if (context->slavelist[slave].mbx_rl == 0)
+            {
+               context->slavelist[slave].mbx_rl = context->slavelist[slave].mbx_l;
+            }
+            sub[m++] = slave;
+         }
+      }
+      ecx_readeeprom_multi(context, m, sub, ECT_SII_MBXPROTO, data, EC_TIMEOUTEEP);
+      for (i = 0; i < m; i++)
+      {
+         context->slavelist[sub[i]].mbx_proto = (uint16)ecx_siidword(&data[i], FALSE);
+      }
+   }
+}
+
 /** Enumerate and init all slaves.
  *
  * @param[in] context      = context struct
@@ -308,13 +629,13 @@ static int ecx_lookup_prev_sii(ecx_contextt *context, uint16 slave)
 int ecx_config_init(ecx_contextt *context, uint8 usetable)
 {
    uint16 slave, ADPh, configadr, ssigen;
-   uint16 topology, estat;
+   uint16 topology, estat, escsup;
    int16 topoc, slavec, aliasadr;
-   uint8 b,h;
+   uint8 b;
    uint8 SMc;
-   uint32 eedat;
    int wkc, cindex, nSM;
    uint16 val16;
+   boolean batched;
 
    EC_PRINT("ec_config_init %d\n",usetable);
    ecx_init_context(context);
@@ -322,7 +643,9 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
    if (wkc > 0)
    {
       ecx_set_slaves_to_default(context);
-      for (slave = 1; slave <= *(context->slavecount); slave++)
+      batched = context->batchdiscovery && ecx_config_discover(context);
+      /* one by one discovery if batched discovery is off or failed */
+      for (slave = 1; !batched && (slave <= *(context->slavecount)); slave++)
       {
          ADPh = (uint16)(1 - slave);
          val16 = ecx_APRDw(context->port, ADPh, ECT_REG_PDICTL, EC_TIMEOUTRET3); /* read interface type of slave */
@@ -350,99 +673,20 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
          {
             context->slavelist[slave].eep_8byte = 1;
          }
-         ecx_readeeprom1(context, slave, ECT_SII_MANUF); /* Manuf */
-      }
-      for (slave = 1; slave <= *(context->slavecount); slave++)
-      {
-         eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* Manuf */
-         context->slavelist[slave].eep_man = etohl(eedat);
-         ecx_readeeprom1(context, slave, ECT_SII_SN); /* serial # */
-      }
-      for (slave = 1; slave <= *(context->slavecount); slave++)
-      {
-         eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* serial # */
-         context->slavelist[slave].eep_sn = etohl(eedat);
-         ecx_readeeprom1(context, slave, ECT_SII_ID); /* ID */
-      }
-      for (slave = 1; slave <= *(context->slavecount); slave++)
-      {
-         eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* ID */
-         context->slavelist[slave].eep_id = etohl(eedat);
-         ecx_readeeprom1(context, slave, ECT_SII_REV); /* revision */
-      }
-      for (slave = 1; slave <= *(context->slavecount); slave++)
-      {
-         eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* revision */
-         context->slavelist[slave].eep_rev = etohl(eedat);
-         ecx_readeeprom1(context, slave, ECT_SII_RXMBXADR); /* write mailbox address + mailboxsize */
-      }
-      for (slave = 1; slave <= *(context->slavecount); slave++)
-      {
-         eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* write mailbox address and mailboxsize */
-         context->slavelist[slave].mbx_wo = (uint16)LO_WORD(etohl(eedat));
-         context->slavelist[slave].mbx_l = (uint16)HI_WORD(etohl(eedat));
-         if (context->slavelist[slave].mbx_l > 0)
-         {
-            ecx_readeeprom1(context, slave, ECT_SII_TXMBXADR); /* read mailbox offset */
-         }
       }
+      ecx_config_siiinfo(context);
+      /* wait for all slaves together, state change Init was requested by broadcast */
+      (void)ecx_statewait(context, 0, NULL, EC_STATE_INIT, EC_TIMEOUTSTATE);
       for (slave = 1; slave <= *(context->slavecount); slave++)
       {
-         if (context->slavelist[slave].mbx_l > 0)
-         {
-            eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP); /* read mailbox offset */
-            context->slavelist[slave].mbx_ro = (uint16)LO_WORD(etohl(eedat)); /* read mailbox offset */
-            context->slavelist[slave].mbx_rl = (uint16)HI_WORD(etohl(eedat)); /*read mailbox length */
-            if (context->slavelist[slave].mbx_rl == 0)
-            {
-               context->slavelist[slave].mbx_rl = context->slavelist[slave].mbx_l;
-            }
-            ecx_readeeprom1(context, slave, ECT_SII_MBXPROTO);
-         }
          configadr = context->slavelist[slave].configadr;
-         val16 = ecx_FPRDw(context->port, configadr, ECT_REG_ESCSUP, EC_TIMEOUTRET3);
-         if ((etohs(val16) & 0x04) > 0)  /* Support DC? */
-         {
-            context->slavelist[slave].hasdc = TRUE;
-         }
-         else
-         {
-            context->slavelist[slave].hasdc = FALSE;
-         }
-         topology = ecx_FPRDw(context->port, configadr, ECT_REG_DLSTAT, EC_TIMEOUTRET3); /* extract topology from DL status */
-         topology = etohs(topology);
-         h = 0;
-         b = 0;
-         if ((topology & 0x0300) == 0x0200) /* port0 open and communication established */
-         {
-            h++;
-            b |= 0x01;
-         }
-         if ((topology & 0x0c00) == 0x0800) /* port1 open and communication established */
+         if (!batched)
          {
-            h++;
-            b |= 0x02;
+            escsup = ecx_FPRDw(context->port, configadr, ECT_REG_ESCSUP, EC_TIMEOUTRET3);
+            topology = ecx_FPRDw(context->port, configadr, ECT_REG_DLSTAT, EC_TIMEOUTRET3);
+            val16 = ecx_FPRDw(context->port, configadr, ECT_REG_PORTDES, EC_TIMEOUTRET3);
+            ecx_config_ports(context, slave, etohs(escsup), etohs(topology), etohs(val16));
          }
-         if ((topology & 0x3000) == 0x2000) /* port2 open and communication established */
-         {
-            h++;
-            b |= 0x04;
-         }
-         if ((topology & 0xc000) == 0x8000) /* port3 open and communication established */
-         {
-            h++;
-            b |= 0x08;
-         }
-         /* ptype = Physical type*/
-         val16 = ecx_FPRDw(context->port, configadr, ECT_REG_PORTDES, EC_TIMEOUTRET3);
-         context->slavelist[slave].ptype = LO_BYTE(etohs(val16));
-         context->slavelist[slave].topology = h;
-         context->slavelist[slave].activeports = b;
-         /* 0=no links, not possible             */
-         /* 1=1 link  , end of line              */
-         /* 2=2 links , one before and one after */
-         /* 3=3 links , split point              */
-         /* 4=4 links , cross point              */
          /* search for parent */
          context->slavelist[slave].parent = 0; /* parent is master */
          if (slave > 1)
@@ -474,7 +718,6 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
             }
             while (slavec > 0);
          }
-         (void)ecx_statecheck(context, slave, EC_STATE_INIT,  EC_TIMEOUTSTATE); //* check state change Init */
 
          /* set default mailbox configuration if slave has mailbox */
          if (context->slavelist[slave].mbx_l>0)
@@ -489,8 +732,6 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
             context->slavelist[slave].SM[1].StartAddr = htoes(context->slavelist[slave].mbx_ro);
             context->slavelist[slave].SM[1].SMlength = htoes(context->slavelist[slave].mbx_rl);
             context->slavelist[slave].SM[1].SMflags = htoel(EC_DEFAULTMBXSM1);
-            eedat = ecx_readeeprom2(context, slave, EC_TIMEOUTEEP);
-            context->slavelist[slave].mbx_proto = (uint16)etohl(eedat);
          }
          cindex = 0;
          /* use configuration table ? */
@@ -499,7 +740,8 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
             cindex = ecx_config_from_table(context, slave);
          }
          /* slave not in configuration table, find out via SII */
-         if (!cindex && !ecx_lookup_prev_sii(context, slave))
+         if (!cindex && !ecx_lookup_prev_sii(context, slave) &&
+             !ecx_siicache_getsii(context, slave))
          {
             ssigen = ecx_siifind(context, slave, ECT_SII_GENERAL);
             /* SII general section */
@@ -568,6 +810,7 @@ int ecx_config_init(ecx_contextt *context, uint8 usetable)
                   context->slavelist[slave].FMMU3func = context->eepFMMU->FMMU3;
                }
             }
+            ecx_siicache_putsii(context, slave);
          }
 
          if (context->slavelist[slave].mbx_l > 0)
@@ -637,6 +880,10 @@ static int ecx_lookup_mapping(ecx_contextt *context, uint16 slave, uint32 *Osize
          *Isize = context->slavelist[i].Ibits;
          context->slavelist[slave].Obits = (uint16)*Osize;
          context->slavelist[slave].Ibits = (uint16)*Isize;
+         if (context->pdodir)
+         {
+            ecx_pdo_copy(context->pdodir, (uint16)i, slave);
+         }
          EC_PRINT("Copy mapping slave %d from %d.\n", slave, i);
          return 1;
       }
@@ -644,58 +891,74 @@ static int ecx_lookup_mapping(ecx_contextt *context, uint16 slave, uint32 *Osize
    return 0;
 }
 
-static int ecx_map_coe_soe(ecx_contextt *context, uint16 slave, int thread_n)
+/** Start the next stage of reading the CoE or SoE mapping of a slave.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = mapping job of slave, stage ECX_MAPJOB_START for a new slave
+ * @return TRUE if a mailbox job is started, FALSE if the mapping is complete
+ */
+static boolean ecx_map_coe_soe(ecx_contextt *context, ec_mapjobt *mj)
 {
+   uint16 slave = mj->slave;
    uint32 Isize, Osize;
-   int rval;
-
-   ecx_statecheck(context, slave, EC_STATE_PRE_OP, EC_TIMEOUTSTATE); /* check state change pre-op */
-
-   EC_PRINT(" >Slave %d, configadr %x, state %2.2x\n",
-            slave, context->slavelist[slave].configadr, context->slavelist[slave].state);
 
-   /* execute special slave configuration hook Pre-Op to Safe-OP */
-   if(context->slavelist[slave].PO2SOconfig) /* only if registered */
+   /* if slave is found in configlist there is nothing to do */
+   if (context->slavelist[slave].configindex)
    {
-      context->slavelist[slave].PO2SOconfig(slave);
+      return FALSE;
    }
-   if (context->slavelist[slave].PO2SOconfigx) /* only if registered */
+   Isize = 0;
+   Osize = 0;
+   if (mj->stage == ECX_MAPJOB_START)
    {
-      context->slavelist[slave].PO2SOconfigx(context, slave);
-   }
-   /* if slave not found in configlist find IO mapping in slave self */
-   if (!context->slavelist[slave].configindex)
-   {
-      Isize = 0;
-      Osize = 0;
       if (context->slavelist[slave].mbx_proto & ECT_MBXPROT_COE) /* has CoE */
       {
-         rval = 0;
-         if (context->slavelist[slave].CoEdetails & ECT_COEDET_SDOCA) /* has Complete Access */
+         /* read PDO mapping via CoE, use Complete Access if available */
+         if (context->slavelist[slave].CoEdetails & ECT_COEDET_SDOCA)
          {
-            /* read PDO mapping via CoE and use Complete Access */
-            rval = ecx_readPDOmapCA(context, slave, thread_n, &Osize, &Isize);
+            ecx_PDOmapjob(context, &(mj->u.coe), slave, TRUE);
+            mj->stage = ECX_MAPJOB_COECA;
          }
-         if (!rval) /* CA not available or not succeeded */
+         else
          {
-            /* read PDO mapping via CoE */
-            rval = ecx_readPDOmap(context, slave, &Osize, &Isize);
+            ecx_PDOmapjob(context, &(mj->u.coe), slave, FALSE);
+            mj->stage = ECX_MAPJOB_COE;
          }
-         EC_PRINT("  CoE Osize:%u Isize:%u\n", Osize, Isize);
+         return TRUE;
       }
-      if ((!Isize && !Osize) && (context->slavelist[slave].mbx_proto & ECT_MBXPROT_SOE)) /* has SoE */
+   }
+   else if (mj->stage != ECX_MAPJOB_SOE)
+   {
+      Osize = mj->u.coe.Osize;
+      Isize = mj->u.coe.Isize;
+      if (!Isize && !Osize && (mj->stage == ECX_MAPJOB_COECA)) /* CA not succeeded */
       {
-         /* read AT / MDT mapping via SoE */
-         rval = ecx_readIDNmap(context, slave, &Osize, &Isize);
-         context->slavelist[slave].SM[2].SMlength = htoes((uint16)((Osize + 7) / 8));
-         context->slavelist[slave].SM[3].SMlength = htoes((uint16)((Isize + 7) / 8));
-         EC_PRINT("  SoE Osize:%u Isize:%u\n", Osize, Isize);
+         /* read PDO mapping via CoE */
+         ecx_PDOmapjob(context, &(mj->u.coe), slave, FALSE);
+         mj->stage = ECX_MAPJOB_COE;
+         return TRUE;
       }
-      context->slavelist[slave].Obits = (uint16)Osize;
-      context->slavelist[slave].Ibits = (uint16)Isize;
+      EC_PRINT("  CoE Osize:%u Isize:%u\n", Osize, Isize);
+   }
+   else
+   {
+      Osize = mj->u.soe.Osize;
+      Isize = mj->u.soe.Isize;
+      context->slavelist[slave].SM[2].SMlength = htoes((uint16)((Osize + 7) / 8));
+      context->slavelist[slave].SM[3].SMlength = htoes((uint16)((Isize + 7) / 8));
+      EC_PRINT("  SoE Osize:%u Isize:%u\n", Osize, Isize);
+   }
+   if ((mj->stage != ECX_MAPJOB_SOE) && (!Isize && !Osize) &&
+       (context->slavelist[slave].mbx_proto & ECT_MBXPROT_SOE)) /* has SoE */
+   {
+      /* read AT / MDT mapping via SoE */
+      ecx_IDNmapjob(context, &(mj->u.soe), slave);
+      mj->stage = ECX_MAPJOB_SOE;
+      return TRUE;
    }
+   context->slavelist[slave].Obits = (uint16)Osize;
+   context->slavelist[slave].Ibits = (uint16)Isize;
 
-   return 1;
+   return FALSE;
 }
 
 static int ecx_map_sii(ecx_contextt *context, uint16 slave)
@@ -711,7 +974,9 @@ static int ecx_map_sii(ecx_contextt *context, uint16 slave)
    {
       (void)ecx_lookup_mapping(context, slave, &Osize, &Isize);
    }
-   if (!Isize && !Osize) /* find PDO mapping by SII */
+   /* find PDO mapping by SII, the cache holds no entries for the PDO directory */
+   if (!Isize && !Osize &&
+       (context->pdodir || !ecx_siicache_getmap(context, slave, &Osize, &Isize)))
    {
       memset(&eepPDO, 0, sizeof(eepPDO));
       Isize = ecx_siiPDO(context, slave, &eepPDO, 0);
@@ -736,6 +1001,11 @@ static int ecx_map_sii(ecx_contextt *context, uint16 slave)
             EC_PRINT("    SM%d length %d\n", nSM, eepPDO.SMbitsize[nSM]);
          }
       }
+      ecx_siicache_putmap(context, slave, Osize, Isize);
+      if (context->pdodir)
+      {
+         ecx_pdo_readsii(context, slave);
+      }
    }
    context->slavelist[slave].Obits = (uint16)Osize;
    context->slavelist[slave].Ibits = (uint16)Isize;
@@ -808,86 +1078,102 @@ static int ecx_map_sm(ecx_contextt *context, uint16 slave)
    return 1;
 }
 
-#if EC_MAX_MAPT > 1
-OSAL_THREAD_FUNC ecx_mapper_thread(void *param)
-{
-   ecx_mapt_t *maptp;
-   maptp = param;
-   ecx_map_coe_soe(maptp->context, maptp->slave, maptp->thread_n);
-   maptp->running = 0;
-}
-
-static int ecx_find_mapt(void)
+static void ecx_config_find_mappings(ecx_contextt *context, uint8 group)
 {
-   int p;
-   p = 0;
-   while((p < EC_MAX_MAPT) && ecx_mapt[p].running)
+   ec_mbxjobt *job[EC_MAXMAPJOB];
+   ec_mapjobt one, *mapjob;
+   uint16 slave, next;
+   uint16 list[EC_MAXWAITLIST];
+   int i, n, nmapjob;
+
+   /* wait for state change pre-op of all slaves of the group, the request
+    * went to all of them so later parts of the list are mostly there */
+   if (!group)
    {
-      p++;
+      (void)ecx_statewait(context, 0, NULL, EC_STATE_PRE_OP, EC_TIMEOUTSTATE);
    }
-   if(p < EC_MAX_MAPT)
+   n = 0;
+   for (slave = 1; group && (slave <= *(context->slavecount)); slave++)
    {
-      return p;
+      if (group == context->slavelist[slave].group)
+      {
+         list[n++] = slave;
+      }
+      if ((n == EC_MAXWAITLIST) || ((slave == *(context->slavecount)) && n))
+      {
+         (void)ecx_statewait(context, n, list, EC_STATE_PRE_OP, EC_TIMEOUTSTATE);
+         n = 0;
+      }
    }
-   else
+   for (slave = 1; slave <= *(context->slavecount); slave++)
    {
-      return -1;
+      if (!group || (group == context->slavelist[slave].group))
+      {
+         EC_PRINT(" >Slave %d, configadr %x, state %2.2x\n",
+                  slave, context->slavelist[slave].configadr, context->slavelist[slave].state);
+         /* execute special slave configuration hook Pre-Op to Safe-OP */
+         if(context->slavelist[slave].PO2SOconfig) /* only if registered */
+         {
+            context->slavelist[slave].PO2SOconfig(slave);
+         }
+         if (context->slavelist[slave].PO2SOconfigx) /* only if registered */
+         {
+            context->slavelist[slave].PO2SOconfigx(context, slave);
+         }
+      }
    }
-}
-#endif
-
-static int ecx_get_threadcount(void)
-{
-   int thrc, thrn;
-   thrc = 0;
-   for(thrn = 0 ; thrn < EC_MAX_MAPT ; thrn++)
+   /* find CoE and SoE mapping of slaves, the mailbox jobs of up to
+    * maxmapjob slaves run together, one at a time without mapjob */
+   mapjob = context->mapjob;
+   nmapjob = context->maxmapjob;
+   if (!mapjob || (nmapjob < 1))
    {
-      thrc += ecx_mapt[thrn].running;
+      mapjob = &one;
+      nmapjob = 1;
    }
-   return thrc;
-}
-
-static void ecx_config_find_mappings(ecx_contextt *context, uint8 group)
-{
-   int thrn, thrc;
-   uint16 slave;
-
-   for (thrn = 0; thrn < EC_MAX_MAPT; thrn++)
+   if (nmapjob > EC_MAXMAPJOB)
    {
-      ecx_mapt[thrn].running = 0;
+      nmapjob = EC_MAXMAPJOB;
    }
-   /* find CoE and SoE mapping of slaves in multiple threads */
-   for (slave = 1; slave <= *(context->slavecount); slave++)
+   for (i = 0; i < nmapjob; i++)
    {
-      if (!group || (group == context->slavelist[slave].group))
+      mapjob[i].slave = 0;
+      mapjob[i].u.job.state = EC_MBXJOB_IDLE;
+   }
+   next = 1;
+   do
+   {
+      n = 0;
+      for (i = 0; i < nmapjob; i++)
       {
-#if EC_MAX_MAPT > 1
-            /* multi-threaded version */
-            while ((thrn = ecx_find_mapt()) < 0)
+         /* next stage of slave when its job is finished, or next slave */
+         while ((mapjob[i].u.job.state == EC_MBXJOB_IDLE) &&
+                (mapjob[i].slave || (next <= *(context->slavecount))))
+         {
+            if (mapjob[i].slave && ecx_map_coe_soe(context, &mapjob[i]))
             {
-               osal_usleep(1000);
+               break;
             }
-            ecx_mapt[thrn].context = context;
-            ecx_mapt[thrn].slave = slave;
-            ecx_mapt[thrn].thread_n = thrn;
-            ecx_mapt[thrn].running = 1;
-            osal_thread_create(&(ecx_threadh[thrn]), 128000,
-               &ecx_mapper_thread, &(ecx_mapt[thrn]));
-#else
-            /* serialised version */
-            ecx_map_coe_soe(context, slave, 0);
-#endif
+            mapjob[i].slave = 0;
+            for (; (next <= *(context->slavecount)) && !mapjob[i].slave; next++)
+            {
+               if (!group || (group == context->slavelist[next].group))
+               {
+                  mapjob[i].slave = next;
+                  mapjob[i].stage = ECX_MAPJOB_START;
+               }
+            }
+         }
+         if (mapjob[i].u.job.state != EC_MBXJOB_IDLE)
+         {
+            job[n++] = &(mapjob[i].u.job);
+         }
       }
-   }
-   /* wait for all threads to finish */
-   do
-   {
-      thrc = ecx_get_threadcount();
-      if (thrc)
+      if (n > 0)
       {
-         osal_usleep(1000);
+         (void)ecx_mbxjob_poll(context, job, n);
       }
-   } while (thrc);
+   } while (n > 0);
    /* find SII mapping of slave and program SM */
    for (slave = 1; slave <= *(context->slavecount); slave++)
    {
@@ -1166,6 +1452,80 @@ static void ecx_config_create_output_mappings(ecx_contextt *context, void *pIOma
    context->slavelist[slave].FMMUunused = FMMUc;
 }
 
+/** Map the SM1 status byte of a mailbox slave through a spare FMMU.
+ *
+ * @param[in]  context = context struct
+ * @param[in]  pIOmap  = pointer to IOmap
+ * @param[in]  group   = group to map, 0 = all groups
+ * @param[in]  slave   = slave number
+ * @param[in,out] LogAddr = logical address of the status byte, incremented when mapped
+ * @return TRUE if mapped
+ */
+static boolean ecx_config_create_mbxstatus_mapping(ecx_contextt *context, void *pIOmap,
+   uint8 group, uint16 slave, uint32 * LogAddr)
+{
+   uint8 FMMUc;
+
+   FMMUc = context->slavelist[slave].FMMUunused;
+   if (!context->slavelist[slave].mbx_rl || (FMMUc >= EC_MAXFMMU))
+   {
+      return FALSE;
+   }
+   EC_PRINT(" =Slave %d, MBXSTATUS MAPPING FMMU %d\n", slave, FMMUc);
+   context->slavelist[slave].FMMU[FMMUc].LogStart = htoel(*LogAddr);
+   context->slavelist[slave].FMMU[FMMUc].LogLength = htoes(1);
+   context->slavelist[slave].FMMU[FMMUc].LogStartbit = 0;
+   context->slavelist[slave].FMMU[FMMUc].LogEndbit = 7;
+   context->slavelist[slave].FMMU[FMMUc].PhysStart = htoes(ECT_REG_SM1STAT);
+   context->slavelist[slave].FMMU[FMMUc].PhysStartBit = 0;
+   context->slavelist[slave].FMMU[FMMUc].FMMUtype = 1;
+   context->slavelist[slave].FMMU[FMMUc].FMMUactive = 1;
+   /* program FMMU for SM1 status */
+   ecx_FPWR(context->port, context->slavelist[slave].configadr,
+      ECT_REG_FMMU0 + (sizeof(ec_fmmut) * FMMUc),
+      sizeof(ec_fmmut), &(context->slavelist[slave].FMMU[FMMUc]), EC_TIMEOUTRET3);
+   context->slavelist[slave].mbxstatus = (uint8 *)(pIOmap) + *LogAddr;
+   if (group)
+   {
+      context->slavelist[slave].mbxstatus -= context->grouplist[group].logstartaddr;
+   }
+   *(context->slavelist[slave].mbxstatus) = 0;
+   context->slavelist[slave].FMMUunused = FMMUc + 1;
+   *LogAddr += 1;
+
+   return TRUE;
+}
+
+/** Test if the inputs of a slave end at or after a logical offset.
+ *
+ * @param[in]  context = context struct
+ * @param[in]  pIOmap  = pointer to IOmap
+ * @param[in]  slave   = slave number
+ * @param[in]  offset  = offset in IOmap
+ * @return TRUE if the last input byte is at or after offset
+ */
+static boolean ecx_config_inputs_from(ecx_contextt *context, void *pIOmap,
+   uint16 slave, uint32 offset)
+{
+   uint32 last;
+
+   if (!context->slavelist[slave].Ibits || !context->slavelist[slave].inputs)
+   {
+      return FALSE;
+   }
+   last = (uint32)(context->slavelist[slave].inputs - (uint8 *)pIOmap);
+   if (context->slavelist[slave].Ibytes)
+   {
+      last += context->slavelist[slave].Ibytes - 1;
+   }
+   else
+   {
+      last += (context->slavelist[slave].Istartbit + context->slavelist[slave].Ibits - 1) / 8;
+   }
+
+   return (last >= offset);
+}
+
 static int ecx_main_config_map_group(ecx_contextt *context, void *pIOmap, uint8 group, boolean forceByteAlignment)
 {
    uint16 slave, configadr;
@@ -1334,6 +1694,33 @@ static int ecx_main_config_map_group(ecx_contextt *context, void *pIOmap, uint8
          }
          segmentsize += 1;
       }
+
+      /* do SM1 status mapping of mailbox slaves behind the inputs */
+      for (slave = 1; slave <= *(context->slavecount); slave++)
+      {
+         if (!group || (group == context->slavelist[slave].group))
+         {
+            context->slavelist[slave].mbxstatus = NULL;
+            if (context->mbxstatusmap &&
+                ecx_config_create_mbxstatus_mapping(context, pIOmap, group, slave, &LogAddr))
+            {
+               oLogAddr = LogAddr;
+               if ((segmentsize + 1) > segmentmaxsize && currentsegment < EC_MAXIOSEGMENTS)
+               {
+                  context->grouplist[group].IOsegment[currentsegment++] = segmentsize;
+                  segmentsize = 0;
+                  segmentmaxsize = EC_MAXLRWDATA; /* can ignore DC overhead after first segment */
+               }
+               segmentsize += 1;
+               /* the slave counts once per datagram it is read by */
+               if (!ecx_config_inputs_from(context, pIOmap, slave,
+                     LogAddr - context->grouplist[group].logstartaddr - segmentsize))
+               {
+                  context->grouplist[group].inputsWKC++;
+               }
+            }
+         }
+      }
       context->grouplist[group].IOsegment[currentsegment] = segmentsize;
       context->grouplist[group].nsegments = currentsegment + 1;
       context->grouplist[group].inputs = (uint8 *)(pIOmap) + context->grouplist[group].Obytes;
@@ -1350,6 +1737,11 @@ static int ecx_main_config_map_group(ecx_contextt *context, void *pIOmap, uint8
 
       EC_PRINT("IOmapSize %d\n", LogAddr - context->grouplist[group].logstartaddr);
 
+      if (context->grouplist[group].prepare)
+      {
+         ecx_prepare_group(context, group, FALSE);
+      }
+
       return (LogAddr - context->grouplist[group].logstartaddr);
    }
 
@@ -1534,6 +1926,11 @@ int ecx_config_overlap_map_group(ecx_contextt *context, void *pIOmap, uint8 grou
 
       EC_PRINT("IOmapSize %d\n", context->grouplist[group].Obytes + context->grouplist[group].Ibytes);
 
+      if (context->grouplist[group].prepare)
+      {
+         ecx_prepare_group(context, group, TRUE);
+      }
+
       return (context->grouplist[group].Obytes + context->grouplist[group].Ibytes);
    }
 
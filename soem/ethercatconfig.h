@@ -19,6 +19,33 @@ extern "C"
 #define EC_NODEOFFSET      0x1000
 #define EC_TEMPNODE        0xffff
 
+/** maximum number of slaves whose CoE or SoE mapping is read at the same
+ * time, see ecx_contextt.maxmapjob */
+#ifndef EC_MAXMAPJOB
+#define EC_MAXMAPJOB       64
+#endif
+/** number of mapping jobs of the default context, each takes about 3 KiB.
+ * Define it smaller to save memory, mapping then takes longer */
+#ifndef EC_MAPJOBS
+#define EC_MAPJOBS         EC_MAXMAPJOB
+#endif
+
+/** CoE or SoE mapping of one slave, see ecx_contextt.mapjob */
+struct ec_mapjob
+{
+   /** slave number, 0 if unused */
+   uint16 slave;
+   /** internal, stage of the mapping */
+   int stage;
+   /** internal, mailbox job of the stage */
+   union
+   {
+      ec_mbxjobt job;
+      ec_PDOmapjobt coe;
+      ec_IDNmapjobt soe;
+   } u;
+};
+
 #ifdef EC_VER1
 int ec_config_init(uint8 usetable);
 int ec_config_map(void *pIOmap);
@@ -74,9 +74,10 @@ ec_groupt               ec_group[EC_MAXGROUP];
 static uint8            ec_esibuf[EC_MAXEEPBUF];
 /** bitmap for filled cache buffer bytes */
 static uint32           ec_esimap[EC_MAXEEPBITMAP];
+/** SII cache of multiple slaves */
+static ec_eepcachet     ec_eepcache;
 /** current slave for EEPROM cache buffer */
 static ec_eringt        ec_elist;
-static ec_idxstackT     ec_idxstack;
 
 /** SyncManager Communication Type struct to store data of one slave */
 static ec_SMcommtypet   ec_SMcommtype[EC_MAX_MAPT];
@@ -85,6 +86,9 @@ static ec_PDOassignt    ec_PDOassign[EC_MAX_MAPT];
 /** PDO description struct to store data of one slave */
 static ec_PDOdesct      ec_PDOdesc[EC_MAX_MAPT];
 
+/** jobs reading the CoE and SoE mappings */
+static ec_mapjobt       ec_mapjob[EC_MAPJOBS];
+
 /** buffer for EEPROM SM data */
 static ec_eepromSMt     ec_SM;
 /** buffer for EEPROM FMMU data */
@@ -108,7 +112,7 @@ ecx_contextt  ecx_context = {
     &ec_esimap[0],      // .esimap        =
     0,                  // .esislave      =
     &ec_elist,          // .elist         =
-    &ec_idxstack,       // .idxstack      =
+    NULL,               // .idxstack      =
     &EcatError,         // .ecaterror     =
     &ec_DCtime,         // .DCtime        =
     &ec_SMcommtype[0],  // .SMcommtype    =
@@ -120,6 +124,14 @@ ecx_contextt  ecx_context = {
     NULL,               // .EOEhook()
     0,                  // .manualstatechange
     NULL,               // .userdata
+    NULL,               // .stats
+    NULL,               // .siicache
+    &ec_eepcache,       // .eepcache
+    FALSE,              // .batchdiscovery
+    FALSE,              // .mbxstatusmap
+    NULL,               // .pdodir
+    &ec_mapjob[0],      // .mapjob
+    EC_MAPJOBS,         // .maxmapjob
 };
 #endif
 
@@ -322,9 +334,144 @@ void ecx_close(ecx_contextt *context)
    ecx_closenic(context->port);
 };
 
+/** Read one EEPROM address of a slave into a cache buffer.
+ *  Depending on the slave capabilities the request is 4 or 8 bytes.
+ *  @param[in]  context = context struct
+ *  @param[in]  slave   = slave number
+ *  @param[in]  eadr    = eeprom address in words
+ *  @param[out] buf     = cache buffer of EC_MAXEEPBUF bytes
+ *  @param[out] map     = bitmap of cached bytes in buf
+ */
+static void ecx_siireadword(ecx_contextt *context, uint16 slave, uint16 eadr, uint8 *buf, uint32 *map)
+{
+   uint16 configadr, mapw, mapb;
+   uint64 edat64;
+   uint32 edat32;
+   uint8 edat[8];
+   int lp, cnt;
+
+   configadr = context->slavelist[slave].configadr;
+   ecx_eeprom2master(context, slave); /* set eeprom control to master */
+   edat64 = ecx_readeepromFP (context, configadr, eadr, EC_TIMEOUTEEP);
+   /* 8 byte response */
+   if (context->slavelist[slave].eep_8byte)
+   {
+      put_unaligned64(edat64, edat);
+      cnt = 8;
+   }
+   /* 4 byte response */
+   else
+   {
+      edat32 = (uint32)edat64;
+      put_unaligned32(edat32, edat);
+      cnt = 4;
+   }
+   /* do not write beyond end of buffer */
+   if ((eadr << 1) + cnt > EC_MAXEEPBUF)
+   {
+      cnt = EC_MAXEEPBUF - (eadr << 1);
+   }
+   memcpy(&(buf[eadr << 1]), edat, cnt);
+   /* find bitmap location */
+   mapw = eadr >> 4;
+   mapb = (uint16)((eadr << 1) - (mapw << 5));
+   for(lp = 0 ; lp < cnt ; lp++)
+   {
+      /* set bitmap for each byte that is read */
+      map[mapw] |= (1U << mapb);
+      mapb++;
+      if (mapb > 31)
+      {
+         mapb = 0;
+         mapw++;
+      }
+   }
+}
+
+/** Find or assign the SII cache slot of a slave.
+ *  @param[in] context = context struct
+ *  @param[in] slave   = slave number
+ *  @return cache slot
+ */
+static ec_eepslott *ecx_siislot(ecx_contextt *context, uint16 slave)
+{
+   ec_eepcachet *cache = context->eepcache;
+   ec_eepslott *slot;
+   uint16 i, nslot, lru;
+
+   nslot = cache->nslot;
+   if ((nslot == 0) || (nslot > EC_MAXEEPSLOT))
+   {
+      nslot = EC_MAXEEPSLOT;
+   }
+   slot = &cache->slot[cache->last];
+   if (slot->slave != slave)
+   {
+      lru = 0;
+      for (i = 0; i < nslot; i++)
+      {
+         if (cache->slot[i].slave == slave)
+         {
+            break;
+         }
+         /* prefer a free slot, else the least recently used one */
+         if ((cache->slot[lru].slave != 0) &&
+             ((cache->slot[i].slave == 0) ||
+              (cache->slot[i].lastuse < cache->slot[lru].lastuse)))
+         {
+            lru = i;
+         }
+      }
+      if (i == nslot)
+      {
+         i = lru;
+         slot = &cache->slot[i];
+         slot->slave = slave;
+         slot->ncat = 0;
+         slot->catnext = ECT_SII_START << 1;
+         memset(slot->map, 0x00, sizeof(slot->map));
+      }
+      cache->last = i;
+      slot = &cache->slot[i];
+   }
+   slot->lastuse = ++cache->usecount;
+
+   return slot;
+}
+
+/** Clear the SII cache of a slave. Needed after the EEPROM was written.
+ *  @param[in] context = context struct
+ *  @param[in] slave   = slave number, 0 clears the cache of all slaves
+ */
+void ecx_siiclear(ecx_contextt *context, uint16 slave)
+{
+   ec_eepcachet *cache = context->eepcache;
+   int i;
+
+   if (cache)
+   {
+      for (i = 0; i < EC_MAXEEPSLOT; i++)
+      {
+         if (!slave || (cache->slot[i].slave == slave))
+         {
+            cache->slot[i].slave = 0;
+            cache->slot[i].ncat = 0;
+            cache->slot[i].lastuse = 0;
+         }
+      }
+   }
+   if (context->esimap && (!slave || (context->esislave == slave)))
+   {
+      memset(context->esimap, 0x00, EC_MAXEEPBITMAP * sizeof(uint32));
+      context->esislave = 0;
+   }
+}
+
 /** Read one byte from slave EEPROM via cache.
  *  If the cache location is empty then a read request is made to the slave.
  *  Depending on the slave capabilities the request is 4 or 8 bytes.
+ *  With context->eepcache the SII of several slaves is cached, else only
+ *  the SII of the last accessed slave.
  *  @param[in] context = context struct
  *  @param[in] slave   = slave number
  *  @param[in] address = eeprom address in bytes (slave uses words)
@@ -332,70 +479,93 @@ void ecx_close(ecx_contextt *context)
  */
 uint8 ecx_siigetbyte(ecx_contextt *context, uint16 slave, uint16 address)
 {
-   uint16 configadr, eadr;
-   uint64 edat64;
-   uint32 edat32;
-   uint16 mapw, mapb;
-   int lp,cnt;
-   uint8 retval;
+   ec_eepslott *slot;
+   uint8 *buf;
+   uint32 *map;
 
-   retval = 0xff;
-   if (slave != context->esislave) /* not the same slave? */
+   if (context->eepcache && slave)
    {
-      memset(context->esimap, 0x00, EC_MAXEEPBITMAP * sizeof(uint32)); /* clear esibuf cache map */
-      context->esislave = slave;
+      slot = ecx_siislot(context, slave);
+      buf = slot->buf;
+      map = slot->map;
    }
-   if (address < EC_MAXEEPBUF)
+   else
    {
-      mapw = address >> 5;
-      mapb = (uint16)(address - (mapw << 5));
-      if (context->esimap[mapw] & (1U << mapb))
+      if (slave != context->esislave) /* not the same slave? */
       {
-         /* byte is already in buffer */
-         retval = context->esibuf[address];
+         memset(context->esimap, 0x00, EC_MAXEEPBITMAP * sizeof(uint32)); /* clear esibuf cache map */
+         context->esislave = slave;
       }
-      else
+      buf = context->esibuf;
+      map = context->esimap;
+   }
+   if (address >= EC_MAXEEPBUF)
+   {
+      return 0xff;
+   }
+   /* byte is not in buffer, put it there */
+   if (!(map[address >> 5] & (1U << (address & 0x1f))))
+   {
+      ecx_siireadword(context, slave, address >> 1, buf, map);
+   }
+
+   return buf[address];
+}
+
+/** Find a category in the category index of a slave. Category headers
+ *  not yet in the index are read until the category is found.
+ *  @param[in] context = context struct
+ *  @param[in] slot    = cache slot of slave
+ *  @param[in] cat     = section category
+ *  @return byte address of section at section length entry, if not available then 0
+ */
+static int16 ecx_siiindex(ecx_contextt *context, ec_eepslott *slot, uint16 cat)
+{
+   uint16 a, p, l, i, next;
+
+   for (i = 0; i < slot->ncat; i++)
+   {
+      if (slot->cat[i] == cat)
       {
-         /* byte is not in buffer, put it there */
-         configadr = context->slavelist[slave].configadr;
-         ecx_eeprom2master(context, slave); /* set eeprom control to master */
-         eadr = address >> 1;
-         edat64 = ecx_readeepromFP (context, configadr, eadr, EC_TIMEOUTEEP);
-         /* 8 byte response */
-         if (context->slavelist[slave].eep_8byte)
-         {
-            put_unaligned64(edat64, &(context->esibuf[eadr << 1]));
-            cnt = 8;
-         }
-         /* 4 byte response */
-         else
-         {
-            edat32 = (uint32)edat64;
-            put_unaligned32(edat32, &(context->esibuf[eadr << 1]));
-            cnt = 4;
-         }
-         /* find bitmap location */
-         mapw = eadr >> 4;
-         mapb = (uint16)((eadr << 1) - (mapw << 5));
-         for(lp = 0 ; lp < cnt ; lp++)
+         return (int16)slot->catpos[i];
+      }
+   }
+   a = slot->catnext;
+   while (a)
+   {
+      p = ecx_siigetbyte(context, slot->slave, a);
+      p += (ecx_siigetbyte(context, slot->slave, a + 1) << 8);
+      l = ecx_siigetbyte(context, slot->slave, a + 2);
+      l += (ecx_siigetbyte(context, slot->slave, a + 3) << 8);
+      next = a + 4 + (l << 1);
+      if ((p == 0xffff) || ((uint32)a + 4 + ((uint32)l << 1) >= EC_MAXEEPBUF))
+      {
+         next = 0; /* end of SII */
+      }
+      /* categories beyond a full index are searched but not stored */
+      if (slot->ncat < EC_MAXEEPCAT)
+      {
+         slot->catnext = next;
+         if (p != 0xffff)
          {
-            /* set bitmap for each byte that is read */
-            context->esimap[mapw] |= (1U << mapb);
-            mapb++;
-            if (mapb > 31)
-            {
-               mapb = 0;
-               mapw++;
-            }
+            slot->cat[slot->ncat] = p;
+            slot->catpos[slot->ncat] = a + 2;
+            slot->ncat++;
          }
-         retval = context->esibuf[address];
       }
+      if (p == cat)
+      {
+         return (int16)(a + 2);
+      }
+      a = next;
    }
 
-   return retval;
+   return 0;
 }
 
 /** Find SII section header in slave EEPROM.
+ *  With context->eepcache the section is looked up in the category index
+ *  of the slave.
  *  @param[in]  context        = context struct
  *  @param[in] slave   = slave number
  *  @param[in] cat     = section category
@@ -407,25 +577,32 @@ int16 ecx_siifind(ecx_contextt *context, uint16 slave, uint16 cat)
    uint16 p;
    uint8 eectl = context->slavelist[slave].eep_pdi;
 
-   a = ECT_SII_START << 1;
-   /* read first SII section category */
-   p = ecx_siigetbyte(context, slave, a++);
-   p += (ecx_siigetbyte(context, slave, a++) << 8);
-   /* traverse SII while category is not found and not EOF */
-   while ((p != cat) && (p != 0xffff))
+   if (context->eepcache && slave)
    {
-      /* read section length */
-      p = ecx_siigetbyte(context, slave, a++);
-      p += (ecx_siigetbyte(context, slave, a++) << 8);
-      /* locate next section category */
-      a += p << 1;
-      /* read section category */
-      p = ecx_siigetbyte(context, slave, a++);
-      p += (ecx_siigetbyte(context, slave, a++) << 8);
+      a = ecx_siiindex(context, ecx_siislot(context, slave), cat);
    }
-   if (p != cat)
+   else
    {
-      a = 0;
+      a = ECT_SII_START << 1;
+      /* read first SII section category */
+      p = ecx_siigetbyte(context, slave, a++);
+      p += (ecx_siigetbyte(context, slave, a++) << 8);
+      /* traverse SII while category is not found and not EOF */
+      while ((p != cat) && (p != 0xffff))
+      {
+         /* read section length */
+         p = ecx_siigetbyte(context, slave, a++);
+         p += (ecx_siigetbyte(context, slave, a++) << 8);
+         /* locate next section category */
+         a += p << 1;
+         /* read section category */
+         p = ecx_siigetbyte(context, slave, a++);
+         p += (ecx_siigetbyte(context, slave, a++) << 8);
+      }
+      if (p != cat)
+      {
+         a = 0;
+      }
    }
    if (eectl)
    {
@@ -689,6 +866,10 @@ int ecx_FPRD_multi(ecx_contextt *context, int n, uint16 *configlst, ec_alstatust
 
    port = context->port;
    idx = ecx_getindex(port);
+   if (idx == EC_NOINDEX)
+   {
+      return EC_NOFRAME;
+   }
    slcnt = 0;
    ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_FPRD, idx,
       *(configlst + slcnt), ECT_REG_ALSTAT, sizeof(ec_alstatust), slstatlst + slcnt);
@@ -904,6 +1085,157 @@ uint16 ecx_statecheck(ecx_contextt *context, uint16 slave, uint16 reqstate, int
    return state;
 }
 
+/** Wait until a set of slaves is in the requested state.
+ * All slaves of the set are polled together every EC_STATEPOLL us, with one
+ * broadcast if the set holds all slaves and else with one datagram per
+ * slave that has not yet arrived, MAX_FPRD_MULTI per ecx_transaction().
+ * The wait ends as soon as the last slave arrived, so it takes as long as the
+ * slowest slave. The state and AL status code of the slaves are updated in
+ * slavelist, a slave that could not be read is left at EC_STATE_NONE.
+ * @param[in] context     = context struct
+ * @param[in] n           = number of slaves in list
+ * @param[in] list        = slave numbers, NULL for all slaves
+ * @param[in] reqstate    = Requested state
+ * @param[in] timeout     = Timeout value in us
+ * @return number of slaves not in the requested state after timeout, 0 if all arrived
+ */
+int ecx_statewait(ecx_contextt *context, int n, const uint16 *list, uint16 reqstate, int timeout)
+{
+   ec_datagramt dg[MAX_FPRD_MULTI];
+   ec_alstatust sl[MAX_FPRD_MULTI];
+   uint16 slv[MAX_FPRD_MULTI];
+   uint16 slave, rval;
+   int npending, i, j, m, wkc;
+   osal_timert timer;
+
+   osal_timer_start(&timer, timeout);
+   if (!list)
+   {
+      n = *(context->slavecount);
+   }
+   reqstate &= 0x0f;
+   /* state is unknown until read, a slave is pending while its state
+    * differs from the requested one */
+   for (i = 0; i < n; i++)
+   {
+      context->slavelist[list ? list[i] : (uint16)(i + 1)].state = EC_STATE_NONE;
+   }
+   npending = n;
+   while (npending > 0)
+   {
+      /* BOOT state can not be told apart from INIT | PRE_OP in a broadcast */
+      if (!list && (reqstate != EC_STATE_BOOT))
+      {
+         rval = 0;
+         wkc = ecx_BRD(context->port, 0, ECT_REG_ALSTAT, sizeof(rval), &rval, EC_TIMEOUTRET);
+         rval = etohs(rval);
+         if ((wkc >= *(context->slavecount)) && ((rval & (0x0f | EC_STATE_ERROR)) == reqstate))
+         {
+            for (i = 0; i < n; i++)
+            {
+               context->slavelist[i + 1].state = reqstate;
+               context->slavelist[i + 1].ALstatuscode = 0x0000;
+            }
+            npending = 0;
+            break;
+         }
+      }
+      /* read AL status of slaves not yet arrived, MAX_FPRD_MULTI at a time */
+      npending = 0;
+      i = 0;
+      while (i < n)
+      {
+         m = 0;
+         for (; (i < n) && (m < MAX_FPRD_MULTI); i++)
+         {
+            slave = list ? list[i] : (uint16)(i + 1);
+            if ((context->slavelist[slave].state & 0x0f) == reqstate)
+            {
+               continue;
+            }
+            memset(&sl[m], 0, sizeof(sl[m]));
+            slv[m] = slave;
+            dg[m].command = EC_CMD_FPRD;
+            dg[m].ADP = context->slavelist[slave].configadr;
+            dg[m].ADO = ECT_REG_ALSTAT;
+            dg[m].length = sizeof(ec_alstatust);
+            dg[m].data = &sl[m];
+            m++;
+         }
+         if (m == 0)
+         {
+            break;
+         }
+         ecx_transaction(context->port, dg, m, EC_TIMEOUTRET);
+         for (j = 0; j < m; j++)
+         {
+            slave = slv[j];
+            if (dg[j].wkc > 0)
+            {
+               context->slavelist[slave].state = etohs(sl[j].alstatus);
+               context->slavelist[slave].ALstatuscode = etohs(sl[j].alstatuscode);
+            }
+            if ((dg[j].wkc <= 0) || ((context->slavelist[slave].state & 0x0f) != reqstate))
+            {
+               npending++;
+            }
+         }
+      }
+      if ((npending == 0) || osal_timer_is_expired(&timer))
+      {
+         break;
+      }
+      osal_usleep(EC_STATEPOLL);
+   }
+
+   return npending;
+}
+
+/** Request a state for a set of slaves and wait until all of them are in
+ * that state, see ecx_statewait(). The request is one broadcast if the set
+ * holds all slaves and else one datagram per slave.
+ * @param[in] context     = context struct
+ * @param[in] n           = number of slaves in list
+ * @param[in] list        = slave numbers, NULL for all slaves
+ * @param[in] reqstate    = Requested state, EC_STATE_ACK may be added
+ * @param[in] timeout     = Timeout value in us
+ * @return number of slaves not in the requested state after timeout, 0 if all arrived
+ */
+int ecx_statechange(ecx_contextt *context, int n, const uint16 *list, uint16 reqstate, int timeout)
+{
+   ec_datagramt dg[MAX_FPRD_MULTI];
+   uint16 slstate;
+   int i, j, m;
+
+   slstate = htoes(reqstate);
+   if (!list)
+   {
+      ecx_BWR(context->port, 0, ECT_REG_ALCTL, sizeof(slstate), &slstate, EC_TIMEOUTRET3);
+   }
+   else
+   {
+      for (i = 0; i < n; i += MAX_FPRD_MULTI)
+      {
+         m = n - i;
+         if (m > MAX_FPRD_MULTI)
+         {
+            m = MAX_FPRD_MULTI;
+         }
+         for (j = 0; j < m; j++)
+         {
+            dg[j].command = EC_CMD_FPWR;
+            dg[j].ADP = context->slavelist[list[i + j]].configadr;
+            dg[j].ADO = ECT_REG_ALCTL;
+            dg[j].length = sizeof(slstate);
+            dg[j].data = &slstate;
+         }
+         ecx_transaction(context->port, dg, m, EC_TIMEOUTRET3);
+      }
+   }
+
+   return ecx_statewait(context, n, list, reqstate, timeout);
+}
+
 /** Get index of next mailbox counter value.
  * Used for Mailbox Link Layer.
  * @param[in] cnt     = Mailbox counter value [0..7]
@@ -995,8 +1327,64 @@ int ecx_mbxsend(ecx_contextt *context, uint16 slave,ec_mbxbuft *mbx, int timeout
    return wkc;
 }
 
+/** Handle OUT mailbox from slave that is no response to a request.
+ * Mailbox errors and CoE emergencies are reported, EoE fragments are passed
+ * to the EoE hook.
+ * @param[in]  context    = context struct
+ * @param[in]  slave      = Slave number
+ * @param[in]  mbx        = Mailbox data
+ * @return TRUE if the mailbox is handled
+ */
+static boolean ecx_mbxhandled(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx)
+{
+   ec_mbxheadert *mbxh;
+   ec_emcyt *EMp;
+   ec_mbxerrort *MBXEp;
+
+   mbxh = (ec_mbxheadert *)mbx;
+   if ((mbxh->mbxtype & 0x0f) == 0x00) /* Mailbox error response? */
+   {
+      MBXEp = (ec_mbxerrort *)mbx;
+      ecx_mbxerror(context, slave, etohs(MBXEp->Detail));
+      return TRUE;
+   }
+   else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_COE) /* CoE response? */
+   {
+      EMp = (ec_emcyt *)mbx;
+      if ((etohs(EMp->CANOpen) >> 12) == 0x01) /* Emergency request? */
+      {
+         ecx_mbxemergencyerror(context, slave, etohs(EMp->ErrorCode), EMp->ErrorReg,
+                 EMp->bData, etohs(EMp->w1), etohs(EMp->w2));
+         return TRUE;
+      }
+   }
+   else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_EOE) /* EoE response? */
+   {
+      ec_EOEt * eoembx = (ec_EOEt *)mbx;
+      uint16 frameinfo1 = etohs(eoembx->frameinfo1);
+      /* All non fragment data frame types are expected to be handled by
+      * slave send/receive API if the EoE hook is set
+      */
+      if (EOE_HDR_FRAME_TYPE_GET(frameinfo1) == EOE_FRAG_DATA)
+      {
+         if (context->EOEhook)
+         {
+            if (context->EOEhook(context, slave, eoembx) > 0)
+            {
+               /* Fragment handled by EoE hook */
+               return TRUE;
+            }
+         }
+      }
+   }
+
+   return FALSE;
+}
+
 /** Read OUT mailbox from slave.
- * Supports Mailbox Link Layer with repeat requests.
+ * Supports Mailbox Link Layer with repeat requests. When the SM1 status of
+ * the slave is mapped in the IOmap and the slave or the whole network is in
+ * SAFE_OP or OP it is taken from there instead of polling the slave.
  * @param[in]  context    = context struct
  * @param[in]  slave      = Slave number
  * @param[out] mbx        = Mailbox data
@@ -1010,9 +1398,7 @@ int ecx_mbxreceive(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int tim
    int wkc2;
    uint16 SMstat;
    uint8 SMcontr;
-   ec_mbxheadert *mbxh;
-   ec_emcyt *EMp;
-   ec_mbxerrort *MBXEp;
+   uint8 *mbxstatus;
 
    configadr = context->slavelist[slave].configadr;
    mbxl = context->slavelist[slave].mbx_rl;
@@ -1021,64 +1407,64 @@ int ecx_mbxreceive(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int tim
       osal_timert timer;
 
       osal_timer_start(&timer, timeout);
+      /* SM1 status mapped in the IOmap is refreshed by the process data exchange */
+      mbxstatus = context->slavelist[slave].mbxstatus;
+      if (((context->slavelist[slave].state & 0x0f) < EC_STATE_SAFE_OP) &&
+          ((context->slavelist[0].state & 0x0f) < EC_STATE_SAFE_OP))
+      {
+         mbxstatus = NULL;
+      }
       wkc = 0;
       do /* wait for read mailbox available */
       {
          SMstat = 0;
-         wkc = ecx_FPRD(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat), &SMstat, EC_TIMEOUTRET);
-         SMstat = etohs(SMstat);
+         if (mbxstatus)
+         {
+            SMstat = *mbxstatus;
+            wkc = 1;
+         }
+         else
+         {
+            wkc = ecx_FPRD(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat), &SMstat, EC_TIMEOUTRET);
+            SMstat = etohs(SMstat);
+         }
          if (((SMstat & 0x08) == 0) && (timeout > EC_LOCALDELAY))
          {
             osal_usleep(EC_LOCALDELAY);
          }
       }
       while (((wkc <= 0) || ((SMstat & 0x08) == 0)) && (osal_timer_is_expired(&timer) == FALSE));
+      if (mbxstatus && ((SMstat & 0x08) == 0)) /* ask the slave itself before giving up */
+      {
+         mbxstatus = NULL;
+         SMstat = 0;
+         wkc = ecx_FPRD(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat), &SMstat, EC_TIMEOUTRET);
+         SMstat = etohs(SMstat);
+      }
 
       if ((wkc > 0) && ((SMstat & 0x08) > 0)) /* read mailbox available ? */
       {
          mbxro = context->slavelist[slave].mbx_ro;
-         mbxh = (ec_mbxheadert *)mbx;
          do
          {
             wkc = ecx_FPRD(context->port, configadr, mbxro, mbxl, mbx, EC_TIMEOUTRET); /* get mailbox */
-            if ((wkc > 0) && ((mbxh->mbxtype & 0x0f) == 0x00)) /* Mailbox error response? */
+            if ((wkc > 0) && context->slavelist[slave].mbxstatus)
             {
-               MBXEp = (ec_mbxerrort *)mbx;
-               ecx_mbxerror(context, slave, etohs(MBXEp->Detail));
-               wkc = 0; /* prevent emergency to cascade up, it is already handled. */
+               /* mapped status stays full until the next process data exchange */
+               *(context->slavelist[slave].mbxstatus) &= (uint8)~0x08;
             }
-            else if ((wkc > 0) && ((mbxh->mbxtype & 0x0f) == ECT_MBXT_COE)) /* CoE response? */
+            if ((wkc > 0) && ecx_mbxhandled(context, slave, mbx))
             {
-               EMp = (ec_emcyt *)mbx;
-               if ((etohs(EMp->CANOpen) >> 12) == 0x01) /* Emergency request? */
-               {
-                  ecx_mbxemergencyerror(context, slave, etohs(EMp->ErrorCode), EMp->ErrorReg,
-                          EMp->bData, etohs(EMp->w1), etohs(EMp->w2));
-                  wkc = 0; /* prevent emergency to cascade up, it is already handled. */
-               }
+               wkc = 0; /* prevent emergency to cascade up, it is already handled. */
             }
-            else if ((wkc > 0) && ((mbxh->mbxtype & 0x0f) == ECT_MBXT_EOE)) /* EoE response? */
+            else if (wkc <= 0) /* read mailbox lost */
             {
-               ec_EOEt * eoembx = (ec_EOEt *)mbx;
-               uint16 frameinfo1 = etohs(eoembx->frameinfo1);
-               /* All non fragment data frame types are expected to be handled by
-               * slave send/receive API if the EoE hook is set
-               */
-               if (EOE_HDR_FRAME_TYPE_GET(frameinfo1) == EOE_FRAG_DATA)
+               if (mbxstatus)
                {
-                  if (context->EOEhook)
-                  {
-                     if (context->EOEhook(context, slave, eoembx) > 0)
-                     {
-                        /* Fragment handled by EoE hook */
-                        wkc = 0;
-                     }
-                  }
+                  /* mapped status was stale, mailbox is not full yet */
+                  mbxstatus = NULL;
                }
-            }
-            else
-            {
-               if (wkc <= 0) /* read mailbox lost */
+               else
                {
                   SMstat ^= 0x0200; /* toggle repeat request */
                   SMstat = htoes(SMstat);
@@ -1087,17 +1473,17 @@ int ecx_mbxreceive(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int tim
                   do /* wait for toggle ack */
                   {
                      wkc2 = ecx_FPRD(context->port, configadr, ECT_REG_SM1CONTR, sizeof(SMcontr), &SMcontr, EC_TIMEOUTRET);
-                   } while (((wkc2 <= 0) || ((SMcontr & 0x02) != (HI_BYTE(SMstat) & 0x02))) && (osal_timer_is_expired(&timer) == FALSE));
-                  do /* wait for read mailbox available */
-                  {
-                     wkc2 = ecx_FPRD(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat), &SMstat, EC_TIMEOUTRET);
-                     SMstat = etohs(SMstat);
-                     if (((SMstat & 0x08) == 0) && (timeout > EC_LOCALDELAY))
-                     {
-                        osal_usleep(EC_LOCALDELAY);
-                     }
-                  } while (((wkc2 <= 0) || ((SMstat & 0x08) == 0)) && (osal_timer_is_expired(&timer) == FALSE));
+                  } while (((wkc2 <= 0) || ((SMcontr & 0x02) != (HI_BYTE(SMstat) & 0x02))) && (osal_timer_is_expired(&timer) == FALSE));
                }
+               do /* wait for read mailbox available */
+               {
+                  wkc2 = ecx_FPRD(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat), &SMstat, EC_TIMEOUTRET);
+                  SMstat = etohs(SMstat);
+                  if (((SMstat & 0x08) == 0) && (timeout > EC_LOCALDELAY))
+                  {
+                     osal_usleep(EC_LOCALDELAY);
+                  }
+               } while (((wkc2 <= 0) || ((SMstat & 0x08) == 0)) && (osal_timer_is_expired(&timer) == FALSE));
             }
          } while ((wkc <= 0) && (osal_timer_is_expired(&timer) == FALSE)); /* if WKC<=0 repeat */
       }
@@ -1111,32 +1497,309 @@ int ecx_mbxreceive(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int tim
    return wkc;
 }
 
-/** Dump complete EEPROM data from slave in buffer.
- * @param[in]  context  = context struct
- * @param[in]  slave    = Slave number
- * @param[out] esibuf   = EEPROM data buffer, make sure it is big enough.
+/** Start a mailbox job. Slave, timeout, step function and the first request
+ * in mbx must be set.
+ * @param[in,out] job     = mailbox job
  */
-void ecx_esidump(ecx_contextt *context, uint16 slave, uint8 *esibuf)
+void ecx_mbxjob_start(ec_mbxjobt *job)
 {
-   uint16 configadr, address, incr;
-   uint64 *p64;
-   uint16 *p16;
-   uint64 edat;
-   uint8 eectl = context->slavelist[slave].eep_pdi;
+   job->wkc = 0;
+   job->state = EC_MBXJOB_SEND;
+   osal_timer_start(&(job->timer), EC_TIMEOUTTXM);
+}
 
-   ecx_eeprom2master(context, slave); /* set eeprom control to master */
-   configadr = context->slavelist[slave].configadr;
-   address = ECT_SII_START;
-   p16=(uint16*)esibuf;
-   if (context->slavelist[slave].eep_8byte)
+/** End the running exchange of a mailbox job and let the job continue.
+ * @param[in]  context    = context struct
+ * @param[in,out] job     = mailbox job
+ * @param[in]  wkc        = result of the exchange
+ */
+static void ecx_mbxjob_next(ecx_contextt *context, ec_mbxjobt *job, int wkc)
+{
+   job->wkc = wkc;
+   job->state = job->step(context, job);
+   if (job->state == EC_MBXJOB_SEND)
    {
-      incr = 4;
+      osal_timer_start(&(job->timer), EC_TIMEOUTTXM);
    }
-   else
+   else if (job->state == EC_MBXJOB_RECEIVE)
    {
-      incr = 2;
+      ec_clearmbx(&(job->mbx));
+      osal_timer_start(&(job->timer), job->timeout);
    }
-   do
+}
+
+/** Write the requests of mailbox jobs whose slave in mailbox is empty.
+ * The status of SM0 and SM1 of all jobs is read in one transaction, the
+ * requests are written in a second one.
+ * @param[in]  context    = context struct
+ * @param[in]  job        = mailbox jobs
+ * @param[in]  n          = number of jobs, at most MAX_FPRD_MULTI
+ * @return number of jobs that changed state
+ */
+static int ecx_mbxjob_send(ecx_contextt *context, ec_mbxjobt **job, int n)
+{
+   ec_datagramt dg[MAX_FPRD_MULTI];
+   ec_mbxjobt *sj[MAX_FPRD_MULTI];
+   uint8 SMstat[MAX_FPRD_MULTI][ECT_REG_SM1STAT - ECT_REG_SM0STAT + 1];
+   ec_mbxbuft mbx;
+   uint16 mbxl;
+   int i, m, progress;
+
+   progress = 0;
+   m = 0;
+   for (i = 0; i < n; i++)
+   {
+      if (job[i]->state == EC_MBXJOB_SEND)
+      {
+         mbxl = context->slavelist[job[i]->slave].mbx_l;
+         if ((mbxl > 0) && (mbxl <= EC_MAXMBX))
+         {
+            sj[m] = job[i];
+            dg[m].command = EC_CMD_FPRD;
+            dg[m].ADP = context->slavelist[job[i]->slave].configadr;
+            dg[m].ADO = ECT_REG_SM0STAT;
+            dg[m].length = sizeof(SMstat[m]);
+            dg[m].data = SMstat[m];
+            m++;
+         }
+         else
+         {
+            ecx_mbxjob_next(context, job[i], 0);
+            progress++;
+         }
+      }
+   }
+   if (m == 0)
+   {
+      return progress;
+   }
+   ecx_transaction(context->port, dg, m, EC_TIMEOUTRET);
+   n = 0;
+   for (i = 0; i < m; i++)
+   {
+      if ((dg[i].wkc > 0) && (SMstat[i][ECT_REG_SM1STAT - ECT_REG_SM0STAT] & 0x08))
+      {
+         /* empty slave out mailbox if something is in, write request next time */
+         ec_clearmbx(&mbx);
+         (void)ecx_mbxreceive(context, sj[i]->slave, &mbx, 0);
+      }
+      else if ((dg[i].wkc > 0) && ((SMstat[i][0] & 0x08) == 0))
+      {
+         /* in mailbox empty, write request */
+         sj[n] = sj[i];
+         dg[n].command = EC_CMD_FPWR;
+         dg[n].ADP = context->slavelist[sj[i]->slave].configadr;
+         dg[n].ADO = context->slavelist[sj[i]->slave].mbx_wo;
+         dg[n].length = context->slavelist[sj[i]->slave].mbx_l;
+         dg[n].data = &(sj[i]->mbx);
+         n++;
+      }
+      else if (osal_timer_is_expired(&(sj[i]->timer)))
+      {
+         ecx_mbxjob_next(context, sj[i], 0);
+         progress++;
+      }
+   }
+   if (n > 0)
+   {
+      ecx_transaction(context->port, dg, n, EC_TIMEOUTRET3);
+   }
+   for (i = 0; i < n; i++)
+   {
+      if (dg[i].wkc > 0)
+      {
+         ec_clearmbx(&(sj[i]->mbx));
+         sj[i]->state = EC_MBXJOB_RECEIVE;
+         osal_timer_start(&(sj[i]->timer), sj[i]->timeout);
+         progress++;
+      }
+      else if (osal_timer_is_expired(&(sj[i]->timer)))
+      {
+         ecx_mbxjob_next(context, sj[i], dg[i].wkc);
+         progress++;
+      }
+   }
+
+   return progress;
+}
+
+/** Read the responses of mailbox jobs whose slave out mailbox is full.
+ * The status of SM1 of all jobs is read in one transaction, the out
+ * mailboxes in a second one. Lost mailboxes are repeated with the Mailbox
+ * Link Layer repeat request.
+ * @param[in]  context    = context struct
+ * @param[in]  job        = mailbox jobs
+ * @param[in]  n          = number of jobs, at most MAX_FPRD_MULTI
+ * @return number of jobs that changed state or got a mailbox
+ */
+static int ecx_mbxjob_receive(ecx_contextt *context, ec_mbxjobt **job, int n)
+{
+   ec_datagramt dg[MAX_FPRD_MULTI];
+   ec_mbxjobt *rj[MAX_FPRD_MULTI];
+   uint16 SMstat[MAX_FPRD_MULTI];
+   uint16 mbxl, configadr;
+   int i, m, progress;
+
+   progress = 0;
+   m = 0;
+   for (i = 0; i < n; i++)
+   {
+      if (job[i]->state == EC_MBXJOB_RECEIVE)
+      {
+         mbxl = context->slavelist[job[i]->slave].mbx_rl;
+         if ((mbxl > 0) && (mbxl <= EC_MAXMBX))
+         {
+            rj[m] = job[i];
+            SMstat[m] = 0;
+            dg[m].command = EC_CMD_FPRD;
+            dg[m].ADP = context->slavelist[job[i]->slave].configadr;
+            dg[m].ADO = ECT_REG_SM1STAT;
+            dg[m].length = sizeof(SMstat[m]);
+            dg[m].data = &SMstat[m];
+            m++;
+         }
+         else
+         {
+            ecx_mbxjob_next(context, job[i], 0);
+            progress++;
+         }
+      }
+   }
+   if (m == 0)
+   {
+      return progress;
+   }
+   ecx_transaction(context->port, dg, m, EC_TIMEOUTRET);
+   n = 0;
+   for (i = 0; i < m; i++)
+   {
+      if ((dg[i].wkc > 0) && (etohs(SMstat[i]) & 0x08))
+      {
+         /* out mailbox full, read it */
+         rj[n] = rj[i];
+         SMstat[n] = etohs(SMstat[i]);
+         dg[n].command = EC_CMD_FPRD;
+         dg[n].ADP = context->slavelist[rj[i]->slave].configadr;
+         dg[n].ADO = context->slavelist[rj[i]->slave].mbx_ro;
+         dg[n].length = context->slavelist[rj[i]->slave].mbx_rl;
+         dg[n].data = &(rj[i]->mbx);
+         n++;
+      }
+      else if (osal_timer_is_expired(&(rj[i]->timer)))
+      {
+         ecx_mbxjob_next(context, rj[i], (dg[i].wkc > 0) ? EC_TIMEOUT : dg[i].wkc);
+         progress++;
+      }
+   }
+   if (n > 0)
+   {
+      ecx_transaction(context->port, dg, n, EC_TIMEOUTRET);
+   }
+   for (i = 0; i < n; i++)
+   {
+      if ((dg[i].wkc > 0) && ecx_mbxhandled(context, rj[i]->slave, &(rj[i]->mbx)))
+      {
+         /* no response, keep waiting */
+         ec_clearmbx(&(rj[i]->mbx));
+         progress++;
+      }
+      else if (dg[i].wkc > 0)
+      {
+         ecx_mbxjob_next(context, rj[i], dg[i].wkc);
+         progress++;
+      }
+      else /* read mailbox lost */
+      {
+         configadr = context->slavelist[rj[i]->slave].configadr;
+         SMstat[i] = htoes(SMstat[i] ^ 0x0200); /* toggle repeat request */
+         (void)ecx_FPWR(context->port, configadr, ECT_REG_SM1STAT, sizeof(SMstat[i]), &SMstat[i], EC_TIMEOUTRET);
+      }
+   }
+
+   return progress;
+}
+
+/** Run one round of the mailbox jobs of many slaves. Requests are written
+ * to all slaves whose in mailbox is empty and responses are read from all
+ * slaves whose out mailbox is full, with a few transactions per round for
+ * all slaves together. When a response arrived the step function of the job
+ * puts its next request in place, so every slave always has one request
+ * outstanding. If no job made progress the round ends with a delay of
+ * EC_LOCALDELAY.
+ * @param[in]  context    = context struct
+ * @param[in]  job        = mailbox jobs, started by ecx_mbxjob_start()
+ * @param[in]  n          = number of jobs
+ * @return number of jobs not finished
+ */
+int ecx_mbxjob_poll(ecx_contextt *context, ec_mbxjobt **job, int n)
+{
+   int i, m, active, progress;
+
+   progress = 0;
+   for (i = 0; i < n; i += MAX_FPRD_MULTI)
+   {
+      m = n - i;
+      if (m > MAX_FPRD_MULTI)
+      {
+         m = MAX_FPRD_MULTI;
+      }
+      progress += ecx_mbxjob_send(context, &job[i], m);
+      progress += ecx_mbxjob_receive(context, &job[i], m);
+   }
+   active = 0;
+   for (i = 0; i < n; i++)
+   {
+      if (job[i]->state != EC_MBXJOB_IDLE)
+      {
+         active++;
+      }
+   }
+   if (active && !progress)
+   {
+      osal_usleep(EC_LOCALDELAY);
+   }
+
+   return active;
+}
+
+/** Run mailbox jobs of many slaves until all are finished.
+ * @param[in]  context    = context struct
+ * @param[in]  job        = mailbox jobs, started by ecx_mbxjob_start()
+ * @param[in]  n          = number of jobs
+ */
+void ecx_mbxjob_run(ecx_contextt *context, ec_mbxjobt **job, int n)
+{
+   while (ecx_mbxjob_poll(context, job, n) > 0)
+   {
+   }
+}
+
+/** Dump complete EEPROM data from slave in buffer.
+ * @param[in]  context  = context struct
+ * @param[in]  slave    = Slave number
+ * @param[out] esibuf   = EEPROM data buffer, make sure it is big enough.
+ */
+void ecx_esidump(ecx_contextt *context, uint16 slave, uint8 *esibuf)
+{
+   uint16 configadr, address, incr;
+   uint64 *p64;
+   uint16 *p16;
+   uint64 edat;
+   uint8 eectl = context->slavelist[slave].eep_pdi;
+
+   ecx_eeprom2master(context, slave); /* set eeprom control to master */
+   configadr = context->slavelist[slave].configadr;
+   address = ECT_SII_START;
+   p16=(uint16*)esibuf;
+   if (context->slavelist[slave].eep_8byte)
+   {
+      incr = 4;
+   }
+   else
+   {
+      incr = 2;
+   }
+   do
    {
       edat = ecx_readeepromFP(context, configadr, address, EC_TIMEOUTEEP);
       p64 = (uint64*)p16;
@@ -1182,6 +1845,7 @@ int ecx_writeeeprom(ecx_contextt *context, uint16 slave, uint16 eeproma, uint16
 
    ecx_eeprom2master(context, slave); /* set eeprom control to master */
    configadr = context->slavelist[slave].configadr;
+   ecx_siiclear(context, slave);
    return (ecx_writeeepromFP(context, configadr, eeproma, data, timeout));
 }
 
@@ -1642,36 +2306,263 @@ uint32 ecx_readeeprom2(ecx_contextt *context, uint16 slave, int timeout)
    return edat;
 }
 
+/** steps of a parallel EEPROM read of one slave */
+enum
+{
+   EC_EEPM_CHECK,
+   EC_EEPM_CLEAR,
+   EC_EEPM_CMD,
+   EC_EEPM_BUSY,
+   EC_EEPM_DATA,
+   EC_EEPM_DONE,
+   EC_EEPM_FAIL
+};
+
+/** Read the same EEPROM address of at most EC_MAXEEPMULTI slaves in parallel.
+ * Every round sends the next step of all slaves in one transaction.
+ * @param[in]  context        = context struct
+ * @param[in]  n              = number of slaves
+ * @param[in]  slave          = slave numbers
+ * @param[in]  eeproma        = (WORD) Address in the EEPROM
+ * @param[out] data           = EEPROM data per slave
+ * @param[in]  timeout        = Timeout in us.
+ * @return number of slaves read
+ */
+static int ecx_readeeprom_chunk(ecx_contextt *context, int n, const uint16 *slave, uint16 eeproma,
+   uint64 *data, int timeout)
+{
+   ec_datagramt dg[EC_MAXEEPMULTI];
+   uint8 map[EC_MAXEEPMULTI];
+   uint16 estat[EC_MAXEEPMULTI];
+   uint8 step[EC_MAXEEPMULTI];
+   uint8 retry[EC_MAXEEPMULTI];
+   uint8 nack[EC_MAXEEPMULTI];
+   uint8 r64[EC_MAXEEPMULTI];
+   ec_eepromt ed;
+   uint16 nop;
+   int i, d, ndg, waiting, nacked, rval;
+   osal_timert timer;
+
+   ed.comm = htoes(EC_ECMD_READ);
+   ed.addr = htoes(eeproma);
+   ed.d2   = 0x0000;
+   nop = htoes(EC_ECMD_NOP);
+   for (i = 0; i < n; i++)
+   {
+      ecx_eeprom2master(context, slave[i]); /* set eeprom control to master */
+      data[i] = 0;
+      step[i] = EC_EEPM_CHECK;
+      retry[i] = 0;
+      nack[i] = 0;
+      r64[i] = 0;
+   }
+   osal_timer_start(&timer, timeout);
+   do
+   {
+      /* next step of all unfinished slaves in one transaction */
+      ndg = 0;
+      for (i = 0; i < n; i++)
+      {
+         if ((step[i] == EC_EEPM_DONE) || (step[i] == EC_EEPM_FAIL))
+         {
+            continue;
+         }
+         map[ndg] = (uint8)i;
+         dg[ndg].ADP = context->slavelist[slave[i]].configadr;
+         if ((step[i] == EC_EEPM_CHECK) || (step[i] == EC_EEPM_BUSY))
+         {
+            estat[i] = 0;
+            dg[ndg].command = EC_CMD_FPRD;
+            dg[ndg].ADO = ECT_REG_EEPSTAT;
+            dg[ndg].length = sizeof(estat[i]);
+            dg[ndg].data = &estat[i];
+         }
+         else if (step[i] == EC_EEPM_CLEAR)
+         {
+            /* clear error bits */
+            dg[ndg].command = EC_CMD_FPWR;
+            dg[ndg].ADO = ECT_REG_EEPCTL;
+            dg[ndg].length = sizeof(nop);
+            dg[ndg].data = &nop;
+         }
+         else if (step[i] == EC_EEPM_CMD)
+         {
+            dg[ndg].command = EC_CMD_FPWR;
+            dg[ndg].ADO = ECT_REG_EEPCTL;
+            dg[ndg].length = sizeof(ed);
+            dg[ndg].data = &ed;
+         }
+         else
+         {
+            dg[ndg].command = EC_CMD_FPRD;
+            dg[ndg].ADO = ECT_REG_EEPDAT;
+            dg[ndg].length = r64[i] ? sizeof(uint64) : sizeof(uint32);
+            dg[ndg].data = &data[i];
+         }
+         ndg++;
+      }
+      if (!ndg)
+      {
+         break;
+      }
+      ecx_transaction(context->port, dg, ndg, EC_TIMEOUTRET);
+      waiting = 0;
+      nacked = 0;
+      for (d = 0; d < ndg; d++)
+      {
+         i = map[d];
+         if (dg[d].wkc <= 0)
+         {
+            /* no response, repeat the step */
+            if (++retry[i] > EC_DEFAULTRETRIES)
+            {
+               step[i] = EC_EEPM_FAIL;
+            }
+            continue;
+         }
+         retry[i] = 0;
+         switch (step[i])
+         {
+            case EC_EEPM_CHECK:
+               estat[i] = etohs(estat[i]);
+               if (estat[i] & EC_ESTAT_BUSY)
+               {
+                  waiting++;
+               }
+               else if (estat[i] & EC_ESTAT_EMASK) /* error bits are set */
+               {
+                  step[i] = EC_EEPM_CLEAR;
+               }
+               else
+               {
+                  step[i] = EC_EEPM_CMD;
+               }
+               break;
+            case EC_EEPM_CLEAR:
+               step[i] = EC_EEPM_CMD;
+               break;
+            case EC_EEPM_CMD:
+               step[i] = EC_EEPM_BUSY;
+               waiting++;
+               break;
+            case EC_EEPM_BUSY:
+               estat[i] = etohs(estat[i]);
+               if (estat[i] & EC_ESTAT_BUSY)
+               {
+                  waiting++;
+               }
+               else if (estat[i] & EC_ESTAT_NACK)
+               {
+                  step[i] = (++nack[i] < 3) ? EC_EEPM_CMD : EC_EEPM_FAIL;
+                  nacked++;
+               }
+               else
+               {
+                  r64[i] = (estat[i] & EC_ESTAT_R64) ? 1 : 0;
+                  step[i] = EC_EEPM_DATA;
+               }
+               break;
+            default:
+               step[i] = EC_EEPM_DONE;
+               break;
+         }
+      }
+      if (nacked)
+      {
+         osal_usleep(EC_LOCALDELAY * 5);
+      }
+      else if (waiting)
+      {
+         osal_usleep(EC_LOCALDELAY);
+      }
+   }
+   while (!osal_timer_is_expired(&timer));
+   rval = 0;
+   for (i = 0; i < n; i++)
+   {
+      if (step[i] == EC_EEPM_DONE)
+      {
+         rval++;
+      }
+      else
+      {
+         data[i] = 0;
+      }
+   }
+
+   return rval;
+}
+
+/** Read the same EEPROM address of many slaves bypassing cache.
+ * The read command, the busy polling and the data read of all slaves are
+ * each sent together in one transaction, EC_MAXEEPMULTI slaves at a time.
+ * The time needed depends on the number of EEPROM addresses read, not on
+ * the number of slaves.
+ * @param[in]  context        = context struct
+ * @param[in]  n              = number of slaves
+ * @param[in]  slave          = slave numbers
+ * @param[in]  eeproma        = (WORD) Address in the EEPROM
+ * @param[out] data           = EEPROM data per slave, 64bit for slaves that
+ *                              read 8 bytes, else 32bit in the first 4 bytes,
+ *                              0 if the read failed
+ * @param[in]  timeout        = Timeout in us per EC_MAXEEPMULTI slaves.
+ * @return number of slaves read
+ */
+int ecx_readeeprom_multi(ecx_contextt *context, int n, const uint16 *slave, uint16 eeproma,
+   uint64 *data, int timeout)
+{
+   int i, m, rval = 0;
+
+   for (i = 0; i < n; i += m)
+   {
+      m = ((n - i) > EC_MAXEEPMULTI) ? EC_MAXEEPMULTI : (n - i);
+      rval += ecx_readeeprom_chunk(context, m, &slave[i], eeproma, &data[i], timeout);
+   }
+
+   return rval;
+}
+
 /** Push index of segmented LRD/LWR/LRW combination.
  * @param[in]  context        = context struct
+ * @param[in] group       = group number
  * @param[in] idx         = Used datagram index.
  * @param[in] data        = Pointer to process data segment.
  * @param[in] length      = Length of data segment in bytes.
  * @param[in] DCO         = Offset position of DC frame.
+ * @param[in] segment     = IOsegment of data.
+ * @param[in] rxoffset    = Offset of datagram data in rx frame.
  */
-static void ecx_pushindex(ecx_contextt *context, uint8 idx, void *data, uint16 length, uint16 DCO)
+static void ecx_pushindex(ecx_contextt *context, uint8 group, uint8 idx, void *data, uint16 length, uint16 DCO,
+   uint8 segment, uint16 rxoffset)
 {
-   if(context->idxstack->pushed < EC_MAXBUF)
+   ec_idxstackT *idxstack = &(context->grouplist[group].idxstack);
+
+   if(idxstack->pushed < EC_MAXFRAMEIDX)
    {
-      context->idxstack->idx[context->idxstack->pushed] = idx;
-      context->idxstack->data[context->idxstack->pushed] = data;
-      context->idxstack->length[context->idxstack->pushed] = length;
-      context->idxstack->dcoffset[context->idxstack->pushed] = DCO;
-      context->idxstack->pushed++;
+      idxstack->idx[idxstack->pushed] = idx;
+      idxstack->data[idxstack->pushed] = data;
+      idxstack->length[idxstack->pushed] = length;
+      idxstack->dcoffset[idxstack->pushed] = DCO;
+      idxstack->segment[idxstack->pushed] = segment;
+      idxstack->rxoffset[idxstack->pushed] = rxoffset;
+      idxstack->pushed++;
    }
 }
 
 /** Pull index of segmented LRD/LWR/LRW combination.
  * @param[in]  context        = context struct
+ * @param[in] group       = group number
  * @return Stack location, -1 if stack is empty.
  */
-static int ecx_pullindex(ecx_contextt *context)
+static int ecx_pullindex(ecx_contextt *context, uint8 group)
 {
+   ec_idxstackT *idxstack = &(context->grouplist[group].idxstack);
    int rval = -1;
-   if(context->idxstack->pulled < context->idxstack->pushed)
+
+   if(idxstack->pulled < idxstack->pushed)
    {
-      rval = context->idxstack->pulled;
-      context->idxstack->pulled++;
+      rval = idxstack->pulled;
+      idxstack->pulled++;
    }
 
    return rval;
@@ -1681,197 +2572,477 @@ static int ecx_pullindex(ecx_contextt *context)
  * Clear the idx stack.
  * 
  * @param context           = context struct
+ * @param group             = group number
  */
-static void ecx_clearindex(ecx_contextt *context)  {
+static void ecx_clearindex(ecx_contextt *context, uint8 group)  {
 
-   context->idxstack->pushed = 0;
-   context->idxstack->pulled = 0;
+   context->grouplist[group].idxstack.pushed = 0;
+   context->grouplist[group].idxstack.pulled = 0;
+   context->grouplist[group].idxstack.keep = FALSE;
 
 }
 
-/** Transmit processdata to slaves.
- * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
- * Both the input and output processdata are transmitted.
- * The outputs with the actual data, the inputs have a placeholder.
- * The inputs are gathered with the receive processdata function.
- * In contrast to the base LRW function this function is non-blocking.
- * If the processdata does not fit in one datagram, multiple are used.
- * In order to recombine the slave response, a stack is used.
+/** Release frame buffers reserved by the prepared frames of a group.
+ * The group then builds its frames every cycle until it is prepared again.
  * @param[in]  context        = context struct
  * @param[in]  group          = group number
- * @param[in]  use_overlap_io = flag if overlapped iomap is used
- * @return >0 if processdata is transmitted.
  */
-static int ecx_main_send_processdata(ecx_contextt *context, uint8 group, boolean use_overlap_io)
+void ecx_release_prepared(ecx_contextt *context, uint8 group)
 {
-   uint32 LogAdr;
-   uint16 w1, w2;
-   int length;
-   uint16 sublength;
-   uint8 idx;
-   int wkc;
-   uint8* data;
-   boolean first=FALSE;
-   uint16 currentsegment = 0;
-   uint32 iomapinputoffset;
-   uint16 DCO;
+   ec_preparedgroupt *pg = &(context->grouplist[group].prepared);
+   int i;
 
-   wkc = 0;
-   if(context->grouplist[group].hasdc)
+   for (i = 0; (i < pg->nframes) && (i < EC_MAXPREPARED); i++)
    {
-      first = TRUE;
+      ecx_setbufstat(context->port, pg->frameidx[i], EC_BUF_EMPTY);
    }
+   pg->nframes = 0;
+   pg->ndatagrams = 0;
+}
 
+/** Count the frames prepared by all groups.
+ * @param[in]  context        = context struct
+ * @return number of frame buffers reserved by prepared frames
+ */
+static int ecx_prepared_total(ecx_contextt *context)
+{
+   int group, total = 0;
+
+   for (group = 0; group < context->maxgroup; group++)
+   {
+      total += context->grouplist[group].prepared.nframes;
+   }
+   return total;
+}
+
+/** Frame being filled with processdata datagrams */
+typedef struct
+{
+   /** prepared group to store the datagrams in, NULL to send them */
+   ec_preparedgroupt *pg;
+   /** frame buffer index of the open frame */
+   uint8   idx;
+   /** TRUE if a frame is open */
+   boolean open;
+   /** TRUE if the DC datagram is still to be added */
+   boolean dc;
+   /** FALSE if the datagrams do not fit in the prepared frames or no frame
+    * buffer was free */
+   boolean ok;
+} ec_pdframet;
+
+/** Close the open processdata frame. The frame is sent unless it is prepared.
+ * @param[in]  context        = context struct
+ * @param[in,out] pdf         = frame being filled
+ */
+static void ecx_pd_close(ecx_contextt *context, ec_pdframet *pdf)
+{
+   if (pdf->open)
+   {
+      if (!pdf->pg)
+      {
+         ecx_outframe_red(context->port, pdf->idx);
+      }
+      pdf->open = FALSE;
+   }
+}
+
+/** Add a processdata datagram to the open frame. A new frame is started when
+ * none is open or the datagram does not fit. The DC datagram is added to
+ * the first frame.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ * @param[in,out] pdf         = frame being filled
+ * @param[in]  com            = command, LRW, LRD or LWR
+ * @param[in]  LogAdr         = logical address
+ * @param[in]  length         = length of datagram data
+ * @param[in]  data           = datagram data in IOmap
+ * @param[in]  rxdata         = pointer pushed on the index stack for the receive
+ * @param[in]  outputlength   = number of output bytes at start of data
+ * @param[in]  segment        = IOsegment of data
+ */
+static void ecx_pd_add(ecx_contextt *context, uint8 group, ec_pdframet *pdf, uint8 com,
+   uint32 LogAdr, uint16 length, uint8 *data, uint8 *rxdata, uint16 outputlength, int segment)
+{
+   ecx_portt *port = context->port;
+   ec_preparedgroupt *pg = pdf->pg;
+   ec_prepareddatagramt *pd;
+   uint16 rxoffset, DCO = 0;
+
+   if (!pdf->ok)
+   {
+      return;
+   }
+   if (pdf->open &&
+       ((port->txbuflength[pdf->idx] + EC_HEADERSIZE - EC_ELENGTHSIZE + length + EC_WKCSIZE) > EC_MAXDGFRAME))
+   {
+      ecx_pd_close(context, pdf);
+   }
+   if (pdf->open)
+   {
+      rxoffset = ecx_adddatagram(port, &(port->txbuf[pdf->idx]), com, pdf->idx, FALSE,
+                                 LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
+   }
+   else
+   {
+      if (pg && ((pg->nframes >= EC_MAXPREPARED) ||
+                 (ecx_prepared_total(context) >= (ecx_bufcount(port) / 2))))
+      {
+         pdf->ok = FALSE;
+         return;
+      }
+      /* get new index */
+      pdf->idx = ecx_getindex(port);
+      if (pdf->idx == EC_NOINDEX)
+      {
+         pdf->ok = FALSE;
+         return;
+      }
+      if (pg)
+      {
+         pg->frameidx[pg->nframes++] = pdf->idx;
+      }
+      ecx_setupdatagram(port, &(port->txbuf[pdf->idx]), com, pdf->idx,
+                        LO_WORD(LogAdr), HI_WORD(LogAdr), length, data);
+      rxoffset = EC_HEADERSIZE;
+      pdf->open = TRUE;
+      if (pdf->dc)
+      {
+         /* FPRMW in second datagram */
+         DCO = ecx_adddatagram(port, &(port->txbuf[pdf->idx]), EC_CMD_FRMW, pdf->idx, FALSE,
+                               context->slavelist[context->grouplist[group].DCnext].configadr,
+                               ECT_REG_DCSYSTIME, sizeof(int64), context->DCtime);
+         pdf->dc = FALSE;
+      }
+   }
+   if (pg)
+   {
+      if (pg->ndatagrams >= EC_MAXPREPAREDDG)
+      {
+         pdf->ok = FALSE;
+         return;
+      }
+      pd = &(pg->datagram[pg->ndatagrams++]);
+      pd->idx = pdf->idx;
+      pd->segment = (uint8)segment;
+      pd->txoutputs = rxoffset + ETH_HEADERSIZE;
+      pd->outputlength = outputlength;
+      pd->outputs = data;
+      pd->data = rxdata;
+      pd->length = length;
+      pd->rxoffset = rxoffset;
+      pd->dcoffset = DCO;
+   }
+   else
+   {
+      /* push index and data pointer on stack */
+      ecx_pushindex(context, group, pdf->idx, rxdata, length, DCO, (uint8)segment, rxoffset);
+   }
+}
+
+/** Build the processdata datagrams of a group.
+ * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW). If the processdata
+ * does not fit in one datagram, one datagram per IOsegment is used. The
+ * datagrams are packed into as few frames as possible.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ * @param[in]  use_overlap_io = flag if overlapped iomap is used
+ * @param[out] pg             = prepared group to store the datagrams in,
+ *                              NULL to send them
+ * @return FALSE if the datagrams do not fit in the prepared frames or no
+ * frame buffer was free, the remaining datagrams are then left out
+ */
+static boolean ecx_pd_build(ecx_contextt *context, uint8 group, boolean use_overlap_io, ec_preparedgroupt *pg)
+{
+   ec_groupt *grp = &(context->grouplist[group]);
+   ec_pdframet pdf;
+   uint32 LogAdr, offset, iomapinputoffset;
+   uint16 sublength, outputlength;
+   uint8 *data;
+   int length;
+   int currentsegment = 0;
+
+   pdf.pg = pg;
+   pdf.open = FALSE;
+   pdf.dc = grp->hasdc;
+   pdf.ok = TRUE;
    /* For overlapping IO map use the biggest */
-   if(use_overlap_io == TRUE)
+   if (use_overlap_io == TRUE)
    {
       /* For overlap IOmap make the frame EQ big to biggest part */
-      length = (context->grouplist[group].Obytes > context->grouplist[group].Ibytes) ?
-         context->grouplist[group].Obytes : context->grouplist[group].Ibytes;
+      length = (grp->Obytes > grp->Ibytes) ? grp->Obytes : grp->Ibytes;
       /* Save the offset used to compensate where to save inputs when frame returns */
-      iomapinputoffset = context->grouplist[group].Obytes;
+      iomapinputoffset = grp->Obytes;
    }
    else
    {
-      length = context->grouplist[group].Obytes + context->grouplist[group].Ibytes;
+      length = grp->Obytes + grp->Ibytes;
       iomapinputoffset = 0;
    }
-   
-   LogAdr = context->grouplist[group].logstartaddr;
-   if(length)
+   LogAdr = grp->logstartaddr;
+   /* LRW blocked by one or more slaves ? */
+   if (length && grp->blockLRW)
    {
-
-      wkc = 1;
-      /* LRW blocked by one or more slaves ? */
-      if(context->grouplist[group].blockLRW)
+      /* if inputs available generate LRD */
+      if (grp->Ibytes)
       {
-         /* if inputs available generate LRD */
-         if(context->grouplist[group].Ibytes)
+         currentsegment = grp->Isegment;
+         data = grp->inputs;
+         length = grp->Ibytes;
+         /* in an overlapped IOmap the inputs share the logical addresses
+          * of the outputs */
+         if (use_overlap_io == FALSE)
          {
-            currentsegment = context->grouplist[group].Isegment;
-            data = context->grouplist[group].inputs;
-            length = context->grouplist[group].Ibytes;
-            LogAdr += context->grouplist[group].Obytes;
-            /* segment transfer if needed */
-            do
-            {
-               if(currentsegment == context->grouplist[group].Isegment)
-               {
-                  sublength = (uint16)(context->grouplist[group].IOsegment[currentsegment++] - context->grouplist[group].Ioffset);
-               }
-               else
-               {
-                  sublength = (uint16)context->grouplist[group].IOsegment[currentsegment++];
-               }
-               /* get new index */
-               idx = ecx_getindex(context->port);
-               w1 = LO_WORD(LogAdr);
-               w2 = HI_WORD(LogAdr);
-               DCO = 0;
-               ecx_setupdatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_LRD, idx, w1, w2, sublength, data);
-               if(first)
-               {
-                  /* FPRMW in second datagram */
-                  DCO = ecx_adddatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                           context->slavelist[context->grouplist[group].DCnext].configadr,
-                                           ECT_REG_DCSYSTIME, sizeof(int64), context->DCtime);
-                  first = FALSE;
-               }
-               /* send frame */
-               ecx_outframe_red(context->port, idx);
-               /* push index and data pointer on stack */
-               ecx_pushindex(context, idx, data, sublength, DCO);
-               length -= sublength;
-               LogAdr += sublength;
-               data += sublength;
-            } while (length && (currentsegment < context->grouplist[group].nsegments));
+            LogAdr += grp->Obytes;
          }
-         /* if outputs available generate LWR */
-         if(context->grouplist[group].Obytes)
+         /* segment transfer if needed */
+         do
          {
-            data = context->grouplist[group].outputs;
-            length = context->grouplist[group].Obytes;
-            LogAdr = context->grouplist[group].logstartaddr;
-            currentsegment = 0;
-            /* segment transfer if needed */
-            do
+            if (currentsegment == grp->Isegment)
             {
-               sublength = (uint16)context->grouplist[group].IOsegment[currentsegment++];
-               if((length - sublength) < 0)
-               {
-                  sublength = (uint16)length;
-               }
-               /* get new index */
-               idx = ecx_getindex(context->port);
-               w1 = LO_WORD(LogAdr);
-               w2 = HI_WORD(LogAdr);
-               DCO = 0;
-               ecx_setupdatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_LWR, idx, w1, w2, sublength, data);
-               if(first)
-               {
-                  /* FPRMW in second datagram */
-                  DCO = ecx_adddatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                           context->slavelist[context->grouplist[group].DCnext].configadr,
-                                           ECT_REG_DCSYSTIME, sizeof(int64), context->DCtime);
-                  first = FALSE;
-               }
-               /* send frame */
-               ecx_outframe_red(context->port, idx);
-               /* push index and data pointer on stack */
-               ecx_pushindex(context, idx, data, sublength, DCO);
-               length -= sublength;
-               LogAdr += sublength;
-               data += sublength;
-            } while (length && (currentsegment < context->grouplist[group].nsegments));
-         }
+               sublength = (uint16)(grp->IOsegment[currentsegment++] - grp->Ioffset);
+            }
+            else
+            {
+               sublength = (uint16)grp->IOsegment[currentsegment++];
+            }
+            if ((length - sublength) < 0)
+            {
+               sublength = (uint16)length;
+            }
+            ecx_pd_add(context, group, &pdf, EC_CMD_LRD, LogAdr, sublength, data, data, 0,
+                       currentsegment - 1);
+            length -= sublength;
+            LogAdr += sublength;
+            data += sublength;
+         } while (length && (currentsegment < grp->nsegments));
       }
-      /* LRW can be used */
-      else
+      /* if outputs available generate LWR */
+      if (grp->Obytes)
       {
-         if (context->grouplist[group].Obytes)
-         {
-            data = context->grouplist[group].outputs;
-         }
-         else
-         {
-            data = context->grouplist[group].inputs;
-            /* Clear offset, don't compensate for overlapping IOmap if we only got inputs */
-            iomapinputoffset = 0;
-         }
+         data = grp->outputs;
+         length = grp->Obytes;
+         LogAdr = grp->logstartaddr;
+         currentsegment = 0;
          /* segment transfer if needed */
          do
          {
-            sublength = (uint16)context->grouplist[group].IOsegment[currentsegment++];
-            /* get new index */
-            idx = ecx_getindex(context->port);
-            w1 = LO_WORD(LogAdr);
-            w2 = HI_WORD(LogAdr);
-            DCO = 0;
-            ecx_setupdatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_LRW, idx, w1, w2, sublength, data);
-            if(first)
+            sublength = (uint16)grp->IOsegment[currentsegment++];
+            if ((length - sublength) < 0)
             {
-               /* FPRMW in second datagram */
-               DCO = ecx_adddatagram(context->port, &(context->port->txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                        context->slavelist[context->grouplist[group].DCnext].configadr,
-                                        ECT_REG_DCSYSTIME, sizeof(int64), context->DCtime);
-               first = FALSE;
+               sublength = (uint16)length;
             }
-            /* send frame */
-            ecx_outframe_red(context->port, idx);
-            /* push index and data pointer on stack.
-             * the iomapinputoffset compensate for where the inputs are stored 
-             * in the IOmap if we use an overlapping IOmap. If a regular IOmap
-             * is used it should always be 0.
-             */
-            ecx_pushindex(context, idx, (data + iomapinputoffset), sublength, DCO);      
+            ecx_pd_add(context, group, &pdf, EC_CMD_LWR, LogAdr, sublength, data, data, sublength,
+                       currentsegment - 1);
             length -= sublength;
             LogAdr += sublength;
             data += sublength;
-         } while (length && (currentsegment < context->grouplist[group].nsegments));
+         } while (length && (currentsegment < grp->nsegments));
       }
    }
+   /* LRW can be used */
+   else if (length)
+   {
+      if (grp->Obytes)
+      {
+         data = grp->outputs;
+      }
+      else
+      {
+         data = grp->inputs;
+         /* Clear offset, don't compensate for overlapping IOmap if we only got inputs */
+         iomapinputoffset = 0;
+      }
+      offset = 0;
+      /* segment transfer if needed */
+      do
+      {
+         sublength = (uint16)grp->IOsegment[currentsegment++];
+         /* only the output part of the datagram changes between cycles */
+         outputlength = 0;
+         if (offset < grp->Obytes)
+         {
+            outputlength = (uint16)(((grp->Obytes - offset) < sublength) ? (grp->Obytes - offset) : sublength);
+         }
+         /* the iomapinputoffset compensate for where the inputs are stored
+          * in the IOmap if we use an overlapping IOmap. If a regular IOmap
+          * is used it should always be 0.
+          */
+         ecx_pd_add(context, group, &pdf, EC_CMD_LRW, LogAdr, sublength, data,
+                    data + iomapinputoffset, outputlength, currentsegment - 1);
+         length -= sublength;
+         LogAdr += sublength;
+         data += sublength;
+         offset += sublength;
+      } while (length && (currentsegment < grp->nsegments));
+   }
+   ecx_pd_close(context, &pdf);
+
+   return pdf.ok;
+}
+
+/** Prepare the processdata frames of a group.
+ * The frames are built once, the same way ecx_send_processdata_group() and
+ * ecx_send_overlap_processdata_group() build them every cycle, each in a
+ * frame buffer that stays reserved for it. When the group has prepare set
+ * the send functions then only copy the outputs and DC time into these
+ * frames. Called by the mapping functions for groups with prepare set and
+ * again by the send functions when the IOmap layout, blockLRW or DC
+ * setting of the group changed.
+ * If the frames do not fit in EC_MAXPREPARED frames, or the prepared frames
+ * of all groups together would take more than half the frame buffers of the
+ * port, or the frame buffer pool is too small, prepare is cleared and frames
+ * are built every cycle.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ * @param[in]  use_overlap_io = flag if overlapped iomap is used
+ * @return number of prepared frames, 0 if none
+ */
+int ecx_prepare_group(ecx_contextt *context, uint8 group, boolean use_overlap_io)
+{
+   ec_groupt *grp = &(context->grouplist[group]);
+   ec_preparedgroupt *pg = &(grp->prepared);
+
+   ecx_release_prepared(context, group);
+   pg->overlap = use_overlap_io;
+   pg->blockLRW = grp->blockLRW;
+   pg->hasdc = grp->hasdc;
+   pg->DCnext = grp->DCnext;
+   pg->outputs = grp->outputs;
+   pg->Obytes = grp->Obytes;
+   pg->Ibytes = grp->Ibytes;
+   if (!ecx_pd_build(context, group, use_overlap_io, pg))
+   {
+      EC_PRINT("Group %d processdata does not fit in prepared frames\n", group);
+      ecx_release_prepared(context, group);
+      grp->prepare = FALSE;
+   }
 
-   return wkc;
+   return pg->nframes;
+}
+
+/** Check if the prepared frames of a group match its current setup.
+ * @param[in]  grp            = group
+ * @param[in]  use_overlap_io = flag if overlapped iomap is used
+ * @return TRUE if the prepared frames can be sent
+ */
+static boolean ecx_prepared_valid(const ec_groupt *grp, boolean use_overlap_io)
+{
+   const ec_preparedgroupt *pg = &(grp->prepared);
+
+   return pg->nframes &&
+          (pg->overlap == use_overlap_io) &&
+          (pg->blockLRW == grp->blockLRW) &&
+          (pg->hasdc == grp->hasdc) &&
+          (pg->DCnext == grp->DCnext) &&
+          (pg->outputs == grp->outputs) &&
+          (pg->Obytes == grp->Obytes) &&
+          (pg->Ibytes == grp->Ibytes);
+}
+
+/** Clear the parts of a prepared datagram that slaves write to. The
+ * redundancy handling of the NIC driver can overwrite a tx frame with the
+ * received one, without this its inputs and work counter would be sent
+ * again in the next cycles.
+ * @param[in,out] frame       = tx frame
+ * @param[in]  offset         = offset of the datagram data in the tx frame
+ * @param[in]  keep           = bytes at the start of the data written by the master
+ * @param[in]  length         = length of datagram data
+ */
+static void ecx_pd_clear(uint8 *frame, uint16 offset, uint16 keep, uint16 length)
+{
+   uint16 dlength;
+
+   /* dlength and irpt are the last words of the datagram header */
+   memcpy(&dlength, &frame[offset - 2 * sizeof(uint16)], sizeof(uint16));
+   dlength &= htoes((uint16)~EC_DATAGRAMCIRCULATING);
+   memcpy(&frame[offset - 2 * sizeof(uint16)], &dlength, sizeof(uint16));
+   memset(&frame[offset - sizeof(uint16)], 0, sizeof(uint16));
+   memset(&frame[offset + keep], 0, length - keep + EC_WKCSIZE);
+}
+
+/** Transmit the prepared processdata frames of a group.
+ * Only the output bytes and the DC system time are copied into the frames,
+ * the headers and index are already in place. Inputs and work counters are
+ * cleared again as the frame buffer may hold a received frame.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ */
+static void ecx_send_prepared(ecx_contextt *context, uint8 group)
+{
+   ec_preparedgroupt *pg = &(context->grouplist[group].prepared);
+   ec_prepareddatagramt *pd;
+   uint8 *frame;
+   int i;
+
+   context->grouplist[group].idxstack.keep = TRUE;
+   for (i = 0; i < pg->ndatagrams; i++)
+   {
+      pd = &(pg->datagram[i]);
+      frame = (uint8 *)&(context->port->txbuf[pd->idx]);
+      ecx_pd_clear(frame, pd->txoutputs, pd->outputlength, pd->length);
+      if (pd->outputlength)
+      {
+         memcpy(&frame[pd->txoutputs], pd->outputs, pd->outputlength);
+      }
+      if (pd->dcoffset)
+      {
+         ecx_pd_clear(frame, ETH_HEADERSIZE + pd->dcoffset, sizeof(int64), sizeof(int64));
+         memcpy(&frame[ETH_HEADERSIZE + pd->dcoffset], context->DCtime, sizeof(int64));
+      }
+      ecx_pushindex(context, group, pd->idx, pd->data, pd->length, pd->dcoffset, pd->segment, pd->rxoffset);
+      /* send frame after its last datagram */
+      if (((i + 1) == pg->ndatagrams) || (pg->datagram[i + 1].idx != pd->idx))
+      {
+         ecx_outframe_red(context->port, pd->idx);
+      }
+   }
+}
+
+/** Transmit processdata to slaves.
+ * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
+ * Both the input and output processdata are transmitted.
+ * The outputs with the actual data, the inputs have a placeholder.
+ * The inputs are gathered with the receive processdata function.
+ * In contrast to the base LRW function this function is non-blocking.
+ * If the processdata does not fit in one datagram, multiple are used,
+ * packed into as few frames as possible.
+ * In order to recombine the slave response, a stack is used.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ * @param[in]  use_overlap_io = flag if overlapped iomap is used
+ * @return >0 if processdata is transmitted, 0 if not or if no frame buffer
+ * was free for all of it.
+ */
+static int ecx_main_send_processdata(ecx_contextt *context, uint8 group, boolean use_overlap_io)
+{
+   ec_groupt *grp = &(context->grouplist[group]);
+   int rval = 1;
+
+   if (!grp->Obytes && !grp->Ibytes)
+   {
+      return 0;
+   }
+   if (grp->prepare && !ecx_prepared_valid(grp, use_overlap_io))
+   {
+      ecx_prepare_group(context, group, use_overlap_io);
+   }
+   if (grp->prepare && grp->prepared.nframes)
+   {
+      ecx_send_prepared(context, group);
+   }
+   else if (!ecx_pd_build(context, group, use_overlap_io, NULL))
+   {
+      rval = 0;
+   }
+   /* send frames queued by a NIC driver in batch mode */
+   ecx_outframe_flush(context->port);
+   if (context->stats)
+   {
+      ecx_stats_sendtime(context, group);
+   }
+
+   return rval;
 }
 
 /** Transmit processdata to slaves.
@@ -1912,6 +3083,13 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
  * Second part from ec_send_processdata().
  * Received datagrams are recombined with the processdata with help from the stack.
  * If a datagram contains input processdata it copies it to the processdata structure.
+ * Each group has its own stack, so different groups can be sent and received
+ * independently of each other, also from different threads.
+ * All frames of the group share one deadline, timeout after the call. Frames
+ * arriving out of order are buffered by the NIC driver, so a lost frame
+ * delays the receive by at most timeout instead of timeout per frame.
+ * The IOsegments whose input data was refreshed are flagged in the
+ * rxsegments bitmap of the group.
  * @param[in]  context        = context struct
  * @param[in]  group          = group number
  * @param[in]  timeout        = Timeout in us.
@@ -1919,73 +3097,102 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
  */
 int ecx_receive_processdata_group(ecx_contextt *context, uint8 group, int timeout)
 {
-   uint8 idx;
-   int pos;
-   int wkc = 0, wkc2;
+   uint8 idx, segment, com;
+   int pos, previdx;
+   int wkc = 0, wkc2 = EC_NOFRAME;
    uint16 le_wkc = 0;
+   uint16 rxoffset;
    int valid_wkc = 0;
+   int lost = 0;
    int64 le_DCtime;
    ec_idxstackT *idxstack;
    ec_bufT *rxbuf;
+   uint8 *rxsegments;
+   ec_changet *change;
+   osal_timert timer;
 
-   /* just to prevent compiler warning for unused group */
-   wkc2 = group;
-
-   idxstack = context->idxstack;
+   osal_timer_start(&timer, timeout);
+   idxstack = &(context->grouplist[group].idxstack);
+   change = context->grouplist[group].change;
+   if (change)
+   {
+      ecx_change_begin(change);
+   }
    rxbuf = context->port->rxbuf;
+   rxsegments = context->grouplist[group].rxsegments;
+   memset(rxsegments, 0, sizeof(context->grouplist[group].rxsegments));
+   previdx = -1;
    /* get first index */
-   pos = ecx_pullindex(context);
-   /* read the same number of frames as send */
+   pos = ecx_pullindex(context, group);
+   /* read the same number of datagrams as send */
    while (pos >= 0)
    {
       idx = idxstack->idx[pos];
-      wkc2 = ecx_waitinframe(context->port, idx, timeout);
+      /* datagrams of one frame are on the stack one after another */
+      if (idx != previdx)
+      {
+         wkc2 = ecx_waitinframe(context->port, idx, ecx_timer_left(&timer));
+         if (wkc2 <= EC_NOFRAME)
+         {
+            lost++;
+         }
+         previdx = idx;
+      }
       /* check if there is input data in frame */
       if (wkc2 > EC_NOFRAME)
       {
-         if((rxbuf[idx][EC_CMDOFFSET]==EC_CMD_LRD) || (rxbuf[idx][EC_CMDOFFSET]==EC_CMD_LRW))
+         rxoffset = idxstack->rxoffset[pos];
+         com = rxbuf[idx][rxoffset - EC_HEADERSIZE + EC_CMDOFFSET];
+         memcpy(&le_wkc, &(rxbuf[idx][rxoffset + idxstack->length[pos]]), EC_WKCSIZE);
+         if((com == EC_CMD_LRD) || (com == EC_CMD_LRW))
          {
-            if(idxstack->dcoffset[pos] > 0)
+            /* copy input data back to process data buffer */
+            if (change)
             {
-               memcpy(idxstack->data[pos], &(rxbuf[idx][EC_HEADERSIZE]), idxstack->length[pos]);
-               memcpy(&le_wkc, &(rxbuf[idx][EC_HEADERSIZE + idxstack->length[pos]]), EC_WKCSIZE);
-               wkc = etohs(le_wkc);
-               memcpy(&le_DCtime, &(rxbuf[idx][idxstack->dcoffset[pos]]), sizeof(le_DCtime));
-               *(context->DCtime) = etohll(le_DCtime);
+               ecx_change_copy(change, idxstack->data[pos], &(rxbuf[idx][rxoffset]),
+                  idxstack->length[pos]);
             }
             else
             {
-               /* copy input data back to process data buffer */
-               memcpy(idxstack->data[pos], &(rxbuf[idx][EC_HEADERSIZE]), idxstack->length[pos]);
-               wkc += wkc2;
+               memcpy(idxstack->data[pos], &(rxbuf[idx][rxoffset]), idxstack->length[pos]);
             }
+            wkc += etohs(le_wkc);
+            segment = idxstack->segment[pos];
+            rxsegments[segment >> 3] |= (uint8)(1 << (segment & 7));
             valid_wkc = 1;
          }
-         else if(rxbuf[idx][EC_CMDOFFSET]==EC_CMD_LWR)
+         else if(com == EC_CMD_LWR)
          {
-            if(idxstack->dcoffset[pos] > 0)
-            {
-               memcpy(&le_wkc, &(rxbuf[idx][EC_HEADERSIZE + idxstack->length[pos]]), EC_WKCSIZE);
-               /* output WKC counts 2 times when using LRW, emulate the same for LWR */
-               wkc = etohs(le_wkc) * 2;
-               memcpy(&le_DCtime, &(rxbuf[idx][idxstack->dcoffset[pos]]), sizeof(le_DCtime));
-               *(context->DCtime) = etohll(le_DCtime);
-            }
-            else
-            {
-               /* output WKC counts 2 times when using LRW, emulate the same for LWR */
-               wkc += wkc2 * 2;
-            }
+            /* output WKC counts 2 times when using LRW, emulate the same for LWR */
+            wkc += etohs(le_wkc) * 2;
             valid_wkc = 1;
          }
+         if(idxstack->dcoffset[pos] > 0)
+         {
+            memcpy(&le_DCtime, &(rxbuf[idx][idxstack->dcoffset[pos]]), sizeof(le_DCtime));
+            *(context->DCtime) = etohll(le_DCtime);
+         }
+      }
+      /* release buffer after the last datagram of the frame,
+         a prepared frame keeps it reserved */
+      if (((pos + 1) >= idxstack->pushed) || (idxstack->idx[pos + 1] != idx))
+      {
+         ecx_setbufstat(context->port, idx, idxstack->keep ? EC_BUF_ALLOC : EC_BUF_EMPTY);
       }
-      /* release buffer */
-      ecx_setbufstat(context->port, idx, EC_BUF_EMPTY);
       /* get next index */
-      pos = ecx_pullindex(context);
+      pos = ecx_pullindex(context, group);
    }
 
-   ecx_clearindex(context);
+   ecx_clearindex(context, group);
+
+   if (context->stats)
+   {
+      ecx_stats_receive(context, group, lost, valid_wkc ? wkc : EC_NOFRAME);
+   }
+   if (change)
+   {
+      ecx_change_receive(context, change);
+   }
 
    /* if no frames has arrived */
    if (valid_wkc == 0)
@@ -2074,6 +3281,15 @@ uint8 ec_siigetbyte(uint16 slave, uint16 address)
    return ecx_siigetbyte (&ecx_context, slave, address);
 }
 
+/** Clear the SII cache of a slave.
+ *  @param[in] slave   = slave number, 0 clears the cache of all slaves
+ *  @see ecx_siiclear
+ */
+void ec_siiclear(uint16 slave)
+{
+   ecx_siiclear(&ecx_context, slave);
+}
+
 /** Find SII section header in slave EEPROM.
  *  @param[in] slave   = slave number
  *  @param[in] cat     = section category
@@ -2182,6 +3398,33 @@ uint16 ec_statecheck(uint16 slave, uint16 reqstate, int timeout)
    return ecx_statecheck (&ecx_context, slave, reqstate, timeout);
 }
 
+/** Wait until a set of slaves is in the requested state.
+ * @param[in] n           = number of slaves in list
+ * @param[in] list        = slave numbers, NULL for all slaves
+ * @param[in] reqstate    = Requested state
+ * @param[in] timeout     = Timeout value in us
+ * @return number of slaves not in the requested state after timeout
+ * @see ecx_statewait
+ */
+int ec_statewait(int n, const uint16 *list, uint16 reqstate, int timeout)
+{
+   return ecx_statewait(&ecx_context, n, list, reqstate, timeout);
+}
+
+/** Request a state for a set of slaves and wait until all of them are in
+ * that state.
+ * @param[in] n           = number of slaves in list
+ * @param[in] list        = slave numbers, NULL for all slaves
+ * @param[in] reqstate    = Requested state
+ * @param[in] timeout     = Timeout value in us
+ * @return number of slaves not in the requested state after timeout
+ * @see ecx_statechange
+ */
+int ec_statechange(int n, const uint16 *list, uint16 reqstate, int timeout)
+{
+   return ecx_statechange(&ecx_context, n, list, reqstate, timeout);
+}
+
 /** Check if IN mailbox of slave is empty.
  * @param[in] slave    = Slave number
  * @param[in] timeout  = Timeout in us
@@ -2218,6 +3461,27 @@ int ec_mbxreceive(uint16 slave, ec_mbxbuft *mbx, int timeout)
    return ecx_mbxreceive (&ecx_context, slave, mbx, timeout);
 }
 
+/** Run one round of the mailbox jobs of many slaves.
+ * @param[in]  job        = mailbox jobs, started by ecx_mbxjob_start()
+ * @param[in]  n          = number of jobs
+ * @return number of jobs not finished
+ * @see ecx_mbxjob_poll
+ */
+int ec_mbxjob_poll(ec_mbxjobt **job, int n)
+{
+   return ecx_mbxjob_poll(&ecx_context, job, n);
+}
+
+/** Run mailbox jobs of many slaves until all are finished.
+ * @param[in]  job        = mailbox jobs, started by ecx_mbxjob_start()
+ * @param[in]  n          = number of jobs
+ * @see ecx_mbxjob_run
+ */
+void ec_mbxjob_run(ec_mbxjobt **job, int n)
+{
+   ecx_mbxjob_run(&ecx_context, job, n);
+}
+
 /** Dump complete EEPROM data from slave in buffer.
  * @param[in]  slave    = Slave number
  * @param[out] esibuf   = EEPROM data buffer, make sure it is big enough.
@@ -2350,6 +3614,20 @@ uint32 ec_readeeprom2(uint16 slave, int timeout)
    return ecx_readeeprom2 (&ecx_context, slave, timeout);
 }
 
+/** Read the same EEPROM address of many slaves bypassing cache.
+ * @param[in]  n              = number of slaves
+ * @param[in]  slave          = slave numbers
+ * @param[in]  eeproma        = (WORD) Address in the EEPROM
+ * @param[out] data           = EEPROM data per slave, 0 if the read failed
+ * @param[in]  timeout        = Timeout in us per EC_MAXEEPMULTI slaves.
+ * @return number of slaves read
+ * @see ecx_readeeprom_multi
+ */
+int ec_readeeprom_multi(int n, const uint16 *slave, uint16 eeproma, uint64 *data, int timeout)
+{
+   return ecx_readeeprom_multi(&ecx_context, n, slave, eeproma, data, timeout);
+}
+
 /** Transmit processdata to slaves.
  * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
  * Both the input and output processdata are transmitted.
@@ -2367,6 +3645,17 @@ int ec_send_processdata_group(uint8 group)
    return ecx_send_processdata_group (&ecx_context, group);
 }
 
+/** Prepare the processdata frames of a group.
+ * @param[in]  group          = group number
+ * @param[in]  use_overlap_io = flag if overlapped iomap is used
+ * @return number of prepared frames, 0 if none
+ * @see ecx_prepare_group
+ */
+int ec_prepare_group(uint8 group, boolean use_overlap_io)
+{
+   return ecx_prepare_group(&ecx_context, group, use_overlap_io);
+}
+
 /** Transmit processdata to slaves.
 * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
 * Both the input and output processdata are transmitted in the overlapped IOmap.
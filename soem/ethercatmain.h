@@ -23,8 +23,11 @@ extern "C"
 #define EC_MAXNAME        40
 /** max. number of slaves in array */
 #define EC_MAXSLAVE       200
-/** max. number of groups */
+/** max. number of groups in default context, the runtime limit is
+ * ecx_contextt.maxgroup together with the size of its grouplist */
+#ifndef EC_MAXGROUP
 #define EC_MAXGROUP       2
+#endif
 /** max. number of IO segments per group */
 #define EC_MAXIOSEGMENTS  64
 /** max. mailbox size */
@@ -37,8 +40,16 @@ extern "C"
 #define EC_MAXFMMU        4
 /** max. Adapter */
 #define EC_MAXLEN_ADAPTERNAME    128
-/** define maximum number of concurrent threads in mapping */
+/** number of PDO assign buffers in context for ecx_readPDOassignCA() */
 #define EC_MAX_MAPT           1
+/** max. number of slaves read in parallel by ecx_readeeprom_multi() */
+#define EC_MAXEEPMULTI        64
+/** max. number of slaves held in the SII cache of the default context */
+#ifndef EC_MAXEEPSLOT
+#define EC_MAXEEPSLOT         8
+#endif
+/** max. number of categories in the SII category index of a slave */
+#define EC_MAXEEPCAT          32
 
 typedef struct ec_adapter ec_adaptert;
 struct ec_adapter
@@ -167,6 +178,9 @@ typedef struct ec_slave
    uint16           mbx_proto;
    /** Counter value of mailbox link layer protocol 1..7 */
    uint8            mbx_cnt;
+   /** copy of SM1 status in IOmap, refreshed by the process data exchange,
+    * NULL if not mapped. See ecx_contextt.mbxstatusmap */
+   uint8            *mbxstatus;
    /** has DC capability */
    boolean          hasdc;
    /** Physical type; Ebus, EtherNet combinations */
@@ -237,6 +251,74 @@ typedef struct ec_slave
    char             name[EC_MAXNAME + 1];
 } ec_slavet;
 
+/** stack structure to store segmented LRD/LWR/LRW constructs, one entry per datagram */
+typedef struct ec_idxstack
+{
+   uint16  pushed;
+   uint16  pulled;
+   uint8   idx[EC_MAXFRAMEIDX];
+   void    *data[EC_MAXFRAMEIDX];
+   uint16  length[EC_MAXFRAMEIDX];
+   uint16  dcoffset[EC_MAXFRAMEIDX];
+   uint8   segment[EC_MAXFRAMEIDX];
+   uint16  rxoffset[EC_MAXFRAMEIDX];
+   /** frame buffers belong to prepared frames and stay reserved */
+   boolean keep;
+} ec_idxstackT;
+
+/** maximum number of prepared processdata frames per group, at run time
+ * also limited to half the frame buffers of the port */
+#define EC_MAXPREPARED    (EC_MAXFRAMEIDX / 2)
+/** maximum number of prepared processdata datagrams per group, LRD and LWR per IOsegment */
+#define EC_MAXPREPAREDDG  (EC_MAXIOSEGMENTS * 2)
+
+/** processdata datagram prepared by ecx_prepare_group() */
+typedef struct ec_prepareddatagram
+{
+   /** frame buffer index reserved for the frame of this datagram */
+   uint8            idx;
+   /** IOsegment of the datagram */
+   uint8            segment;
+   /** offset of the output bytes in the tx frame */
+   uint16           txoutputs;
+   /** number of output bytes copied into the frame each cycle */
+   uint16           outputlength;
+   /** output bytes in IOmap */
+   uint8            *outputs;
+   /** destination of the returned data in IOmap, pushed on the index stack */
+   uint8            *data;
+   /** length of the returned data */
+   uint16           length;
+   /** offset of the datagram data in the rx frame */
+   uint16           rxoffset;
+   /** offset of DC system time in the rx frame, 0 if none */
+   uint16           dcoffset;
+} ec_prepareddatagramt;
+
+/** processdata frames of a group, built once and sent every cycle */
+typedef struct ec_preparedgroup
+{
+   /** number of prepared frames, 0 if not prepared */
+   uint16             nframes;
+   /** number of prepared datagrams */
+   uint16             ndatagrams;
+   /** IOmap layout, blockLRW and DC setting the frames were built for */
+   boolean            overlap;
+   uint8              blockLRW;
+   boolean            hasdc;
+   uint16             DCnext;
+   uint8              *outputs;
+   uint32             Obytes;
+   uint32             Ibytes;
+   /** frame buffer indexes reserved for the prepared frames */
+   uint8              frameidx[EC_MAXPREPARED];
+   /** prepared datagrams, in frame order */
+   ec_prepareddatagramt datagram[EC_MAXPREPAREDDG];
+} ec_preparedgroupt;
+
+/** input change detection, see ethercatchange.h */
+typedef struct ec_change ec_changet;
+
 /** for list of ethercat slave groups */
 typedef struct ec_group
 {
@@ -272,6 +354,17 @@ typedef struct ec_group
    boolean          docheckstate;
    /** IO segmentation list. Datagrams must not break SM in two. */
    uint32           IOsegment[EC_MAXIOSEGMENTS];
+   /** IOsegments refreshed by the last processdata receive, bit n of
+    * byte n / 8 is set if the LRD or LRW frame of IOsegment n returned */
+   uint8            rxsegments[(EC_MAXIOSEGMENTS + 7) / 8];
+   /** internal, processdata frames in flight for this group */
+   ec_idxstackT     idxstack;
+   /** TRUE to send prepared processdata frames, see ecx_prepare_group() */
+   boolean          prepare;
+   /** internal, prepared processdata frames */
+   ec_preparedgroupt prepared;
+   /** input change detection, NULL if not used. Set with ecx_change_attach() */
+   ec_changet       *change;
 } ec_groupt;
 
 /** SII FMMU structure */
@@ -310,6 +403,41 @@ typedef struct ec_eepromPDO
    uint16  SMbitsize[EC_MAXSM];
 } ec_eepromPDOt;
 
+/** SII cache of one slave, see ec_eepcachet */
+typedef struct ec_eepslot
+{
+   /** slave number, 0 if slot is free */
+   uint16  slave;
+   /** number of categories in index */
+   uint16  ncat;
+   /** byte address of next category header not in index, 0 at end of SII */
+   uint16  catnext;
+   /** last use, for replacement of the least recently used slot */
+   uint32  lastuse;
+   /** category types */
+   uint16  cat[EC_MAXEEPCAT];
+   /** byte address of category at its length entry */
+   uint16  catpos[EC_MAXEEPCAT];
+   /** bitmap of cached bytes */
+   uint32  map[EC_MAXEEPBITMAP];
+   /** cached SII bytes */
+   uint8   buf[EC_MAXEEPBUF];
+} ec_eepslott;
+
+/** SII cache of multiple slaves. Slots are assigned to slaves on first
+ * access, the least recently used slot is reassigned when all are taken. */
+typedef struct ec_eepcache
+{
+   /** internal, use counter */
+   uint32       usecount;
+   /** internal, slot of last access */
+   uint16       last;
+   /** number of slots to use, 0 for EC_MAXEEPSLOT */
+   uint16       nslot;
+   /** slots */
+   ec_eepslott  slot[EC_MAXEEPSLOT];
+} ec_eepcachet;
+
 /** mailbox buffer array */
 typedef uint8 ec_mbxbuft[EC_MAXMBX + 1];
 
@@ -334,16 +462,42 @@ typedef struct PACKED ec_alstatus
 } ec_alstatust;
 PACKED_END
 
-/** stack structure to store segmented LRD/LWR/LRW constructs */
-typedef struct ec_idxstack
+/** states of a mailbox job, see ecx_mbxjob_poll() */
+typedef enum
 {
-   uint8   pushed;
-   uint8   pulled;
-   uint8   idx[EC_MAXBUF];
-   void    *data[EC_MAXBUF];
-   uint16  length[EC_MAXBUF];
-   uint16  dcoffset[EC_MAXBUF];
-} ec_idxstackT;
+   /** job finished or not started */
+   EC_MBXJOB_IDLE       = 0,
+   /** request is written as soon as the slave in mailbox is empty */
+   EC_MBXJOB_SEND,
+   /** waiting for a response of the slave */
+   EC_MBXJOB_RECEIVE
+} ec_mbxjobstate;
+
+typedef struct ec_mbxjob ec_mbxjobt;
+
+/** Mailbox job of one slave. A job is a sequence of request and response
+ * exchanges driven by its step function. The jobs of many slaves are run
+ * together by ecx_mbxjob_poll(), each with one request outstanding.
+ */
+struct ec_mbxjob
+{
+   /** slave number */
+   uint16            slave;
+   /** job state, see ec_mbxjobstate */
+   int               state;
+   /** result of last exchange, >0 response in mbx, 0 or EC_NOFRAME request
+    * not written, EC_TIMEOUT no response */
+   int               wkc;
+   /** timeout in us of a response, standard is EC_TIMEOUTRXM */
+   int               timeout;
+   /** timer of the running exchange */
+   osal_timert       timer;
+   /** Called after every exchange while state still tells where it ended.
+    * Puts the next request in mbx and returns the next state. */
+   int               (*step)(ecx_contextt *context, ec_mbxjobt *job);
+   /** request to send, after the exchange the response */
+   ec_mbxbuft        mbx;
+};
 
 /** ringbuf for error storage */
 typedef struct ec_ering
@@ -383,6 +537,15 @@ typedef struct PACKED ec_PDOdesc
 } ec_PDOdesct;
 PACKED_END
 
+/** latency and jitter statistics, see ethercatstats.h */
+typedef struct ec_stats ec_statst;
+/** persistent SII cache, see ethercatsiicache.h */
+typedef struct ec_siicache ec_siicachet;
+/** directory of mapped PDO entries, see ethercatpdo.h */
+typedef struct ec_pdodir ec_pdodirt;
+/** CoE or SoE mapping job of one slave, see ethercatconfig.h */
+typedef struct ec_mapjob ec_mapjobt;
+
 /** Context structure , referenced by all ecx functions*/
 struct ecx_context
 {
@@ -406,7 +569,8 @@ struct ecx_context
    uint16         esislave;
    /** internal, reference to error list */
    ec_eringt      *elist;
-   /** internal, reference to processdata stack buffer info */
+   /** not used anymore, processdata frames are tracked per group in
+    * ec_groupt.idxstack. Kept for source compatibility. */
    ec_idxstackT   *idxstack;
    /** reference to ecaterror state */
    boolean        *ecaterror;
@@ -431,6 +595,25 @@ struct ecx_context
    /** userdata, promotes application configuration esp. in EC_VER2 with multiple 
     * ec_context instances. Note: userdata memory is managed by application, not SOEM */
    void           *userdata;
+   /** statistics, NULL if not recording. Set with ecx_stats_attach() */
+   ec_statst      *stats;
+   /** SII cache, NULL if not used. Set with ecx_siicache_attach() */
+   ec_siicachet   *siicache;
+   /** SII cache of multiple slaves, if NULL esibuf caches only one slave */
+   ec_eepcachet   *eepcache;
+   /** ecx_config_init() discovers slaves with batched register access */
+   boolean        batchdiscovery;
+   /** ecx_config_map_group() maps the SM1 status of mailbox slaves behind
+    * the inputs, ecx_mbxreceive() then takes it from the process data */
+   boolean        mbxstatusmap;
+   /** PDO entry directory, NULL if not recording. Set with ecx_pdo_attach() */
+   ec_pdodirt     *pdodir;
+   /** jobs reading the CoE and SoE mappings of slaves together in
+    * ecx_config_map_group(). NULL means serial mapping, the mapping of one
+    * slave is read after the other */
+   ec_mapjobt     *mapjob;
+   /** number of jobs in mapjob, at most EC_MAXMAPJOB are used */
+   int            maxmapjob;
 };
 
 #ifdef EC_VER1
@@ -453,6 +636,7 @@ int ec_init(const char * ifname);
 int ec_init_redundant(const char *ifname, char *if2name);
 void ec_close(void);
 uint8 ec_siigetbyte(uint16 slave, uint16 address);
+void ec_siiclear(uint16 slave);
 int16 ec_siifind(uint16 slave, uint16 cat);
 void ec_siistring(char *str, uint16 slave, uint16 Sn);
 uint16 ec_siiFMMU(uint16 slave, ec_eepromFMMUt* FMMU);
@@ -462,9 +646,13 @@ uint32 ec_siiPDO(uint16 slave, ec_eepromPDOt* PDO, uint8 t);
 int ec_readstate(void);
 int ec_writestate(uint16 slave);
 uint16 ec_statecheck(uint16 slave, uint16 reqstate, int timeout);
+int ec_statewait(int n, const uint16 *list, uint16 reqstate, int timeout);
+int ec_statechange(int n, const uint16 *list, uint16 reqstate, int timeout);
 int ec_mbxempty(uint16 slave, int timeout);
 int ec_mbxsend(uint16 slave,ec_mbxbuft *mbx, int timeout);
 int ec_mbxreceive(uint16 slave, ec_mbxbuft *mbx, int timeout);
+int ec_mbxjob_poll(ec_mbxjobt **job, int n);
+void ec_mbxjob_run(ec_mbxjobt **job, int n);
 void ec_esidump(uint16 slave, uint8 *esibuf);
 uint32 ec_readeeprom(uint16 slave, uint16 eeproma, int timeout);
 int ec_writeeeprom(uint16 slave, uint16 eeproma, uint16 data, int timeout);
@@ -476,6 +664,8 @@ uint64 ec_readeepromFP(uint16 configadr, uint16 eeproma, int timeout);
 int ec_writeeepromFP(uint16 configadr, uint16 eeproma, uint16 data, int timeout);
 void ec_readeeprom1(uint16 slave, uint16 eeproma);
 uint32 ec_readeeprom2(uint16 slave, int timeout);
+int ec_readeeprom_multi(int n, const uint16 *slave, uint16 eeproma, uint64 *data, int timeout);
+int ec_prepare_group(uint8 group, boolean use_overlap_io);
 int ec_send_processdata_group(uint8 group);
 int ec_send_overlap_processdata_group(uint8 group);
 int ec_receive_processdata_group(uint8 group, int timeout);
@@ -496,6 +686,7 @@ int ecx_init(ecx_contextt *context, const char * ifname);
 int ecx_init_redundant(ecx_contextt *context, ecx_redportt *redport, const char *ifname, char *if2name);
 void ecx_close(ecx_contextt *context);
 uint8 ecx_siigetbyte(ecx_contextt *context, uint16 slave, uint16 address);
+void ecx_siiclear(ecx_contextt *context, uint16 slave);
 int16 ecx_siifind(ecx_contextt *context, uint16 slave, uint16 cat);
 void ecx_siistring(ecx_contextt *context, char *str, uint16 slave, uint16 Sn);
 uint16 ecx_siiFMMU(ecx_contextt *context, uint16 slave, ec_eepromFMMUt* FMMU);
@@ -505,9 +696,14 @@ uint32 ecx_siiPDO(ecx_contextt *context, uint16 slave, ec_eepromPDOt* PDO, uint8
 int ecx_readstate(ecx_contextt *context);
 int ecx_writestate(ecx_contextt *context, uint16 slave);
 uint16 ecx_statecheck(ecx_contextt *context, uint16 slave, uint16 reqstate, int timeout);
+int ecx_statewait(ecx_contextt *context, int n, const uint16 *list, uint16 reqstate, int timeout);
+int ecx_statechange(ecx_contextt *context, int n, const uint16 *list, uint16 reqstate, int timeout);
 int ecx_mbxempty(ecx_contextt *context, uint16 slave, int timeout);
 int ecx_mbxsend(ecx_contextt *context, uint16 slave,ec_mbxbuft *mbx, int timeout);
 int ecx_mbxreceive(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int timeout);
+void ecx_mbxjob_start(ec_mbxjobt *job);
+int ecx_mbxjob_poll(ecx_contextt *context, ec_mbxjobt **job, int n);
+void ecx_mbxjob_run(ecx_contextt *context, ec_mbxjobt **job, int n);
 void ecx_esidump(ecx_contextt *context, uint16 slave, uint8 *esibuf);
 uint32 ecx_readeeprom(ecx_contextt *context, uint16 slave, uint16 eeproma, int timeout);
 int ecx_writeeeprom(ecx_contextt *context, uint16 slave, uint16 eeproma, uint16 data, int timeout);
@@ -519,6 +715,9 @@ uint64 ecx_readeepromFP(ecx_contextt *context, uint16 configadr, uint16 eeproma,
 int ecx_writeeepromFP(ecx_contextt *context, uint16 configadr, uint16 eeproma, uint16 data, int timeout);
 void ecx_readeeprom1(ecx_contextt *context, uint16 slave, uint16 eeproma);
 uint32 ecx_readeeprom2(ecx_contextt *context, uint16 slave, int timeout);
+int ecx_readeeprom_multi(ecx_contextt *context, int n, const uint16 *slave, uint16 eeproma, uint64 *data, int timeout);
+int ecx_prepare_group(ecx_contextt *context, uint8 group, boolean use_overlap_io);
+void ecx_release_prepared(ecx_contextt *context, uint8 group);
 int ecx_send_overlap_processdata_group(ecx_contextt *context, uint8 group);
 int ecx_receive_processdata_group(ecx_contextt *context, uint8 group, int timeout);
 int ecx_send_processdata(ecx_contextt *context);
@@ -0,0 +1,587 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Directory of mapped PDO entries.
+ *
+ * When a directory is attached to a context with ecx_pdo_attach() the
+ * mapping phase of ecx_config_map_group() keeps every PDO entry it walks,
+ * from the CoE PDO assign and mapping objects or from the SII PDO
+ * categories, with its SM and bit offset inside the data of that SM.
+ *
+ * After mapping, ecx_pdo_find() and ecx_pdo_findname() look up an entry by
+ * slave, index and subindex or by slave and SII name through a hash table,
+ * and turn it into a handle that points into the IOmap. The hash tables are
+ * updated when entries are added or removed, lookups only read the
+ * directory so any thread can use them once mapping is done.
+ *
+ * Reading and writing through the handle with ecx_pdo_get() and
+ * ecx_pdo_set() is a single load or store for byte aligned entries of 8,
+ * 16, 32 or 64 bits and for entries within one byte; other entries are
+ * assembled bit by bit.
+ *
+ * SoE mappings and mappings set by the configuration table are not in the
+ * directory.
+ */
+
+#include <string.h>
+#include "osal.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatpdo.h"
+
+/** Hash of slave, index and subindex.
+ * @param[in]  slave    = slave number
+ * @param[in]  index    = object index
+ * @param[in]  subindex = object subindex
+ * @return slot in hash table
+ */
+static uint32 ecx_pdo_idxhash(uint16 slave, uint16 index, uint8 subindex)
+{
+   uint32 h;
+
+   h = ((uint32)slave * 0x9E3779B1U) ^ ((((uint32)index << 8) | subindex) * 0x85EBCA6BU);
+   return (h ^ (h >> 15)) & (EC_PDODIR_HASHSIZE - 1);
+}
+
+/** Hash of slave and name.
+ * @param[in]  slave    = slave number
+ * @param[in]  name     = entry name
+ * @return slot in hash table
+ */
+static uint32 ecx_pdo_namehash(uint16 slave, const char *name)
+{
+   uint32 h = 2166136261U ^ slave;
+
+   while (*name)
+   {
+      h = (h ^ (uint8)*name++) * 16777619U;
+   }
+   return (h ^ (h >> 15)) & (EC_PDODIR_HASHSIZE - 1);
+}
+
+/** Add an entry to the hash tables.
+ * @param[in]  dir      = PDO directory
+ * @param[in]  n        = entry number
+ */
+static void ecx_pdo_hashentry(ec_pdodirt *dir, uint32 n)
+{
+   ec_pdoentryt *e = &(dir->entry[n]);
+   uint32 h;
+
+   if (!e->index)
+   {
+      return;
+   }
+   h = ecx_pdo_idxhash(e->slave, e->index, e->subindex);
+   while (dir->idxhash[h])
+   {
+      h = (h + 1) & (EC_PDODIR_HASHSIZE - 1);
+   }
+   dir->idxhash[h] = (uint16)(n + 1);
+   if (e->name)
+   {
+      h = ecx_pdo_namehash(e->slave, &(dir->names[e->name - 1]));
+      while (dir->namehash[h])
+      {
+         h = (h + 1) & (EC_PDODIR_HASHSIZE - 1);
+      }
+      dir->namehash[h] = (uint16)(n + 1);
+   }
+}
+
+/** Move the names still in use to the start of the name pool. Entries
+ * copied with ecx_pdo_copy() share the name of the entry they were copied
+ * from. The name hash table is used as scratch list of the named entries,
+ * it has to be rebuilt afterwards.
+ * @param[in]  dir      = PDO directory
+ */
+static void ecx_pdo_compact(ec_pdodirt *dir)
+{
+   uint16 *list = dir->namehash;
+   uint32 n, i, k, name, last, newname, len;
+
+   /* list the named entries by name offset, mostly in order already */
+   for (n = 0, k = 0; n < dir->nentry; n++)
+   {
+      name = dir->entry[n].name;
+      if (!name)
+      {
+         continue;
+      }
+      for (i = k++; (i > 0) && (dir->entry[list[i - 1]].name > name); i--)
+      {
+         list[i] = list[i - 1];
+      }
+      list[i] = (uint16)n;
+   }
+   /* names only move down, so moving them in order of offset is safe */
+   dir->namelen = 0;
+   last = 0;
+   newname = 0;
+   for (i = 0; i < k; i++)
+   {
+      n = list[i];
+      name = dir->entry[n].name;
+      if (name != last)
+      {
+         last = name;
+         newname = dir->namelen + 1;
+         len = (uint32)strlen(&(dir->names[name - 1])) + 1;
+         memmove(&(dir->names[dir->namelen]), &(dir->names[name - 1]), len);
+         dir->namelen += len;
+      }
+      dir->entry[n].name = newname;
+   }
+}
+
+/** Rebuild the hash tables after entries were removed.
+ * @param[in]  dir      = PDO directory
+ */
+static void ecx_pdo_rehash(ec_pdodirt *dir)
+{
+   uint32 n;
+
+   memset(dir->idxhash, 0, sizeof(dir->idxhash));
+   memset(dir->namehash, 0, sizeof(dir->namehash));
+   for (n = 0; n < dir->nentry; n++)
+   {
+      ecx_pdo_hashentry(dir, n);
+   }
+}
+
+/** Attach PDO directory to context, or detach it. The directory is
+ * cleared and filled by the next ecx_config_map_group().
+ * @param[in]  context  = context struct
+ * @param[in]  dir      = PDO directory, NULL to stop recording
+ */
+void ecx_pdo_attach(ecx_contextt *context, ec_pdodirt *dir)
+{
+   if (dir)
+   {
+      ecx_pdo_clear(dir);
+   }
+   context->pdodir = dir;
+}
+
+/** Remove all entries of a PDO directory.
+ * @param[in]  dir      = PDO directory
+ */
+void ecx_pdo_clear(ec_pdodirt *dir)
+{
+   dir->nentry = 0;
+   dir->namelen = 0;
+   memset(dir->idxhash, 0, sizeof(dir->idxhash));
+   memset(dir->namehash, 0, sizeof(dir->namehash));
+}
+
+/** Remove the entries of one slave, before its mapping is read again.
+ * The names no longer used are dropped from the name pool.
+ * @param[in]  dir      = PDO directory
+ * @param[in]  slave    = slave number
+ */
+void ecx_pdo_remove(ec_pdodirt *dir, uint16 slave)
+{
+   uint32 n, m;
+
+   for (n = 0, m = 0; n < dir->nentry; n++)
+   {
+      if (dir->entry[n].slave != slave)
+      {
+         dir->entry[m++] = dir->entry[n];
+      }
+   }
+   if (m != dir->nentry)
+   {
+      dir->nentry = m;
+      ecx_pdo_compact(dir);
+      ecx_pdo_rehash(dir);
+   }
+}
+
+/** Add a mapped PDO entry, called by the mapping functions.
+ * @param[in]  dir       = PDO directory
+ * @param[in]  slave     = slave number
+ * @param[in]  sm        = SM the PDO is assigned to
+ * @param[in]  pdo       = index of the PDO
+ * @param[in]  index     = object index of the entry, 0 for a gap
+ * @param[in]  subindex  = object subindex of the entry
+ * @param[in]  bitoffset = bit offset in the data of the SM
+ * @param[in]  bitlen    = bit length
+ * @param[in]  datatype  = data type, 0 if not known
+ * @param[in]  name      = entry name, NULL or empty if not known
+ */
+void ecx_pdo_add(ec_pdodirt *dir, uint16 slave, uint8 sm, uint16 pdo, uint16 index,
+   uint8 subindex, uint32 bitoffset, uint8 bitlen, uint8 datatype, const char *name)
+{
+   ec_pdoentryt *e;
+   uint32 l;
+
+   if (dir->nentry >= EC_PDODIR_MAXENTRY)
+   {
+      return;
+   }
+   e = &(dir->entry[dir->nentry]);
+   e->slave = slave;
+   e->sm = sm;
+   e->pdo = pdo;
+   e->index = index;
+   e->subindex = subindex;
+   e->bitoffset = bitoffset;
+   e->bitlen = bitlen;
+   e->datatype = datatype;
+   e->name = 0;
+   l = name ? (uint32)strlen(name) : 0;
+   if (l && ((dir->namelen + l + 1) <= EC_PDODIR_NAMEPOOL))
+   {
+      memcpy(&(dir->names[dir->namelen]), name, l + 1);
+      e->name = dir->namelen + 1;
+      dir->namelen += l + 1;
+   }
+   ecx_pdo_hashentry(dir, dir->nentry++);
+}
+
+/** Copy the entries of a slave to a slave with the same mapping.
+ * @param[in]  dir      = PDO directory
+ * @param[in]  from     = slave with entries
+ * @param[in]  to       = slave to copy them to
+ */
+void ecx_pdo_copy(ec_pdodirt *dir, uint16 from, uint16 to)
+{
+   uint32 n, nentry;
+
+   ecx_pdo_remove(dir, to);
+   nentry = dir->nentry;
+   for (n = 0; (n < nentry) && (dir->nentry < EC_PDODIR_MAXENTRY); n++)
+   {
+      if (dir->entry[n].slave == from)
+      {
+         dir->entry[dir->nentry] = dir->entry[n];
+         dir->entry[dir->nentry].slave = to;
+         ecx_pdo_hashentry(dir, dir->nentry++);
+      }
+   }
+}
+
+/** Add the entries of the SII PDO categories of a slave.
+ * @param[in]  context  = context struct
+ * @param[in]  slave    = slave number
+ */
+void ecx_pdo_readsii(ecx_contextt *context, uint16 slave)
+{
+   ec_pdodirt *dir = context->pdodir;
+   uint32 smbits[EC_MAXSM];
+   uint16 a, c, len, pdo, index;
+   uint8 t, e, er, sm, subindex, sn, datatype, bitlen;
+   uint8 eectl = context->slavelist[slave].eep_pdi;
+   char name[EC_MAXNAME + 1];
+
+   ecx_pdo_remove(dir, slave);
+   memset(smbits, 0, sizeof(smbits));
+   for (t = 0; t < 2; t++)
+   {
+      a = ecx_siifind(context, slave, ECT_SII_PDO + t);
+      if (!a)
+      {
+         continue;
+      }
+      len = ecx_siigetbyte(context, slave, a++);
+      len += (ecx_siigetbyte(context, slave, a++) << 8);
+      /* len counts words, each PDO has a header of 4 words and 4 words per entry */
+      for (c = 0; (c + 4) <= len; )
+      {
+         pdo = ecx_siigetbyte(context, slave, a++);
+         pdo += (ecx_siigetbyte(context, slave, a++) << 8);
+         e = ecx_siigetbyte(context, slave, a++);
+         sm = ecx_siigetbyte(context, slave, a++);
+         a += 4;
+         c += 4;
+         for (er = 1; er <= e; er++)
+         {
+            index = ecx_siigetbyte(context, slave, a++);
+            index += (ecx_siigetbyte(context, slave, a++) << 8);
+            subindex = ecx_siigetbyte(context, slave, a++);
+            sn = ecx_siigetbyte(context, slave, a++);
+            datatype = ecx_siigetbyte(context, slave, a++);
+            bitlen = ecx_siigetbyte(context, slave, a++);
+            a += 2;
+            c += 4;
+            if (sm < EC_MAXSM) /* active and in range SM? */
+            {
+               name[0] = 0;
+               if (index && sn)
+               {
+                  ecx_siistring(context, name, slave, sn);
+               }
+               if (index)
+               {
+                  ecx_pdo_add(dir, slave, sm, pdo, index, subindex, smbits[sm],
+                     bitlen, datatype, name);
+               }
+               smbits[sm] += bitlen;
+            }
+         }
+      }
+   }
+   if (eectl)
+   {
+      ecx_eeprom2pdi(context, slave); /* if eeprom control was previously pdi then restore */
+   }
+}
+
+/** Make the accessor of a directory entry, after the IOmap is mapped.
+ * @param[in]  context  = context struct
+ * @param[in]  n        = entry number
+ * @param[out] h        = accessor
+ * @return 1 if successful, 0 if the entry is not in the IOmap
+ */
+int ecx_pdo_handle(ecx_contextt *context, uint32 n, ec_pdohandlet *h)
+{
+   ec_pdodirt *dir = context->pdodir;
+   ec_pdoentryt *e;
+   ec_slavet *sl;
+   uint8 *p, type;
+   uint32 bit;
+   int k;
+
+   if (!dir || (n >= dir->nentry))
+   {
+      return 0;
+   }
+   e = &(dir->entry[n]);
+   sl = &(context->slavelist[e->slave]);
+   type = sl->SMtype[e->sm];
+   if ((type != 3) && (type != 4))
+   {
+      return 0;
+   }
+   p = (type == 3) ? sl->outputs : sl->inputs;
+   if (!p)
+   {
+      return 0;
+   }
+   /* the SMs of one direction follow each other in the IOmap */
+   bit = (type == 3) ? sl->Ostartbit : sl->Istartbit;
+   for (k = 0; k < e->sm; k++)
+   {
+      if (sl->SMtype[k] == type)
+      {
+         bit += (uint32)etohs(sl->SM[k].SMlength) * 8;
+      }
+   }
+   bit += e->bitoffset;
+   h->p = p + (bit >> 3);
+   h->shift = (uint8)(bit & 7);
+   h->bitlen = e->bitlen;
+   h->output = (type == 3);
+   h->entry = (uint16)n;
+
+   return 1;
+}
+
+/** Find a PDO entry by slave, index and subindex.
+ * @param[in]  context  = context struct
+ * @param[in]  slave    = slave number
+ * @param[in]  index    = object index
+ * @param[in]  subindex = object subindex
+ * @param[out] h        = accessor
+ * @return 1 if found, 0 if not
+ */
+int ecx_pdo_find(ecx_contextt *context, uint16 slave, uint16 index, uint8 subindex,
+   ec_pdohandlet *h)
+{
+   ec_pdodirt *dir = context->pdodir;
+   ec_pdoentryt *e;
+   uint32 s;
+
+   if (!dir)
+   {
+      return 0;
+   }
+   for (s = ecx_pdo_idxhash(slave, index, subindex); dir->idxhash[s];
+        s = (s + 1) & (EC_PDODIR_HASHSIZE - 1))
+   {
+      e = &(dir->entry[dir->idxhash[s] - 1]);
+      if ((e->slave == slave) && (e->index == index) && (e->subindex == subindex))
+      {
+         return ecx_pdo_handle(context, dir->idxhash[s] - 1U, h);
+      }
+   }
+
+   return 0;
+}
+
+/** Find a PDO entry by slave and the entry name from SII.
+ * @param[in]  context  = context struct
+ * @param[in]  slave    = slave number
+ * @param[in]  name     = entry name
+ * @param[out] h        = accessor
+ * @return 1 if found, 0 if not
+ */
+int ecx_pdo_findname(ecx_contextt *context, uint16 slave, const char *name, ec_pdohandlet *h)
+{
+   ec_pdodirt *dir = context->pdodir;
+   ec_pdoentryt *e;
+   uint32 s;
+
+   if (!dir)
+   {
+      return 0;
+   }
+   for (s = ecx_pdo_namehash(slave, name); dir->namehash[s];
+        s = (s + 1) & (EC_PDODIR_HASHSIZE - 1))
+   {
+      e = &(dir->entry[dir->namehash[s] - 1]);
+      if ((e->slave == slave) && (strcmp(&(dir->names[e->name - 1]), name) == 0))
+      {
+         return ecx_pdo_handle(context, dir->namehash[s] - 1U, h);
+      }
+   }
+
+   return 0;
+}
+
+/** Read a PDO entry from the IOmap.
+ * @param[in]  h        = accessor
+ * @return value, the lowest 64 bits for longer entries
+ */
+uint64 ecx_pdo_get(const ec_pdohandlet *h)
+{
+   uint16 w;
+   uint32 l;
+   uint64 ll, v;
+   uint32 bit;
+   int i;
+
+   if (!h->shift)
+   {
+      switch (h->bitlen)
+      {
+         case 8:
+            return *(h->p);
+         case 16:
+            memcpy(&w, h->p, sizeof(w));
+            return etohs(w);
+         case 32:
+            memcpy(&l, h->p, sizeof(l));
+            return etohl(l);
+         case 64:
+            memcpy(&ll, h->p, sizeof(ll));
+            return etohll(ll);
+         default:
+            break;
+      }
+   }
+   if ((h->shift + h->bitlen) <= 8)
+   {
+      return (*(h->p) >> h->shift) & ((1U << h->bitlen) - 1);
+   }
+   v = 0;
+   for (i = 0; (i < h->bitlen) && (i < 64); i++)
+   {
+      bit = h->shift + (uint32)i;
+      if ((h->p[bit >> 3] >> (bit & 7)) & 1)
+      {
+         v |= (uint64)1 << i;
+      }
+   }
+
+   return v;
+}
+
+/** Write a PDO entry to the IOmap.
+ * @param[in]  h        = accessor
+ * @param[in]  value    = value, the lowest bitlen bits are written
+ */
+void ecx_pdo_set(const ec_pdohandlet *h, uint64 value)
+{
+   uint16 w;
+   uint32 l;
+   uint64 ll;
+   uint32 bit;
+   uint8 mask;
+   int i;
+
+   if (!h->shift)
+   {
+      switch (h->bitlen)
+      {
+         case 8:
+            *(h->p) = (uint8)value;
+            return;
+         case 16:
+            w = htoes((uint16)value);
+            memcpy(h->p, &w, sizeof(w));
+            return;
+         case 32:
+            l = htoel((uint32)value);
+            memcpy(h->p, &l, sizeof(l));
+            return;
+         case 64:
+            ll = htoell(value);
+            memcpy(h->p, &ll, sizeof(ll));
+            return;
+         default:
+            break;
+      }
+   }
+   if ((h->shift + h->bitlen) <= 8)
+   {
+      mask = (uint8)(((1U << h->bitlen) - 1) << h->shift);
+      *(h->p) = (uint8)((*(h->p) & ~mask) | (((uint32)value << h->shift) & mask));
+      return;
+   }
+   for (i = 0; i < h->bitlen; i++)
+   {
+      bit = h->shift + (uint32)i;
+      mask = (uint8)(1 << (bit & 7));
+      if ((i < 64) && ((value >> i) & 1))
+      {
+         h->p[bit >> 3] |= mask;
+      }
+      else
+      {
+         h->p[bit >> 3] &= (uint8)~mask;
+      }
+   }
+}
+
+#ifdef EC_VER1
+/** Attach PDO directory to context, or detach it.
+ * @param[in]  dir      = PDO directory, NULL to stop recording
+ * @see ecx_pdo_attach
+ */
+void ec_pdo_attach(ec_pdodirt *dir)
+{
+   ecx_pdo_attach(&ecx_context, dir);
+}
+
+/** Find a PDO entry by slave, index and subindex.
+ * @param[in]  slave    = slave number
+ * @param[in]  index    = object index
+ * @param[in]  subindex = object subindex
+ * @param[out] h        = accessor
+ * @return 1 if found, 0 if not
+ * @see ecx_pdo_find
+ */
+int ec_pdo_find(uint16 slave, uint16 index, uint8 subindex, ec_pdohandlet *h)
+{
+   return ecx_pdo_find(&ecx_context, slave, index, subindex, h);
+}
+
+/** Find a PDO entry by slave and the entry name from SII.
+ * @param[in]  slave    = slave number
+ * @param[in]  name     = entry name
+ * @param[out] h        = accessor
+ * @return 1 if found, 0 if not
+ * @see ecx_pdo_findname
+ */
+int ec_pdo_findname(uint16 slave, const char *name, ec_pdohandlet *h)
+{
+   return ecx_pdo_findname(&ecx_context, slave, name, h);
+}
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatpdo.c
+ */
+
+#ifndef _EC_ECATPDO_H
+#define _EC_ECATPDO_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** maximum number of PDO entries in a directory, must be a power of 2 */
+#ifndef EC_PDODIR_MAXENTRY
+#define EC_PDODIR_MAXENTRY    2048
+#endif
+/* the hash tables and handles hold entry numbers in uint16 */
+#if (EC_PDODIR_MAXENTRY > 32767) || (EC_PDODIR_MAXENTRY & (EC_PDODIR_MAXENTRY - 1))
+#error "EC_PDODIR_MAXENTRY must be a power of 2 not above 16384"
+#endif
+/** size of the hash tables of a directory */
+#define EC_PDODIR_HASHSIZE    (EC_PDODIR_MAXENTRY * 2)
+/** size of the name pool of a directory */
+#ifndef EC_PDODIR_NAMEPOOL
+#define EC_PDODIR_NAMEPOOL    (EC_PDODIR_MAXENTRY * 16)
+#endif
+
+/** one mapped PDO entry */
+typedef struct
+{
+   /** slave number */
+   uint16          slave;
+   /** index of the PDO the entry is mapped in */
+   uint16          pdo;
+   /** object index of the entry, 0 for a gap */
+   uint16          index;
+   /** object subindex of the entry */
+   uint8           subindex;
+   /** SM the PDO is assigned to */
+   uint8           sm;
+   /** bit offset from the start of the data of the SM */
+   uint32          bitoffset;
+   /** bit length */
+   uint8           bitlen;
+   /** data type from SII, ECT_xxx, 0 if not known */
+   uint8           datatype;
+   /** offset of the name in the name pool + 1, 0 if no name */
+   uint32          name;
+} ec_pdoentryt;
+
+/** directory of all mapped PDO entries, attached with ecx_pdo_attach() */
+struct ec_pdodir
+{
+   /** number of entries */
+   uint32          nentry;
+   /** used bytes of the name pool */
+   uint32          namelen;
+   /** entries, in mapping order per slave */
+   ec_pdoentryt    entry[EC_PDODIR_MAXENTRY];
+   /** internal, hash of slave, index and subindex, entry + 1 or 0 */
+   uint16          idxhash[EC_PDODIR_HASHSIZE];
+   /** internal, hash of slave and name, entry + 1 or 0 */
+   uint16          namehash[EC_PDODIR_HASHSIZE];
+   /** zero terminated entry names */
+   char            names[EC_PDODIR_NAMEPOOL];
+};
+
+/** accessor of one PDO entry in the IOmap, made by ecx_pdo_find() */
+typedef struct
+{
+   /** first byte of the entry in the IOmap */
+   uint8           *p;
+   /** bit position of the entry in the first byte */
+   uint8           shift;
+   /** bit length */
+   uint8           bitlen;
+   /** TRUE for an output, FALSE for an input */
+   boolean         output;
+   /** entry number in the directory */
+   uint16          entry;
+} ec_pdohandlet;
+
+#ifdef EC_VER1
+void ec_pdo_attach(ec_pdodirt *dir);
+int ec_pdo_find(uint16 slave, uint16 index, uint8 subindex, ec_pdohandlet *h);
+int ec_pdo_findname(uint16 slave, const char *name, ec_pdohandlet *h);
+#endif
+
+void ecx_pdo_attach(ecx_contextt *context, ec_pdodirt *dir);
+void ecx_pdo_clear(ec_pdodirt *dir);
+void ecx_pdo_remove(ec_pdodirt *dir, uint16 slave);
+void ecx_pdo_add(ec_pdodirt *dir, uint16 slave, uint8 sm, uint16 pdo, uint16 index,
+   uint8 subindex, uint32 bitoffset, uint8 bitlen, uint8 datatype, const char *name);
+void ecx_pdo_copy(ec_pdodirt *dir, uint16 from, uint16 to);
+void ecx_pdo_readsii(ecx_contextt *context, uint16 slave);
+int ecx_pdo_handle(ecx_contextt *context, uint32 n, ec_pdohandlet *h);
+int ecx_pdo_find(ecx_contextt *context, uint16 slave, uint16 index, uint8 subindex,
+   ec_pdohandlet *h);
+int ecx_pdo_findname(ecx_contextt *context, uint16 slave, const char *name, ec_pdohandlet *h);
+uint64 ecx_pdo_get(const ec_pdohandlet *h);
+void ecx_pdo_set(const ec_pdohandlet *h, uint64 value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATPDO_H */
@@ -0,0 +1,240 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Process image exchange between the cyclic thread and an application thread.
+ *
+ * The cyclic thread calls ecx_pi_send() and ecx_pi_receive() instead of the
+ * process data functions of the group. After every receive a complete copy
+ * of the group inputs is published together with the cycle number, the work
+ * counter and the DC time. Before every send the latest complete output
+ * snapshot committed by the application is copied into the IOmap.
+ *
+ * Both directions use a lock-free triple buffer: producer and consumer each
+ * own one buffer and swap it with the middle one by a single atomic exchange,
+ * so neither side ever waits for the other. The application no longer
+ * touches the IOmap and never sees a half updated cycle, and the cyclic
+ * thread never stalls on the application. Each direction supports one
+ * producer and one consumer thread.
+ *
+ * The snapshots hold the data in IOmap layout, the process data of a slave
+ * is at ec_slave[].inputs - ec_group[].inputs and ec_slave[].outputs -
+ * ec_group[].outputs.
+ */
+
+#include <string.h>
+#include "osal.h"
+#include "osal_atomic.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatpi.h"
+
+/** flag in ec_tribuft.middle, the middle buffer holds a new snapshot */
+#define EC_PI_FRESH             0x04
+
+/** Publish the buffer of the producer and take over the middle buffer.
+ * @param[in]  tb             = triple buffer
+ * @return new buffer of the producer
+ */
+static ec_pibuft *ecx_tribuf_publish(ec_tribuft *tb)
+{
+   tb->back = OSAL_ATOMIC_XCHG(&(tb->middle), tb->back | EC_PI_FRESH) & 0x03;
+   return &(tb->buf[tb->back]);
+}
+
+/** Take the newest snapshot for the consumer, if there is one.
+ * @param[in]  tb             = triple buffer
+ * @return TRUE if the buffer of the consumer changed
+ */
+static boolean ecx_tribuf_update(ec_tribuft *tb)
+{
+   if (!(OSAL_ATOMIC_LOAD(&(tb->middle)) & EC_PI_FRESH))
+   {
+      return FALSE;
+   }
+   tb->front = OSAL_ATOMIC_XCHG(&(tb->middle), tb->front) & 0x03;
+   return TRUE;
+}
+
+/** Set up process image exchange of a group, after it is mapped.
+ * The output snapshots start with the current outputs in the IOmap.
+ * @param[in]  context        = context struct
+ * @param[out] pi             = process image exchange
+ * @param[in]  group          = group number
+ * @param[in]  overlap        = TRUE if the group is mapped with ecx_config_overlap_map_group()
+ * @return 1 if successful, 0 if the group does not fit in EC_PIMAXBYTES
+ */
+int ecx_pi_init(ecx_contextt *context, ec_pit *pi, uint8 group, boolean overlap)
+{
+   ec_groupt *grp;
+   int i;
+
+   if (group >= context->maxgroup)
+   {
+      return 0;
+   }
+   grp = &(context->grouplist[group]);
+   if ((grp->Obytes > EC_PIMAXBYTES) || (grp->Ibytes > EC_PIMAXBYTES))
+   {
+      return 0;
+   }
+   memset(pi, 0, sizeof(*pi));
+   pi->group = group;
+   pi->overlap = overlap;
+   pi->Obytes = grp->Obytes;
+   pi->Ibytes = grp->Ibytes;
+   pi->in.middle = pi->out.middle = 1;
+   pi->in.front = pi->out.front = 2;
+   for (i = 0; (i < 3) && pi->Obytes; i++)
+   {
+      memcpy(pi->out.buf[i].data, grp->outputs, pi->Obytes);
+   }
+
+   return 1;
+}
+
+/** Copy the newest committed outputs to the IOmap and send process data.
+ * Called by the cyclic thread instead of ecx_send_processdata_group().
+ * @param[in]  context        = context struct
+ * @param[in]  pi             = process image exchange
+ * @return >0 if processdata is transmitted
+ */
+int ecx_pi_send(ecx_contextt *context, ec_pit *pi)
+{
+   ec_groupt *grp = &(context->grouplist[pi->group]);
+   ec_pibuft *b;
+
+   if (ecx_tribuf_update(&(pi->out)))
+   {
+      b = &(pi->out.buf[pi->out.front]);
+      if (pi->Obytes)
+      {
+         memcpy(grp->outputs, b->data, pi->Obytes);
+      }
+      pi->outseq = b->stamp.seq;
+   }
+   if (pi->overlap)
+   {
+      return ecx_send_overlap_processdata_group(context, pi->group);
+   }
+   return ecx_send_processdata_group(context, pi->group);
+}
+
+/** Receive process data and publish a snapshot of the inputs.
+ * Called by the cyclic thread instead of ecx_receive_processdata_group().
+ * A snapshot is published also when no frame returned, with the work counter
+ * telling so.
+ * @param[in]  context        = context struct
+ * @param[in]  pi             = process image exchange
+ * @param[in]  timeout        = Timeout in us
+ * @return Work counter
+ */
+int ecx_pi_receive(ecx_contextt *context, ec_pit *pi, int timeout)
+{
+   ec_groupt *grp = &(context->grouplist[pi->group]);
+   ec_pibuft *b;
+   int wkc;
+
+   wkc = ecx_receive_processdata_group(context, pi->group, timeout);
+   b = &(pi->in.buf[pi->in.back]);
+   if (pi->Ibytes)
+   {
+      memcpy(b->data, grp->inputs, pi->Ibytes);
+   }
+   b->stamp.seq = ++(pi->cycles);
+   b->stamp.outseq = pi->outseq;
+   b->stamp.wkc = wkc;
+   b->stamp.dctime = grp->hasdc ? *(context->DCtime) : 0;
+   (void)ecx_tribuf_publish(&(pi->in));
+
+   return wkc;
+}
+
+/** Get the newest input snapshot, called by the application thread.
+ * The snapshot stays unchanged until the next call.
+ * @param[in]  pi             = process image exchange
+ * @param[out] stamp          = stamp of the snapshot, may be NULL. seq is 0
+ *                              until the first cycle was received
+ * @return pointer to the inputs of the group
+ */
+const uint8 *ecx_pi_inputs(ec_pit *pi, ec_pistampt *stamp)
+{
+   ec_pibuft *b;
+
+   (void)ecx_tribuf_update(&(pi->in));
+   b = &(pi->in.buf[pi->in.front]);
+   if (stamp)
+   {
+      *stamp = b->stamp;
+   }
+   return b->data;
+}
+
+/** Get the output buffer of the application thread. It holds the outputs
+ * of the last commit, changes are sent after ecx_pi_commit().
+ * @param[in]  pi             = process image exchange
+ * @return pointer to the outputs of the group
+ */
+uint8 *ecx_pi_outputs(ec_pit *pi)
+{
+   return pi->out.buf[pi->out.back].data;
+}
+
+/** Commit the output buffer, the cyclic thread sends it with its next
+ * ecx_pi_send(). Commits in between cycles replace each other. The
+ * pointer returned by ecx_pi_outputs() is no longer valid afterwards.
+ * @param[in]  pi             = process image exchange
+ */
+void ecx_pi_commit(ec_pit *pi)
+{
+   ec_pibuft *b, *n;
+
+   b = &(pi->out.buf[pi->out.back]);
+   b->stamp.seq++;
+   n = ecx_tribuf_publish(&(pi->out));
+   /* the published buffer is only read from now on, continue from it */
+   n->stamp = b->stamp;
+   if (pi->Obytes)
+   {
+      memcpy(n->data, b->data, pi->Obytes);
+   }
+}
+
+#ifdef EC_VER1
+/** Set up process image exchange of a group, after it is mapped.
+ * @param[out] pi             = process image exchange
+ * @param[in]  group          = group number
+ * @param[in]  overlap        = TRUE if the group is mapped with ec_config_overlap_map_group()
+ * @return 1 if successful, 0 if the group does not fit in EC_PIMAXBYTES
+ * @see ecx_pi_init
+ */
+int ec_pi_init(ec_pit *pi, uint8 group, boolean overlap)
+{
+   return ecx_pi_init(&ecx_context, pi, group, overlap);
+}
+
+/** Copy the newest committed outputs to the IOmap and send process data.
+ * @param[in]  pi             = process image exchange
+ * @return >0 if processdata is transmitted
+ * @see ecx_pi_send
+ */
+int ec_pi_send(ec_pit *pi)
+{
+   return ecx_pi_send(&ecx_context, pi);
+}
+
+/** Receive process data and publish a snapshot of the inputs.
+ * @param[in]  pi             = process image exchange
+ * @param[in]  timeout        = Timeout in us
+ * @return Work counter
+ * @see ecx_pi_receive
+ */
+int ec_pi_receive(ec_pit *pi, int timeout)
+{
+   return ecx_pi_receive(&ecx_context, pi, timeout);
+}
+#endif
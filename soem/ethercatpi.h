@@ -0,0 +1,100 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatpi.c
+ */
+
+#ifndef _EC_ECATPI_H
+#define _EC_ECATPI_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** maximum number of input or output bytes of a group in a process image exchange */
+#ifndef EC_PIMAXBYTES
+#define EC_PIMAXBYTES      4096
+#endif
+
+/** stamp of one process image snapshot */
+typedef struct
+{
+   /** sequence number, inputs count the cycles, outputs the commits */
+   uint32          seq;
+   /** inputs only, sequence number of the outputs sent in the same cycle */
+   uint32          outseq;
+   /** inputs only, work counter of the cycle or EC_NOFRAME */
+   int             wkc;
+   /** inputs only, DC time of the reference clock, 0 if the group has no DC */
+   int64           dctime;
+} ec_pistampt;
+
+/** one snapshot of a triple buffer */
+typedef struct
+{
+   /** stamp of the snapshot */
+   ec_pistampt     stamp;
+   /** process data */
+   uint8           data[EC_PIMAXBYTES];
+} ec_pibuft;
+
+/** lock-free triple buffer with one producer and one consumer thread */
+typedef struct
+{
+   /** internal, index of the middle buffer, EC_PI_FRESH set if not yet consumed */
+   uint32          middle;
+   /** internal, buffer owned by the producer */
+   uint32          back;
+   /** internal, buffer owned by the consumer */
+   uint32          front;
+   /** snapshots */
+   ec_pibuft       buf[3];
+} ec_tribuft;
+
+/** process image exchange of one group between the cyclic thread and an
+ * application thread, set up with ecx_pi_init() */
+typedef struct
+{
+   /** group number */
+   uint8           group;
+   /** TRUE if the group is mapped with ecx_config_overlap_map_group() */
+   boolean         overlap;
+   /** output bytes of the group */
+   uint32          Obytes;
+   /** input bytes of the group */
+   uint32          Ibytes;
+   /** internal, number of receive cycles */
+   uint32          cycles;
+   /** internal, sequence number of the outputs in the IOmap */
+   uint32          outseq;
+   /** inputs, produced by the cyclic thread */
+   ec_tribuft      in;
+   /** outputs, produced by the application */
+   ec_tribuft      out;
+} ec_pit;
+
+#ifdef EC_VER1
+int ec_pi_init(ec_pit *pi, uint8 group, boolean overlap);
+int ec_pi_send(ec_pit *pi);
+int ec_pi_receive(ec_pit *pi, int timeout);
+#endif
+
+int ecx_pi_init(ecx_contextt *context, ec_pit *pi, uint8 group, boolean overlap);
+int ecx_pi_send(ecx_contextt *context, ec_pit *pi);
+int ecx_pi_receive(ecx_contextt *context, ec_pit *pi, int timeout);
+const uint8 *ecx_pi_inputs(ec_pit *pi, ec_pistampt *stamp);
+uint8 *ecx_pi_outputs(ec_pit *pi);
+void ecx_pi_commit(ec_pit *pi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATPI_H */
@@ -0,0 +1,403 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Persistent cache of slave SII data.
+ *
+ * The SII content of a slave is constant for a given manufacturer, ID and
+ * revision. When a cache is attached to a context with ecx_siicache_attach()
+ * ecx_config_init() only reads the identity from the EEPROM of slaves that
+ * are in the cache and takes mailbox settings, SII general, strings, SM and
+ * FMMU data from the cache. ecx_config_map_group() takes the process data
+ * mapping from the cache when it would otherwise parse the SII PDO
+ * categories. Slaves not in the cache are read as usual and added.
+ *
+ * The cache is stored in a binary file with ecx_siicache_save() and read
+ * back with ecx_siicache_load(). The file holds a header with magic number,
+ * layout version, entry size and a CRC32 over the entries. A file that does
+ * not match is ignored and the cache starts empty. The file is written in
+ * host byte order and is meant for the machine that wrote it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "osal.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatsiicache.h"
+
+/** header of a SII cache file */
+typedef struct
+{
+   /** EC_SIICACHE_MAGIC */
+   uint32   magic;
+   /** EC_SIICACHE_VERSION */
+   uint16   version;
+   /** size of one entry */
+   uint16   entrysize;
+   /** number of entries following the header */
+   uint32   nentry;
+   /** CRC32 of the entries */
+   uint32   crc;
+} ec_siicachefilet;
+
+/** CRC32 (IEEE 802.3) of a memory block.
+ * @param[in] data         = data
+ * @param[in] size         = size of data in bytes
+ * @return CRC32
+ */
+static uint32 ecx_siicache_crc(const void *data, size_t size)
+{
+   const uint8 *p = (const uint8 *)data;
+   uint32 crc = 0xffffffff;
+   int i;
+
+   while (size--)
+   {
+      crc ^= *p++;
+      for (i = 0; i < 8; i++)
+      {
+         crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+      }
+   }
+
+   return ~crc;
+}
+
+/** Find the cache entry of the identity of a slave.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ * @param[in] valid        = EC_SIICACHE_xxx bits the entry must hold
+ * @return entry or NULL if not found
+ */
+static ec_siicacheentryt *ecx_siicache_find(ecx_contextt *context, uint16 slave, uint8 valid)
+{
+   ec_siicachet *cache = context->siicache;
+   ec_slavet *sl = &context->slavelist[slave];
+   int i;
+
+   if (cache)
+   {
+      for (i = 0; i < cache->nentry; i++)
+      {
+         if ((cache->entry[i].eep_man == sl->eep_man) &&
+             (cache->entry[i].eep_id == sl->eep_id) &&
+             (cache->entry[i].eep_rev == sl->eep_rev))
+         {
+            return ((cache->entry[i].valid & valid) == valid) ? &cache->entry[i] : NULL;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+/** Find or create the cache entry of the identity of a slave.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ * @return entry or NULL if no cache is attached or the cache is full
+ */
+static ec_siicacheentryt *ecx_siicache_add(ecx_contextt *context, uint16 slave)
+{
+   ec_siicachet *cache = context->siicache;
+   ec_siicacheentryt *entry = ecx_siicache_find(context, slave, 0);
+
+   if (entry || !cache)
+   {
+      return entry;
+   }
+   if (cache->nentry >= EC_SIICACHE_MAXENTRY)
+   {
+      EC_PRINT("SII cache full, slave %d not cached.\n", slave);
+      return NULL;
+   }
+   entry = &cache->entry[cache->nentry++];
+   memset(entry, 0, sizeof(*entry));
+   entry->eep_man = context->slavelist[slave].eep_man;
+   entry->eep_id = context->slavelist[slave].eep_id;
+   entry->eep_rev = context->slavelist[slave].eep_rev;
+
+   return entry;
+}
+
+/** Attach a SII cache to a context. The cache is used by ecx_config_init()
+ * and ecx_config_map_group() until it is detached with a NULL pointer.
+ * @param[in] context      = context struct
+ * @param[in] cache        = SII cache, NULL to detach
+ */
+void ecx_siicache_attach(ecx_contextt *context, ec_siicachet *cache)
+{
+   context->siicache = cache;
+}
+
+/** Remove all entries from a SII cache.
+ * @param[out] cache       = SII cache
+ */
+void ecx_siicache_clear(ec_siicachet *cache)
+{
+   memset(cache, 0, sizeof(*cache));
+}
+
+/** Load a SII cache from a file. The cache is cleared first and stays empty
+ * if the file does not exist, has another layout or is corrupt.
+ * @param[out] cache       = SII cache
+ * @param[in]  filename    = name of cache file
+ * @return number of loaded entries
+ */
+int ecx_siicache_load(ec_siicachet *cache, const char *filename)
+{
+   ec_siicachefilet hdr;
+   FILE *f;
+   int ok = 0;
+
+   ecx_siicache_clear(cache);
+   f = fopen(filename, "rb");
+   if (!f)
+   {
+      return 0;
+   }
+   if ((fread(&hdr, sizeof(hdr), 1, f) == 1) &&
+       (hdr.magic == EC_SIICACHE_MAGIC) &&
+       (hdr.version == EC_SIICACHE_VERSION) &&
+       (hdr.entrysize == sizeof(ec_siicacheentryt)) &&
+       (hdr.nentry <= EC_SIICACHE_MAXENTRY) &&
+       (fread(cache->entry, sizeof(ec_siicacheentryt), hdr.nentry, f) == hdr.nentry) &&
+       (ecx_siicache_crc(cache->entry, hdr.nentry * sizeof(ec_siicacheentryt)) == hdr.crc))
+   {
+      ok = 1;
+   }
+   fclose(f);
+   if (!ok)
+   {
+      EC_PRINT("SII cache %s invalid, ignored.\n", filename);
+      ecx_siicache_clear(cache);
+      return 0;
+   }
+   cache->nentry = (int)hdr.nentry;
+
+   return cache->nentry;
+}
+
+/** Save a SII cache to a file. The file is written under a temporary name
+ * and renamed when complete, a crash while saving leaves the old file.
+ * @param[in,out] cache    = SII cache
+ * @param[in]     filename = name of cache file
+ * @return 1 on success, 0 on failure
+ */
+int ecx_siicache_save(ec_siicachet *cache, const char *filename)
+{
+   ec_siicachefilet hdr;
+   char tmpname[256];
+   FILE *f;
+   int ok;
+
+   if (strlen(filename) + 5 > sizeof(tmpname))
+   {
+      return 0;
+   }
+   sprintf(tmpname, "%s.tmp", filename);
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.magic = EC_SIICACHE_MAGIC;
+   hdr.version = EC_SIICACHE_VERSION;
+   hdr.entrysize = sizeof(ec_siicacheentryt);
+   hdr.nentry = (uint32)cache->nentry;
+   hdr.crc = ecx_siicache_crc(cache->entry, cache->nentry * sizeof(ec_siicacheentryt));
+   f = fopen(tmpname, "wb");
+   if (!f)
+   {
+      return 0;
+   }
+   ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1) &&
+        (fwrite(cache->entry, sizeof(ec_siicacheentryt), (size_t)cache->nentry, f) == (size_t)cache->nentry);
+   ok = (fclose(f) == 0) && ok;
+   if (ok && (rename(tmpname, filename) != 0))
+   {
+      /* rename does not replace an existing file on all systems */
+      remove(filename);
+      ok = (rename(tmpname, filename) == 0);
+   }
+   if (!ok)
+   {
+      remove(tmpname);
+      return 0;
+   }
+   cache->dirty = FALSE;
+
+   return 1;
+}
+
+/** Set mailbox settings of a slave from the SII cache.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number, identity must be read
+ * @return TRUE if slave was found in the cache
+ */
+boolean ecx_siicache_getmbx(ecx_contextt *context, uint16 slave)
+{
+   ec_siicacheentryt *entry = ecx_siicache_find(context, slave, EC_SIICACHE_INFO);
+   ec_slavet *sl = &context->slavelist[slave];
+
+   if (!entry)
+   {
+      return FALSE;
+   }
+   sl->mbx_wo = entry->mbx_wo;
+   sl->mbx_l = entry->mbx_l;
+   sl->mbx_ro = entry->mbx_ro;
+   sl->mbx_rl = entry->mbx_rl;
+   sl->mbx_proto = entry->mbx_proto;
+
+   return TRUE;
+}
+
+/** Set SII general, name, SM and FMMU data of a slave from the SII cache.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ * @return TRUE if slave was found in the cache
+ */
+boolean ecx_siicache_getsii(ecx_contextt *context, uint16 slave)
+{
+   ec_siicacheentryt *entry = ecx_siicache_find(context, slave, EC_SIICACHE_INFO);
+   ec_slavet *sl = &context->slavelist[slave];
+   int nSM;
+
+   if (!entry)
+   {
+      return FALSE;
+   }
+   sl->CoEdetails = entry->CoEdetails;
+   sl->FoEdetails = entry->FoEdetails;
+   sl->EoEdetails = entry->EoEdetails;
+   sl->SoEdetails = entry->SoEdetails;
+   if (entry->blockLRW)
+   {
+      sl->blockLRW = 1;
+      context->slavelist[0].blockLRW++;
+   }
+   sl->Ebuscurrent = entry->Ebuscurrent;
+   context->slavelist[0].Ebuscurrent += sl->Ebuscurrent;
+   memcpy(sl->name, entry->name, EC_MAXNAME + 1);
+   for (nSM = 0; nSM < EC_MAXSM; nSM++)
+   {
+      sl->SM[nSM].StartAddr = entry->SM[nSM].StartAddr;
+      sl->SM[nSM].SMlength = entry->SM[nSM].SMlength;
+      sl->SM[nSM].SMflags = entry->SM[nSM].SMflags;
+   }
+   sl->FMMU0func = entry->FMMUfunc[0];
+   sl->FMMU1func = entry->FMMUfunc[1];
+   sl->FMMU2func = entry->FMMUfunc[2];
+   sl->FMMU3func = entry->FMMUfunc[3];
+   EC_PRINT("Cached SII slave %d.\n", slave);
+
+   return TRUE;
+}
+
+/** Store mailbox settings, SII general, name, SM and FMMU data of a slave
+ * in the SII cache. Does nothing if no cache is attached.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ */
+void ecx_siicache_putsii(ecx_contextt *context, uint16 slave)
+{
+   ec_siicacheentryt *entry = ecx_siicache_add(context, slave);
+   ec_slavet *sl = &context->slavelist[slave];
+   int nSM;
+
+   if (!entry)
+   {
+      return;
+   }
+   entry->CoEdetails = sl->CoEdetails;
+   entry->FoEdetails = sl->FoEdetails;
+   entry->EoEdetails = sl->EoEdetails;
+   entry->SoEdetails = sl->SoEdetails;
+   entry->blockLRW = sl->blockLRW;
+   entry->Ebuscurrent = sl->Ebuscurrent;
+   entry->mbx_wo = sl->mbx_wo;
+   entry->mbx_l = sl->mbx_l;
+   entry->mbx_ro = sl->mbx_ro;
+   entry->mbx_rl = sl->mbx_rl;
+   entry->mbx_proto = sl->mbx_proto;
+   memcpy(entry->name, sl->name, EC_MAXNAME + 1);
+   for (nSM = 0; nSM < EC_MAXSM; nSM++)
+   {
+      entry->SM[nSM].StartAddr = sl->SM[nSM].StartAddr;
+      entry->SM[nSM].SMlength = sl->SM[nSM].SMlength;
+      entry->SM[nSM].SMflags = sl->SM[nSM].SMflags;
+   }
+   entry->FMMUfunc[0] = sl->FMMU0func;
+   entry->FMMUfunc[1] = sl->FMMU1func;
+   entry->FMMUfunc[2] = sl->FMMU2func;
+   entry->FMMUfunc[3] = sl->FMMU3func;
+   entry->valid |= EC_SIICACHE_INFO;
+   context->siicache->dirty = TRUE;
+}
+
+/** Set the SII process data mapping of a slave from the SII cache.
+ * @param[in]  context     = context struct
+ * @param[in]  slave       = slave number
+ * @param[out] Osize       = size in bits of output mapping
+ * @param[out] Isize       = size in bits of input mapping
+ * @return TRUE if slave was found in the cache
+ */
+boolean ecx_siicache_getmap(ecx_contextt *context, uint16 slave, uint32 *Osize, uint32 *Isize)
+{
+   ec_siicacheentryt *entry = ecx_siicache_find(context, slave, EC_SIICACHE_MAP);
+   ec_slavet *sl = &context->slavelist[slave];
+   int nSM;
+
+   if (!entry)
+   {
+      return FALSE;
+   }
+   for (nSM = 0; nSM < EC_MAXSM; nSM++)
+   {
+      sl->SM[nSM].SMlength = entry->SMlength[nSM];
+      sl->SMtype[nSM] = entry->SMtype[nSM];
+   }
+   *Osize = entry->Obits;
+   *Isize = entry->Ibits;
+   sl->Obits = entry->Obits;
+   sl->Ibits = entry->Ibits;
+   EC_PRINT("Cached mapping slave %d.\n", slave);
+
+   return TRUE;
+}
+
+/** Store the SII process data mapping of a slave in the SII cache.
+ * Does nothing if no cache is attached.
+ * @param[in] context      = context struct
+ * @param[in] slave        = slave number
+ * @param[in] Osize        = size in bits of output mapping
+ * @param[in] Isize        = size in bits of input mapping
+ */
+void ecx_siicache_putmap(ecx_contextt *context, uint16 slave, uint32 Osize, uint32 Isize)
+{
+   ec_siicacheentryt *entry = ecx_siicache_add(context, slave);
+   ec_slavet *sl = &context->slavelist[slave];
+   int nSM;
+
+   if (!entry)
+   {
+      return;
+   }
+   for (nSM = 0; nSM < EC_MAXSM; nSM++)
+   {
+      entry->SMlength[nSM] = sl->SM[nSM].SMlength;
+      entry->SMtype[nSM] = sl->SMtype[nSM];
+   }
+   entry->Obits = (uint16)Osize;
+   entry->Ibits = (uint16)Isize;
+   entry->valid |= EC_SIICACHE_MAP;
+   context->siicache->dirty = TRUE;
+}
+
+#ifdef EC_VER1
+void ec_siicache_attach(ec_siicachet *cache)
+{
+   ecx_siicache_attach(&ecx_context, cache);
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatsiicache.c
+ */
+
+#ifndef _EC_ECATSIICACHE_H
+#define _EC_ECATSIICACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** maximum number of slave identities in a SII cache */
+#ifndef EC_SIICACHE_MAXENTRY
+#define EC_SIICACHE_MAXENTRY  64
+#endif
+/** magic number at start of a SII cache file, "SIIC" */
+#define EC_SIICACHE_MAGIC     0x43494953
+/** version of the SII cache file layout */
+#define EC_SIICACHE_VERSION   1
+
+/** entry holds SII general, strings, SM, FMMU and mailbox data */
+#define EC_SIICACHE_INFO      0x01
+/** entry holds the process data mapping derived from the SII PDO categories */
+#define EC_SIICACHE_MAP       0x02
+
+/** SII data of one slave identity */
+typedef struct
+{
+   /** manufacturer from EEPROM */
+   uint32          eep_man;
+   /** ID from EEPROM */
+   uint32          eep_id;
+   /** revision from EEPROM */
+   uint32          eep_rev;
+   /** valid parts of the entry, EC_SIICACHE_xxx bits */
+   uint8           valid;
+   /** CoE details */
+   uint8           CoEdetails;
+   /** FoE details */
+   uint8           FoEdetails;
+   /** EoE details */
+   uint8           EoEdetails;
+   /** SoE details */
+   uint8           SoEdetails;
+   /** slave can not handle LRW */
+   uint8           blockLRW;
+   /** E-bus current */
+   int16           Ebuscurrent;
+   /** mailbox write offset */
+   uint16          mbx_wo;
+   /** mailbox length */
+   uint16          mbx_l;
+   /** mailbox read offset */
+   uint16          mbx_ro;
+   /** mailbox read length */
+   uint16          mbx_rl;
+   /** mailbox supported protocols */
+   uint16          mbx_proto;
+   /** output bits of SII mapping */
+   uint16          Obits;
+   /** input bits of SII mapping */
+   uint16          Ibits;
+   /** FMMU functions */
+   uint8           FMMUfunc[4];
+   /** SM types after SII mapping */
+   uint8           SMtype[EC_MAXSM];
+   /** SM lengths after SII mapping, EtherCAT byte order */
+   uint16          SMlength[EC_MAXSM];
+   /** SM settings from SII, EtherCAT byte order */
+   ec_smt          SM[EC_MAXSM];
+   /** readable name */
+   char            name[EC_MAXNAME + 1];
+} ec_siicacheentryt;
+
+/** SII cache, attached to a context with ecx_siicache_attach() */
+struct ec_siicache
+{
+   /** number of used entries */
+   int                  nentry;
+   /** set when an entry was added or changed since load or save */
+   boolean              dirty;
+   /** entries */
+   ec_siicacheentryt    entry[EC_SIICACHE_MAXENTRY];
+};
+
+#ifdef EC_VER1
+void ec_siicache_attach(ec_siicachet *cache);
+#endif
+
+void ecx_siicache_attach(ecx_contextt *context, ec_siicachet *cache);
+void ecx_siicache_clear(ec_siicachet *cache);
+int ecx_siicache_load(ec_siicachet *cache, const char *filename);
+int ecx_siicache_save(ec_siicachet *cache, const char *filename);
+boolean ecx_siicache_getmbx(ecx_contextt *context, uint16 slave);
+boolean ecx_siicache_getsii(ecx_contextt *context, uint16 slave);
+void ecx_siicache_putsii(ecx_contextt *context, uint16 slave);
+boolean ecx_siicache_getmap(ecx_contextt *context, uint16 slave, uint32 *Osize, uint32 *Isize);
+void ecx_siicache_putmap(ecx_contextt *context, uint16 slave, uint32 Osize, uint32 Isize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATSIICACHE_H */
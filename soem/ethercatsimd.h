@@ -0,0 +1,40 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Selection of the vector instructions used by the process data kernels of
+ * ethercatbits.c and ethercatchange.c. Internal header.
+ *
+ * AVX2 or SSE2 are used when the compiler targets them. NEON is only used
+ * if EC_SIMD_USE_NEON is defined as well, f.e. with the SOEM_USE_NEON CMake
+ * option, since that path has not been verified on ARM hardware yet. Without
+ * any of them EC_SIMD_WIDTH is 8 and the kernels work on uint64 words.
+ */
+
+#ifndef _EC_ECATSIMD_H
+#define _EC_ECATSIMD_H
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+/** 32 byte AVX2 vectors */
+#define EC_SIMD_AVX2
+#define EC_SIMD_WIDTH      32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+/** 16 byte SSE2 vectors */
+#define EC_SIMD_SSE2
+#define EC_SIMD_WIDTH      16
+#elif defined(__ARM_NEON) && defined(EC_SIMD_USE_NEON)
+#include <arm_neon.h>
+/** 16 byte NEON vectors */
+#define EC_SIMD_NEON
+#define EC_SIMD_WIDTH      16
+#else
+/** bytes processed per step */
+#define EC_SIMD_WIDTH      8
+#endif
+
+#endif /* _EC_ECATSIMD_H */
@@ -297,11 +297,214 @@ int ecx_SoEwrite(ecx_contextt *context, uint16 slave, uint8 driveNo, uint8 eleme
    return wkc;
 }
 
+/** Start SoE read of an IDN mapping job, as ecx_SoEread().
+ * @param[in]  context      = context struct
+ * @param[in]  mj           = IDN mapping job
+ * @param[in]  elementflags = Flags to select what properties of IDN are to be transferred.
+ * @param[in]  idn          = IDN.
+ * @param[in]  size         = Size in bytes of parameter buffer
+ * @param[out] p            = Pointer to parameter buffer
+ * @return next state of the mailbox job
+ */
+static int ecx_IDNmapjob_read(ecx_contextt *context, ec_IDNmapjobt *mj, uint8 elementflags,
+   uint16 idn, int size, void *p)
+{
+   ec_SoEt *SoEp;
+   uint16 slave = mj->job.slave;
+   uint8 cnt;
+
+   mj->elementflags = elementflags;
+   mj->idn = idn;
+   mj->size = size;
+   mj->p = p;
+   mj->len = 0;
+   ec_clearmbx(&(mj->job.mbx));
+   SoEp = (ec_SoEt *)&(mj->job.mbx);
+   SoEp->MbxHeader.length = htoes(sizeof(ec_SoEt) - sizeof(ec_mbxheadert));
+   SoEp->MbxHeader.address = htoes(0x0000);
+   SoEp->MbxHeader.priority = 0x00;
+   /* get new mailbox count value, used as session handle */
+   cnt = ec_nextmbxcnt(context->slavelist[slave].mbx_cnt);
+   context->slavelist[slave].mbx_cnt = cnt;
+   SoEp->MbxHeader.mbxtype = ECT_MBXT_SOE + MBX_HDR_SET_CNT(cnt); /* SoE */
+   SoEp->opCode = ECT_SOE_READREQ;
+   SoEp->incomplete = 0;
+   SoEp->error = 0;
+   SoEp->driveNo = mj->driveNr;
+   SoEp->elementflags = elementflags;
+   SoEp->idn = htoes(idn);
+
+   return EC_MBXJOB_SEND;
+}
+
+/** Handle SoE read response of an IDN mapping job. Sets mj->wkc as
+ * ecx_SoEread() would return it.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = IDN mapping job
+ * @return TRUE if read is finished, FALSE if more fragments follow
+ */
+static boolean ecx_IDNmapjob_response(ecx_contextt *context, ec_IDNmapjobt *mj)
+{
+   ec_SoEt *aSoEp;
+   uint16 slave = mj->job.slave;
+   int framedatasize;
+   uint8 *mp;
+   uint16 *errorcode;
+
+   mj->wkc = mj->job.wkc;
+   if (mj->wkc <= 0)
+   {
+      if (mj->job.state == EC_MBXJOB_RECEIVE)
+      {
+         ecx_packeterror(context, slave, mj->idn, 0, 4); /* no response */
+      }
+      return TRUE;
+   }
+   aSoEp = (ec_SoEt *)&(mj->job.mbx);
+   /* slave response should be SoE, ReadRes */
+   if (((aSoEp->MbxHeader.mbxtype & 0x0f) == ECT_MBXT_SOE) &&
+       (aSoEp->opCode == ECT_SOE_READRES) &&
+       (aSoEp->error == 0) &&
+       (aSoEp->driveNo == mj->driveNr) &&
+       (aSoEp->elementflags == mj->elementflags))
+   {
+      mp = (uint8 *)&(mj->job.mbx) + sizeof(ec_SoEt);
+      framedatasize = etohs(aSoEp->MbxHeader.length) - sizeof(ec_SoEt)  + sizeof(ec_mbxheadert);
+      /* copy what fits in parameter buffer */
+      if (framedatasize > (mj->size - mj->len))
+      {
+         framedatasize = mj->size - mj->len;
+      }
+      if (framedatasize > 0)
+      {
+         memcpy(mj->p + mj->len, mp, framedatasize);
+         mj->len += framedatasize;
+      }
+      return aSoEp->incomplete ? FALSE : TRUE;
+   }
+   /* other slave response */
+   if (((aSoEp->MbxHeader.mbxtype & 0x0f) == ECT_MBXT_SOE) &&
+       (aSoEp->opCode == ECT_SOE_READRES) &&
+       (aSoEp->error == 1))
+   {
+      mp = (uint8 *)&(mj->job.mbx) + (etohs(aSoEp->MbxHeader.length) + sizeof(ec_mbxheadert) - sizeof(uint16));
+      errorcode = (uint16 *)mp;
+      ecx_SoEerror(context, slave, mj->idn, *errorcode);
+   }
+   else
+   {
+      ecx_packeterror(context, slave, mj->idn, 0, 1); /* Unexpected frame returned */
+   }
+   mj->wkc = 0;
+
+   return TRUE;
+}
+
+/** Continue an IDN mapping job with the current entry of the current
+ * mapping list or the next list.
+ * @param[in]  context  = context struct
+ * @param[in]  mj       = IDN mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_IDNmapjob_nextitem(ecx_contextt *context, ec_IDNmapjobt *mj)
+{
+   if (mj->itemcount < mj->entries)
+   {
+      /* read attribute of each IDN in mapping list */
+      return ecx_IDNmapjob_read(context, mj, EC_SOE_ATTRIBUTE_B, mj->SoEmapping.idn[mj->itemcount],
+         sizeof(mj->SoEattribute), &(mj->SoEattribute));
+   }
+   if (!mj->at)
+   {
+      /* read input mapping via SoE */
+      mj->at = TRUE;
+      return ecx_IDNmapjob_read(context, mj, EC_SOE_VALUE_B, EC_IDN_ATCONFIG,
+         sizeof(mj->SoEmapping), &(mj->SoEmapping));
+   }
+   mj->at = FALSE;
+   mj->driveNr++;
+   if (mj->driveNr < EC_SOE_MAX_DRIVES)
+   {
+      /* read output mapping via SoE */
+      return ecx_IDNmapjob_read(context, mj, EC_SOE_VALUE_B, EC_IDN_MDTCONFIG,
+         sizeof(mj->SoEmapping), &(mj->SoEmapping));
+   }
+
+   return EC_MBXJOB_IDLE;
+}
+
+/** Step function of an IDN mapping job, see ec_mbxjobt.
+ * @param[in]  context  = context struct
+ * @param[in]  job      = mailbox job of the IDN mapping job
+ * @return next state of the mailbox job
+ */
+static int ecx_IDNmapjob_step(ecx_contextt *context, ec_mbxjobt *job)
+{
+   ec_IDNmapjobt *mj = (ec_IDNmapjobt *)job;
+   uint32 *size;
+
+   if (!ecx_IDNmapjob_response(context, mj))
+   {
+      /* wait for next fragment */
+      return EC_MBXJOB_RECEIVE;
+   }
+   size = mj->at ? &(mj->Isize) : &(mj->Osize);
+   if (mj->elementflags == EC_SOE_VALUE_B)
+   {
+      mj->entries = 0;
+      mj->itemcount = 0;
+      if ((mj->wkc > 0) && (mj->len >= 4) &&
+          ((etohs(mj->SoEmapping.currentlength) / 2) > 0) &&
+          ((etohs(mj->SoEmapping.currentlength) / 2) <= EC_SOE_MAXMAPPING))
+      {
+         mj->entries = etohs(mj->SoEmapping.currentlength) / 2;
+         /* command word or status word (uint16) is always mapped but not in list */
+         *size += 16;
+      }
+   }
+   else
+   {
+      if ((mj->wkc > 0) && (!mj->SoEattribute.list))
+      {
+         /* length : 0 = 8bit, 1 = 16bit .... */
+         *size += (int)8 << mj->SoEattribute.length;
+      }
+      mj->itemcount++;
+   }
+
+   return ecx_IDNmapjob_nextitem(context, mj);
+}
+
+/** Start an SoE IDN mapping job. The job reads the same IDNs as
+ * ecx_readIDNmap(), but does not block. Run it with ecx_mbxjob_poll()
+ * together with the jobs of other slaves, the mapping is found when its
+ * state is EC_MBXJOB_IDLE again.
+ *
+ * @param[in]  context = context struct
+ * @param[out] mj      = IDN mapping job
+ * @param[in]  slave   = Slave number
+ */
+void ecx_IDNmapjob(ecx_contextt *context, ec_IDNmapjobt *mj, uint16 slave)
+{
+   mj->job.slave = slave;
+   mj->job.timeout = EC_TIMEOUTRXM;
+   mj->job.step = &ecx_IDNmapjob_step;
+   mj->Osize = 0;
+   mj->Isize = 0;
+   mj->driveNr = 0;
+   mj->at = FALSE;
+   /* read output mapping via SoE */
+   (void)ecx_IDNmapjob_read(context, mj, EC_SOE_VALUE_B, EC_IDN_MDTCONFIG,
+      sizeof(mj->SoEmapping), &(mj->SoEmapping));
+   ecx_mbxjob_start(&(mj->job));
+}
+
 /** SoE read AT and MTD mapping.
  *
  * SoE has standard indexes defined for mapping. This function
  * tries to read them and collect a full input and output mapping size
- * of designated slave.
+ * of designated slave. The IDNs are read by an IDN mapping job, see
+ * ecx_IDNmapjob().
  *
  * @param[in]  context = context struct
  * @param[in]  slave   = Slave number
@@ -311,64 +514,16 @@ int ecx_SoEwrite(ecx_contextt *context, uint16 slave, uint8 driveNo, uint8 eleme
  */
 int ecx_readIDNmap(ecx_contextt *context, uint16 slave, uint32 *Osize, uint32 *Isize)
 {
-   int retVal = 0;
-   int   wkc;
-   int psize;
-   uint8 driveNr;
-   uint16 entries, itemcount;
-   ec_SoEmappingt     SoEmapping;
-   ec_SoEattributet   SoEattribute;
+   ec_IDNmapjobt mj;
+   ec_mbxjobt *job = &(mj.job);
 
-   *Isize = 0;
-   *Osize = 0;
-   for(driveNr = 0; driveNr < EC_SOE_MAX_DRIVES; driveNr++)
-   {
-      psize = sizeof(SoEmapping);
-      /* read output mapping via SoE */
-      wkc = ecx_SoEread(context, slave, driveNr, EC_SOE_VALUE_B, EC_IDN_MDTCONFIG, &psize, &SoEmapping, EC_TIMEOUTRXM);
-      if ((wkc > 0) && (psize >= 4) && ((entries = etohs(SoEmapping.currentlength) / 2) > 0) && (entries <= EC_SOE_MAXMAPPING))
-      {
-         /* command word (uint16) is always mapped but not in list */
-         *Osize += 16;
-         for (itemcount = 0 ; itemcount < entries ; itemcount++)
-         {
-            psize = sizeof(SoEattribute);
-            /* read attribute of each IDN in mapping list */
-            wkc = ecx_SoEread(context, slave, driveNr, EC_SOE_ATTRIBUTE_B, SoEmapping.idn[itemcount], &psize, &SoEattribute, EC_TIMEOUTRXM);
-            if ((wkc > 0) && (!SoEattribute.list))
-            {
-               /* length : 0 = 8bit, 1 = 16bit .... */
-               *Osize += (int)8 << SoEattribute.length;
-            }
-         }
-      }
-      psize = sizeof(SoEmapping);
-      /* read input mapping via SoE */
-      wkc = ecx_SoEread(context, slave, driveNr, EC_SOE_VALUE_B, EC_IDN_ATCONFIG, &psize, &SoEmapping, EC_TIMEOUTRXM);
-      if ((wkc > 0) && (psize >= 4) && ((entries = etohs(SoEmapping.currentlength) / 2) > 0) && (entries <= EC_SOE_MAXMAPPING))
-      {
-         /* status word (uint16) is always mapped but not in list */
-         *Isize += 16;
-         for (itemcount = 0 ; itemcount < entries ; itemcount++)
-         {
-            psize = sizeof(SoEattribute);
-            /* read attribute of each IDN in mapping list */
-            wkc = ecx_SoEread(context, slave, driveNr, EC_SOE_ATTRIBUTE_B, SoEmapping.idn[itemcount], &psize, &SoEattribute, EC_TIMEOUTRXM);
-            if ((wkc > 0) && (!SoEattribute.list))
-            {
-               /* length : 0 = 8bit, 1 = 16bit .... */
-               *Isize += (int)8 << SoEattribute.length;
-            }
-         }
-      }
-   }
+   ecx_IDNmapjob(context, &mj, slave);
+   ecx_mbxjob_run(context, &job, 1);
+   *Osize = mj.Osize;
+   *Isize = mj.Isize;
 
    /* found some I/O bits ? */
-   if ((*Isize > 0) || (*Osize > 0))
-   {
-      retVal = 1;
-   }
-   return retVal;
+   return ((*Isize > 0) || (*Osize > 0)) ? 1 : 0;
 }
 
 #ifdef EC_VER1
@@ -113,6 +113,40 @@ typedef struct PACKED
 } ec_SoEattributet;
 PACKED_END
 
+/** SoE IDN mapping job of one slave, see ecx_IDNmapjob() */
+typedef struct
+{
+   /** mailbox job, run by ecx_mbxjob_poll() */
+   ec_mbxjobt        job;
+   /** size in bits of output mapping (MDT) found */
+   uint32            Osize;
+   /** size in bits of input mapping (AT) found */
+   uint32            Isize;
+   /** internal, current drive */
+   uint8             driveNr;
+   /** internal, TRUE while doing the AT mapping of the drive */
+   boolean           at;
+   /** internal, number of IDNs in current mapping list */
+   uint16            entries;
+   /** internal, current IDN in mapping list */
+   uint16            itemcount;
+   /** internal, element flags of running SoE read */
+   uint8             elementflags;
+   /** internal, IDN of running SoE read */
+   uint16            idn;
+   /** internal, buffer of running SoE read */
+   uint8             *p;
+   /** internal, size of buffer */
+   int               size;
+   /** internal, bytes read */
+   int               len;
+   /** internal, result of SoE read as of ecx_SoEread() */
+   int               wkc;
+   /** internal, read buffers */
+   ec_SoEmappingt    SoEmapping;
+   ec_SoEattributet  SoEattribute;
+} ec_IDNmapjobt;
+
 #ifdef EC_VER1
 int ec_SoEread(uint16 slave, uint8 driveNo, uint8 elementflags, uint16 idn, int *psize, void *p, int timeout);
 int ec_SoEwrite(uint16 slave, uint8 driveNo, uint8 elementflags, uint16 idn, int psize, void *p, int timeout);
@@ -122,6 +156,7 @@ int ec_readIDNmap(uint16 slave, uint32 *Osize, uint32 *Isize);
 int ecx_SoEread(ecx_contextt *context, uint16 slave, uint8 driveNo, uint8 elementflags, uint16 idn, int *psize, void *p, int timeout);
 int ecx_SoEwrite(ecx_contextt *context, uint16 slave, uint8 driveNo, uint8 elementflags, uint16 idn, int psize, void *p, int timeout);
 int ecx_readIDNmap(ecx_contextt *context, uint16 slave, uint32 *Osize, uint32 *Isize);
+void ecx_IDNmapjob(ecx_contextt *context, ec_IDNmapjobt *mj, uint16 slave);
 
 #ifdef __cplusplus
 }
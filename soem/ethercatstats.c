@@ -0,0 +1,385 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Latency and jitter statistics of the cyclic path.
+ *
+ * When a statistics struct is attached to a context with ecx_stats_attach()
+ * the NIC driver writes a record with tx and rx timestamps and round trip
+ * time for every frame exchange into a ring, and the process data functions
+ * count lost frames, work counter mismatches and the send interval per
+ * group. Nothing is recorded while no struct is attached.
+ *
+ * Kernel and NIC tx timestamps are queued by the socket after the frame is
+ * sent. They are not read in the cyclic path, the records carry a user
+ * space tx time marked EC_STAT_TSPEND until the reader thread calls
+ * ecx_stats_collect() before ecx_stats_readframes().
+ *
+ * Realtime writers never wait. A frame record is dropped if the ring is full
+ * or another thread holds the ring at the same time. Histograms and group
+ * counters have one writer at a time, the round trip histogram by holding
+ * the ring lock, and are read with a sequence counter, so a non realtime
+ * thread can copy a consistent snapshot at any time with
+ * ecx_stats_readframes(), ecx_stats_readhist() and ecx_stats_readgroup().
+ */
+
+#include <string.h>
+#include "osal.h"
+#include "osal_atomic.h"
+#include "oshw.h"
+#include "ethercattype.h"
+#include "ethercatmain.h"
+#include "ethercatstats.h"
+
+/** take lock of the frame ring, TRUE if it was free */
+#define EC_STAT_TRYLOCK(p)      (OSAL_ATOMIC_XCHG((p), 1) == 0)
+
+/** Current time of the osal clock in ns.
+ * @return time in ns
+ */
+static int64 ecx_stats_now(void)
+{
+   ec_timet t;
+
+   t = osal_current_time();
+   return (int64)t.sec * 1000000000 + (int64)t.usec * 1000;
+}
+
+/** Initialise statistics struct before attaching it.
+ * @param[out] stats          = statistics struct
+ * @param[in]  rttbinwidth    = bin width of round trip histogram in ns
+ * @param[in]  periodbinwidth = bin width of group send interval histograms in ns
+ */
+void ecx_stats_init(ec_statst *stats, int32 rttbinwidth, int32 periodbinwidth)
+{
+   int i;
+
+   memset(stats, 0, sizeof(*stats));
+   stats->rtt.binwidth = (rttbinwidth > 0) ? rttbinwidth : 1000;
+   for (i = 0; i < EC_MAXGROUP; i++)
+   {
+      stats->group[i].period.binwidth = (periodbinwidth > 0) ? periodbinwidth : 1000;
+   }
+}
+
+/** Attach statistics struct to context and its NIC driver, or detach it.
+ * @param[in]  context        = context struct
+ * @param[in]  stats          = initialised statistics struct, NULL to stop recording
+ * @param[in]  hwstamp        = if TRUE ask the NIC for hardware timestamps
+ * @return timestamp sources provided by the NIC driver, EC_STAT_TSxxx bits
+ */
+int ecx_stats_attach(ecx_contextt *context, ec_statst *stats, int hwstamp)
+{
+   context->stats = stats;
+   return ecx_setstats(context->port, stats, hwstamp);
+}
+
+/** Add frame record to ring and its round trip time to the histogram.
+ * Called by the NIC driver, from any thread. Never waits, the record is
+ * dropped if the ring is full or another thread is adding a record.
+ * @param[in]  stats          = statistics struct
+ * @param[in]  rec            = frame record
+ */
+void ecx_stats_putframe(ec_statst *stats, const ec_framerect *rec)
+{
+   ec_frameringt *ring = &(stats->frames);
+   uint32 head;
+
+   if (!EC_STAT_TRYLOCK(&(ring->lock)))
+   {
+      OSAL_ATOMIC_INC(&(ring->dropped));
+      return;
+   }
+   head = ring->head;
+   if ((head - OSAL_ATOMIC_LOAD(&(ring->tail))) >= EC_STATRING)
+   {
+      OSAL_ATOMIC_INC(&(ring->dropped));
+   }
+   else
+   {
+      ring->rec[head & (EC_STATRING - 1)] = *rec;
+      OSAL_ATOMIC_STORE(&(ring->head), head + 1);
+   }
+   if ((rec->rtt >= 0) && !((rec->tssrc >> 4) & EC_STAT_TSPEND))
+   {
+      ecx_stats_histadd(&(stats->rtt), rec->rtt);
+   }
+   OSAL_ATOMIC_STORE(&(ring->lock), 0);
+}
+
+/** Collect tx timestamps queued by the NIC driver into the frame records
+ * not read yet. Call from the thread reading the records, before
+ * ecx_stats_readframes(). Timestamps of frames still in flight are lost, and
+ * the driver drops them itself when not collected for EC_STATTXPEND frames.
+ * @param[in]  context        = context struct
+ * @return number of records that got their tx timestamp
+ */
+int ecx_stats_collect(ecx_contextt *context)
+{
+   if (!context->stats)
+   {
+      return 0;
+   }
+   return ecx_collectstats(context->port);
+}
+
+/** Set tx timestamp of the oldest pending record of a frame index, called
+ * by the NIC driver from ecx_stats_collect(). The round trip time of the
+ * record is recalculated and added to the histogram.
+ * @param[in]  stats          = statistics struct
+ * @param[in]  idx            = frame index
+ * @param[in]  txtime         = tx timestamp in ns
+ * @param[in]  txsrc          = timestamp source, EC_STAT_TSSOFT or EC_STAT_TSHW
+ * @return 1 if a record was found, else 0
+ */
+int ecx_stats_txstamp(ec_statst *stats, uint8 idx, int64 txtime, uint8 txsrc)
+{
+   ec_frameringt *ring = &(stats->frames);
+   ec_framerect *rec;
+   uint32 pos, head;
+   uint8 rxsrc;
+   int64 rtt;
+   int found = 0;
+
+   /* the round trip histogram is also written by ecx_stats_putframe(), the
+    * ring lock keeps it to one writer at a time. The realtime thread never
+    * waits for it, it drops its record instead. */
+   while (!EC_STAT_TRYLOCK(&(ring->lock)))
+   {
+      ;
+   }
+   head = ring->head;
+   for (pos = ring->tail; pos != head; pos++)
+   {
+      rec = &(ring->rec[pos & (EC_STATRING - 1)]);
+      if ((rec->idx != idx) || !((rec->tssrc >> 4) & EC_STAT_TSPEND))
+      {
+         continue;
+      }
+      /* a kernel stamp older than the user space one belongs to an earlier
+       * send without record */
+      if ((txsrc != EC_STAT_TSHW) && (txtime < rec->txtime))
+      {
+         break;
+      }
+      rxsrc = rec->tssrc & 0x0f;
+      /* a stamp later than the receive belongs to a later send */
+      if (rec->rxtime && ((txsrc == EC_STAT_TSHW) == (rxsrc == EC_STAT_TSHW)) &&
+          (txtime > rec->rxtime))
+      {
+         continue;
+      }
+      rec->txtime = txtime;
+      rec->tssrc = (uint8)((txsrc << 4) | rxsrc);
+      rec->rtt = -1;
+      /* NIC clock and system clock can not be compared */
+      if (rec->rxtime && ((txsrc == EC_STAT_TSHW) == (rxsrc == EC_STAT_TSHW)))
+      {
+         rtt = rec->rxtime - rec->txtime;
+         if ((rtt >= 0) && (rtt <= 0x7fffffff))
+         {
+            rec->rtt = (int32)rtt;
+            ecx_stats_histadd(&(stats->rtt), rec->rtt);
+         }
+      }
+      found = 1;
+      break;
+   }
+   OSAL_ATOMIC_STORE(&(ring->lock), 0);
+
+   return found;
+}
+
+/** Add sample to histogram. Only one thread at a time may write a histogram.
+ * @param[in]  hist           = histogram
+ * @param[in]  value          = sample in ns
+ */
+void ecx_stats_histadd(ec_histt *hist, int32 value)
+{
+   int32 bin;
+
+   bin = (value > 0) ? (value / hist->binwidth) : 0;
+   if (bin >= EC_STATBINS)
+   {
+      bin = EC_STATBINS - 1;
+   }
+   OSAL_ATOMIC_STORE(&(hist->seq), hist->seq + 1);
+   OSAL_ATOMIC_FENCE();
+   if ((hist->count == 0) || (value < hist->min))
+   {
+      hist->min = value;
+   }
+   if ((hist->count == 0) || (value > hist->max))
+   {
+      hist->max = value;
+   }
+   hist->count++;
+   hist->sum += value;
+   hist->bin[bin]++;
+   OSAL_ATOMIC_STORE(&(hist->seq), hist->seq + 1);
+}
+
+/** Record send of process data of a group, called by the send functions.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ */
+void ecx_stats_sendtime(ecx_contextt *context, uint8 group)
+{
+   ec_groupstatt *gs;
+   int64 now;
+
+   if (group >= EC_MAXGROUP)
+   {
+      return;
+   }
+   gs = &(context->stats->group[group]);
+   now = ecx_stats_now();
+   if (gs->lastsend)
+   {
+      ecx_stats_histadd(&(gs->period), (int32)(now - gs->lastsend));
+   }
+   gs->lastsend = now;
+}
+
+/** Record receive of process data of a group, called by the receive functions.
+ * @param[in]  context        = context struct
+ * @param[in]  group          = group number
+ * @param[in]  lost           = number of frames that did not return
+ * @param[in]  wkc            = work counter of the cycle or EC_NOFRAME
+ */
+void ecx_stats_receive(ecx_contextt *context, uint8 group, int lost, int wkc)
+{
+   ec_groupstatt *gs;
+   ec_groupt *grp = &(context->grouplist[group]);
+
+   if (group >= EC_MAXGROUP)
+   {
+      return;
+   }
+   gs = &(context->stats->group[group]);
+   OSAL_ATOMIC_STORE(&(gs->seq), gs->seq + 1);
+   OSAL_ATOMIC_FENCE();
+   gs->cycles++;
+   gs->lost += lost;
+   if (wkc != (grp->outputsWKC * 2) + grp->inputsWKC)
+   {
+      gs->wkcmismatch++;
+   }
+   OSAL_ATOMIC_STORE(&(gs->seq), gs->seq + 1);
+}
+
+/** Read frame records from ring. Only one thread may read the ring.
+ * @param[in]  stats          = statistics struct
+ * @param[out] rec            = array to store the records in
+ * @param[in]  maxrec         = size of rec array
+ * @return number of records read
+ */
+int ecx_stats_readframes(ec_statst *stats, ec_framerect *rec, int maxrec)
+{
+   ec_frameringt *ring = &(stats->frames);
+   uint32 tail, n, i;
+
+   tail = ring->tail;
+   n = OSAL_ATOMIC_LOAD(&(ring->head)) - tail;
+   if (n > (uint32)maxrec)
+   {
+      n = (uint32)maxrec;
+   }
+   for (i = 0; i < n; i++)
+   {
+      rec[i] = ring->rec[(tail + i) & (EC_STATRING - 1)];
+   }
+   OSAL_ATOMIC_STORE(&(ring->tail), tail + n);
+
+   return (int)n;
+}
+
+/** Copy consistent snapshot of a histogram while it is being written.
+ * @param[in]  hist           = histogram
+ * @param[out] copy           = snapshot
+ */
+void ecx_stats_readhist(const ec_histt *hist, ec_histt *copy)
+{
+   uint32 seq;
+
+   do
+   {
+      while ((seq = OSAL_ATOMIC_LOAD(&(hist->seq))) & 1);
+      memcpy(copy, hist, sizeof(*copy));
+      OSAL_ATOMIC_FENCE();
+   } while (OSAL_ATOMIC_LOAD(&(hist->seq)) != seq);
+}
+
+/** Copy consistent snapshot of the statistics of a group.
+ * @param[in]  stats          = statistics struct
+ * @param[in]  group          = group number, groups from EC_MAXGROUP on
+ *                              are not recorded and read as zero
+ * @param[out] copy           = snapshot
+ */
+void ecx_stats_readgroup(const ec_statst *stats, uint8 group, ec_groupstatt *copy)
+{
+   const ec_groupstatt *gs;
+   uint32 seq;
+
+   if (group >= EC_MAXGROUP)
+   {
+      memset(copy, 0, sizeof(*copy));
+      return;
+   }
+   gs = &(stats->group[group]);
+   do
+   {
+      while ((seq = OSAL_ATOMIC_LOAD(&(gs->seq))) & 1);
+      copy->seq = seq;
+      copy->cycles = gs->cycles;
+      copy->lost = gs->lost;
+      copy->wkcmismatch = gs->wkcmismatch;
+      copy->lastsend = gs->lastsend;
+      OSAL_ATOMIC_FENCE();
+   } while (OSAL_ATOMIC_LOAD(&(gs->seq)) != seq);
+   ecx_stats_readhist(&(gs->period), &(copy->period));
+}
+
+/** Estimate percentile of histogram samples.
+ * @param[in]  hist           = histogram, preferably a snapshot
+ * @param[in]  permille       = percentile in 1/1000, f.e. 999 for 99.9%
+ * @return upper edge of the bin holding the percentile in ns, or max if it
+ * is in the last bin
+ */
+int32 ecx_stats_percentile(const ec_histt *hist, int permille)
+{
+   uint64 limit, sum;
+   int i;
+
+   if (hist->count == 0)
+   {
+      return 0;
+   }
+   limit = ((uint64)hist->count * permille + 999) / 1000;
+   sum = 0;
+   for (i = 0; i < EC_STATBINS - 1; i++)
+   {
+      sum += hist->bin[i];
+      if (sum >= limit)
+      {
+         return (i + 1) * hist->binwidth;
+      }
+   }
+
+   return hist->max;
+}
+
+#ifdef EC_VER1
+int ec_stats_attach(ec_statst *stats, int hwstamp)
+{
+   return ecx_stats_attach(&ecx_context, stats, hwstamp);
+}
+
+int ec_stats_collect(void)
+{
+   return ecx_stats_collect(&ecx_context);
+}
+#endif
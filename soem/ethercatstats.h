@@ -0,0 +1,146 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ethercatstats.c
+ */
+
+#ifndef _EC_ECATSTATS_H
+#define _EC_ECATSTATS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ethercatmain.h"
+
+/** number of records in frame record ring, must be a power of 2 */
+#ifndef EC_STATRING
+#define EC_STATRING        1024
+#endif
+/** number of bins in a histogram, the last bin counts all larger values */
+#define EC_STATBINS        64
+
+/** timestamp taken in user space with CLOCK_REALTIME */
+#define EC_STAT_TSUSER     0x01
+/** timestamp taken by the kernel network stack */
+#define EC_STAT_TSSOFT     0x02
+/** timestamp taken by the NIC */
+#define EC_STAT_TSHW       0x04
+/** tx timestamp not collected yet, txtime is taken in user space until
+ * ecx_stats_collect() sets the kernel or NIC timestamp */
+#define EC_STAT_TSPEND     0x08
+/** frames sent by the NIC driver before it drops uncollected tx timestamps
+ * itself, so they can not fill the receive buffer of the socket */
+#ifndef EC_STATTXPEND
+#define EC_STATTXPEND      64
+#endif
+
+/** record of one frame exchange */
+typedef struct
+{
+   /** transmit time in ns */
+   int64           txtime;
+   /** receive time in ns, 0 if frame was lost */
+   int64           rxtime;
+   /** round trip time in ns, -1 if lost or stamps are not comparable */
+   int32           rtt;
+   /** returned work counter or EC_NOFRAME */
+   int16           wkc;
+   /** frame index */
+   uint8           idx;
+   /** timestamp source of txtime and rxtime, EC_STAT_TSxxx << 4 | EC_STAT_TSxxx */
+   uint8           tssrc;
+} ec_framerect;
+
+/** ring of frame records, written by any thread and read by one reader */
+typedef struct
+{
+   /** internal, set while a writer adds a record */
+   uint32          lock;
+   /** next record to write, only written by writers */
+   uint32          head;
+   /** next record to read, only written by the reader */
+   uint32          tail;
+   /** records dropped because the ring was full or another thread was writing */
+   uint32          dropped;
+   /** records */
+   ec_framerect    rec[EC_STATRING];
+} ec_frameringt;
+
+/** histogram of a time interval */
+typedef struct
+{
+   /** internal, odd while the writer updates the histogram */
+   uint32          seq;
+   /** bin width in ns */
+   int32           binwidth;
+   /** number of samples */
+   uint32          count;
+   /** smallest sample in ns */
+   int32           min;
+   /** largest sample in ns */
+   int32           max;
+   /** sum of all samples in ns */
+   int64           sum;
+   /** sample counts, bin n holds n * binwidth to (n + 1) * binwidth - 1 */
+   uint32          bin[EC_STATBINS];
+} ec_histt;
+
+/** process data statistics of one group */
+typedef struct
+{
+   /** internal, odd while the writer updates the counters */
+   uint32          seq;
+   /** number of receive cycles */
+   uint32          cycles;
+   /** number of frames that did not return */
+   uint32          lost;
+   /** number of cycles with a work counter other than expected */
+   uint32          wkcmismatch;
+   /** internal, time of last send in ns */
+   int64           lastsend;
+   /** interval between sends, shows the cycle jitter */
+   ec_histt        period;
+} ec_groupstatt;
+
+/** statistics of one context, attached with ecx_stats_attach() */
+struct ec_stats
+{
+   /** frame records written by the NIC driver */
+   ec_frameringt   frames;
+   /** histogram of frame round trip times, updated with the frame ring or,
+    * for records with pending tx timestamps, by ecx_stats_collect() */
+   ec_histt        rtt;
+   /** process data statistics per group, groups from EC_MAXGROUP on are
+    * not recorded */
+   ec_groupstatt   group[EC_MAXGROUP];
+};
+
+#ifdef EC_VER1
+int ec_stats_attach(ec_statst *stats, int hwstamp);
+int ec_stats_collect(void);
+#endif
+
+void ecx_stats_init(ec_statst *stats, int32 rttbinwidth, int32 periodbinwidth);
+int ecx_stats_attach(ecx_contextt *context, ec_statst *stats, int hwstamp);
+void ecx_stats_putframe(ec_statst *stats, const ec_framerect *rec);
+int ecx_stats_collect(ecx_contextt *context);
+int ecx_stats_txstamp(ec_statst *stats, uint8 idx, int64 txtime, uint8 txsrc);
+void ecx_stats_histadd(ec_histt *hist, int32 value);
+void ecx_stats_sendtime(ecx_contextt *context, uint8 group);
+void ecx_stats_receive(ecx_contextt *context, uint8 group, int lost, int wkc);
+int ecx_stats_readframes(ec_statst *stats, ec_framerect *rec, int maxrec);
+void ecx_stats_readhist(const ec_histt *hist, ec_histt *copy);
+void ecx_stats_readgroup(const ec_statst *stats, uint8 group, ec_groupstatt *copy);
+int32 ecx_stats_percentile(const ec_histt *hist, int permille);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_ECATSTATS_H */
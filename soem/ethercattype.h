@@ -54,12 +54,20 @@ extern "C"
 #define EC_MAXLRWDATA      (EC_MAXECATFRAME - 14 - 2 - 10 - 2 - 4)
 /** size of DC datagram used in first LRW frame */
 #define EC_FIRSTDCDATAGRAM 20
-/** standard frame buffer size in bytes */
-#define EC_BUFSIZE         EC_MAXECATFRAME
+/** cache line size in bytes, frame buffers are a multiple of it */
+#define EC_CACHELINE       64
+/** standard frame buffer size in bytes, rounded up to whole cache lines */
+#define EC_BUFSIZE         ((EC_MAXECATFRAME + EC_CACHELINE - 1) & ~(EC_CACHELINE - 1))
 /** datagram type EtherCAT */
 #define EC_ECATTYPE        0x1000
-/** number of frame buffers per channel (tx, rx1 rx2) */
+/** default number of frame buffers per channel (tx, rx1 rx2) */
+#ifndef EC_MAXBUF
 #define EC_MAXBUF          16
+#endif
+/** number of distinct frame indexes, upper limit for frame buffers per channel */
+#define EC_MAXFRAMEIDX     256
+/** frame index returned by ecx_getindex() when all frame buffers are in use */
+#define EC_NOINDEX         0xff
 /** timeout value in us for tx frame to return to rx */
 #define EC_TIMEOUTRET      2000
 /** timeout value in us for safe data transfer, max. triple retry */
@@ -74,10 +82,12 @@ extern "C"
 #define EC_TIMEOUTRXM      700000
 /** timeout value in us for check statechange */
 #define EC_TIMEOUTSTATE    2000000
+/** interval in us between state polls of ecx_statewait() */
+#define EC_STATEPOLL       100
 /** size of EEPROM bitmap cache */
 #define EC_MAXEEPBITMAP    128
 /** size of EEPROM cache buffer */
-#define EC_MAXEEPBUF       EC_MAXEEPBITMAP << 5
+#define EC_MAXEEPBUF       (EC_MAXEEPBITMAP << 5)
 /** default number of retries if wkc <= 0 */
 #define EC_DEFAULTRETRIES  3
 /** default group size in 2^x */
@@ -133,6 +143,13 @@ PACKED_END
 #define EC_WKCSIZE          sizeof(uint16)
 /** definition of datagram follows bit in ec_comt.dlength */
 #define EC_DATAGRAMFOLLOWS  (1 << 15)
+/** definition of circulating frame bit in ec_comt.dlength, set by slaves */
+#define EC_DATAGRAMCIRCULATING (1 << 14)
+/** mask of data length in ec_comt.dlength */
+#define EC_DATAGRAMLENGTH   0x07ff
+/** maximum tx buffer length of a frame packed with datagrams, payload of
+ * one EC_MAXLRWDATA datagram */
+#define EC_MAXDGFRAME       (ETH_HEADERSIZE + EC_HEADERSIZE + EC_MAXLRWDATA + EC_WKCSIZE)
 
 /** Possible error codes returned. */
 typedef enum
@@ -0,0 +1,543 @@
+/** \file
+ * \brief Cyclic loop benchmark for Simple Open EtherCAT master
+ *
+ * Usage : ecbench [options] ifname peer
+ * ifname is the NIC the master uses, peer is the interface connected to it,
+ * f.e. the two ends of a veth pair. For every scenario a simulated segment
+ * (see test/linux/ecsim) is started on peer in a thread, the master
+ * configures it, goes to OP and runs the cyclic process data exchange.
+ *
+ * Scenarios are all combinations of the slave counts, process data commands
+ * (LRW or LRD/LWR as with blockLRW), IOmap layouts (classic or overlapped)
+ * and cycle times given, optionally also in redundant mode on a second
+ * veth pair. One JSON object per run is written to stdout with the round
+ * trip percentiles, CPU time, system calls and context switches per cycle.
+ * System calls are counted with the raw_syscalls tracepoint and reported
+ * as -1 where it is not available.
+ *
+ * With -w a previous output is used as baseline and the exit code is 2 if
+ * the p99 round trip or CPU time of any scenario got worse by more than the
+ * tolerance, or frames were lost that were not lost in the baseline. The
+ * exit code is 3 if a scenario could not be run, f.e. the segment could not
+ * be simulated or did not reach OP, so a broken setup is not taken for a
+ * regression.
+ *
+ * Options :
+ *  -s list       : slave counts, default 1,10,100,199
+ *  -c list       : cycle times in us, default 125,250,500,1000,2000,4000
+ *  -n cycles     : measured cycles per run, default 1000
+ *  -x list       : process data commands lrw,split, default both
+ *  -m list       : IOmap layouts classic,overlap, default both
+ *  -r if2,peer2  : also run the scenarios in redundant mode
+ *  -w file       : baseline for the regression gate
+ *  -t percent    : tolerance of the regression gate, default 20
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "ethercat.h"
+#include "ecsim.h"
+
+#ifndef SOEM_VERSION
+#define SOEM_VERSION "unknown"
+#endif
+
+#define MAXLIST      16
+#define WARMUP       100
+#define NSEC_PER_SEC 1000000000
+
+typedef struct
+{
+   int slaves;
+   int split;
+   int overlap;
+   int red;
+   int cycletime;
+} scenariot;
+
+typedef struct
+{
+   scenariot sc;
+   int cycles;
+   double configms;
+   int lost;
+   int wkcerr;
+   int overrun;
+   int32 p50, p99, p999, max;
+   int64 cpu;
+   double syscalls;
+   double ctxsw;
+} resultt;
+
+typedef struct
+{
+   ecsim_segmentt seg;
+   int fd, fd2;
+   volatile int run;
+   pthread_t thread;
+} simt;
+
+static char IOmap[16384];
+static char ifname[64], ifname2[64], peer[64], peer2[64];
+
+static int64 now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int64 thread_cpu_ns(struct rusage *ru)
+{
+   getrusage(RUSAGE_THREAD, ru);
+   return ((int64)ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * NSEC_PER_SEC +
+          ((int64)ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000;
+}
+
+/** Open counter of system calls of the calling thread, -1 if the kernel
+ * does not provide the raw_syscalls tracepoint to us. */
+static int syscall_counter(void)
+{
+   static const char *path[] =
+   {
+      "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+      "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+   };
+   struct perf_event_attr attr;
+   FILE *f;
+   unsigned long long id;
+   unsigned int i;
+
+   for (i = 0; i < sizeof(path) / sizeof(path[0]); i++)
+   {
+      f = fopen(path[i], "r");
+      if (f)
+      {
+         if (fscanf(f, "%llu", &id) == 1)
+         {
+            fclose(f);
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            attr.sample_period = 1;
+            return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+         }
+         fclose(f);
+      }
+   }
+   return -1;
+}
+
+static int64 syscall_count(int fd)
+{
+   unsigned long long n = 0;
+
+   if ((fd < 0) || (read(fd, &n, sizeof(n)) != sizeof(n)))
+   {
+      return 0;
+   }
+   return (int64)n;
+}
+
+static void *sim_thread(void *arg)
+{
+   simt *sim = arg;
+
+   ecsim_serve(&sim->seg, sim->fd, sim->fd2, FALSE, &sim->run);
+   return NULL;
+}
+
+static int sim_start(simt *sim, const scenariot *sc)
+{
+   if (ecsim_init(&sim->seg, sc->slaves, 2, 2, FALSE, 500))
+   {
+      return 0;
+   }
+   sim->fd = ecsim_open(peer, FALSE);
+   sim->fd2 = sc->red ? ecsim_open(peer2, FALSE) : -1;
+   if ((sim->fd < 0) || (sc->red && (sim->fd2 < 0)))
+   {
+      if (sim->fd >= 0)
+      {
+         close(sim->fd);
+      }
+      ecsim_free(&sim->seg);
+      return 0;
+   }
+   sim->run = TRUE;
+   pthread_create(&sim->thread, NULL, sim_thread, sim);
+   return 1;
+}
+
+static void sim_stop(simt *sim)
+{
+   sim->run = FALSE;
+   pthread_join(sim->thread, NULL);
+   close(sim->fd);
+   if (sim->fd2 >= 0)
+   {
+      close(sim->fd2);
+   }
+   ecsim_free(&sim->seg);
+}
+
+static int cmp32(const void *a, const void *b)
+{
+   int32 x = *(const int32 *)a, y = *(const int32 *)b;
+
+   return (x > y) - (x < y);
+}
+
+static int32 percentile(const int32 *sorted, int n, int permille)
+{
+   int i = (int)(((int64)n * permille + 999) / 1000) - 1;
+
+   return sorted[(i < 0) ? 0 : i];
+}
+
+/** Send the process data the way the IOmap of the scenario is laid out. */
+static int send_processdata(const scenariot *sc)
+{
+   return sc->overlap ? ec_send_overlap_processdata() : ec_send_processdata();
+}
+
+/** Configure the segment, go to OP and run the cyclic exchange. */
+static int run_scenario(const scenariot *sc, int cycles, resultt *res)
+{
+   struct rusage ru0, ru1;
+   struct timespec next;
+   int32 *sample;
+   int64 t0, t1, cpu0 = 0, sys0 = 0;
+   int i, wkc, expected = 0, sysfd, ok;
+
+   memset(res, 0, sizeof(*res));
+   res->sc = *sc;
+   res->cycles = cycles;
+   sample = malloc(cycles * sizeof(int32));
+   if (!sample)
+   {
+      return 0;
+   }
+   ok = sc->red ? ec_init_redundant(ifname, ifname2) : ec_init(ifname);
+   if (!ok)
+   {
+      fprintf(stderr, "ec_init on %s failed\n", ifname);
+      free(sample);
+      return 0;
+   }
+   t0 = now_ns();
+   ok = (ec_config_init(FALSE) == sc->slaves);
+   res->configms = (now_ns() - t0) / 1e6;
+   if (ok)
+   {
+      if (sc->overlap)
+      {
+         ec_config_overlap_map(&IOmap);
+      }
+      else
+      {
+         ec_config_map(&IOmap);
+      }
+      ec_group[0].blockLRW = (uint8)sc->split;
+      ec_statecheck(0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE);
+      expected = (ec_group[0].outputsWKC * 2) + ec_group[0].inputsWKC;
+      ec_slave[0].state = EC_STATE_OPERATIONAL;
+      send_processdata(sc);
+      ec_receive_processdata(EC_TIMEOUTRET);
+      ec_writestate(0);
+      ok = (ec_statecheck(0, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE) == EC_STATE_OPERATIONAL);
+   }
+   if (!ok)
+   {
+      fprintf(stderr, "%d slaves did not reach OP\n", sc->slaves);
+      ec_close();
+      free(sample);
+      return 0;
+   }
+
+   sysfd = syscall_counter();
+   clock_gettime(CLOCK_MONOTONIC, &next);
+   for (i = -WARMUP; i < cycles; i++)
+   {
+      if (i == 0)
+      {
+         cpu0 = thread_cpu_ns(&ru0);
+         sys0 = syscall_count(sysfd);
+      }
+      next.tv_nsec += sc->cycletime * 1000;
+      while (next.tv_nsec >= NSEC_PER_SEC)
+      {
+         next.tv_nsec -= NSEC_PER_SEC;
+         next.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+      ec_slave[0].outputs[0] = (uint8)i;
+      t0 = now_ns();
+      send_processdata(sc);
+      wkc = ec_receive_processdata(EC_TIMEOUTRET);
+      t1 = now_ns();
+      if (i < 0)
+      {
+         continue;
+      }
+      sample[i] = (int32)(t1 - t0);
+      if (wkc == EC_NOFRAME)
+      {
+         res->lost++;
+      }
+      else if (wkc != expected)
+      {
+         res->wkcerr++;
+      }
+      if (t1 > ((int64)next.tv_sec * NSEC_PER_SEC + next.tv_nsec + sc->cycletime * 1000))
+      {
+         res->overrun++;
+      }
+   }
+   res->cpu = (thread_cpu_ns(&ru1) - cpu0) / cycles;
+   res->syscalls = (sysfd >= 0) ? (double)(syscall_count(sysfd) - sys0) / cycles : -1.0;
+   res->ctxsw = (double)((ru1.ru_nvcsw - ru0.ru_nvcsw) + (ru1.ru_nivcsw - ru0.ru_nivcsw)) / cycles;
+   if (sysfd >= 0)
+   {
+      close(sysfd);
+   }
+
+   ec_slave[0].state = EC_STATE_INIT;
+   ec_writestate(0);
+   ec_close();
+
+   qsort(sample, cycles, sizeof(int32), cmp32);
+   res->p50 = percentile(sample, cycles, 500);
+   res->p99 = percentile(sample, cycles, 990);
+   res->p999 = percentile(sample, cycles, 999);
+   res->max = sample[cycles - 1];
+   free(sample);
+   return 1;
+}
+
+static void print_result(FILE *f, const resultt *r)
+{
+   fprintf(f, "{\"version\":\"%s\",\"slaves\":%d,\"cmd\":\"%s\",\"map\":\"%s\",\"red\":%d,"
+              "\"cycle_us\":%d,\"cycles\":%d,\"config_ms\":%.1f,\"lost\":%d,\"wkcerr\":%d,"
+              "\"overrun\":%d,\"rtt_p50_ns\":%d,\"rtt_p99_ns\":%d,\"rtt_p999_ns\":%d,"
+              "\"rtt_max_ns\":%d,\"cpu_ns\":%lld,\"syscalls\":%.2f,\"ctxsw\":%.2f}\n",
+           SOEM_VERSION, r->sc.slaves, r->sc.split ? "split" : "lrw",
+           r->sc.overlap ? "overlap" : "classic", r->sc.red, r->sc.cycletime, r->cycles,
+           r->configms, r->lost, r->wkcerr, r->overrun, r->p50, r->p99, r->p999, r->max,
+           (long long)r->cpu, r->syscalls, r->ctxsw);
+   fflush(f);
+}
+
+/** Number following "key": in a line of our own output, -1 if missing. */
+static long long json_num(const char *line, const char *key)
+{
+   char pat[64];
+   const char *p;
+
+   snprintf(pat, sizeof(pat), "\"%s\":", key);
+   p = strstr(line, pat);
+   if (!p)
+   {
+      return -1;
+   }
+   p += strlen(pat);
+   if (*p == '"')
+   {
+      p++;
+   }
+   return strtoll(p, NULL, 10);
+}
+
+static int json_is(const char *line, const char *key, const char *val)
+{
+   char pat[64];
+
+   snprintf(pat, sizeof(pat), "\"%s\":\"%s\"", key, val);
+   return strstr(line, pat) != NULL;
+}
+
+/** Compare result with the same scenario in the baseline.
+ * @return TRUE if it regressed
+ */
+static int gate(FILE *base, const resultt *r, int tolerance)
+{
+   char line[1024];
+   long long p99, cpu, lost;
+   int fail = FALSE;
+
+   rewind(base);
+   while (fgets(line, sizeof(line), base))
+   {
+      if ((json_num(line, "slaves") != r->sc.slaves) ||
+          !json_is(line, "cmd", r->sc.split ? "split" : "lrw") ||
+          !json_is(line, "map", r->sc.overlap ? "overlap" : "classic") ||
+          (json_num(line, "red") != r->sc.red) ||
+          (json_num(line, "cycle_us") != r->sc.cycletime))
+      {
+         continue;
+      }
+      p99 = json_num(line, "rtt_p99_ns");
+      cpu = json_num(line, "cpu_ns");
+      lost = json_num(line, "lost") + json_num(line, "wkcerr");
+      if (r->p99 * 100LL > p99 * (100 + tolerance))
+      {
+         fprintf(stderr, "regression: p99 %d ns, baseline %lld ns\n", r->p99, p99);
+         fail = TRUE;
+      }
+      if (r->cpu * 100LL > cpu * (100 + tolerance))
+      {
+         fprintf(stderr, "regression: cpu %lld ns, baseline %lld ns\n", (long long)r->cpu, cpu);
+         fail = TRUE;
+      }
+      if ((r->lost + r->wkcerr) > lost)
+      {
+         fprintf(stderr, "regression: %d lost or bad frames, baseline %lld\n",
+                 r->lost + r->wkcerr, lost);
+         fail = TRUE;
+      }
+      break;
+   }
+   return fail;
+}
+
+static int parse_list(char *arg, int *list)
+{
+   char *tok;
+   int n = 0;
+
+   for (tok = strtok(arg, ","); tok && (n < MAXLIST); tok = strtok(NULL, ","))
+   {
+      list[n++] = atoi(tok);
+   }
+   return n;
+}
+
+static int parse_modes(const char *arg, const char *m0, const char *m1, int *list)
+{
+   int n = 0;
+
+   if (strstr(arg, m0))
+   {
+      list[n++] = 0;
+   }
+   if (strstr(arg, m1))
+   {
+      list[n++] = 1;
+   }
+   return n;
+}
+
+int main(int argc, char *argv[])
+{
+   int slaves[MAXLIST] = {1, 10, 100, 199}, nslaves = 4;
+   int cycletime[MAXLIST] = {125, 250, 500, 1000, 2000, 4000}, ncycletime = 6;
+   int split[2] = {0, 1}, nsplit = 2;
+   int overlap[2] = {0, 1}, noverlap = 2;
+   int cycles = 1000, tolerance = 20, red = FALSE, failed = 0, broken = 0;
+   int is, ic, ix, im, ir, opt;
+   FILE *base = NULL;
+   scenariot sc;
+   resultt res;
+   simt sim;
+   char *comma;
+
+   while ((opt = getopt(argc, argv, "s:c:n:x:m:r:w:t:")) != -1)
+   {
+      switch (opt)
+      {
+         case 's': nslaves = parse_list(optarg, slaves); break;
+         case 'c': ncycletime = parse_list(optarg, cycletime); break;
+         case 'n': cycles = atoi(optarg); break;
+         case 'x': nsplit = parse_modes(optarg, "lrw", "split", split); break;
+         case 'm': noverlap = parse_modes(optarg, "classic", "overlap", overlap); break;
+         case 'r':
+            comma = strchr(optarg, ',');
+            if (comma)
+            {
+               *comma = 0;
+               strncpy(ifname2, optarg, sizeof(ifname2) - 1);
+               strncpy(peer2, comma + 1, sizeof(peer2) - 1);
+               red = TRUE;
+            }
+            break;
+         case 'w':
+            base = fopen(optarg, "r");
+            if (!base)
+            {
+               perror(optarg);
+               return 1;
+            }
+            break;
+         case 't': tolerance = atoi(optarg); break;
+         default: optind = argc + 1; break;
+      }
+   }
+   if ((optind != argc - 2) || (cycles <= 0))
+   {
+      printf("Usage: ecbench [options] ifname peer\n"
+             " -s list      : slave counts, default 1,10,100,199\n"
+             " -c list      : cycle times in us, default 125,250,500,1000,2000,4000\n"
+             " -n cycles    : measured cycles per run, default 1000\n"
+             " -x list      : process data commands lrw,split\n"
+             " -m list      : IOmap layouts classic,overlap\n"
+             " -r if2,peer2 : also run redundant mode on second veth pair\n"
+             " -w file      : baseline output for the regression gate\n"
+             " -t percent   : tolerance of the regression gate, default 20\n");
+      return 1;
+   }
+   strncpy(ifname, argv[optind], sizeof(ifname) - 1);
+   strncpy(peer, argv[optind + 1], sizeof(peer) - 1);
+
+   for (ir = 0; ir <= red; ir++)
+   for (is = 0; is < nslaves; is++)
+   for (ix = 0; ix < nsplit; ix++)
+   for (im = 0; im < noverlap; im++)
+   for (ic = 0; ic < ncycletime; ic++)
+   {
+      sc.slaves = slaves[is];
+      sc.split = split[ix];
+      sc.overlap = overlap[im];
+      sc.red = ir;
+      sc.cycletime = cycletime[ic];
+      if (!sim_start(&sim, &sc))
+      {
+         fprintf(stderr, "cannot simulate %d slaves on %s\n", sc.slaves, peer);
+         broken++;
+         continue;
+      }
+      if (run_scenario(&sc, cycles, &res))
+      {
+         print_result(stdout, &res);
+         if (base && gate(base, &res, tolerance))
+         {
+            failed++;
+         }
+      }
+      else
+      {
+         broken++;
+      }
+      sim_stop(&sim);
+   }
+   if (base)
+   {
+      fclose(base);
+   }
+
+   if (broken)
+   {
+      return 3;
+   }
+   return failed ? 2 : 0;
+}
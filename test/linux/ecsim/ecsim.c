@@ -0,0 +1,122 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief EtherCAT slave segment simulator
+ *
+ * Usage : ecsim [options] ifname
+ * ifname is the interface the simulated slaves are connected to, f.e. the
+ * peer of a veth pair whose other end is used by the master, or the name of
+ * a TAP device to create with -t.
+ *
+ * Every EtherCAT frame received on ifname is passed through a line of
+ * simulated slaves and sent back, so the master can run ecx_config_init(),
+ * ecx_config_map_group(), state changes, SDO access, DC configuration and
+ * the cyclic process data exchange without hardware. Outputs of every slave
+ * are copied back to its inputs.
+ *
+ * Options :
+ *  -n slaves    : number of slaves, default 8
+ *  -o bytes     : output bytes per slave, default 2
+ *  -i bytes     : input bytes per slave, default 2
+ *  -m           : slaves with CoE mailbox, PDO mapping read by SDO
+ *  -l us        : time a slave takes to answer a mailbox request, default 0
+ *  -d ns        : propagation delay per slave, default 500
+ *  -r ifname2   : ring, the last slave is connected to ifname2, for
+ *                 testing cable redundancy
+ *  -t           : create TAP devices instead of using interfaces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "ecsim.h"
+
+static volatile int run = 1;
+
+static void sighandler(int sig)
+{
+   (void)sig;
+   run = 0;
+}
+
+int main(int argc, char *argv[])
+{
+   ecsim_segmentt seg;
+   struct sigaction sa;
+   char *ifname2 = NULL;
+   int nslave = 8, obytes = 2, ibytes = 2, mailbox = FALSE, tap = FALSE;
+   int64 hopdelay = 500, mbxlatency = 0;
+   int fd, fd2 = -1, opt;
+
+   while ((opt = getopt(argc, argv, "n:o:i:ml:d:r:t")) != -1)
+   {
+      switch (opt)
+      {
+         case 'n': nslave = atoi(optarg); break;
+         case 'o': obytes = atoi(optarg); break;
+         case 'i': ibytes = atoi(optarg); break;
+         case 'm': mailbox = TRUE; break;
+         case 'l': mbxlatency = atoll(optarg) * 1000; break;
+         case 'd': hopdelay = atoll(optarg); break;
+         case 'r': ifname2 = optarg; break;
+         case 't': tap = TRUE; break;
+         default: optind = argc + 1; break;
+      }
+   }
+   if (optind != argc - 1)
+   {
+      printf("Usage: ecsim [options] ifname\n"
+             " -n slaves  : number of slaves, default 8\n"
+             " -o bytes   : output bytes per slave, default 2\n"
+             " -i bytes   : input bytes per slave, default 2\n"
+             " -m         : slaves with CoE mailbox\n"
+             " -l us      : time a slave takes to answer a mailbox request, default 0\n"
+             " -d ns      : propagation delay per slave, default 500\n"
+             " -r ifname2 : ring, last slave connected to ifname2\n"
+             " -t         : create TAP devices\n");
+      return 1;
+   }
+   if (ecsim_init(&seg, nslave, obytes, ibytes, mailbox, hopdelay))
+   {
+      printf("Invalid segment configuration\n");
+      return 1;
+   }
+   seg.mbxlatency = mbxlatency;
+   fd = ecsim_open(argv[optind], tap);
+   if ((fd >= 0) && ifname2)
+   {
+      fd2 = ecsim_open(ifname2, tap);
+   }
+   if ((fd < 0) || (ifname2 && (fd2 < 0)))
+   {
+      if (fd >= 0)
+      {
+         close(fd);
+      }
+      ecsim_free(&seg);
+      return 1;
+   }
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = sighandler;
+   sigaction(SIGINT, &sa, NULL);
+   sigaction(SIGTERM, &sa, NULL);
+   printf("Simulating %d slaves, %d output and %d input bytes each%s on %s%s%s\n",
+          nslave, obytes, ibytes, mailbox ? ", CoE mailbox" : "", argv[optind],
+          ifname2 ? " and " : "", ifname2 ? ifname2 : "");
+   ecsim_serve(&seg, fd, fd2, tap, &run);
+   printf("\n%u frames, %u datagrams processed\n", seg.frames, seg.datagrams);
+   close(fd);
+   if (fd2 >= 0)
+   {
+      close(fd2);
+   }
+   ecsim_free(&seg);
+
+   return 0;
+}
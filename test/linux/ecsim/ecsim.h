@@ -0,0 +1,94 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ecsim_esc.c and ecsim_net.c
+ */
+
+#ifndef _ecsimh_
+#define _ecsimh_
+
+#include "ethercat.h"
+
+/** ESC address space emulated per slave, registers and process RAM */
+#define ECSIM_MEMSIZE     0x2000
+/** size of SII EEPROM in bytes */
+#define ECSIM_SIISIZE     1024
+/** number of FMMUs per slave */
+#define ECSIM_FMMUS       4
+/** size of mailbox SM in bytes */
+#define ECSIM_MBXSIZE     128
+/** number of entries in the writable parameter object 0x8000 */
+#define ECSIM_PARAMS      8
+
+/** vendor id of simulated slaves */
+#define ECSIM_VENDOR      0x00000e51
+/** product code of simulated slaves */
+#define ECSIM_PRODUCT     0x00005e51
+/** revision of simulated slaves */
+#define ECSIM_REVISION    0x00010000
+
+/** one simulated slave */
+typedef struct
+{
+   /** ESC registers and process RAM */
+   uint8       mem[ECSIM_MEMSIZE];
+   /** SII EEPROM content */
+   uint8       sii[ECSIM_SIISIZE];
+   /** position in segment, 0 is first slave */
+   int         position;
+   /** TRUE if slave is the last one in the segment */
+   int         last;
+   /** output process data bytes */
+   int         obytes;
+   /** input process data bytes */
+   int         ibytes;
+   /** TRUE if slave has a mailbox with CoE */
+   int         mailbox;
+   /** SM used for outputs */
+   int         smout;
+   /** SM used for inputs */
+   int         smin;
+   /** offset of local DC clock to simulator clock in ns */
+   int64       clkoffset;
+   /** mailbox counter of the last response */
+   uint8       mbxcnt;
+   /** TRUE if a mailbox response waits for its latency to pass */
+   int         mbxpending;
+   /** simulator time in ns the pending mailbox response is available */
+   int64       mbxdue;
+   /** pending mailbox response */
+   uint8       mbxres[ECSIM_MBXSIZE];
+   /** writable parameters, object 0x8000 */
+   uint32      param[ECSIM_PARAMS];
+   /** number of process data exchanges */
+   uint32      cycles;
+} ecsim_slavet;
+
+/** line of simulated slaves */
+typedef struct
+{
+   /** number of slaves */
+   int            nslave;
+   /** slaves, nslave entries */
+   ecsim_slavet   *slave;
+   /** propagation delay per slave in ns */
+   int64          hopdelay;
+   /** time in ns a slave takes to answer a mailbox request */
+   int64          mbxlatency;
+   /** number of frames processed */
+   uint32         frames;
+   /** number of datagrams processed */
+   uint32         datagrams;
+} ecsim_segmentt;
+
+int ecsim_init(ecsim_segmentt *seg, int nslave, int obytes, int ibytes, int mailbox, int64 hopdelay);
+void ecsim_free(ecsim_segmentt *seg);
+int ecsim_process(ecsim_segmentt *seg, uint8 *frame, int len, int64 now);
+int ecsim_open(const char *ifname, int tap);
+void ecsim_serve(ecsim_segmentt *seg, int fd, int fd2, int tap, volatile int *run);
+
+#endif
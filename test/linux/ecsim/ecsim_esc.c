@@ -0,0 +1,1145 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * EtherCAT slave controller emulation for the segment simulator.
+ *
+ * Every slave has its own register and process RAM image. A frame is
+ * processed datagram by datagram, and every datagram passes all slaves in
+ * line order just like on the wire. Implemented are the addressing modes
+ * of all commands, FMMUs with bit granularity, the SII EEPROM interface,
+ * the AL state machine, the mailbox with CoE SDO upload and download and
+ * the DC receive time latch and system time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ecsim.h"
+
+#define ECSIM_MBXOUT       0x1000
+#define ECSIM_MBXIN        0x1080
+#define ECSIM_PDOUT        0x1100
+#define ECSIM_PDIN         0x1800
+#define ECSIM_MAXPD        0x0700
+
+/* SDO abort codes */
+#define ECSIM_ABORT_CMD    0x05040001
+#define ECSIM_ABORT_RO     0x06010002
+#define ECSIM_ABORT_NOOBJ  0x06020000
+#define ECSIM_ABORT_LEN    0x06070010
+#define ECSIM_ABORT_NOSUB  0x06090011
+
+static uint16 ecsim_get16(const uint8 *p)
+{
+   return (uint16)(p[0] | (p[1] << 8));
+}
+
+static uint32 ecsim_get32(const uint8 *p)
+{
+   return (uint32)p[0] | ((uint32)p[1] << 8) | ((uint32)p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static void ecsim_put16(uint8 *p, uint16 v)
+{
+   p[0] = (uint8)v;
+   p[1] = (uint8)(v >> 8);
+}
+
+static void ecsim_put32(uint8 *p, uint32 v)
+{
+   p[0] = (uint8)v;
+   p[1] = (uint8)(v >> 8);
+   p[2] = (uint8)(v >> 16);
+   p[3] = (uint8)(v >> 24);
+}
+
+static void ecsim_put64(uint8 *p, uint64 v)
+{
+   ecsim_put32(p, (uint32)v);
+   ecsim_put32(p + 4, (uint32)(v >> 32));
+}
+
+/** Local DC clock of a slave.
+ * @param[in] s       = slave
+ * @param[in] t       = simulator time in ns
+ * @return local time in ns
+ */
+static uint64 ecsim_localtime(const ecsim_slavet *s, int64 t)
+{
+   return (uint64)(t + s->clkoffset);
+}
+
+/** Check if the master may write a register byte.
+ * @param[in] ado     = register address
+ * @return TRUE if writable
+ */
+static int ecsim_writable(uint16 ado)
+{
+   return ((ado >= 0x0010) && (ado < 0x0014)) ||
+          ((ado >= 0x0100) && (ado < 0x0104)) ||
+          ((ado >= 0x0120) && (ado < 0x0122)) ||
+          ((ado >= 0x0200) && (ado < 0x0204)) ||
+          ((ado >= 0x0400) && (ado < 0x0444)) ||
+          ((ado >= 0x0500) && (ado < 0x0504) && (ado != 0x0501)) ||
+          ((ado >= 0x0504) && (ado < 0x0510)) ||
+          ((ado >= 0x0600) && (ado < 0x0700)) ||
+          ((ado >= 0x0800) && (ado < 0x0880) && ((ado & 7) != 5)) ||
+          ((ado >= 0x0920) && (ado < 0x0938)) ||
+          ((ado >= 0x0980) && (ado < 0x09B0)) ||
+          ((ado >= 0x1000) && (ado < ECSIM_MEMSIZE));
+}
+
+/** Start address of a sync manager, 0 if it is not enabled. */
+static uint16 ecsim_smstart(const ecsim_slavet *s, int sm)
+{
+   const uint8 *r = &(s->mem[ECT_REG_SM0 + (sm << 3)]);
+
+   if (!(r[6] & 0x01))
+   {
+      return 0;
+   }
+   return ecsim_get16(r);
+}
+
+/** Length of a sync manager. */
+static uint16 ecsim_smlength(const ecsim_slavet *s, int sm)
+{
+   return ecsim_get16(&(s->mem[ECT_REG_SM0 + (sm << 3) + 2]));
+}
+
+/** Check if [ado, ado + len) covers the last byte of a sync manager buffer. */
+static int ecsim_smlast(const ecsim_slavet *s, int sm, uint16 ado, int len)
+{
+   uint16 start = ecsim_smstart(s, sm);
+   uint16 smlen = ecsim_smlength(s, sm);
+   int last = start + smlen - 1;
+
+   return start && smlen && (last >= ado) && (last < ado + len);
+}
+
+/** Slave application, copies outputs back to the inputs. */
+static void ecsim_application(ecsim_slavet *s)
+{
+   uint16 in, out;
+   int i;
+
+   if ((s->mem[ECT_REG_ALSTAT] & 0x0f) < EC_STATE_SAFE_OP)
+   {
+      return;
+   }
+   in = ecsim_smstart(s, s->smin);
+   out = ecsim_smstart(s, s->smout);
+   if (!in)
+   {
+      return;
+   }
+   for (i = 0; i < s->ibytes; i++)
+   {
+      if (out && s->obytes)
+      {
+         s->mem[in + i] = s->mem[out + (i % s->obytes)];
+      }
+      else
+      {
+         s->mem[in + i] = (uint8)(s->cycles + i);
+      }
+   }
+}
+
+/** Handle write of AL control. */
+static void ecsim_alcontrol(ecsim_slavet *s)
+{
+   uint8 req = s->mem[ECT_REG_ALCTL] & 0x0f;
+   uint8 ack = s->mem[ECT_REG_ALCTL] & EC_STATE_ACK;
+   uint8 cur = s->mem[ECT_REG_ALSTAT] & 0x0f;
+   uint16 code = 0;
+
+   if ((s->mem[ECT_REG_ALSTAT] & EC_STATE_ERROR) && !ack && (req > cur))
+   {
+      return;
+   }
+   switch (req)
+   {
+      case EC_STATE_INIT:
+         break;
+      case EC_STATE_PRE_OP:
+         if ((cur == EC_STATE_INIT) && s->mailbox &&
+             (!ecsim_smstart(s, 0) || !ecsim_smstart(s, 1)))
+         {
+            code = 0x0016;
+         }
+         else if (cur == EC_STATE_BOOT)
+         {
+            code = 0x0011;
+         }
+         break;
+      case EC_STATE_BOOT:
+         if ((cur != EC_STATE_INIT) && (cur != EC_STATE_BOOT))
+         {
+            code = 0x0011;
+         }
+         break;
+      case EC_STATE_SAFE_OP:
+         if ((cur == EC_STATE_INIT) || (cur == EC_STATE_BOOT))
+         {
+            code = 0x0011;
+         }
+         else if (cur == EC_STATE_PRE_OP)
+         {
+            if (s->obytes && !ecsim_smstart(s, s->smout))
+            {
+               code = 0x001D;
+            }
+            else if (s->ibytes && !ecsim_smstart(s, s->smin))
+            {
+               code = 0x001E;
+            }
+         }
+         break;
+      case EC_STATE_OPERATIONAL:
+         if ((cur != EC_STATE_SAFE_OP) && (cur != EC_STATE_OPERATIONAL))
+         {
+            code = 0x0011;
+         }
+         break;
+      default:
+         code = 0x0012;
+         break;
+   }
+   if (code)
+   {
+      s->mem[ECT_REG_ALSTAT] = cur | EC_STATE_ERROR;
+   }
+   else
+   {
+      s->mem[ECT_REG_ALSTAT] = req;
+   }
+   ecsim_put16(&(s->mem[ECT_REG_ALSTATCODE]), code);
+}
+
+/** Handle write of EEPROM control. */
+static void ecsim_eeprom(ecsim_slavet *s)
+{
+   uint16 ctl = ecsim_get16(&(s->mem[ECT_REG_EEPCTL]));
+   uint32 addr = ecsim_get32(&(s->mem[ECT_REG_EEPADR])) << 1;
+   int i;
+
+   switch ((ctl >> 8) & 0x07)
+   {
+      case 0x01:
+         for (i = 0; i < 8; i++)
+         {
+            s->mem[ECT_REG_EEPDAT + i] = ((addr + i) < ECSIM_SIISIZE) ? s->sii[addr + i] : 0xff;
+         }
+         break;
+      case 0x02:
+         if ((ctl & 0x0001) && ((addr + 1) < ECSIM_SIISIZE))
+         {
+            s->sii[addr] = s->mem[ECT_REG_EEPDAT];
+            s->sii[addr + 1] = s->mem[ECT_REG_EEPDAT + 1];
+         }
+         break;
+      default:
+         break;
+   }
+   /* done, not busy, 8 byte read support */
+   ecsim_put16(&(s->mem[ECT_REG_EEPSTAT]), (uint16)(0x0040 | (ctl & 0x0001)));
+}
+
+/** Read object dictionary entry.
+ * @param[in]  s       = slave
+ * @param[in]  index   = object index
+ * @param[in]  sub     = object subindex
+ * @param[out] buf     = value, at least 32 bytes
+ * @param[out] size    = size of value in bytes
+ * @return 0 or SDO abort code
+ */
+static uint32 ecsim_odread(ecsim_slavet *s, uint16 index, uint8 sub, uint8 *buf, int *size)
+{
+   static const char name[] = "SOEM simulated slave";
+   uint16 io;
+   int n;
+
+   *size = 1;
+   switch (index)
+   {
+      case 0x1000:
+         *size = 4;
+         ecsim_put32(buf, 0);
+         return sub ? ECSIM_ABORT_NOSUB : 0;
+      case 0x1008:
+         *size = sizeof(name) - 1;
+         memcpy(buf, name, *size);
+         return sub ? ECSIM_ABORT_NOSUB : 0;
+      case 0x1018:
+         if (sub == 0)
+         {
+            buf[0] = 4;
+            return 0;
+         }
+         *size = 4;
+         switch (sub)
+         {
+            case 1: ecsim_put32(buf, ECSIM_VENDOR); return 0;
+            case 2: ecsim_put32(buf, ECSIM_PRODUCT); return 0;
+            case 3: ecsim_put32(buf, ECSIM_REVISION); return 0;
+            case 4: ecsim_put32(buf, (uint32)s->position); return 0;
+            default: return ECSIM_ABORT_NOSUB;
+         }
+      case ECT_SDO_SMCOMMTYPE:
+         if (sub > 4)
+         {
+            return ECSIM_ABORT_NOSUB;
+         }
+         buf[0] = sub ? sub : 4;
+         return 0;
+      case ECT_SDO_RXPDOASSIGN:
+      case ECT_SDO_TXPDOASSIGN:
+         n = (index == ECT_SDO_RXPDOASSIGN) ? s->obytes : s->ibytes;
+         if (sub == 0)
+         {
+            buf[0] = n ? 1 : 0;
+            return 0;
+         }
+         if ((sub > 1) || !n)
+         {
+            return ECSIM_ABORT_NOSUB;
+         }
+         *size = 2;
+         ecsim_put16(buf, (index == ECT_SDO_RXPDOASSIGN) ? 0x1600 : 0x1A00);
+         return 0;
+      case 0x1600:
+      case 0x1A00:
+      case 0x6000:
+      case 0x7000:
+         n = ((index == 0x1600) || (index == 0x7000)) ? s->obytes : s->ibytes;
+         if (sub == 0)
+         {
+            buf[0] = (uint8)((n > 254) ? 254 : n);
+            return 0;
+         }
+         if (sub > n)
+         {
+            return ECSIM_ABORT_NOSUB;
+         }
+         if (index == 0x6000)
+         {
+            ecsim_application(s);
+            io = ecsim_smstart(s, s->smin);
+            buf[0] = io ? s->mem[io + sub - 1] : 0;
+            return 0;
+         }
+         if (index == 0x7000)
+         {
+            io = ecsim_smstart(s, s->smout);
+            buf[0] = io ? s->mem[io + sub - 1] : 0;
+            return 0;
+         }
+         *size = 4;
+         ecsim_put32(buf, ((uint32)((index == 0x1600) ? 0x7000 : 0x6000) << 16) | ((uint32)sub << 8) | 8);
+         return 0;
+      case 0x8000:
+         if (sub == 0)
+         {
+            buf[0] = ECSIM_PARAMS;
+            return 0;
+         }
+         if (sub > ECSIM_PARAMS)
+         {
+            return ECSIM_ABORT_NOSUB;
+         }
+         *size = 4;
+         ecsim_put32(buf, s->param[sub - 1]);
+         return 0;
+      default:
+         return ECSIM_ABORT_NOOBJ;
+   }
+}
+
+/** Write object dictionary entry.
+ * @param[in]  s       = slave
+ * @param[in]  index   = object index
+ * @param[in]  sub     = object subindex
+ * @param[in]  buf     = value
+ * @param[in]  size    = size of value in bytes
+ * @return 0 or SDO abort code
+ */
+static uint32 ecsim_odwrite(ecsim_slavet *s, uint16 index, uint8 sub, const uint8 *buf, int size)
+{
+   uint8 cur[32];
+   uint32 abort;
+   uint16 io;
+   int cursize;
+
+   abort = ecsim_odread(s, index, sub, cur, &cursize);
+   if (abort)
+   {
+      return abort;
+   }
+   if (size > cursize)
+   {
+      return ECSIM_ABORT_LEN;
+   }
+   if ((index == 0x7000) && sub)
+   {
+      io = ecsim_smstart(s, s->smout);
+      if (io)
+      {
+         s->mem[io + sub - 1] = buf[0];
+      }
+      return 0;
+   }
+   if ((index == 0x8000) && sub)
+   {
+      memset(cur, 0, 4);
+      memcpy(cur, buf, size);
+      s->param[sub - 1] = ecsim_get32(cur);
+      return 0;
+   }
+   /* assign and mapping are fixed, accept rewriting the current value */
+   if (((index == ECT_SDO_RXPDOASSIGN) || (index == ECT_SDO_TXPDOASSIGN) ||
+        (index == 0x1600) || (index == 0x1A00)) && (memcmp(cur, buf, size) == 0))
+   {
+      return 0;
+   }
+
+   return ECSIM_ABORT_RO;
+}
+
+/** Handle CoE SDO request and build the response.
+ * @param[in]  s       = slave
+ * @param[in]  req     = request mailbox
+ * @param[out] res     = response mailbox, at least ECSIM_MBXSIZE bytes
+ * @return length of response data after the mailbox header
+ */
+static int ecsim_sdo(ecsim_slavet *s, const uint8 *req, uint8 *res)
+{
+   uint8 cmd = req[8];
+   uint16 index = ecsim_get16(&req[9]);
+   uint8 sub = req[11];
+   uint8 buf[32];
+   uint32 abort;
+   int size, len;
+
+   ecsim_put16(&res[9], index);
+   res[11] = sub;
+   len = 10;
+   if ((cmd & 0xe0) == ECT_SDO_UP_REQ)
+   {
+      abort = (cmd & 0x10) ? ECSIM_ABORT_CMD : ecsim_odread(s, index, sub, buf, &size);
+      if (!abort)
+      {
+         if (size <= 4)
+         {
+            res[8] = (uint8)(0x43 | ((4 - size) << 2));
+            memset(&res[12], 0, 4);
+            memcpy(&res[12], buf, size);
+         }
+         else
+         {
+            res[8] = 0x41;
+            ecsim_put32(&res[12], (uint32)size);
+            memcpy(&res[16], buf, size);
+            len += size;
+         }
+      }
+   }
+   else if ((cmd & 0xe0) == 0x20)
+   {
+      if (cmd & 0x10)
+      {
+         abort = ECSIM_ABORT_CMD;
+      }
+      else if (cmd & 0x02)
+      {
+         size = (cmd & 0x01) ? 4 - ((cmd >> 2) & 0x03) : 4;
+         abort = ecsim_odwrite(s, index, sub, &req[12], size);
+      }
+      else
+      {
+         size = (int)ecsim_get32(&req[12]);
+         if ((size > (int)sizeof(buf)) || (size > ecsim_get16(req) - 10))
+         {
+            abort = ECSIM_ABORT_LEN;
+         }
+         else
+         {
+            abort = ecsim_odwrite(s, index, sub, &req[16], size);
+         }
+      }
+      if (!abort)
+      {
+         res[8] = 0x60;
+         memset(&res[12], 0, 4);
+      }
+   }
+   else
+   {
+      abort = ECSIM_ABORT_CMD;
+   }
+   if (abort)
+   {
+      ecsim_put16(&res[6], (uint16)(ECT_COES_SDOREQ << 12));
+      res[8] = ECT_SDO_ABORT;
+      ecsim_put32(&res[12], abort);
+      len = 10;
+   }
+   else
+   {
+      ecsim_put16(&res[6], (uint16)(ECT_COES_SDORES << 12));
+   }
+
+   return len;
+}
+
+/** Handle mailbox written by the master into SM0.
+ * @param[in]  seg     = segment
+ * @param[in]  s       = slave
+ * @param[in]  arrival = arrival time of the frame at the slave
+ */
+static void ecsim_mailbox(ecsim_segmentt *seg, ecsim_slavet *s, int64 arrival)
+{
+   uint16 in = ecsim_smstart(s, 0);
+   uint16 out = ecsim_smstart(s, 1);
+   uint16 outlen = ecsim_smlength(s, 1);
+   const uint8 *req = &(s->mem[in]);
+   uint8 res[ECSIM_MBXSIZE];
+   int len;
+
+   if (!out || (outlen < 16) || (outlen > ECSIM_MBXSIZE))
+   {
+      return;
+   }
+   memset(res, 0, sizeof(res));
+   if (((req[5] & 0x0f) == ECT_MBXT_COE) && ((ecsim_get16(&req[6]) >> 12) == ECT_COES_SDOREQ))
+   {
+      len = ecsim_sdo(s, req, res);
+      res[5] = ECT_MBXT_COE;
+   }
+   else
+   {
+      /* mailbox error, unsupported protocol */
+      ecsim_put16(&res[6], 0x0001);
+      ecsim_put16(&res[8], 0x0002);
+      len = 4;
+      res[5] = ECT_MBXT_ERR;
+   }
+   if (len > outlen - 6)
+   {
+      len = outlen - 6;
+   }
+   s->mbxcnt = (s->mbxcnt % 7) + 1;
+   ecsim_put16(res, (uint16)len);
+   res[5] |= (uint8)(s->mbxcnt << 4);
+   if (seg->mbxlatency > 0)
+   {
+      /* response is available after the latency, see ecsim_mbxlatency() */
+      memcpy(s->mbxres, res, outlen);
+      s->mbxdue = arrival + seg->mbxlatency;
+      s->mbxpending = TRUE;
+      return;
+   }
+   memcpy(&(s->mem[out]), res, outlen);
+   s->mem[ECT_REG_SM1STAT] |= 0x08;
+}
+
+/** Put a pending mailbox response in SM1 when its latency has passed.
+ * @param[in]  s       = slave
+ * @param[in]  arrival = arrival time of the frame at the slave
+ */
+static void ecsim_mbxlatency(ecsim_slavet *s, int64 arrival)
+{
+   uint16 out = ecsim_smstart(s, 1);
+   uint16 outlen = ecsim_smlength(s, 1);
+
+   if (s->mbxpending && (arrival >= s->mbxdue) && out && (outlen <= sizeof(s->mbxres)))
+   {
+      memcpy(&(s->mem[out]), s->mbxres, outlen);
+      s->mem[ECT_REG_SM1STAT] |= 0x08;
+      s->mbxpending = FALSE;
+   }
+}
+
+/** Latch DC receive times, called on write to register 0x0900. */
+static void ecsim_dclatch(ecsim_segmentt *seg, ecsim_slavet *s, int64 arrival)
+{
+   uint64 t0 = ecsim_localtime(s, arrival);
+   uint64 t1 = 0;
+
+   if (!s->last)
+   {
+      t1 = ecsim_localtime(s, arrival + 2 * (seg->nslave - 1 - s->position) * seg->hopdelay);
+   }
+   ecsim_put32(&(s->mem[ECT_REG_DCTIME0]), (uint32)t0);
+   ecsim_put32(&(s->mem[ECT_REG_DCTIME1]), (uint32)t1);
+   ecsim_put64(&(s->mem[ECT_REG_DCSOF]), t0);
+}
+
+/** Read slave memory into datagram data.
+ * @param[in]  s       = slave
+ * @param[in]  ado     = register address
+ * @param[out] data    = datagram data
+ * @param[in]  len     = length
+ * @param[in]  or      = TRUE to or the data, used by broadcast read
+ * @param[in]  arrival = arrival time of the frame at the slave
+ */
+static void ecsim_read(ecsim_slavet *s, uint16 ado, uint8 *data, int len, int or, int64 arrival)
+{
+   int i, n;
+
+   if (ado >= ECSIM_MEMSIZE)
+   {
+      return;
+   }
+   n = (ado + len > ECSIM_MEMSIZE) ? ECSIM_MEMSIZE - ado : len;
+   ecsim_mbxlatency(s, arrival);
+   if ((ado < ECT_REG_DCSYSTIME + 8) && (ado + n > ECT_REG_DCSYSTIME))
+   {
+      ecsim_put64(&(s->mem[ECT_REG_DCSYSTIME]), ecsim_localtime(s, arrival) +
+         (uint64)ecsim_get32(&(s->mem[ECT_REG_DCSYSOFFSET])) +
+         ((uint64)ecsim_get32(&(s->mem[ECT_REG_DCSYSOFFSET + 4])) << 32));
+   }
+   if (ado >= 0x1000)
+   {
+      ecsim_application(s);
+   }
+   if (or)
+   {
+      for (i = 0; i < n; i++)
+      {
+         data[i] |= s->mem[ado + i];
+      }
+   }
+   else
+   {
+      memcpy(data, &(s->mem[ado]), n);
+   }
+   if (s->mailbox && ecsim_smlast(s, 1, ado, n))
+   {
+      s->mem[ECT_REG_SM1STAT] &= ~0x08;
+   }
+}
+
+/** Write datagram data into slave memory.
+ * @param[in]  seg     = segment
+ * @param[in]  s       = slave
+ * @param[in]  ado     = register address
+ * @param[in]  data    = datagram data
+ * @param[in]  len     = length
+ * @param[in]  arrival = arrival time of the frame at the slave
+ */
+static void ecsim_write(ecsim_segmentt *seg, ecsim_slavet *s, uint16 ado, const uint8 *data, int len, int64 arrival)
+{
+   int i, n;
+
+   if (ado >= ECSIM_MEMSIZE)
+   {
+      return;
+   }
+   n = (ado + len > ECSIM_MEMSIZE) ? ECSIM_MEMSIZE - ado : len;
+   if (ado >= 0x1000)
+   {
+      memcpy(&(s->mem[ado]), data, n);
+   }
+   else
+   {
+      for (i = 0; i < n; i++)
+      {
+         if (ecsim_writable((uint16)(ado + i)))
+         {
+            s->mem[ado + i] = data[i];
+         }
+      }
+   }
+   if ((ado <= ECT_REG_ALCTL) && (ado + n > ECT_REG_ALCTL))
+   {
+      ecsim_alcontrol(s);
+   }
+   if ((ado <= ECT_REG_EEPCTL + 1) && (ado + n > ECT_REG_EEPCTL + 1))
+   {
+      ecsim_eeprom(s);
+   }
+   if ((ado <= ECT_REG_DCTIME0) && (ado + n > ECT_REG_DCTIME0))
+   {
+      ecsim_dclatch(seg, s, arrival);
+   }
+   if (s->mailbox && ecsim_smlast(s, 0, ado, n))
+   {
+      ecsim_mailbox(seg, s, arrival);
+   }
+}
+
+/** Map logical datagram through the FMMUs of a slave.
+ * @param[in]  s       = slave
+ * @param[in]  laddr   = logical address of datagram
+ * @param[in,out] data = datagram data
+ * @param[in]  len     = length
+ * @param[in]  dir     = 1 to read slave memory, 2 to write it
+ * @return TRUE if any FMMU matched
+ */
+static int ecsim_fmmu(ecsim_slavet *s, uint32 laddr, uint8 *data, int len, int dir)
+{
+   const uint8 *f;
+   uint32 lstart, lo, hi, b, first, last, lb;
+   uint16 flen, pstart;
+   uint8 sbit, ebit, pbit, v;
+   int i, hit = FALSE;
+
+   for (i = 0; i < ECSIM_FMMUS; i++)
+   {
+      f = &(s->mem[ECT_REG_FMMU0 + (i << 4)]);
+      if (!(f[12] & 0x01) || !(f[11] & dir))
+      {
+         continue;
+      }
+      lstart = ecsim_get32(f);
+      flen = ecsim_get16(&f[4]);
+      sbit = f[6] & 0x07;
+      ebit = f[7] & 0x07;
+      pstart = ecsim_get16(&f[8]);
+      pbit = f[10] & 0x07;
+      lo = (lstart > laddr) ? lstart : laddr;
+      hi = ((lstart + flen) < (laddr + len)) ? (lstart + flen) : (laddr + len);
+      if (!flen || (lo >= hi))
+      {
+         continue;
+      }
+      hit = TRUE;
+      if ((dir == 1) && (pstart >= 0x1000))
+      {
+         ecsim_application(s);
+      }
+      if (!sbit && (ebit == 7) && !pbit)
+      {
+         /* byte aligned mapping */
+         for (b = lo; b < hi; b++)
+         {
+            if ((pstart + (b - lstart)) < ECSIM_MEMSIZE)
+            {
+               if (dir == 2)
+               {
+                  s->mem[pstart + (b - lstart)] = data[b - laddr];
+               }
+               else
+               {
+                  data[b - laddr] = s->mem[pstart + (b - lstart)];
+               }
+            }
+         }
+         continue;
+      }
+      first = (lstart << 3) + sbit;
+      last = ((lstart + flen - 1) << 3) + ebit;
+      lb = (lo << 3 > first) ? lo << 3 : first;
+      for (; (lb <= last) && (lb < (hi << 3)); lb++)
+      {
+         b = (pstart << 3) + pbit + (lb - first);
+         if ((b >> 3) >= ECSIM_MEMSIZE)
+         {
+            break;
+         }
+         if (dir == 2)
+         {
+            v = (data[(lb >> 3) - laddr] >> (lb & 7)) & 1;
+            s->mem[b >> 3] = (uint8)((s->mem[b >> 3] & ~(1 << (b & 7))) | (v << (b & 7)));
+         }
+         else
+         {
+            v = (s->mem[b >> 3] >> (b & 7)) & 1;
+            data[(lb >> 3) - laddr] = (uint8)((data[(lb >> 3) - laddr] & ~(1 << (lb & 7))) | (v << (lb & 7)));
+         }
+      }
+   }
+
+   return hit;
+}
+
+/** Pass one datagram through one slave.
+ * @param[in]  seg     = segment
+ * @param[in]  s       = slave
+ * @param[in]  cmd     = datagram command
+ * @param[in,out] adp  = address position, incremented by auto increment and broadcast
+ * @param[in]  ado     = address offset
+ * @param[in,out] data = datagram data
+ * @param[in]  len     = data length
+ * @param[in]  arrival = arrival time of the frame at the slave
+ * @return work counter increment
+ */
+static int ecsim_datagram(ecsim_segmentt *seg, ecsim_slavet *s, uint8 cmd, uint16 *adp,
+   uint16 ado, uint8 *data, int len, int64 arrival)
+{
+   uint8 copy[EC_MAXECATFRAME];
+   uint32 laddr;
+   int hit, wkc = 0;
+
+   switch (cmd)
+   {
+      case EC_CMD_APRD:
+      case EC_CMD_APWR:
+      case EC_CMD_APRW:
+      case EC_CMD_ARMW:
+         hit = (*adp == 0);
+         (*adp)++;
+         break;
+      case EC_CMD_FPRD:
+      case EC_CMD_FPWR:
+      case EC_CMD_FPRW:
+      case EC_CMD_FRMW:
+         hit = (*adp == ecsim_get16(&(s->mem[ECT_REG_STADR])));
+         break;
+      case EC_CMD_BRD:
+      case EC_CMD_BWR:
+      case EC_CMD_BRW:
+         hit = TRUE;
+         (*adp)++;
+         break;
+      default:
+         hit = FALSE;
+         break;
+   }
+   switch (cmd)
+   {
+      case EC_CMD_APRD:
+      case EC_CMD_FPRD:
+         if (hit)
+         {
+            ecsim_read(s, ado, data, len, FALSE, arrival);
+            wkc = 1;
+         }
+         break;
+      case EC_CMD_BRD:
+         ecsim_read(s, ado, data, len, TRUE, arrival);
+         wkc = 1;
+         break;
+      case EC_CMD_APWR:
+      case EC_CMD_FPWR:
+      case EC_CMD_BWR:
+         if (hit)
+         {
+            ecsim_write(seg, s, ado, data, len, arrival);
+            wkc = 1;
+         }
+         break;
+      case EC_CMD_APRW:
+      case EC_CMD_FPRW:
+      case EC_CMD_BRW:
+         if (hit)
+         {
+            memcpy(copy, data, len);
+            if (cmd == EC_CMD_BRW)
+            {
+               ecsim_read(s, ado, data, len, TRUE, arrival);
+            }
+            else
+            {
+               ecsim_read(s, ado, data, len, FALSE, arrival);
+            }
+            ecsim_write(seg, s, ado, copy, len, arrival);
+            wkc = 3;
+         }
+         break;
+      case EC_CMD_ARMW:
+      case EC_CMD_FRMW:
+         if (hit)
+         {
+            ecsim_read(s, ado, data, len, FALSE, arrival);
+         }
+         else if ((ado != ECT_REG_DCSYSTIME) || (len > 8))
+         {
+            ecsim_write(seg, s, ado, data, len, arrival);
+         }
+         wkc = 1;
+         break;
+      case EC_CMD_LRD:
+      case EC_CMD_LWR:
+      case EC_CMD_LRW:
+         if ((s->mem[ECT_REG_ALSTAT] & 0x0f) < EC_STATE_SAFE_OP)
+         {
+            break;
+         }
+         laddr = (uint32)*adp | ((uint32)ado << 16);
+         if ((cmd != EC_CMD_LRD) && ecsim_fmmu(s, laddr, data, len, 2))
+         {
+            wkc += (cmd == EC_CMD_LRW) ? 2 : 1;
+         }
+         if (cmd != EC_CMD_LWR)
+         {
+            ecsim_mbxlatency(s, arrival);
+         }
+         if ((cmd != EC_CMD_LWR) && ecsim_fmmu(s, laddr, data, len, 1))
+         {
+            wkc += 1;
+         }
+         if (wkc)
+         {
+            s->cycles++;
+         }
+         break;
+      default:
+         break;
+   }
+
+   return wkc;
+}
+
+/** Process EtherCAT frame in place, as if it passed the whole segment.
+ * @param[in]  seg     = segment
+ * @param[in,out] frame = Ethernet frame
+ * @param[in]  len     = frame length
+ * @param[in]  now     = simulator time in ns the frame entered the segment
+ * @return TRUE if the frame was an EtherCAT frame and must be returned
+ */
+int ecsim_process(ecsim_segmentt *seg, uint8 *frame, int len, int64 now)
+{
+   uint8 *p, *end;
+   uint16 adp, ado, dlen, wkc;
+   uint8 cmd;
+   int i, more;
+
+   if ((len < (int)(ETH_HEADERSIZE + EC_ELENGTHSIZE)) ||
+       (frame[12] != (ETH_P_ECAT >> 8)) || (frame[13] != (ETH_P_ECAT & 0xff)))
+   {
+      return FALSE;
+   }
+   end = frame + len;
+   p = frame + ETH_HEADERSIZE + EC_ELENGTHSIZE;
+   do
+   {
+      if ((p + EC_HEADERSIZE - EC_ELENGTHSIZE + EC_WKCSIZE) > end)
+      {
+         return FALSE;
+      }
+      cmd = p[0];
+      adp = ecsim_get16(&p[2]);
+      ado = ecsim_get16(&p[4]);
+      dlen = ecsim_get16(&p[6]) & 0x07ff;
+      more = ecsim_get16(&p[6]) & EC_DATAGRAMFOLLOWS;
+      if ((p + 10 + dlen + EC_WKCSIZE) > end)
+      {
+         return FALSE;
+      }
+      wkc = ecsim_get16(&p[10 + dlen]);
+      for (i = 0; i < seg->nslave; i++)
+      {
+         wkc = (uint16)(wkc + ecsim_datagram(seg, &(seg->slave[i]), cmd, &adp, ado, &p[10],
+            dlen, now + i * seg->hopdelay));
+      }
+      ecsim_put16(&p[2], adp);
+      ecsim_put16(&p[10 + dlen], wkc);
+      p += 10 + dlen + EC_WKCSIZE;
+      seg->datagrams++;
+   } while (more);
+   /* first slave marks the frame as processed */
+   frame[6] |= 0x02;
+   seg->frames++;
+
+   return TRUE;
+}
+
+/** Append SII category. */
+static int ecsim_siicat(uint8 *sii, int a, uint16 cat, const uint8 *data, int len)
+{
+   int words = (len + 1) >> 1;
+
+   if ((a + 4 + (words << 1) + 2) > ECSIM_SIISIZE)
+   {
+      return a;
+   }
+   ecsim_put16(&sii[a], cat);
+   ecsim_put16(&sii[a + 2], (uint16)words);
+   memset(&sii[a + 4], 0, words << 1);
+   memcpy(&sii[a + 4], data, len);
+
+   return a + 4 + (words << 1);
+}
+
+/** Append SII PDO category with one PDO of byte entries. */
+static int ecsim_siipdo(uint8 *sii, int a, uint16 cat, uint16 pdo, uint16 obj, int n, int sm)
+{
+   uint8 buf[8 + 8 * 64];
+   int i;
+
+   if (n > 64)
+   {
+      n = 64;
+   }
+   memset(buf, 0, sizeof(buf));
+   ecsim_put16(buf, pdo);
+   buf[2] = (uint8)n;
+   buf[3] = (uint8)sm;
+   for (i = 0; i < n; i++)
+   {
+      ecsim_put16(&buf[8 + 8 * i], obj);
+      buf[8 + 8 * i + 2] = (uint8)(i + 1);
+      buf[8 + 8 * i + 4] = 0x05;
+      buf[8 + 8 * i + 5] = 8;
+   }
+
+   return ecsim_siicat(sii, a, cat, buf, 8 + 8 * n);
+}
+
+/** Append SII SM entry to a buffer. */
+static void ecsim_siism(uint8 *buf, uint16 start, uint16 len, uint8 ctrl, uint8 enable, uint8 type)
+{
+   ecsim_put16(buf, start);
+   ecsim_put16(&buf[2], len);
+   buf[4] = ctrl;
+   buf[5] = 0;
+   buf[6] = enable;
+   buf[7] = type;
+}
+
+/** SII CRC over the first 7 words. */
+static uint8 ecsim_siicrc(const uint8 *sii)
+{
+   uint8 crc = 0xff;
+   int i, b;
+
+   for (i = 0; i < 14; i++)
+   {
+      crc ^= sii[i];
+      for (b = 0; b < 8; b++)
+      {
+         crc = (crc & 0x80) ? (uint8)((crc << 1) ^ 0x07) : (uint8)(crc << 1);
+      }
+   }
+
+   return crc;
+}
+
+/** Build SII EEPROM content of a slave. */
+static void ecsim_buildsii(ecsim_slavet *s)
+{
+   static const char name[] = "SOEM-SIM";
+   uint8 buf[64];
+   uint8 *sii = s->sii;
+   int a;
+
+   memset(sii, 0xff, ECSIM_SIISIZE);
+   memset(sii, 0, ECT_SII_START << 1);
+   sii[14] = ecsim_siicrc(sii);
+   ecsim_put32(&sii[ECT_SII_MANUF << 1], ECSIM_VENDOR);
+   ecsim_put32(&sii[ECT_SII_ID << 1], ECSIM_PRODUCT);
+   ecsim_put32(&sii[ECT_SII_REV << 1], ECSIM_REVISION);
+   ecsim_put32(&sii[ECT_SII_SN << 1], (uint32)s->position);
+   if (s->mailbox)
+   {
+      ecsim_put16(&sii[ECT_SII_RXMBXADR << 1], ECSIM_MBXOUT);
+      ecsim_put16(&sii[(ECT_SII_RXMBXADR + 1) << 1], ECSIM_MBXSIZE);
+      ecsim_put16(&sii[ECT_SII_TXMBXADR << 1], ECSIM_MBXIN);
+      ecsim_put16(&sii[(ECT_SII_TXMBXADR + 1) << 1], ECSIM_MBXSIZE);
+      ecsim_put16(&sii[ECT_SII_MBXPROTO << 1], 0x0004);
+   }
+   ecsim_put16(&sii[0x3e << 1], (ECSIM_SIISIZE * 8 / 1024) - 1);
+   ecsim_put16(&sii[0x3f << 1], 1);
+
+   a = ECT_SII_START << 1;
+   memset(buf, 0, sizeof(buf));
+   buf[0] = 1;
+   buf[1] = sizeof(name) - 1;
+   memcpy(&buf[2], name, sizeof(name) - 1);
+   a = ecsim_siicat(sii, a, ECT_SII_STRING, buf, 2 + sizeof(name) - 1);
+
+   memset(buf, 0, sizeof(buf));
+   buf[3] = 1;
+   buf[5] = s->mailbox ? 0x05 : 0;
+   a = ecsim_siicat(sii, a, ECT_SII_GENERAL, buf, 32);
+
+   buf[0] = 0x01;
+   buf[1] = 0x02;
+   buf[2] = s->mailbox ? 0x03 : 0xff;
+   buf[3] = 0xff;
+   a = ecsim_siicat(sii, a, ECT_SII_FMMU, buf, 4);
+
+   if (s->mailbox)
+   {
+      ecsim_siism(&buf[0], ECSIM_MBXOUT, ECSIM_MBXSIZE, 0x26, 1, 1);
+      ecsim_siism(&buf[8], ECSIM_MBXIN, ECSIM_MBXSIZE, 0x22, 1, 2);
+      ecsim_siism(&buf[16], ECSIM_PDOUT, (uint16)s->obytes, 0x64, s->obytes ? 1 : 0, 3);
+      ecsim_siism(&buf[24], ECSIM_PDIN, (uint16)s->ibytes, 0x20, s->ibytes ? 1 : 0, 4);
+      a = ecsim_siicat(sii, a, ECT_SII_SM, buf, 32);
+   }
+   else
+   {
+      ecsim_siism(&buf[0], ECSIM_PDOUT, (uint16)s->obytes, 0x64, s->obytes ? 1 : 0, 3);
+      ecsim_siism(&buf[8], ECSIM_PDIN, (uint16)s->ibytes, 0x20, s->ibytes ? 1 : 0, 4);
+      a = ecsim_siicat(sii, a, ECT_SII_SM, buf, 16);
+   }
+   if (s->ibytes)
+   {
+      a = ecsim_siipdo(sii, a, ECT_SII_PDO, 0x1A00, 0x6000, s->ibytes, s->smin);
+   }
+   if (s->obytes)
+   {
+      a = ecsim_siipdo(sii, a, ECT_SII_PDO + 1, 0x1600, 0x7000, s->obytes, s->smout);
+   }
+   ecsim_put16(&sii[a], 0xffff);
+}
+
+/** Create segment of identical slaves.
+ * @param[out] seg      = segment
+ * @param[in]  nslave   = number of slaves
+ * @param[in]  obytes   = output bytes per slave
+ * @param[in]  ibytes   = input bytes per slave
+ * @param[in]  mailbox  = TRUE for slaves with CoE mailbox
+ * @param[in]  hopdelay = propagation delay per slave in ns
+ * @return 0 on success, -1 on failure
+ */
+int ecsim_init(ecsim_segmentt *seg, int nslave, int obytes, int ibytes, int mailbox, int64 hopdelay)
+{
+   ecsim_slavet *s;
+   int i;
+
+   memset(seg, 0, sizeof(*seg));
+   if ((nslave <= 0) || (obytes < 0) || (ibytes < 0) ||
+       (obytes > ECSIM_MAXPD) || (ibytes > ECSIM_MAXPD))
+   {
+      return -1;
+   }
+   seg->slave = calloc(nslave, sizeof(ecsim_slavet));
+   if (!seg->slave)
+   {
+      return -1;
+   }
+   seg->nslave = nslave;
+   seg->hopdelay = hopdelay;
+   for (i = 0; i < nslave; i++)
+   {
+      s = &(seg->slave[i]);
+      s->position = i;
+      s->last = (i == nslave - 1);
+      s->obytes = obytes;
+      s->ibytes = ibytes;
+      s->mailbox = mailbox;
+      s->smout = mailbox ? 2 : 0;
+      s->smin = mailbox ? 3 : 1;
+      s->clkoffset = (int64)(i + 1) * 123456789;
+      s->mem[ECT_REG_TYPE] = 0x11;
+      s->mem[0x0004] = ECSIM_FMMUS;
+      s->mem[0x0005] = 8;
+      s->mem[0x0006] = ECSIM_MEMSIZE >> 10;
+      s->mem[ECT_REG_PORTDES] = 0x0f;
+      ecsim_put16(&(s->mem[ECT_REG_ESCSUP]), 0x000c);
+      /* ports 0 and 1 link, port 1 open only if a slave follows */
+      ecsim_put16(&(s->mem[ECT_REG_DLSTAT]), s->last ? 0x5610 : 0x5a30);
+      s->mem[ECT_REG_ALSTAT] = EC_STATE_INIT;
+      ecsim_put16(&(s->mem[ECT_REG_EEPSTAT]), 0x0040);
+      ecsim_buildsii(s);
+   }
+
+   return 0;
+}
+
+/** Release segment.
+ * @param[in]  seg      = segment
+ */
+void ecsim_free(ecsim_segmentt *seg)
+{
+   free(seg->slave);
+   seg->slave = NULL;
+   seg->nslave = 0;
+}
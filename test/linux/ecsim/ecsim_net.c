@@ -0,0 +1,195 @@
+/*
+ * Licensed under the GNU General Public License version 2 with exceptions. See
+ * LICENSE file in the project root for full license information
+ */
+
+/** \file
+ * \brief
+ * Network side of the segment simulator, raw socket or TAP device.
+ *
+ * With one interface every processed frame is sent back where it came
+ * from, as by a line whose last slave closes the loop. With a second
+ * interface the segment is a ring for cable redundancy: frames entering
+ * the first slave are processed and leave the last slave on the second
+ * interface, frames entering the last slave pass unprocessed to the first.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <netpacket/packet.h>
+#include <arpa/inet.h>
+#include "ecsim.h"
+
+static int64 ecsim_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Open raw socket on an existing interface. */
+static int ecsim_openraw(const char *ifname)
+{
+   struct ifreq ifr;
+   struct sockaddr_ll sll;
+   int fd;
+
+   fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ECAT));
+   if (fd < 0)
+   {
+      perror("socket");
+      return -1;
+   }
+   memset(&ifr, 0, sizeof(ifr));
+   strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+   if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0)
+   {
+      perror(ifname);
+      close(fd);
+      return -1;
+   }
+   memset(&sll, 0, sizeof(sll));
+   sll.sll_family = AF_PACKET;
+   sll.sll_ifindex = ifr.ifr_ifindex;
+   sll.sll_protocol = htons(ETH_P_ECAT);
+   if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+   {
+      perror("bind");
+      close(fd);
+      return -1;
+   }
+   /* frames from the master are not addressed to us */
+   ioctl(fd, SIOCGIFFLAGS, &ifr);
+   ifr.ifr_flags |= IFF_PROMISC | IFF_UP;
+   ioctl(fd, SIOCSIFFLAGS, &ifr);
+
+   return fd;
+}
+
+/** Create TAP device and bring it up. */
+static int ecsim_opentap(const char *ifname)
+{
+   struct ifreq ifr;
+   int fd, sock;
+
+   fd = open("/dev/net/tun", O_RDWR);
+   if (fd < 0)
+   {
+      perror("/dev/net/tun");
+      return -1;
+   }
+   memset(&ifr, 0, sizeof(ifr));
+   ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+   strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+   if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+   {
+      perror("TUNSETIFF");
+      close(fd);
+      return -1;
+   }
+   sock = socket(AF_INET, SOCK_DGRAM, 0);
+   if (sock >= 0)
+   {
+      ioctl(sock, SIOCGIFFLAGS, &ifr);
+      ifr.ifr_flags |= IFF_UP;
+      ioctl(sock, SIOCSIFFLAGS, &ifr);
+      close(sock);
+   }
+
+   return fd;
+}
+
+/** Open interface the segment is connected to.
+ * @param[in]  ifname   = interface name
+ * @param[in]  tap      = TRUE to create TAP device ifname
+ * @return file descriptor or -1 on failure
+ */
+int ecsim_open(const char *ifname, int tap)
+{
+   return tap ? ecsim_opentap(ifname) : ecsim_openraw(ifname);
+}
+
+/** Receive one EtherCAT frame, skipping our own transmitted frames.
+ * @return frame length, 0 if nothing was received
+ */
+static int ecsim_recv(int fd, int tap, uint8 *frame, int size)
+{
+   struct sockaddr_ll from;
+   socklen_t fromlen;
+   int len;
+
+   if (tap)
+   {
+      len = (int)read(fd, frame, size);
+   }
+   else
+   {
+      fromlen = sizeof(from);
+      len = (int)recvfrom(fd, frame, size, 0, (struct sockaddr *)&from, &fromlen);
+      /* a packet socket also sees the frames we send */
+      if ((len > 0) && (from.sll_pkttype == PACKET_OUTGOING))
+      {
+         len = 0;
+      }
+   }
+
+   return (len > 0) ? len : 0;
+}
+
+/** Serve frames until *run is cleared.
+ * @param[in]  seg      = segment
+ * @param[in]  fd       = interface connected to the first slave
+ * @param[in]  fd2      = interface connected to the last slave, -1 for a line
+ * @param[in]  tap      = TRUE if the descriptors are TAP devices
+ * @param[in]  run      = serve while this is TRUE
+ */
+void ecsim_serve(ecsim_segmentt *seg, int fd, int fd2, int tap, volatile int *run)
+{
+   struct pollfd pfd[2];
+   uint8 frame[EC_MAXECATFRAME + 64];
+   int len, nfd;
+
+   pfd[0].fd = fd;
+   pfd[0].events = POLLIN;
+   pfd[1].fd = fd2;
+   pfd[1].events = POLLIN;
+   nfd = (fd2 >= 0) ? 2 : 1;
+   while (*run)
+   {
+      pfd[0].revents = 0;
+      pfd[1].revents = 0;
+      if (poll(pfd, nfd, 100) <= 0)
+      {
+         continue;
+      }
+      if (pfd[0].revents & POLLIN)
+      {
+         len = ecsim_recv(fd, tap, frame, sizeof(frame));
+         if (len && ecsim_process(seg, frame, len, ecsim_now()))
+         {
+            if (write((fd2 >= 0) ? fd2 : fd, frame, len) != len)
+            {
+               perror("write");
+            }
+         }
+      }
+      if ((nfd > 1) && (pfd[1].revents & POLLIN))
+      {
+         /* passes the ring backwards without processing */
+         len = ecsim_recv(fd2, tap, frame, sizeof(frame));
+         if (len && (write(fd, frame, len) != len))
+         {
+            perror("write");
+         }
+      }
+   }
+}
@@ -27,6 +27,7 @@ typedef struct {
     ec_groupt       grouplist[EC_MAXGROUP];
     uint8           esibuf[EC_MAXEEPBUF];
     uint32          esimap[EC_MAXEEPBITMAP];
+    ec_eepcachet    eepcache;
     ec_eringt       elist;
     ec_idxstackT    idxstack;
     boolean         ecaterror;
@@ -63,6 +64,7 @@ fieldbus_initialize(Fieldbus *fieldbus, char *iface)
     context->esibuf = fieldbus->esibuf;
     context->esimap = fieldbus->esimap;
     context->esislave = 0;
+    context->eepcache = &fieldbus->eepcache;
     context->elist = &fieldbus->elist;
     context->idxstack = &fieldbus->idxstack;
     context->ecaterror = &fieldbus->ecaterror;